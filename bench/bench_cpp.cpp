@@ -0,0 +1,149 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_cpp.cpp
+ * @brief Per call overhead of the C++ front end (tfft.hpp) against the C API.
+ *
+ * Reads and writes the normal files FILE0 (uint8_t) and FILE3 (int32_t)
+ * of the default file table in tfft_user.h with TFFT_ReadU8()/
+ * TFFT_WriteU8() etc. and with tfft::File, on a simulated EEPROM without
+ * modelled device time, so only the CPU time of the calls is measured.
+ * Prints one JSON object with ns per call of both (fastest of five rounds)
+ * and the low level calls per operation (which must be equal).
+ * Usage: bench_cpp [operations per round (default 200000)]
+ * Build from the repository root, e.g.:
+ * gcc -O2 -c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c
+ * g++ -std=c++11 -O2 -I. bench/bench_cpp.cpp *.o -pthread -o bench_cpp
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tfft.hpp"
+
+typedef tfft::File<FILE0_NAME_EEPROM_FILE_VERSION_U8, uint8_t> BenchFileU8;
+typedef tfft::File<FILE3_NAME_SENSOR_VAL2_S32, int32_t> BenchFileS32;
+
+static_assert(BenchFileS32::address == TFFT_START_ADDRESS + offsetof(TFFT_FILE_LAYOUT, FILE3_NAME_SENSOR_VAL2_S32),
+              "address of FILE3");
+
+/* Rounds of each measurement */
+#define BENCH_ROUNDS 5
+
+typedef struct
+{
+  double ns;                // Per call
+  double lowLevelCalls;     // Per call
+  unsigned long errors;
+} BENCH_RESULT;
+
+/*----------------------------------------------------------------------------*/
+static uint64_t BENCH_NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Run ops calls of call(n). Keeps the fastest round in pResult. */
+template<class CALL>
+static void BENCH_Run(unsigned long ops, CALL call, BENCH_RESULT *pResult)
+{
+  TFFT_EEPROM_SIMU_COUNTERS c;
+  uint64_t start;
+  unsigned long n;
+  double ns;
+
+  TFFT_EepromResetCounters();
+  start = BENCH_NowNs();
+
+  for(n = 0; n < ops; n++)
+  {
+    if(call(n) != TFFT_RW_OK)
+    {
+      pResult->errors++;
+    }
+  }
+
+  ns = (double)(BENCH_NowNs() - start) / (double)ops;
+  pResult->ns = (pResult->ns == 0 || ns < pResult->ns) ? ns : pResult->ns;
+  TFFT_EepromGetCounters(&c);
+  pResult->lowLevelCalls = (double)(c.blockReads + c.pageWrites + c.byteReads + c.byteWrites) / (double)ops;
+}
+
+/*----------------------------------------------------------------------------*/
+static void BENCH_Print(const char *pOp, const BENCH_RESULT *pC, const BENCH_RESULT *pCpp, int f_last)
+{
+  printf("    {\"op\": \"%s\", \"cNsPerCall\": %.1f, \"cppNsPerCall\": %.1f, \"reductionPercent\": %.1f, "
+         "\"cLowLevelCallsPerOp\": %.2f, \"cppLowLevelCallsPerOp\": %.2f, \"errors\": %lu}%s\n",
+         pOp, pC->ns, pCpp->ns, 100.0 * (pC->ns - pCpp->ns) / pC->ns,
+         pC->lowLevelCalls, pCpp->lowLevelCalls, pC->errors + pCpp->errors, f_last ? "" : ",");
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  // No device time, only the CPU time of the calls
+  static const TFFT_EEPROM_SIMU_CONFIG simConfig = {(uint32_t)TFFT_MAX_ADDRESS + 1, TFFT_EEPROM_PAGE_SIZE, 0, 0, 0, 0, 0, 0, 0};
+  unsigned long ops = (argc > 1) ? strtoul(argv[1], 0, 10) : 200000;
+  BENCH_RESULT c[4] = {};
+  BENCH_RESULT cpp[4] = {};
+  int round;
+
+  if(ops == 0 || TFFT_EepromSimuOpen(NULL, &simConfig) != 0)
+  {
+    fprintf(stderr, "bench_cpp: setup failed\n");
+    return 1;
+  }
+
+  TFFT_Mount(0);
+
+  // Both APIs run in turn, the fastest of the rounds is kept
+  for(round = 0; round < BENCH_ROUNDS; round++)
+  {
+    BENCH_Run(ops, [](unsigned long n) { return TFFT_WriteS32(FILE3_NAME_SENSOR_VAL2_S32, (int32_t)n); }, &c[0]);
+    BENCH_Run(ops, [](unsigned long n) { return BenchFileS32::write((int32_t)n); }, &cpp[0]);
+    BENCH_Run(ops, [](unsigned long) { int32_t v; return TFFT_ReadS32(FILE3_NAME_SENSOR_VAL2_S32, &v); }, &c[1]);
+    BENCH_Run(ops, [](unsigned long) { int32_t v; return BenchFileS32::read(v); }, &cpp[1]);
+    BENCH_Run(ops, [](unsigned long n) { return TFFT_WriteU8(FILE0_NAME_EEPROM_FILE_VERSION_U8, (uint8_t)n); }, &c[2]);
+    BENCH_Run(ops, [](unsigned long n) { return BenchFileU8::write((uint8_t)n); }, &cpp[2]);
+    BENCH_Run(ops, [](unsigned long) { uint8_t v; return TFFT_ReadU8(FILE0_NAME_EEPROM_FILE_VERSION_U8, &v); }, &c[3]);
+    BENCH_Run(ops, [](unsigned long) { uint8_t v; return BenchFileU8::read(v); }, &cpp[3]);
+  }
+
+  printf("{\n  \"config\": {\"crc\": \"%s\", \"backup\": %d, \"compare\": %d, \"cache\": %d, \"ops\": %lu},\n",
+         TFFT_USE_FILE_CRC32C ? "crc32c" : (TFFT_USE_FILE_CRC16 ? "crc16" : (TFFT_USE_FILE_CRC8 ? "crc8" : "none")),
+         TFFT_BACKUP_MODE_ENABLED, TFFT_COMPARE_BEFORE_WRITE, TFFT_CACHE_ENABLED, ops);
+  printf("  \"results\": [\n");
+  BENCH_Print("writeS32", &c[0], &cpp[0], 0);
+  BENCH_Print("readS32", &c[1], &cpp[1], 0);
+  BENCH_Print("writeU8", &c[2], &cpp[2], 0);
+  BENCH_Print("readU8", &c[3], &cpp[3], 1);
+  printf("  ]\n}\n");
+
+  TFFT_EepromSimuClose();
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_crc.c
+ * @brief CRC throughput micro-benchmark.
+ *
+ * Compares byte-wise TFFT_Crc8()/TFFT_Crc16()/TFFT_Crc32c() against
+ * TFFT_Crc8Buffer(), TFFT_Crc16Buffer() and TFFT_Crc32cBuffer() for a range
+ * of buffer sizes and prints MB/s.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -I. bench/bench_crc.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c -o bench_crc
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tfft_crc8.h"
+#include "tfft_crc16.h"
+#include "tfft_crc32c.h"
+
+#define BENCH_TOTAL_BYTES (64UL * 1024UL * 1024UL) // Bytes processed per measurement
+
+static volatile uint32_t s_sink; // Keeps the compiler from removing the work
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc8Bytewise(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  size_t i;
+  uint8_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    for(i = 0; i < len; i++)
+    {
+      TFFT_Crc8(pBuf[i], &crc);
+    }
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc8Buffer(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  uint8_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    crc = TFFT_Crc8Buffer(pBuf, len, crc);
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc16Bytewise(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  size_t i;
+  uint16_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    for(i = 0; i < len; i++)
+    {
+      TFFT_Crc16(pBuf[i], &crc);
+    }
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc16Buffer(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  uint16_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    crc = TFFT_Crc16Buffer(pBuf, len, crc);
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc32cBytewise(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  size_t i;
+  uint32_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    for(i = 0; i < len; i++)
+    {
+      TFFT_Crc32c(pBuf[i], &crc);
+    }
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Crc32cBuffer(const uint8_t *pBuf, size_t len, unsigned long rounds)
+{
+  double start = BENCH_Now();
+  unsigned long r;
+  uint32_t crc = 0;
+
+  for(r = 0; r < rounds; r++)
+  {
+    crc = TFFT_Crc32cBuffer(pBuf, len, crc);
+  }
+  s_sink += crc;
+
+  return BENCH_Now() - start;
+}
+
+/*----------------------------------------------------------------------------*/
+int main()
+{
+  static const size_t sizes[] = { 4, 16, 64, 256, 1024, 4096, 65536 };
+  static uint8_t buf[65536];
+  size_t i;
+
+  srand(1);
+  for(i = 0; i < sizeof(buf); i++)
+  {
+    buf[i] = (uint8_t)rand();
+  }
+
+  printf("%8s %14s %14s %14s %14s %14s %14s\n", "size", "crc8 byte", "crc8 buffer",
+         "crc16 byte", "crc16 buffer", "crc32c byte", "crc32c buffer");
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    size_t len = sizes[i];
+    unsigned long rounds = BENCH_TOTAL_BYTES / len;
+    double mb = (double)rounds * (double)len / (1024.0 * 1024.0);
+
+    printf("%8lu %9.1f MB/s %9.1f MB/s %9.1f MB/s %9.1f MB/s %9.1f MB/s %9.1f MB/s\n", (unsigned long)len,
+           mb / BENCH_Crc8Bytewise(buf, len, rounds),
+           mb / BENCH_Crc8Buffer(buf, len, rounds),
+           mb / BENCH_Crc16Bytewise(buf, len, rounds),
+           mb / BENCH_Crc16Buffer(buf, len, rounds),
+           mb / BENCH_Crc32cBytewise(buf, len, rounds),
+           mb / BENCH_Crc32cBuffer(buf, len, rounds));
+  }
+
+  return 0;
+}
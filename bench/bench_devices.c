@@ -0,0 +1,319 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_devices.c
+ * @brief Benchmark of several devices driven in parallel.
+ *
+ * Four instances on RAM devices, each with its own bus time per low level
+ * transaction and its own lock. Reads and writes are run from 1, 2 and 4
+ * threads, first with all threads on one device and then with one device
+ * per thread. The bus time is slept, as for a transfer done by DMA or
+ * interrupts, so independent devices overlap their transfers.
+ * Set TFFT_DEBUG_ENABLED to 0 in tfft_user.h to not measure printf.
+ * Usage: bench_devices [bus time per transaction in us (default 100)] [operations per thread]
+ * Build from the repository root, e.g.:
+ * gcc -O2 -I. bench/bench_devices.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o bench_devices
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "tfft.h"
+
+#define BENCH_DEVICE_COUNT 4
+#define BENCH_DEVICE_SIZE  256
+
+// Small layout header (if TFFT_LAYOUT_ENABLED), the default does not fit
+#define BENCH_LAYOUT_MAX_FILES 4
+
+#define BENCH_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(BENCH_FILE_CONFIG,  16, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(BENCH_FILE_COUNTER,  4, TFFT_FILE_TYPE_RING,   4) \
+  TFFT_FILE(BENCH_FILE_LABEL,   10, TFFT_FILE_TYPE_NORMAL, 1)
+TFFT_FILE_NAMES(BENCH_FILE_TABLE, BENCH_FILE_COUNT)
+
+typedef struct
+{
+  uint8_t mem[BENCH_DEVICE_SIZE];
+  pthread_mutex_t lock;
+  unsigned long transactions;
+} BENCH_DEVICE;
+
+typedef struct
+{
+  pthread_t thread;
+  TFFT_INSTANCE *pInst;
+  unsigned int seed;
+  unsigned long ops;
+  unsigned long errors;
+} BENCH_THREAD;
+
+static long sl_busNs = 100000;
+static BENCH_DEVICE sa_devices[BENCH_DEVICE_COUNT];
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*----------------------------------------------------------------------------*/
+/* One transaction on the bus of the device */
+static void BENCH_Bus(BENCH_DEVICE *pDevice)
+{
+  struct timespec ts = {0, sl_busNs};
+
+  pDevice->transactions++; // Lock of the device is held
+  nanosleep(&ts, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+static int BENCH_WriteByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t byte)
+{
+  BENCH_Bus((BENCH_DEVICE*)pDevice);
+  ((BENCH_DEVICE*)pDevice)->mem[address] = byte;
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int BENCH_ReadByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pByte)
+{
+  BENCH_Bus((BENCH_DEVICE*)pDevice);
+  *pByte = ((BENCH_DEVICE*)pDevice)->mem[address];
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int BENCH_ReadBlock(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  BENCH_Bus((BENCH_DEVICE*)pDevice);
+  memcpy(pData, &((BENCH_DEVICE*)pDevice)->mem[address], len);
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int BENCH_WritePage(void *pDevice, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  BENCH_Bus((BENCH_DEVICE*)pDevice);
+  memcpy(&((BENCH_DEVICE*)pDevice)->mem[address], pData, len);
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Each device has its own lock. Shared and exclusive are the same here. */
+static int BENCH_Lock(void *pDevice, uint8_t f_shared, uint32_t timeoutMs)
+{
+  (void)f_shared;
+  (void)timeoutMs;
+  return pthread_mutex_lock(&((BENCH_DEVICE*)pDevice)->lock);
+}
+
+/*----------------------------------------------------------------------------*/
+static void BENCH_Unlock(void *pDevice, uint8_t f_shared)
+{
+  (void)f_shared;
+  pthread_mutex_unlock(&((BENCH_DEVICE*)pDevice)->lock);
+}
+
+static const TFFT_DRIVER s_benchDriver =
+{
+  BENCH_WriteByte,
+  BENCH_ReadByte,
+  BENCH_ReadBlock,
+  BENCH_WritePage,
+  0,
+  BENCH_Lock,
+  BENCH_Unlock,
+  0,
+  0
+};
+
+#define TFFT_INSTANCE_NAME          s_benchInst0
+#define TFFT_INSTANCE_STATIC
+#define TFFT_INSTANCE_FILES         BENCH_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS 0
+#define TFFT_INSTANCE_END_ADDRESS   (BENCH_DEVICE_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER        (&s_benchDriver)
+#define TFFT_INSTANCE_DEVICE        (&sa_devices[0])
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES BENCH_LAYOUT_MAX_FILES
+#include "tfft_instance.h"
+
+#define TFFT_INSTANCE_NAME          s_benchInst1
+#define TFFT_INSTANCE_STATIC
+#define TFFT_INSTANCE_FILES         BENCH_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS 0
+#define TFFT_INSTANCE_END_ADDRESS   (BENCH_DEVICE_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER        (&s_benchDriver)
+#define TFFT_INSTANCE_DEVICE        (&sa_devices[1])
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES BENCH_LAYOUT_MAX_FILES
+#include "tfft_instance.h"
+
+#define TFFT_INSTANCE_NAME          s_benchInst2
+#define TFFT_INSTANCE_STATIC
+#define TFFT_INSTANCE_FILES         BENCH_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS 0
+#define TFFT_INSTANCE_END_ADDRESS   (BENCH_DEVICE_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER        (&s_benchDriver)
+#define TFFT_INSTANCE_DEVICE        (&sa_devices[2])
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES BENCH_LAYOUT_MAX_FILES
+#include "tfft_instance.h"
+
+#define TFFT_INSTANCE_NAME          s_benchInst3
+#define TFFT_INSTANCE_STATIC
+#define TFFT_INSTANCE_FILES         BENCH_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS 0
+#define TFFT_INSTANCE_END_ADDRESS   (BENCH_DEVICE_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER        (&s_benchDriver)
+#define TFFT_INSTANCE_DEVICE        (&sa_devices[3])
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES BENCH_LAYOUT_MAX_FILES
+#include "tfft_instance.h"
+
+static TFFT_INSTANCE* const sa_benchInst[BENCH_DEVICE_COUNT] =
+{
+  &s_benchInst0,
+  &s_benchInst1,
+  &s_benchInst2,
+  &s_benchInst3
+};
+
+/*----------------------------------------------------------------------------*/
+static void* BENCH_Worker(void *pArg)
+{
+  BENCH_THREAD *pThread = (BENCH_THREAD*)pArg;
+  uint8_t buf[16];
+  unsigned long n;
+  int rtnCode;
+
+  for(n = 0; n < pThread->ops; n++)
+  {
+    unsigned int r = (unsigned int)rand_r(&pThread->seed);
+    TFFT_FILE_NAME_TYPE fname = (TFFT_FILE_NAME_TYPE)(r % BENCH_FILE_COUNT);
+
+    if((r / 8) % 4 == 0)
+    {
+      buf[0] = (uint8_t)n;
+      buf[1] = (uint8_t)(n >> 8);
+      rtnCode = TFFT_InstReadWriteFile(pThread->pInst, fname, sizeof(buf), buf, TFFT_RW_WRITE, 1);
+    }
+    else
+    {
+      rtnCode = TFFT_InstReadWriteFile(pThread->pInst, fname, sizeof(buf), buf, TFFT_RW_READ, 0);
+    }
+
+    if(rtnCode != TFFT_RW_OK)
+    {
+      pThread->errors++;
+    }
+  }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Run nThreads threads, on one device or on one device each.
+   Returns operations per second. */
+static double BENCH_Run(unsigned int nThreads, uint8_t f_separate, unsigned long ops,
+                        unsigned long *pErrors, unsigned long *pTransactions)
+{
+  static BENCH_THREAD threads[BENCH_DEVICE_COUNT];
+  double start;
+  unsigned int i;
+
+  *pErrors = 0;
+  *pTransactions = 0;
+  for(i = 0; i < BENCH_DEVICE_COUNT; i++)
+  {
+    sa_devices[i].transactions = 0;
+  }
+
+  start = BENCH_Now();
+  for(i = 0; i < nThreads; i++)
+  {
+    threads[i].pInst = sa_benchInst[f_separate ? i : 0];
+    threads[i].seed = i + 1;
+    threads[i].ops = ops;
+    threads[i].errors = 0;
+    pthread_create(&threads[i].thread, 0, BENCH_Worker, &threads[i]);
+  }
+
+  for(i = 0; i < nThreads; i++)
+  {
+    pthread_join(threads[i].thread, 0);
+    *pErrors += threads[i].errors;
+  }
+
+  for(i = 0; i < BENCH_DEVICE_COUNT; i++)
+  {
+    *pTransactions += sa_devices[i].transactions;
+  }
+
+  return (double)nThreads * (double)ops / (BENCH_Now() - start);
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  unsigned long busUs = (argc > 1) ? strtoul(argv[1], 0, 10) : 100;
+  unsigned long ops = (argc > 2) ? strtoul(argv[2], 0, 10) : 500;
+  unsigned long errors;
+  unsigned long transactions;
+  TFFT_FILE_NAME_TYPE fname;
+  unsigned int nThreads;
+  uint8_t f_separate;
+  double opsPerSec;
+  unsigned int i;
+
+  sl_busNs = (long)busUs * 1000;
+
+  // Valid content in all files before the reads start
+  for(i = 0; i < BENCH_DEVICE_COUNT; i++)
+  {
+    pthread_mutex_init(&sa_devices[i].lock, 0);
+    for(fname = 0; fname < BENCH_FILE_COUNT; fname++)
+    {
+      TFFT_InstReadWriteFile(sa_benchInst[i], fname, 0, 0, TFFT_RW_WRITE, 0);
+    }
+    TFFT_InstMount(sa_benchInst[i], 0);
+  }
+
+  printf("%lu us bus time per transaction, %lu operations per thread, 25%% writes\n", busUs, ops);
+  printf("%8s %10s %12s %14s %10s\n", "threads", "devices", "ops/s", "transactions", "errors");
+
+  for(f_separate = 0; f_separate <= 1; f_separate++)
+  {
+    for(nThreads = 1; nThreads <= BENCH_DEVICE_COUNT; nThreads *= 2)
+    {
+      opsPerSec = BENCH_Run(nThreads, f_separate, ops, &errors, &transactions);
+      printf("%8u %10u %12.0f %14lu %10lu\n", nThreads, f_separate ? nThreads : 1,
+             opsPerSec, transactions, errors);
+    }
+  }
+
+  return 0;
+}
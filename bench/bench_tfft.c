@@ -0,0 +1,192 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_tfft.c
+ * @brief Read/write benchmark of the file table in tfft_user.h.
+ *
+ * Reads and writes random files of the file table on the simulated EEPROM
+ * and prints one JSON object with the configuration and, for reads and
+ * writes, ops/s, bytes/s, p50/p99 latency, low level calls per operation
+ * and the modelled device time per operation (400 kHz I2C EEPROM timing).
+ * bench/run_bench.sh builds and runs it for a range of configurations.
+ * Usage: bench_tfft [operations (default 20000)]
+ * Build from the repository root, e.g.:
+ * gcc -O2 -I. bench/bench_tfft.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o bench_tfft
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tfft.h"
+
+/* Largest file size that TFFT_SIZE_TYPE can hold */
+#define BENCH_MAX_FILE_SIZE ((TFFT_SIZE_TYPE)~(TFFT_SIZE_TYPE)0)
+
+#define BENCH_FILE_SIZE_ENTRY(fname, size, type, count) size,
+static const uint32_t sa_benchFileSize[] = { TFFT_FILE_TABLE(BENCH_FILE_SIZE_ENTRY) };
+
+typedef struct
+{
+  double seconds;
+  uint64_t bytes;
+  uint64_t p50Ns;
+  uint64_t p99Ns;
+  unsigned long errors;
+  TFFT_EEPROM_SIMU_COUNTERS counters;
+} BENCH_RESULT;
+
+/*----------------------------------------------------------------------------*/
+static uint64_t BENCH_NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*----------------------------------------------------------------------------*/
+static int BENCH_CompareU64(const void *pA, const void *pB)
+{
+  uint64_t a = *(const uint64_t*)pA;
+  uint64_t b = *(const uint64_t*)pB;
+  return (a > b) - (a < b);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Run ops reads or writes of random files. pLatency holds ops entries. */
+static void BENCH_Run(uint8_t f_write, unsigned long ops, uint64_t *pLatency, BENCH_RESULT *pResult)
+{
+  static uint8_t buf[BENCH_MAX_FILE_SIZE];
+  uint64_t start;
+  unsigned long n;
+
+  memset(pResult, 0, sizeof(*pResult));
+  srand(f_write + 1);
+  TFFT_EepromResetCounters();
+  start = BENCH_NowNs();
+
+  for(n = 0; n < ops; n++)
+  {
+    TFFT_FILE_NAME_TYPE fname = (TFFT_FILE_NAME_TYPE)((unsigned long)rand() % TFFT_FILE_COUNT);
+    TFFT_SIZE_TYPE size = (TFFT_SIZE_TYPE)sa_benchFileSize[fname];
+    uint64_t t0;
+    int rtnCode;
+
+    buf[0] = (uint8_t)n;
+    buf[size - 1] = (uint8_t)(n >> 8);
+
+    t0 = BENCH_NowNs();
+    rtnCode = TFFT_ReadWriteFile(fname, size, buf, f_write ? TFFT_RW_WRITE : TFFT_RW_READ, 0);
+    pLatency[n] = BENCH_NowNs() - t0;
+
+    if(rtnCode != TFFT_RW_OK)
+    {
+      pResult->errors++;
+    }
+    pResult->bytes += size;
+  }
+
+  pResult->seconds = (double)(BENCH_NowNs() - start) * 1e-9;
+  TFFT_EepromGetCounters(&pResult->counters);
+
+  qsort(pLatency, ops, sizeof(uint64_t), BENCH_CompareU64);
+  pResult->p50Ns = pLatency[ops / 2];
+  pResult->p99Ns = pLatency[(ops * 99) / 100];
+}
+
+/*----------------------------------------------------------------------------*/
+static void BENCH_Print(const char *pOp, unsigned long ops, const BENCH_RESULT *pResult, int f_last)
+{
+  const TFFT_EEPROM_SIMU_COUNTERS *c = &pResult->counters;
+  double perOp = 1.0 / (double)ops;
+
+  printf("    {\"op\": \"%s\", \"ops\": %lu, \"errors\": %lu, "
+         "\"opsPerSec\": %.0f, \"bytesPerSec\": %.0f, \"p50Ns\": %llu, \"p99Ns\": %llu, "
+         "\"lowLevelCallsPerOp\": %.2f, \"blockReadsPerOp\": %.2f, \"pageWritesPerOp\": %.2f, "
+         "\"byteReadsPerOp\": %.2f, \"byteWritesPerOp\": %.2f, "
+         "\"bytesReadPerOp\": %.2f, \"bytesWrittenPerOp\": %.2f, \"deviceUsPerOp\": %.1f}%s\n",
+         pOp, ops, pResult->errors,
+         (double)ops / pResult->seconds, (double)pResult->bytes / pResult->seconds,
+         (unsigned long long)pResult->p50Ns, (unsigned long long)pResult->p99Ns,
+         (double)(c->blockReads + c->pageWrites + c->byteReads + c->byteWrites) * perOp,
+         (double)c->blockReads * perOp, (double)c->pageWrites * perOp,
+         (double)c->byteReads * perOp, (double)c->byteWrites * perOp,
+         (double)c->bytesRead * perOp, (double)c->bytesWritten * perOp,
+         (double)c->simTimeNs * 1e-3 * perOp,
+         f_last ? "" : ",");
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  // 400 kHz I2C EEPROM, 5 ms write cycle
+  static const TFFT_EEPROM_SIMU_CONFIG simConfig = {(uint32_t)TFFT_MAX_ADDRESS + 1, TFFT_EEPROM_PAGE_SIZE, 50000, 22500, 5000000, 5000000, 0, 0, 0};
+  unsigned long ops = (argc > 1) ? strtoul(argv[1], 0, 10) : 20000;
+  BENCH_RESULT writeResult;
+  BENCH_RESULT readResult;
+  uint64_t *pLatency;
+  uint32_t minSize = BENCH_MAX_FILE_SIZE;
+  uint32_t maxSize = 0;
+  uint32_t i;
+
+  pLatency = malloc((ops ? ops : 1) * sizeof(uint64_t));
+  if(ops == 0 || pLatency == NULL || TFFT_EepromSimuOpen(NULL, &simConfig) != 0)
+  {
+    fprintf(stderr, "bench_tfft: setup failed\n");
+    return 1;
+  }
+
+  for(i = 0; i < TFFT_FILE_COUNT; i++)
+  {
+    minSize = (sa_benchFileSize[i] < minSize) ? sa_benchFileSize[i] : minSize;
+    maxSize = (sa_benchFileSize[i] > maxSize) ? sa_benchFileSize[i] : maxSize;
+  }
+
+  // Valid content in all files before the reads start
+  TFFT_Mount(0);
+  for(i = 0; i < TFFT_FILE_COUNT; i++)
+  {
+    TFFT_WriteData((TFFT_FILE_NAME_TYPE)i, 0, "");
+  }
+
+  BENCH_Run(1, ops, pLatency, &writeResult);
+  BENCH_Run(0, ops, pLatency, &readResult);
+
+  printf("{\n  \"config\": {\"crc\": \"%s\", \"backup\": %d, \"compare\": %d, \"cache\": %d, "
+         "\"files\": %u, \"minFileSize\": %lu, \"maxFileSize\": %lu, \"pageSize\": %u, \"eepromBytes\": %lu},\n",
+         TFFT_USE_FILE_CRC32C ? "crc32c" : (TFFT_USE_FILE_CRC16 ? "crc16" : (TFFT_USE_FILE_CRC8 ? "crc8" : "none")),
+         TFFT_BACKUP_MODE_ENABLED, TFFT_COMPARE_BEFORE_WRITE, TFFT_CACHE_ENABLED,
+         (unsigned int)TFFT_FILE_COUNT, (unsigned long)minSize, (unsigned long)maxSize,
+         (unsigned int)TFFT_EEPROM_PAGE_SIZE, (unsigned long)simConfig.size);
+  printf("  \"results\": [\n");
+  BENCH_Print("write", ops, &writeResult, 0);
+  BENCH_Print("read", ops, &readResult, 1);
+  printf("  ]\n}\n");
+
+  free(pLatency);
+  TFFT_EepromSimuClose();
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_threads.c
+ * @brief Multi-threaded stress benchmark.
+ *
+ * Runs a mix of reads and writes of all files from 1, 2, 4 and 8 threads
+ * and prints throughput together with lock contention (TFFT_LOCK_FUNC must
+ * be TFFT_LockAcquire). Cached reads only take a shared lock, so enable
+ * TFFT_CACHE_ENABLED in tfft_user.h to see reads scale with threads.
+ * Debug output must be off (TFFT_DEBUG_ENABLED 0) to not measure printf.
+ * Usage: bench_threads [write percent (default 10)] [operations per thread]
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_DEBUG_ENABLED=0 -I. bench/bench_threads.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o bench_threads
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "tfft.h"
+#include "tfft_lock_posix.h"
+
+#if TFFT_DEBUG_ENABLED
+#error "Build with TFFT_DEBUG_ENABLED 0, printf would be measured"
+#endif
+
+#define BENCH_MAX_THREADS 8
+
+typedef struct
+{
+  pthread_t thread;
+  unsigned int seed;
+  unsigned long ops;
+  unsigned long writePercent;
+  unsigned long busy;   // Calls that failed with TFFT_RW_ERR_EEPROM_BUSY
+  unsigned long errors; // Calls that failed with other errors
+} BENCH_THREAD;
+
+static const TFFT_FILE_NAME_TYPE sa_benchFiles[] =
+{
+  FILE0_NAME_EEPROM_FILE_VERSION_U8,
+  FILE2_NAME_TEXT_LABEL1_STR10,
+  FILE3_NAME_SENSOR_VAL2_S32
+};
+
+/*----------------------------------------------------------------------------*/
+static double BENCH_Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*----------------------------------------------------------------------------*/
+static void* BENCH_Worker(void *pArg)
+{
+  BENCH_THREAD *pThread = (BENCH_THREAD*)pArg;
+  uint8_t buf[16];
+  unsigned long n;
+  int rtnCode;
+
+  for(n = 0; n < pThread->ops; n++)
+  {
+    unsigned int r = (unsigned int)rand_r(&pThread->seed);
+    TFFT_FILE_NAME_TYPE fname = sa_benchFiles[r % (sizeof(sa_benchFiles) / sizeof(sa_benchFiles[0]))];
+
+    if((r / 8) % 100 < pThread->writePercent)
+    {
+      buf[0] = (uint8_t)n;
+      buf[1] = (uint8_t)(n >> 8);
+      rtnCode = TFFT_ReadWriteFile(fname, sizeof(buf), buf, TFFT_RW_WRITE, 1);
+    }
+    else
+    {
+      rtnCode = TFFT_ReadData(fname, sizeof(buf), buf);
+    }
+
+    if(rtnCode == TFFT_RW_ERR_EEPROM_BUSY)
+    {
+      pThread->busy++;
+    }
+    else if(rtnCode != TFFT_RW_OK)
+    {
+      pThread->errors++;
+    }
+  }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  static BENCH_THREAD threads[BENCH_MAX_THREADS];
+  unsigned long writePercent = (argc > 1) ? strtoul(argv[1], 0, 10) : 10;
+  unsigned long ops = (argc > 2) ? strtoul(argv[2], 0, 10) : 200000;
+  TFFT_FILE_NAME_TYPE fname;
+  TFFT_LOCK_COUNTERS lock;
+  unsigned int nThreads;
+  unsigned int i;
+
+  // Valid content in all files before the reads start
+  for(i = 0; i < sizeof(sa_benchFiles) / sizeof(sa_benchFiles[0]); i++)
+  {
+    fname = sa_benchFiles[i];
+    TFFT_WriteData(fname, 0, "");
+  }
+  TFFT_CacheLoad();
+
+  printf("cache %s, %lu%% writes, %lu operations per thread\n",
+         TFFT_CACHE_ENABLED ? "enabled" : "disabled", writePercent, ops);
+  printf("%8s %14s %10s %10s %10s %10s\n", "threads", "ops/s", "contended", "timeouts", "busy", "errors");
+
+  for(nThreads = 1; nThreads <= BENCH_MAX_THREADS; nThreads *= 2)
+  {
+    unsigned long busy = 0;
+    unsigned long errors = 0;
+    double start;
+    double seconds;
+
+    TFFT_LockResetCounters();
+    start = BENCH_Now();
+
+    for(i = 0; i < nThreads; i++)
+    {
+      threads[i].seed = i + 1;
+      threads[i].ops = ops;
+      threads[i].writePercent = writePercent;
+      threads[i].busy = 0;
+      threads[i].errors = 0;
+      pthread_create(&threads[i].thread, 0, BENCH_Worker, &threads[i]);
+    }
+
+    for(i = 0; i < nThreads; i++)
+    {
+      pthread_join(threads[i].thread, 0);
+      busy += threads[i].busy;
+      errors += threads[i].errors;
+    }
+
+    seconds = BENCH_Now() - start;
+    TFFT_Flush();
+    TFFT_LockGetCounters(&lock);
+
+    printf("%8u %14.0f %10lu %10lu %10lu %10lu\n", nThreads,
+           (double)nThreads * (double)ops / seconds,
+           (unsigned long)lock.contended, (unsigned long)lock.timeouts, busy, errors);
+  }
+
+  return 0;
+}
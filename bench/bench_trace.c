@@ -0,0 +1,469 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file bench_trace.c
+ * @brief Decode and replay trace dumps from TFFT_TraceDump().
+ *
+ * decode: print each traced call and a summary per operation.
+ * replay: run the traced calls against the simulated EEPROM (400 kHz I2C
+ * timing model) and print JSON with latency, low level calls and modelled
+ * device time per operation, next to what was recorded. Must be built with
+ * the same file table (tfft_user.h) as the traced device. All files are
+ * written once before the replay, so reads of files that were valid in the
+ * field do not fail. Written data is a pattern of the recorded size.
+ * Usage: bench_trace decode <dump file>
+ *        bench_trace replay <dump file> [image file]
+ * Build from the repository root, e.g.:
+ * gcc -O2 -I. bench/bench_trace.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o bench_trace
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tfft.h"
+
+/* Same format as TFFT_TraceDump(), also when TFFT_TRACE_SIZE is 0 */
+#define TRACE_MAGIC       0x52544654
+#define TRACE_VERSION     1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 24
+#define TRACE_ALL_FILES   0xFFFF
+
+/* Operations, see TFFT_TRACE_.. in tfft.h */
+#define TRACE_OP_COUNT 24
+
+/* Sizes above this fail in the replay as they did on the device */
+#define TRACE_MAX_SIZE sizeof(TFFT_FILE_LAYOUT)
+
+typedef struct
+{
+  uint32_t seq;
+  uint32_t start;
+  uint32_t end;
+  uint32_t size;
+  uint16_t fname;
+  uint16_t lowLevelCalls;
+  int8_t result;
+  uint8_t op;
+} TRACE_RECORD;
+
+typedef struct
+{
+  unsigned long count;
+  unsigned long errors;
+  uint64_t recordedTime;      // Sum of end - start
+  uint64_t recordedLowLevel;
+  unsigned long replayErrors;
+  uint64_t replayLowLevel;
+  uint64_t replayDeviceNs;
+  uint64_t *pLatency;         // Replay wall time of each call
+} TRACE_OP_SUMMARY;
+
+/*----------------------------------------------------------------------------*/
+static const char* TRACE_OpName(uint8_t op)
+{
+  switch(op)
+  {
+    case TFFT_RW_READ:          return "read";
+    case TFFT_RW_WRITE:         return "write";
+    case TFFT_RW_WRITE_COMPARE: return "write_compare";
+    case TFFT_RW_WRITE_ALWAYS:  return "write_always";
+    case 16:                    return "write_async";
+    case 17:                    return "poll";
+    case 18:                    return "batch_read";
+    case 19:                    return "batch_write";
+    case 20:                    return "flush";
+    case 21:                    return "mount";
+    case 22:                    return "verify";
+    case 23:                    return "scrub";
+    default:                    return "unknown";
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static uint32_t TRACE_Get(const uint8_t *pBuf, uint8_t len)
+{
+  uint32_t value = 0;
+
+  while(len > 0)
+  {
+    len--;
+    value = (value << 8) | pBuf[len]; // Least significant byte first
+  }
+
+  return value;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Load a dump. Returns the records (to be freed) or NULL on error. */
+static TRACE_RECORD* TRACE_Load(const char *pPath, uint32_t *pCount, uint32_t *pFileCount)
+{
+  uint8_t au8_header[TRACE_HEADER_SIZE];
+  uint8_t au8_record[TRACE_RECORD_SIZE];
+  TRACE_RECORD *pRecords;
+  uint32_t i;
+  FILE *pFile = fopen(pPath, "rb");
+
+  if(pFile == NULL)
+  {
+    fprintf(stderr, "bench_trace: can not open %s\n", pPath);
+    return NULL;
+  }
+
+  if(fread(au8_header, 1, sizeof(au8_header), pFile) != sizeof(au8_header) ||
+     TRACE_Get(&au8_header[0], 4) != TRACE_MAGIC || au8_header[4] != TRACE_VERSION ||
+     au8_header[5] != TRACE_RECORD_SIZE)
+  {
+    fprintf(stderr, "bench_trace: %s is not a version %d trace dump\n", pPath, TRACE_VERSION);
+    fclose(pFile);
+    return NULL;
+  }
+
+  *pFileCount = TRACE_Get(&au8_header[6], 2);
+  *pCount = TRACE_Get(&au8_header[8], 4);
+  pRecords = calloc(*pCount ? *pCount : 1, sizeof(TRACE_RECORD));
+
+  for(i = 0; pRecords != NULL && i < *pCount; i++)
+  {
+    if(fread(au8_record, 1, sizeof(au8_record), pFile) != sizeof(au8_record))
+    {
+      fprintf(stderr, "bench_trace: %s is truncated after %lu records\n", pPath, (unsigned long)i);
+      *pCount = i;
+      break;
+    }
+    pRecords[i].seq = TRACE_Get(&au8_record[0], 4);
+    pRecords[i].start = TRACE_Get(&au8_record[4], 4);
+    pRecords[i].end = TRACE_Get(&au8_record[8], 4);
+    pRecords[i].size = TRACE_Get(&au8_record[12], 4);
+    pRecords[i].fname = (uint16_t)TRACE_Get(&au8_record[16], 2);
+    pRecords[i].lowLevelCalls = (uint16_t)TRACE_Get(&au8_record[18], 2);
+    pRecords[i].result = (int8_t)au8_record[20];
+    pRecords[i].op = au8_record[21];
+  }
+
+  fclose(pFile);
+
+  return pRecords;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TRACE_Decode(const TRACE_RECORD *pRecords, uint32_t count, uint32_t fileCount)
+{
+  TRACE_OP_SUMMARY summary[TRACE_OP_COUNT];
+  unsigned long lost = 0;
+  uint32_t i;
+  uint8_t op;
+
+  memset(summary, 0, sizeof(summary));
+
+  printf("%u records, %u files in the file table\n", (unsigned int)count, (unsigned int)fileCount);
+  printf("%10s %10s %8s %8s %-14s %6s %8s %9s %6s\n",
+         "seq", "start", "gap", "time", "op", "fname", "size", "lowLevel", "result");
+
+  for(i = 0; i < count; i++)
+  {
+    const TRACE_RECORD *pRec = &pRecords[i];
+
+    if(i > 0 && pRec->seq != pRecords[i - 1].seq + 1)
+    {
+      lost += pRec->seq - pRecords[i - 1].seq - 1; // Entries taken but not completed at dump
+    }
+
+    printf("%10lu %10lu %8lu %8lu %-14s ", (unsigned long)pRec->seq, (unsigned long)pRec->start,
+           (unsigned long)(i > 0 ? pRec->start - pRecords[i - 1].start : 0),
+           (unsigned long)(pRec->end - pRec->start), TRACE_OpName(pRec->op));
+    if(pRec->fname == TRACE_ALL_FILES)
+    {
+      printf("%6s ", "all");
+    }
+    else
+    {
+      printf("%6u ", (unsigned int)pRec->fname);
+    }
+    printf("%8lu %9u %6d\n", (unsigned long)pRec->size, (unsigned int)pRec->lowLevelCalls, (int)pRec->result);
+
+    op = (pRec->op < TRACE_OP_COUNT) ? pRec->op : 0;
+    summary[op].count++;
+    summary[op].errors += (pRec->result < 0);
+    summary[op].recordedTime += pRec->end - pRec->start;
+    summary[op].recordedLowLevel += pRec->lowLevelCalls;
+  }
+
+  printf("\n%-14s %8s %8s %12s %12s\n", "op", "count", "errors", "avg time", "avg lowLevel");
+  for(op = 0; op < TRACE_OP_COUNT; op++)
+  {
+    if(summary[op].count > 0)
+    {
+      printf("%-14s %8lu %8lu %12.1f %12.2f\n", TRACE_OpName(op), summary[op].count, summary[op].errors,
+             (double)summary[op].recordedTime / (double)summary[op].count,
+             (double)summary[op].recordedLowLevel / (double)summary[op].count);
+    }
+  }
+  if(lost > 0)
+  {
+    printf("%lu entries missing in sequence\n", lost);
+  }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+static uint64_t TRACE_NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TRACE_CompareU64(const void *pA, const void *pB)
+{
+  uint64_t a = *(const uint64_t*)pA;
+  uint64_t b = *(const uint64_t*)pB;
+  return (a > b) - (a < b);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Replay the records from first, returns the number of records used */
+static uint32_t TRACE_ReplayCall(const TRACE_RECORD *pRecords, uint32_t first, uint32_t count, int *pResult)
+{
+  static uint8_t data[TFFT_FILE_COUNT][TRACE_MAX_SIZE];
+  static TFFT_BATCH_ITEM items[TFFT_FILE_COUNT];
+  const TRACE_RECORD *pRec = &pRecords[first];
+  TFFT_SIZE_TYPE size = (TFFT_SIZE_TYPE)((pRec->size < TRACE_MAX_SIZE) ? pRec->size : TRACE_MAX_SIZE);
+  uint8_t *pData = data[(pRec->fname < TFFT_FILE_COUNT) ? pRec->fname : 0];
+  uint32_t n;
+
+  if(pRec->op & 1)
+  {
+    memset(pData, (int)pRec->seq, size); // New content for each write
+  }
+
+  switch(pRec->op)
+  {
+    case TFFT_RW_READ:
+    case TFFT_RW_WRITE:
+    case TFFT_RW_WRITE_COMPARE:
+    case TFFT_RW_WRITE_ALWAYS:
+      *pResult = TFFT_ReadWriteFile(pRec->fname, size, pData, pRec->op, 0);
+      return 1;
+
+    case 16: // write_async
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+      *pResult = TFFT_WriteAsync(pRec->fname, size, pData, 0, 0);
+#else
+      *pResult = TFFT_WriteData(pRec->fname, size, pData); // Written directly without queue
+#endif
+      return 1;
+
+    case 17: // poll
+      *pResult = TFFT_Poll();
+      *pResult = (*pResult == TFFT_RW_PENDING) ? TFFT_RW_OK : *pResult;
+      return 1;
+
+    case 18: // batch_read
+    case 19: // batch_write
+      // Items of one batch have the same op and times
+      for(n = 0; first + n < count && n < TFFT_FILE_COUNT &&
+                 pRecords[first + n].op == pRec->op && pRecords[first + n].start == pRec->start &&
+                 pRecords[first + n].end == pRec->end; n++)
+      {
+        items[n].fname = (TFFT_FILE_NAME_TYPE)pRecords[first + n].fname;
+        items[n].size = (TFFT_SIZE_TYPE)((pRecords[first + n].size < TRACE_MAX_SIZE) ?
+                                         pRecords[first + n].size : TRACE_MAX_SIZE);
+        items[n].pData = data[(items[n].fname < TFFT_FILE_COUNT) ? items[n].fname : 0];
+        if(pRec->op == 19)
+        {
+          memset(items[n].pData, (int)pRecords[first + n].seq, items[n].size);
+        }
+      }
+      *pResult = (pRec->op == 19) ? TFFT_WriteBatch(items, (uint16_t)n) : TFFT_ReadBatch(items, (uint16_t)n);
+      return n;
+
+    case 20: // flush
+      *pResult = (pRec->fname == TRACE_ALL_FILES) ? TFFT_Flush() : TFFT_FlushFile(pRec->fname);
+      return 1;
+
+    case 21: // mount
+      *pResult = TFFT_Mount(0);
+      return 1;
+
+    case 22: // verify
+      *pResult = TFFT_VerifyAll(0);
+      return 1;
+
+    case 23: // scrub
+#if TFFT_REPAIR_ENABLED
+      *pResult = TFFT_Scrub(pRec->size);
+      *pResult = (*pResult == TFFT_RW_SCRUB_DONE) ? TFFT_RW_OK : *pResult;
+#else
+      *pResult = TFFT_RW_OK; // Skipped without repair
+#endif
+      return 1;
+
+    default:
+      *pResult = TFFT_RW_OK; // Unknown operation is skipped
+      return 1;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static int TRACE_Replay(const TRACE_RECORD *pRecords, uint32_t count, uint32_t fileCount, const char *pImage)
+{
+  // 400 kHz I2C EEPROM, 5 ms write cycle
+  static const TFFT_EEPROM_SIMU_CONFIG simConfig = {(uint32_t)TFFT_MAX_ADDRESS + 1, TFFT_EEPROM_PAGE_SIZE, 50000, 22500, 5000000, 5000000, 0, 0, 0};
+  TRACE_OP_SUMMARY summary[TRACE_OP_COUNT];
+  TFFT_EEPROM_SIMU_COUNTERS before;
+  TFFT_EEPROM_SIMU_COUNTERS after;
+  uint64_t wallStart = TRACE_NowNs();
+  uint64_t t0;
+  uint32_t i;
+  uint32_t n;
+  uint32_t k;
+  uint8_t op;
+  uint8_t f_first = 1;
+  int result;
+
+  if(fileCount != TFFT_FILE_COUNT)
+  {
+    fprintf(stderr, "bench_trace: the dump has %u files, this build has %u\n",
+            (unsigned int)fileCount, (unsigned int)TFFT_FILE_COUNT);
+    return 1;
+  }
+
+  if(TFFT_EepromSimuOpen(pImage, &simConfig) != 0)
+  {
+    fprintf(stderr, "bench_trace: can not open the simulated EEPROM\n");
+    return 1;
+  }
+
+  memset(summary, 0, sizeof(summary));
+  for(op = 0; op < TRACE_OP_COUNT; op++)
+  {
+    summary[op].pLatency = malloc((count ? count : 1) * sizeof(uint64_t));
+  }
+
+  // Valid content in all files before the replay
+  TFFT_Mount(0);
+  for(i = 0; i < TFFT_FILE_COUNT; i++)
+  {
+    TFFT_WriteData((TFFT_FILE_NAME_TYPE)i, 0, "");
+  }
+  TFFT_Flush();
+
+  for(i = 0; i < count; i += n)
+  {
+    op = (pRecords[i].op < TRACE_OP_COUNT) ? pRecords[i].op : 0;
+
+    TFFT_EepromGetCounters(&before);
+    t0 = TRACE_NowNs();
+    n = TRACE_ReplayCall(pRecords, i, count, &result);
+    summary[op].pLatency[summary[op].count] = TRACE_NowNs() - t0;
+    TFFT_EepromGetCounters(&after);
+
+    summary[op].count++;
+    summary[op].replayErrors += (result < 0);
+    summary[op].replayLowLevel += (after.byteReads - before.byteReads) + (after.byteWrites - before.byteWrites) +
+                                  (after.blockReads - before.blockReads) + (after.pageWrites - before.pageWrites);
+    summary[op].replayDeviceNs += after.simTimeNs - before.simTimeNs;
+    for(k = i; k < i + n; k++)
+    {
+      summary[op].errors += (pRecords[k].result < 0);
+      summary[op].recordedTime += pRecords[k].end - pRecords[k].start;
+      summary[op].recordedLowLevel += pRecords[k].lowLevelCalls;
+    }
+  }
+
+  printf("{\n  \"records\": %lu, \"wallSeconds\": %.6f,\n  \"results\": [\n",
+         (unsigned long)count, (double)(TRACE_NowNs() - wallStart) * 1e-9);
+  for(op = 0; op < TRACE_OP_COUNT; op++)
+  {
+    TRACE_OP_SUMMARY *pSum = &summary[op];
+    double perCall;
+
+    if(pSum->count == 0)
+    {
+      continue;
+    }
+
+    perCall = 1.0 / (double)pSum->count;
+    qsort(pSum->pLatency, pSum->count, sizeof(uint64_t), TRACE_CompareU64);
+    printf("%s    {\"op\": \"%s\", \"calls\": %lu, \"recordedErrors\": %lu, \"replayErrors\": %lu, "
+           "\"recordedTimePerCall\": %.1f, \"recordedLowLevelPerCall\": %.2f, "
+           "\"replayLowLevelPerCall\": %.2f, \"replayDeviceUsPerCall\": %.1f, "
+           "\"replayP50Ns\": %llu, \"replayP99Ns\": %llu}",
+           f_first ? "" : ",\n", TRACE_OpName(op), pSum->count, pSum->errors, pSum->replayErrors,
+           (double)pSum->recordedTime * perCall, (double)pSum->recordedLowLevel * perCall,
+           (double)pSum->replayLowLevel * perCall, (double)pSum->replayDeviceNs * 1e-3 * perCall,
+           (unsigned long long)pSum->pLatency[pSum->count / 2],
+           (unsigned long long)pSum->pLatency[(pSum->count * 99) / 100]);
+    f_first = 0;
+  }
+  printf("\n  ]\n}\n");
+
+  for(op = 0; op < TRACE_OP_COUNT; op++)
+  {
+    free(summary[op].pLatency);
+  }
+  TFFT_EepromSimuClose();
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  TRACE_RECORD *pRecords;
+  uint32_t count = 0;
+  uint32_t fileCount = 0;
+  int rtnVal;
+
+  if(argc < 3 || (strcmp(argv[1], "decode") != 0 && strcmp(argv[1], "replay") != 0))
+  {
+    fprintf(stderr, "Usage: %s decode <dump file>\n"
+                    "       %s replay <dump file> [image file]\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  pRecords = TRACE_Load(argv[2], &count, &fileCount);
+  if(pRecords == NULL)
+  {
+    return 1;
+  }
+
+  if(strcmp(argv[1], "decode") == 0)
+  {
+    rtnVal = TRACE_Decode(pRecords, count, fileCount);
+  }
+  else
+  {
+    rtnVal = TRACE_Replay(pRecords, count, fileCount, (argc > 3) ? argv[3] : NULL);
+  }
+
+  free(pRecords);
+
+  return rtnVal;
+}
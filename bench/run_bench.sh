@@ -0,0 +1,71 @@
+#!/bin/sh
+# Build and run bench/bench_tfft.c for a range of TFFT configurations and
+# print all results as one JSON array.
+# Each configuration is built in a temporary copy of the sources where
+# tfft_user.h is edited: checksum (none, CRC8, CRC16, CRC32C), backup mode, file
+# size (1 byte to the largest TFFT_SIZE_TYPE) and number of files (4 to
+# thousands). The file table is replaced by files of one size.
+# Usage (from the repository root): bench/run_bench.sh [operations] > result.json
+# Environment: CC (default gcc), CFLAGS (default -O2)
+
+OPS=${1:-20000}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+# bench_config <crc8> <crc16> <crc32c> <backup> <files> <file size>
+bench_config()
+{
+  rm -rf "$WORK/src" && mkdir "$WORK/src" || exit 1
+  cp "$ROOT"/*.c "$ROOT"/*.h "$ROOT"/bench/bench_tfft.c "$WORK/src/" || exit 1
+  awk -v crc8="$1" -v crc16="$2" -v crc32c="$3" -v backup="$4" -v files="$5" -v size="$6" '
+    /^#define TFFT_ADDR_TYPE /           { print "#define TFFT_ADDR_TYPE uint32_t"; next }
+    /^#define TFFT_FILE_NAME_TYPE /      { print "#define TFFT_FILE_NAME_TYPE uint16_t"; next }
+    /^#define TFFT_USE_FILE_CRC8 /       { print "#define TFFT_USE_FILE_CRC8 " crc8; next }
+    /^#define TFFT_USE_FILE_CRC16 /      { print "#define TFFT_USE_FILE_CRC16 " crc16; next }
+    /^#define TFFT_USE_FILE_CRC32C /     { print "#define TFFT_USE_FILE_CRC32C " crc32c; next }
+    /^#define TFFT_BACKUP_MODE_ENABLED / { print "#define TFFT_BACKUP_MODE_ENABLED " backup; next }
+    /^#define TFFT_END_ADDRESS /         { print "#define TFFT_END_ADDRESS 0xFFFFFFFE"; next }
+    /^#define TFFT_DEBUG_ENABLED /       { print "#define TFFT_DEBUG_ENABLED 0"; next }
+    /^#define TFFT_FILE_TABLE\(/ {
+      print "#define TFFT_FILE_TABLE(TFFT_FILE) \\"
+      for(i = 0; i < files; i++)
+      {
+        printf "  TFFT_FILE(BENCH_FILE%d, %d, TFFT_FILE_TYPE_NORMAL, 1)%s\n", i, size, (i < files - 1) ? " \\" : ""
+      }
+      skip = 1
+      next
+    }
+    skip && !/\\$/ { skip = 0; next }
+    skip { next }
+    { print }
+  ' "$ROOT/tfft_user.h" > "$WORK/src/tfft_user.h" || exit 1
+
+  (cd "$WORK/src" && $CC $CFLAGS -I. -o bench_tfft bench_tfft.c tfft.c tfft_crc8.c tfft_crc16.c \
+    tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread) >&2 || exit 1
+
+  [ -n "$FIRST" ] || printf ',\n'
+  FIRST=
+  "$WORK/src/bench_tfft" "$OPS" || exit 1
+}
+
+FIRST=1
+printf '[\n'
+
+# Checksum and backup mode for a range of file sizes
+for crc in "0 0 0" "1 0 0" "0 1 0" "0 0 1"; do
+  for backup in 0 1; do
+    for size in 1 4 16 64 255; do
+      bench_config $crc $backup 4 $size
+    done
+  done
+done
+
+# Table size
+for files in 16 256 1024 4096; do
+  bench_config 0 1 0 0 $files 16
+done
+
+printf ']\n'
@@ -53,11 +53,17 @@ int main()
 
   char szRead[FILE2_SIZE_STR10 + 1];
 
+  TFFT_EEPROM_SIMU_COUNTERS counters;
+
   printf("EEPROM Super Simple File System!\n");
 
   printf("Max address: %lu [ < 256 = u8, < 65536 = u16 else u32 ]\n", (unsigned long)TFFT_GetMaxAddress());
   printf("File table size: %u\n", (unsigned int)TFFT_GetFileTableSize());
 
+  // Verify all files and find the newest slot of the ring files with one
+  // sequential read (optional, otherwise done at first access of each file)
+  MAIN_ChkRetVal(TFFT_Mount(0));
+
   // ### WRITE ###
   printf("\n## Write u8: 1\n");
   MAIN_ChkRetVal(TFFT_WriteU8(FILE0_NAME_EEPROM_FILE_VERSION_U8, (uint8_t)1));
@@ -74,6 +80,11 @@ int main()
   printf("\n## Write s32: -34567890\n");
   MAIN_ChkRetVal(TFFT_WriteS32(45, (int32_t)-34567890));
 
+  // Ring file, each write goes to the next of its slots
+  printf("\n## Increment boot count\n");
+  MAIN_ChkRetVal(TFFT_ReadU32(FILE4_NAME_BOOT_COUNT_U32, &u32TestRead));
+  MAIN_ChkRetVal(TFFT_WriteU32(FILE4_NAME_BOOT_COUNT_U32, u32TestRead + 1));
+
   // ### READ BACK ###
   printf("\n$$ Read u8\n");
   MAIN_ChkRetVal(TFFT_ReadU8(FILE0_NAME_EEPROM_FILE_VERSION_U8, &u8TestRead));
@@ -94,5 +105,11 @@ int main()
 
   TFFT_EepromPrintMemory(0, 255);
 
+  TFFT_EepromGetCounters(&counters);
+  printf("\n\nLow level calls: byte reads %lu, byte writes %lu, block reads %lu (%lu bytes), page writes %lu (%lu bytes)\n",
+         (unsigned long)counters.byteReads, (unsigned long)counters.byteWrites,
+         (unsigned long)counters.blockReads, (unsigned long)counters.bytesRead,
+         (unsigned long)counters.pageWrites, (unsigned long)counters.bytesWritten);
+
   return 0;
 }
@@ -0,0 +1,122 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_array.c
+ * @brief Array files: elements are read and written one range at a time.
+ *
+ * An array file of eight elements of an instance on a RAM EEPROM is written
+ * as a whole and then element by element. Writing one element must not
+ * touch the others, each element has its own checksum, and ranges outside
+ * the array and whole file calls are rejected.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_array.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c
+ *     tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_array
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_CHECKSUM_ENABLED || TFFT_BACKUP_MODE_ENABLED || TFFT_CACHE_ENABLED
+#error "Build with a checksum, without backup mode and cache"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_ELEMENTS 8
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_ARRAY, sizeof(uint32_t), TFFT_FILE_TYPE_ARRAY,  TEST_ELEMENTS) \
+  TFFT_FILE(TEST_FILE_AFTER, sizeof(uint32_t), TFFT_FILE_TYPE_NORMAL, 1)
+
+/* EEPROM address of an element */
+#define TEST_ELEMENT_ADDRESS(index) ((index) * (sizeof(uint32_t) + TFFT_CHECKSUM_SIZE))
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testArray
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  uint32_t au32_data[TEST_ELEMENTS];
+  uint32_t au32_read[TEST_ELEMENTS];
+  uint8_t au8_before[sizeof(sa_testEeprom)];
+  uint32_t after = 0x12345678;
+  uint32_t value;
+  TFFT_VERIFY_RESULT result;
+  uint32_t writes;
+  int i;
+
+  TEST_ERASE();
+  for(i = 0; i < TEST_ELEMENTS; i++)
+  {
+    au32_data[i] = 1000u * i + 7;
+  }
+
+  TEST_Check(TFFT_InstWriteRange(&g_testArray, TEST_FILE_ARRAY, 0, TEST_ELEMENTS, au32_data) == TFFT_RW_OK,
+             "write all elements");
+  TEST_Check(TFFT_InstReadWriteFile(&g_testArray, TEST_FILE_AFTER, sizeof(after), (uint8_t*)&after, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write the file after the array");
+  TEST_Check(TFFT_InstReadRange(&g_testArray, TEST_FILE_ARRAY, 2, 3, au32_read) == TFFT_RW_OK &&
+             memcmp(au32_read, &au32_data[2], 3 * sizeof(uint32_t)) == 0, "read elements 2 to 4");
+
+  // One element is written, the bytes of the others stay as they are
+  memcpy(au8_before, sa_testEeprom, sizeof(au8_before));
+  writes = s_testWrites;
+  value = 55555;
+  TEST_Check(TFFT_InstWriteElement(&g_testArray, TEST_FILE_ARRAY, 5, &value) == TFFT_RW_OK, "write element 5");
+  TEST_Check(s_testWrites - writes == 1, "element 5 is written with one page write");
+  TEST_Check(memcmp(au8_before, sa_testEeprom, TEST_ELEMENT_ADDRESS(5)) == 0 &&
+             memcmp(&au8_before[TEST_ELEMENT_ADDRESS(6)], &sa_testEeprom[TEST_ELEMENT_ADDRESS(6)],
+                    sizeof(au8_before) - TEST_ELEMENT_ADDRESS(6)) == 0, "other elements are not written");
+  au32_data[5] = value;
+  TEST_Check(TFFT_InstReadRange(&g_testArray, TEST_FILE_ARRAY, 0, TEST_ELEMENTS, au32_read) == TFFT_RW_OK &&
+             memcmp(au32_read, au32_data, sizeof(au32_data)) == 0, "read all elements");
+
+  TEST_Check(TFFT_InstReadRange(&g_testArray, TEST_FILE_ARRAY, 6, 3, au32_read) == TFFT_RW_ERR_ELEMENT,
+             "range past the last element is rejected");
+  TEST_Check(TFFT_InstReadWriteFile(&g_testArray, TEST_FILE_ARRAY, sizeof(au32_read), (uint8_t*)au32_read,
+                                    TFFT_RW_READ, 0) == TFFT_RW_ERR_FILE_TYPE, "whole file read is rejected");
+
+  // Each element has its own checksum
+  TEST_CORRUPT(TEST_ELEMENT_ADDRESS(3));
+  TEST_Check(TFFT_InstReadElement(&g_testArray, TEST_FILE_ARRAY, 3, &value) == TFFT_RW_ERR_CHECKSUM,
+             "corrupt element 3 fails with a checksum error");
+  TEST_Check(TFFT_InstReadElement(&g_testArray, TEST_FILE_ARRAY, 4, &value) == TFFT_RW_OK && value == au32_data[4],
+             "element 4 is still read");
+  TEST_Check(TFFT_InstMount(&g_testArray, &result) == TFFT_RW_ERR_CHECKSUM &&
+             !TFFT_FILE_BIT(result.valid, TEST_FILE_ARRAY) && TFFT_FILE_BIT(result.valid, TEST_FILE_AFTER),
+             "mount finds the array invalid");
+
+  value = 3333;
+  TEST_Check(TFFT_InstWriteElement(&g_testArray, TEST_FILE_ARRAY, 3, &value) == TFFT_RW_OK &&
+             TFFT_InstMount(&g_testArray, &result) == TFFT_RW_OK, "array is valid after element 3 is written");
+
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_async.c
+ * @brief Asynchronous writes: queue, replace, priority and completion.
+ *
+ * Writes are queued on an instance on a RAM EEPROM with a queue of two
+ * entries. A queued write of the same file is replaced, which calls the
+ * callback of the replaced write. TFFT_InstPoll() then writes the higher
+ * priority file first, one page per call, and calls the callbacks.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_ASYNC_QUEUE_SIZE=2 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_async.c tfft.c tfft_crc8.c tfft_crc16.c
+ *     tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_async
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if TFFT_ASYNC_QUEUE_SIZE != 2
+#error "Build with TFFT_ASYNC_QUEUE_SIZE 2"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_A 4
+#define TEST_SIZE_B 40
+#define TEST_SIZE_C 4
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A, TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B, TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_C, TEST_SIZE_C, TFFT_FILE_TYPE_NORMAL, 1)
+
+#define TEST_FILE_SIZE(fname) (TFFT_SIZE_TYPE)(((fname) == TEST_FILE_B) ? TEST_SIZE_B : TEST_SIZE_A)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testAsync
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/* Callbacks in the order they were called */
+#define TEST_MAX_DONE 8
+static TFFT_FILE_NAME_TYPE sa_doneFname[TEST_MAX_DONE];
+static int sa_doneResult[TEST_MAX_DONE];
+static int s_doneCount;
+
+/*----------------------------------------------------------------------------*/
+static void TEST_Done(TFFT_FILE_NAME_TYPE fname, int result)
+{
+  if(s_doneCount < TEST_MAX_DONE)
+  {
+    sa_doneFname[s_doneCount] = fname;
+    sa_doneResult[s_doneCount] = result;
+  }
+  s_doneCount++;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Queue(TFFT_FILE_NAME_TYPE fname, uint8_t fill, uint8_t priority)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+
+  memset(au8_data, fill, sizeof(au8_data));
+  return TFFT_InstWriteAsync(&g_testAsync, fname, TEST_FILE_SIZE(fname), au8_data, priority, TEST_Done);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that fname holds fill in every byte */
+static int TEST_Holds(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+  TFFT_SIZE_TYPE size = TEST_FILE_SIZE(fname);
+  TFFT_SIZE_TYPE i;
+
+  if(TFFT_InstReadWriteFile(&g_testAsync, fname, size, au8_data, TFFT_RW_READ, 0) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+  for(i = 0; i < size && au8_data[i] == fill; i++)
+  {
+  }
+
+  return i == size;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  uint8_t au8_data[TEST_SIZE_A];
+  uint32_t writes;
+  int polls = 0;
+  int rtnCode;
+
+  TEST_ERASE();
+  (void)TFFT_InstMount(&g_testAsync, 0); // Blank, no valid file
+
+  writes = s_testWrites;
+  TEST_Check(TEST_Queue(TEST_FILE_A, 0x11, 0) == TFFT_RW_OK, "queue A");
+  TEST_Check(TFFT_InstGetAsyncStatus(&g_testAsync, TEST_FILE_A) == TFFT_RW_PENDING, "A is pending");
+  TEST_Check(s_testWrites == writes, "queued A is not written yet");
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x11), "read of A returns the queued data");
+
+  memset(au8_data, 0x19, sizeof(au8_data));
+  TEST_Check(TFFT_InstReadWriteFile(&g_testAsync, TEST_FILE_A, TEST_SIZE_A, au8_data, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_ERR_EEPROM_BUSY, "write of A while queued is rejected");
+
+  TEST_Check(TEST_Queue(TEST_FILE_A, 0x12, 0) == TFFT_RW_OK, "queue A again");
+  TEST_Check(s_doneCount == 1 && sa_doneFname[0] == TEST_FILE_A && sa_doneResult[0] == TFFT_RW_OK,
+             "replaced write of A calls its callback");
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x12), "read of A returns the new data");
+
+  TEST_Check(TEST_Queue(TEST_FILE_B, 0x21, 1) == TFFT_RW_OK, "queue B with higher priority");
+  TEST_Check(TEST_Queue(TEST_FILE_C, 0x31, 0) == TFFT_RW_ERR_QUEUE_FULL, "queue C when the queue is full");
+
+  do
+  {
+    rtnCode = TFFT_InstPoll(&g_testAsync);
+    polls++;
+  } while(rtnCode == TFFT_RW_PENDING && polls < 100);
+
+  TEST_Check(rtnCode == TFFT_RW_OK, "poll until the queue is empty");
+  TEST_Check(polls > 3, "writes are done one page per poll");
+  TEST_Check(s_doneCount == 3 && sa_doneFname[1] == TEST_FILE_B && sa_doneFname[2] == TEST_FILE_A,
+             "B is written before A");
+  TEST_Check(sa_doneResult[1] == TFFT_RW_OK && sa_doneResult[2] == TFFT_RW_OK, "callbacks get TFFT_RW_OK");
+  TEST_Check(TFFT_InstGetAsyncStatus(&g_testAsync, TEST_FILE_A) == TFFT_RW_OK &&
+             TFFT_InstGetAsyncStatus(&g_testAsync, TEST_FILE_B) == TFFT_RW_OK, "A and B are done");
+
+  TEST_Check(TFFT_InstMount(&g_testAsync, 0) == TFFT_RW_ERR_CHECKSUM, "mount, C was never written");
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x12) && TEST_Holds(TEST_FILE_B, 0x21), "A and B are read after the mount");
+
+  return s_failures ? 1 : 0;
+}
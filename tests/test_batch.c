@@ -0,0 +1,136 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_batch.c
+ * @brief Batches: adjacent files are merged into one sequential transfer.
+ *
+ * Three small adjacent files of an instance on a RAM EEPROM are written and
+ * read as one batch, which must take fewer low level calls than one call
+ * per file. Items that are too large, have a bad file name or a bad
+ * checksum must get the same result as when transferred alone, without
+ * failing the other items.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_batch.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c
+ *     tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_batch
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if TFFT_CACHE_ENABLED || TFFT_ASYNC_QUEUE_SIZE > 0 || !TFFT_CHECKSUM_ENABLED || TFFT_BACKUP_MODE_ENABLED
+#error "Build with a checksum, without cache, asynchronous writes and backup mode"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_A 1
+#define TEST_SIZE_B 4
+#define TEST_SIZE_C 10
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A, TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B, TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_C, TEST_SIZE_C, TFFT_FILE_TYPE_NORMAL, 1)
+
+/* EEPROM address of file C */
+#define TEST_ADDRESS_C (TFFT_FILE_REAL_SIZE(TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) + \
+                        TFFT_FILE_REAL_SIZE(TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1))
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testBatch
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  uint8_t a = 0x11;
+  uint8_t au8_b[TEST_SIZE_B] = {0x21, 0x22, 0x23, 0x24};
+  uint8_t au8_c[TEST_SIZE_C] = {0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A};
+  uint8_t readA = 0;
+  uint8_t au8_readB[TEST_SIZE_B] = {0};
+  uint8_t au8_readC[2 * TEST_SIZE_C] = {0};
+  uint8_t au8_large[2 * TEST_SIZE_C] = {0};
+  uint32_t calls;
+  int single;
+  TFFT_BATCH_ITEM writeItems[] =
+  {
+    {TEST_FILE_C, TEST_SIZE_C, au8_c, 1},
+    {TEST_FILE_A, TEST_SIZE_A, &a, 1},
+    {TEST_FILE_B, TEST_SIZE_B, au8_b, 1}
+  };
+  TFFT_BATCH_ITEM readItems[] =
+  {
+    {TEST_FILE_B, TEST_SIZE_B, au8_readB, 1},
+    {TEST_FILE_C, TEST_SIZE_C, au8_readC, 1},
+    {TEST_FILE_A, TEST_SIZE_A, &readA, 1}
+  };
+  TFFT_BATCH_ITEM errorItems[] =
+  {
+    {TEST_FILE_A, TEST_SIZE_A, &a, 1},
+    {TEST_FILE_C, sizeof(au8_large), au8_large, 1},
+    {TEST_FILE_COUNT, TEST_SIZE_A, &a, 1}
+  };
+
+  TEST_ERASE();
+
+  calls = s_testWrites;
+  TEST_Check(TFFT_InstWriteBatch(&g_testBatch, writeItems, 3) == TFFT_RW_OK &&
+             writeItems[0].result == TFFT_RW_OK && writeItems[1].result == TFFT_RW_OK &&
+             writeItems[2].result == TFFT_RW_OK, "write batch of A, B and C");
+  TEST_Check(s_testWrites - calls == 2, "A, B and C are written with two page writes");
+
+  calls = s_testReads;
+  TEST_Check(TFFT_InstReadBatch(&g_testBatch, readItems, 3) == TFFT_RW_OK &&
+             readItems[0].result == TFFT_RW_OK && readItems[1].result == TFFT_RW_OK &&
+             readItems[2].result == TFFT_RW_OK, "read batch of A, B and C");
+  TEST_Check(s_testReads - calls == 2, "A, B and C are read with two block reads");
+  TEST_Check(readA == a && memcmp(au8_readB, au8_b, TEST_SIZE_B) == 0 && memcmp(au8_readC, au8_c, TEST_SIZE_C) == 0,
+             "read batch returns the written data");
+
+  // Too large items get the same result as alone
+  single = TFFT_InstReadWriteFile(&g_testBatch, TEST_FILE_C, sizeof(au8_large), au8_large, TFFT_RW_WRITE, 0);
+  TEST_Check(TFFT_InstWriteBatch(&g_testBatch, errorItems, 3) == TFFT_RW_ERR_FILE_TOO_LARGE &&
+             errorItems[1].result == single, "too large write item fails as alone");
+  TEST_Check(errorItems[0].result == TFFT_RW_OK && errorItems[2].result == TFFT_RW_ERR_FILE_NAME,
+             "other items of the write batch");
+
+  single = TFFT_InstReadWriteFile(&g_testBatch, TEST_FILE_C, sizeof(au8_large), au8_large, TFFT_RW_READ, 0);
+  memset(au8_readC, 0, sizeof(au8_readC));
+  readItems[1].size = sizeof(au8_readC);
+  TEST_Check(TFFT_InstReadBatch(&g_testBatch, readItems, 3) == TFFT_RW_OK && readItems[1].result == single &&
+             memcmp(au8_readC, au8_large, sizeof(au8_readC)) == 0, "too large read item reads as alone");
+
+  // A bad checksum only fails its own item
+  TEST_CORRUPT(TEST_ADDRESS_C);
+  TEST_Check(TFFT_InstReadBatch(&g_testBatch, readItems, 3) == TFFT_RW_ERR_CHECKSUM &&
+             readItems[1].result == TFFT_RW_ERR_CHECKSUM, "corrupt C fails with a checksum error");
+  TEST_Check(readItems[0].result == TFFT_RW_OK && readItems[2].result == TFFT_RW_OK, "A and B are still read");
+
+  return s_failures ? 1 : 0;
+}
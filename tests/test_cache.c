@@ -0,0 +1,156 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_cache.c
+ * @brief RAM cache: writes stay in RAM until flushed, reads do not touch
+ * the device.
+ *
+ * Two files are written to the cache of an instance on a RAM EEPROM and
+ * flushed one by one and together. A second instance on the same EEPROM
+ * mounts and must read what was flushed.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_CACHE_ENABLED=1 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_cache.c tfft.c tfft_crc8.c tfft_crc16.c
+ *     tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_cache
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_CACHE_ENABLED
+#error "Build with TFFT_CACHE_ENABLED 1"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_A 4
+#define TEST_SIZE_B 10
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A, TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B, TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1)
+
+#define TEST_FILE_SIZE(fname) (TFFT_SIZE_TYPE)(((fname) == TEST_FILE_A) ? TEST_SIZE_A : TEST_SIZE_B)
+
+/* EEPROM address of the first copy of the files */
+#define TEST_ADDRESS_A 0
+#define TEST_ADDRESS_B TFFT_FILE_REAL_SIZE(TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testCache
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/* Same files, mounted after the flush */
+#define TFFT_INSTANCE_NAME              g_testMounted
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Write(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+
+  memset(au8_data, fill, sizeof(au8_data));
+  return TFFT_InstReadWriteFile(&g_testCache, fname, TEST_FILE_SIZE(fname), au8_data, TFFT_RW_WRITE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that fname of an instance holds fill in every byte */
+static int TEST_Holds(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+  TFFT_SIZE_TYPE size = TEST_FILE_SIZE(fname);
+  TFFT_SIZE_TYPE i;
+
+  if(TFFT_InstReadWriteFile(pInst, fname, size, au8_data, TFFT_RW_READ, 0) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+  for(i = 0; i < size && au8_data[i] == fill; i++)
+  {
+  }
+
+  return i == size;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that the first copy of a file in the EEPROM holds fill */
+static int TEST_Stored(TFFT_ADDR_TYPE address, TFFT_SIZE_TYPE size, uint8_t fill)
+{
+  TFFT_SIZE_TYPE i;
+
+  for(i = 0; i < size && sa_testEeprom[address + i] == fill; i++)
+  {
+  }
+
+  return i == size;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  uint32_t writes;
+  uint32_t reads;
+
+  TEST_ERASE();
+  TEST_Check(TFFT_InstMount(&g_testCache, 0) == TFFT_RW_ERR_CHECKSUM, "mount of a blank EEPROM finds no valid file");
+
+  writes = s_testWrites;
+  TEST_Check(TEST_Write(TEST_FILE_A, 0x11) == TFFT_RW_OK, "write A");
+  TEST_Check(s_testWrites == writes && !TEST_Stored(TEST_ADDRESS_A, TEST_SIZE_A, 0x11), "A is only written to the cache");
+
+  reads = s_testReads;
+  TEST_Check(TEST_Holds(&g_testCache, TEST_FILE_A, 0x11), "read A");
+  TEST_Check(s_testReads == reads, "A is read from the cache");
+
+  TEST_Check(TFFT_InstFlushFile(&g_testCache, TEST_FILE_A) == TFFT_RW_OK, "flush A");
+  TEST_Check(TEST_Stored(TEST_ADDRESS_A, TEST_SIZE_A, 0x11), "A is stored after the flush");
+
+  TEST_Check(TEST_Write(TEST_FILE_B, 0x22) == TFFT_RW_OK && TEST_Write(TEST_FILE_A, 0x12) == TFFT_RW_OK,
+             "write B and A");
+  TEST_Check(TFFT_InstFlush(&g_testCache) == TFFT_RW_OK, "flush all");
+  TEST_Check(TEST_Stored(TEST_ADDRESS_A, TEST_SIZE_A, 0x12) && TEST_Stored(TEST_ADDRESS_B, TEST_SIZE_B, 0x22),
+             "A and B are stored after the flush");
+
+  writes = s_testWrites;
+  TEST_Check(TFFT_InstFlush(&g_testCache) == TFFT_RW_OK && s_testWrites == writes, "flush without changes writes nothing");
+
+  // A bad byte in the EEPROM is not seen while the file is cached
+  TEST_CORRUPT(TEST_ADDRESS_B);
+  TEST_Check(TEST_Holds(&g_testCache, TEST_FILE_B, 0x22), "cached B is kept when the EEPROM changes");
+  TEST_CORRUPT(TEST_ADDRESS_B);
+
+  TEST_Check(TFFT_InstMount(&g_testMounted, 0) == TFFT_RW_OK, "mount");
+  TEST_Check(TEST_Holds(&g_testMounted, TEST_FILE_A, 0x12) && TEST_Holds(&g_testMounted, TEST_FILE_B, 0x22),
+             "A and B are read after the mount");
+
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_eeprom.h
+ * @brief RAM EEPROM and check helpers of the tests.
+ *
+ * Included once by each test. The test instances use s_testDriver, so the
+ * tests do not depend on the file table in tfft_user.h. The EEPROM starts
+ * erased (0xFF) after TEST_ERASE(). Low level calls are counted, so tests
+ * can check if the device was accessed, and s_testWriteLimit makes writes
+ * fail from a given write on, as a power loss.
+ *
+ * @author Lars Jelleryd
+ */
+
+#ifndef TEST_EEPROM_H_
+#define TEST_EEPROM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tfft.h"
+
+#ifndef TEST_EEPROM_SIZE
+#define TEST_EEPROM_SIZE 1024
+#endif
+
+static uint8_t sa_testEeprom[TEST_EEPROM_SIZE];
+static uint32_t s_testReads;  // Low level read calls
+static uint32_t s_testWrites; // Low level write calls
+static uint32_t s_testWriteLimit; // Writes fail when s_testWrites has reached it, 0 for no limit
+static int s_failures;
+
+/* Set all bytes to the erased state */
+#define TEST_ERASE() memset(sa_testEeprom, 0xFF, sizeof(sa_testEeprom))
+
+/* Flip one bit of a stored byte, as a worn out cell */
+#define TEST_CORRUPT(address) (sa_testEeprom[address] ^= 0x40)
+
+/*----------------------------------------------------------------------------*/
+static int TEST_WriteByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t byte)
+{
+  (void)pDevice;
+  if(s_testWriteLimit && s_testWrites >= s_testWriteLimit)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_WRITE;
+  }
+  s_testWrites++;
+  sa_testEeprom[address] = byte;
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_ReadByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pByte)
+{
+  (void)pDevice;
+  s_testReads++;
+  *pByte = sa_testEeprom[address];
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_ReadBlock(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  s_testReads++;
+  memcpy(pData, &sa_testEeprom[address], len);
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_WritePage(void *pDevice, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  if(s_testWriteLimit && s_testWrites >= s_testWriteLimit)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_WRITE;
+  }
+  s_testWrites++;
+  memcpy(&sa_testEeprom[address], pData, len);
+  return TFFT_RW_OK;
+}
+
+static const TFFT_DRIVER s_testDriver = {TEST_WriteByte, TEST_ReadByte, TEST_ReadBlock, TEST_WritePage, 0, 0, 0, 0, 0};
+
+/*----------------------------------------------------------------------------*/
+static void TEST_Check(int f_ok, const char *pWhat)
+{
+  printf("%s: %s\n", f_ok ? "PASS" : "FAIL", pWhat);
+  s_failures += !f_ok;
+}
+
+#endif /* TEST_EEPROM_H_ */
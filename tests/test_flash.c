@@ -0,0 +1,209 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_flash.c
+ * @brief Garbage collection of a flash instance when the write after it fails.
+ *
+ * A flash instance with two files is put on a RAM flash model. A write of
+ * file B that does not fit in the active sector starts a new sector. Every
+ * program after the new sector has been marked complete fails, so the new
+ * record of B is never written (as if power was lost). The previous contents
+ * of both files must then still be read, also after a new mount.
+ * Prints one line per check and returns 1 if any check failed.
+ * Needs TFFT_FLASH_ENABLED, which is set on the command line.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_FLASH_ENABLED=1 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_flash.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_flash
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tfft.h"
+
+#if !TFFT_FLASH_ENABLED
+#error "Build with TFFT_FLASH_ENABLED 1"
+#endif
+
+#include "tfft_instance.h"
+
+/* Flash model: two sectors, programming can only clear bits */
+#define TEST_SECTOR_SIZE 128
+#define TEST_FLASH_SIZE  (2 * TEST_SECTOR_SIZE)
+
+/* Program of a sector state byte */
+#define TEST_IS_COMPLETE(address, data) \
+  ((address) % TEST_SECTOR_SIZE == TFFT_FLASH_SECTOR_HEADER_SIZE - 1 && (data) == TFFT_FLASH_SECTOR_COMPLETE)
+
+static uint8_t s_flash[TEST_FLASH_SIZE];
+static uint8_t f_failAfterComplete; // Armed by the test
+static uint8_t f_failing;           // All programs fail
+static int s_failures;
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Program(TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  TFFT_ADDR_TYPE i;
+
+  if(f_failing)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_WRITE;
+  }
+
+  for(i = 0; i < len; i++)
+  {
+    s_flash[address + i] &= pData[i];
+  }
+
+  if(f_failAfterComplete && len == 1 && TEST_IS_COMPLETE(address, pData[0]))
+  {
+    f_failing = 1;
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_WriteByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t byte)
+{
+  (void)pDevice;
+  return TEST_Program(address, &byte, 1);
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_ReadByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pByte)
+{
+  (void)pDevice;
+  *pByte = s_flash[address];
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_ReadBlock(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  memcpy(pData, &s_flash[address], len);
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_WritePage(void *pDevice, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  return TEST_Program(address, pData, len);
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_EraseSector(void *pDevice, TFFT_ADDR_TYPE address)
+{
+  (void)pDevice;
+  memset(&s_flash[address], TFFT_FLASH_ERASED, TEST_SECTOR_SIZE);
+  return TFFT_RW_OK;
+}
+
+static const TFFT_DRIVER s_testDriver = {TEST_WriteByte, TEST_ReadByte, TEST_ReadBlock, TEST_WritePage, 0, 0, 0, TEST_EraseSector, 0};
+
+#define TEST_SIZE_A 4
+#define TEST_SIZE_B 40
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A, TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B, TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1)
+
+#define TEST_FILE_SIZE(fname) (TFFT_SIZE_TYPE)(((fname) == TEST_FILE_A) ? TEST_SIZE_A : TEST_SIZE_B)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testFlash
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_FLASH_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         8
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_FLASH_SECTOR_SIZE TEST_SECTOR_SIZE
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+static void TEST_Check(int f_ok, const char *pWhat)
+{
+  printf("%s: %s\n", f_ok ? "PASS" : "FAIL", pWhat);
+  s_failures += !f_ok;
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Write(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+
+  memset(au8_data, fill, sizeof(au8_data));
+  return TFFT_InstReadWriteFile(&g_testFlash, fname, TEST_FILE_SIZE(fname), au8_data, TFFT_RW_WRITE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that fname holds fill in every byte */
+static int TEST_Holds(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_B];
+  TFFT_SIZE_TYPE size = TEST_FILE_SIZE(fname);
+  TFFT_SIZE_TYPE i;
+
+  if(TFFT_InstReadWriteFile(&g_testFlash, fname, size, au8_data, TFFT_RW_READ, 0) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+  for(i = 0; i < size && au8_data[i] == fill; i++)
+  {
+  }
+
+  return i == size;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  memset(s_flash, TFFT_FLASH_ERASED, sizeof(s_flash));
+
+  // Sector 0: A, B(1), B(2). B(3) does not fit and starts sector 1.
+  TEST_Check(TEST_Write(TEST_FILE_A, 0x11) == TFFT_RW_OK, "write A");
+  TEST_Check(TEST_Write(TEST_FILE_B, 0x21) == TFFT_RW_OK, "write B");
+  TEST_Check(TEST_Write(TEST_FILE_B, 0x22) == TFFT_RW_OK, "write B again");
+
+  f_failAfterComplete = 1;
+  TEST_Check(TEST_Write(TEST_FILE_B, 0x23) == TFFT_RW_ERR_LOW_LEVEL_WRITE, "write B after collection fails");
+  TEST_Check(s_flash[TEST_SECTOR_SIZE + TFFT_FLASH_SECTOR_HEADER_SIZE - 1] == TFFT_FLASH_SECTOR_COMPLETE,
+             "new sector is complete");
+  TEST_Check(TEST_Holds(TEST_FILE_B, 0x22), "B keeps previous contents");
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x11), "A keeps its contents");
+
+  // As after a power loss before the record was programmed
+  f_failing = 0;
+  f_failAfterComplete = 0;
+  TEST_Check(TFFT_InstMount(&g_testFlash, 0) == TFFT_RW_OK, "mount");
+  TEST_Check(TEST_Holds(TEST_FILE_B, 0x22), "B keeps previous contents after mount");
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x11), "A keeps its contents after mount");
+
+  TEST_Check(TEST_Write(TEST_FILE_B, 0x24) == TFFT_RW_OK && TEST_Holds(TEST_FILE_B, 0x24), "write B after mount");
+
+  return s_failures ? 1 : 0;
+}
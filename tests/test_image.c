@@ -0,0 +1,152 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_image.c
+ * @brief Images: all files of an instance exported and imported as stored.
+ *
+ * The image of an instance on one half of a RAM EEPROM is exported and
+ * imported into an instance with the same files on the other half, in one
+ * part and in several parts, which must then read the same files. Files
+ * never written (erased) are accepted, while an image with a corrupt byte
+ * in a file is rejected with a checksum error.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_image.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c
+ *     tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_image
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_CHECKSUM_ENABLED || TFFT_CACHE_ENABLED || TFFT_LAYOUT_ENABLED
+#error "Build with a checksum, without cache and layout header"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_A 8
+#define TEST_SIZE_B 4
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A,    TEST_SIZE_A,      TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B,    TEST_SIZE_B,      TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_RING, sizeof(uint32_t), TFFT_FILE_TYPE_RING,   3)
+
+#define TEST_IMAGE_SIZE (TFFT_FILE_REAL_SIZE(TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) + \
+                         TFFT_FILE_REAL_SIZE(TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1) + \
+                         TFFT_FILE_REAL_SIZE(sizeof(uint32_t), TFFT_FILE_TYPE_RING, 3))
+
+/* Start of the instance the image is imported into */
+#define TEST_TARGET_ADDRESS (TEST_EEPROM_SIZE / 2)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testSource
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_TARGET_ADDRESS - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+#define TFFT_INSTANCE_NAME              g_testTarget
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     TEST_TARGET_ADDRESS
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+/* Erase the half of the EEPROM of the target instance */
+static void TEST_EraseTarget(void)
+{
+  memset(&sa_testEeprom[TEST_TARGET_ADDRESS], 0xFF, TEST_EEPROM_SIZE - TEST_TARGET_ADDRESS);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that the target instance holds the files written to the source */
+static int TEST_TargetHolds(void)
+{
+  uint8_t au8_dataA[TEST_SIZE_A];
+  uint8_t au8_dataB[TEST_SIZE_B];
+  uint32_t value = 0;
+
+  return TFFT_InstMount(&g_testTarget, 0) == TFFT_RW_ERR_CHECKSUM &&
+         TFFT_InstReadWriteFile(&g_testTarget, TEST_FILE_A, TEST_SIZE_A, au8_dataA, TFFT_RW_READ, 0) == TFFT_RW_OK &&
+         memcmp(au8_dataA, "imported", TEST_SIZE_A) == 0 &&
+         TFFT_InstReadWriteFile(&g_testTarget, TEST_FILE_B, TEST_SIZE_B, au8_dataB, TFFT_RW_READ, 0) ==
+         TFFT_RW_ERR_CHECKSUM &&
+         TFFT_InstReadWriteFile(&g_testTarget, TEST_FILE_RING, sizeof(value), (uint8_t*)&value, TFFT_RW_READ, 0) ==
+         TFFT_RW_OK && value == 4;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  uint8_t au8_image[TEST_IMAGE_SIZE];
+  uint8_t au8_data[TEST_SIZE_A];
+  uint32_t value;
+  uint32_t offset;
+  uint32_t len;
+  int rtnCode = TFFT_RW_OK;
+
+  TEST_ERASE();
+  memcpy(au8_data, "imported", TEST_SIZE_A);
+  TEST_Check(TFFT_InstReadWriteFile(&g_testSource, TEST_FILE_A, TEST_SIZE_A, au8_data, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write A, B is never written");
+  for(value = 1; value <= 4 && rtnCode == TFFT_RW_OK; value++)
+  {
+    rtnCode = TFFT_InstReadWriteFile(&g_testSource, TEST_FILE_RING, sizeof(value), (uint8_t*)&value, TFFT_RW_WRITE, 0);
+  }
+  TEST_Check(rtnCode == TFFT_RW_OK, "write the ring file past its last slot");
+
+  TEST_Check(TFFT_InstGetImageSize(&g_testSource) == TEST_IMAGE_SIZE, "image size is the size of the files");
+  TEST_Check(TFFT_InstExportImage(&g_testSource, 0, au8_image, sizeof(au8_image)) == TFFT_RW_OK &&
+             memcmp(au8_image, sa_testEeprom, sizeof(au8_image)) == 0, "export the image");
+  TEST_Check(TFFT_InstExportImage(&g_testSource, 1, au8_image, sizeof(au8_image)) == TFFT_RW_ERR_ADDRESS,
+             "export past the end of the image is rejected");
+
+  TEST_Check(TFFT_InstImportImage(&g_testTarget, 0, au8_image, sizeof(au8_image)) == TFFT_RW_OK,
+             "import the image in one part");
+  TEST_Check(TEST_TargetHolds(), "target reads A and the ring file, B is erased");
+
+  // Parts of any length, in order
+  TEST_EraseTarget();
+  for(offset = 0; offset < sizeof(au8_image) && rtnCode == TFFT_RW_OK; offset += len)
+  {
+    len = (sizeof(au8_image) - offset < 5) ? sizeof(au8_image) - offset : 5;
+    rtnCode = TFFT_InstImportImage(&g_testTarget, offset, &au8_image[offset], len);
+  }
+  TEST_Check(rtnCode == TFFT_RW_OK && TEST_TargetHolds(), "import the image in parts of five bytes");
+
+  // A corrupt file is found when the part that ends the image is imported
+  TEST_EraseTarget();
+  au8_image[1] ^= 0x40;
+  TEST_Check(TFFT_InstImportImage(&g_testTarget, 0, au8_image, sizeof(au8_image)) == TFFT_RW_ERR_CHECKSUM,
+             "image with a corrupt file is rejected");
+  TEST_Check(TFFT_InstImportImage(&g_testTarget, 1, au8_image, sizeof(au8_image)) == TFFT_RW_ERR_ADDRESS,
+             "import past the end of the image is rejected");
+
+  return s_failures ? 1 : 0;
+}
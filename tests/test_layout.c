@@ -0,0 +1,161 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_layout.c
+ * @brief Layout header: files are moved to a changed file table, also
+ * after an interrupted migration.
+ *
+ * Files are written with an old file table to a RAM EEPROM, then mounted
+ * with a new table where the first file has grown and the ring file has
+ * more slots. The migration is interrupted by failing writes after each
+ * number of writes in turn, as a power loss, and the next mount must
+ * complete it with all data kept.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_LAYOUT_ENABLED=1 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_layout.c tfft.c tfft_crc8.c tfft_crc16.c
+ *     tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_layout
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_LAYOUT_ENABLED || TFFT_CACHE_ENABLED
+#error "Build with TFFT_LAYOUT_ENABLED 1, without cache"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_OLD_SIZE_A 8
+#define TEST_NEW_SIZE_A 12
+#define TEST_SIZE_C     10
+
+#define TEST_OLD_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_OLD_FILE_A, TEST_OLD_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_OLD_FILE_B, sizeof(uint32_t), TFFT_FILE_TYPE_RING, 2) \
+  TFFT_FILE(TEST_OLD_FILE_C, TEST_SIZE_C,      TFFT_FILE_TYPE_NORMAL, 1)
+
+#define TEST_NEW_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_NEW_FILE_A, TEST_NEW_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_NEW_FILE_B, sizeof(uint32_t), TFFT_FILE_TYPE_RING, 4) \
+  TFFT_FILE(TEST_NEW_FILE_C, TEST_SIZE_C,      TFFT_FILE_TYPE_NORMAL, 1)
+
+TFFT_FILE_NAMES(TEST_OLD_FILE_TABLE, TEST_OLD_FILE_COUNT)
+TFFT_FILE_NAMES(TEST_NEW_FILE_TABLE, TEST_NEW_FILE_COUNT)
+
+/* Files written before the firmware update */
+#define TFFT_INSTANCE_NAME              g_testOld
+#define TFFT_INSTANCE_FILES             TEST_OLD_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES  4
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/* Same EEPROM area and header size after the update */
+#define TFFT_INSTANCE_NAME              g_testNew
+#define TFFT_INSTANCE_FILES             TEST_NEW_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES  4
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+static const uint8_t sa_dataA[TEST_OLD_SIZE_A] = {1, 2, 3, 4, 5, 6, 7, 8};
+static const uint8_t sa_dataC[TEST_SIZE_C] = {'c', 'o', 'n', 'f', 'i', 'g', 0, 0, 9, 9};
+#define TEST_VALUE_B 0xB0B0u
+
+/*----------------------------------------------------------------------------*/
+/* Check that the files of the new table hold the data written with the
+   old one, the grown file padded with zeros */
+static int TEST_NewHolds(void)
+{
+  uint8_t au8_dataA[TEST_NEW_SIZE_A];
+  uint8_t au8_zeros[TEST_NEW_SIZE_A - TEST_OLD_SIZE_A] = {0};
+  uint8_t au8_dataC[TEST_SIZE_C];
+  uint32_t valueB = 0;
+
+  return TFFT_InstReadWriteFile(&g_testNew, TEST_NEW_FILE_A, sizeof(au8_dataA), au8_dataA, TFFT_RW_READ, 0) ==
+         TFFT_RW_OK && memcmp(au8_dataA, sa_dataA, TEST_OLD_SIZE_A) == 0 &&
+         memcmp(&au8_dataA[TEST_OLD_SIZE_A], au8_zeros, sizeof(au8_zeros)) == 0 &&
+         TFFT_InstReadWriteFile(&g_testNew, TEST_NEW_FILE_B, sizeof(valueB), (uint8_t*)&valueB, TFFT_RW_READ, 0) ==
+         TFFT_RW_OK && valueB == TEST_VALUE_B &&
+         TFFT_InstReadWriteFile(&g_testNew, TEST_NEW_FILE_C, sizeof(au8_dataC), au8_dataC, TFFT_RW_READ, 0) ==
+         TFFT_RW_OK && memcmp(au8_dataC, sa_dataC, TEST_SIZE_C) == 0;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  static uint8_t au8_stored[TEST_EEPROM_SIZE];
+  uint8_t au8_data[TEST_SIZE_C];
+  uint32_t valueB = TEST_VALUE_B;
+  uint32_t limit;
+  uint32_t writes;
+  int interrupted = 0;
+  int resumed = 0;
+  int rtnCode;
+
+  TEST_ERASE();
+  TEST_Check(TFFT_InstMount(&g_testOld, 0) == TFFT_RW_ERR_CHECKSUM, "first mount writes the layout header");
+  memcpy(au8_data, sa_dataA, TEST_OLD_SIZE_A);
+  TEST_Check(TFFT_InstReadWriteFile(&g_testOld, TEST_OLD_FILE_A, TEST_OLD_SIZE_A, au8_data, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write A with the old table");
+  TEST_Check(TFFT_InstReadWriteFile(&g_testOld, TEST_OLD_FILE_B, sizeof(valueB), (uint8_t*)&valueB, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write B with the old table");
+  memcpy(au8_data, sa_dataC, TEST_SIZE_C);
+  TEST_Check(TFFT_InstReadWriteFile(&g_testOld, TEST_OLD_FILE_C, TEST_SIZE_C, au8_data, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write C with the old table");
+  TEST_Check(TFFT_InstMount(&g_testOld, 0) == TFFT_RW_OK, "mount with the old table");
+  memcpy(au8_stored, sa_testEeprom, sizeof(au8_stored));
+
+  // Each run stops the migration one write later, until it is not stopped
+  for(limit = 1; limit < 1000; limit++)
+  {
+    memcpy(sa_testEeprom, au8_stored, sizeof(au8_stored));
+    s_testWrites = 0;
+    s_testWriteLimit = limit;
+    rtnCode = TFFT_InstMount(&g_testNew, 0);
+    s_testWriteLimit = 0;
+    if(rtnCode == TFFT_RW_OK)
+    {
+      break;
+    }
+
+    interrupted++;
+    if(rtnCode == TFFT_RW_ERR_LOW_LEVEL_WRITE && TFFT_InstMount(&g_testNew, 0) == TFFT_RW_OK && TEST_NewHolds())
+    {
+      resumed++;
+    }
+  }
+  TEST_Check(rtnCode == TFFT_RW_OK && TEST_NewHolds(), "migration without interruption keeps the data");
+  TEST_Check(interrupted > 3, "migration takes several writes");
+  TEST_Check(resumed == interrupted, "next mount completes an interrupted migration");
+
+  writes = s_testWrites;
+  TEST_Check(TFFT_InstMount(&g_testNew, 0) == TFFT_RW_OK && s_testWrites == writes,
+             "mount after the migration writes nothing");
+
+  return s_failures ? 1 : 0;
+}
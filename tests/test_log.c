@@ -0,0 +1,165 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_log.c
+ * @brief Ring and log files wrapping around their slots.
+ *
+ * A ring file and a log file of four slots each, of an instance on a RAM
+ * EEPROM, are written many more times than they have slots, also past the
+ * wrap of the 16 bit sequence number. The ring file must return the newest
+ * value (the previous one if the newest slot is corrupt) and the log file
+ * the newest records in order, also after a new mount.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_log.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c
+ *     tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_log
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_CHECKSUM_ENABLED || TFFT_CACHE_ENABLED
+#error "Build with a checksum and without cache"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SLOTS 4
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_RING, sizeof(uint32_t), TFFT_FILE_TYPE_RING, TEST_SLOTS) \
+  TFFT_FILE(TEST_FILE_LOG,  sizeof(uint32_t), TFFT_FILE_TYPE_LOG,  TEST_SLOTS)
+
+/* Slots of the ring file: sequence number, data and checksum */
+#define TEST_SLOT_SIZE (TFFT_RING_HEADER_SIZE + sizeof(uint32_t) + TFFT_CHECKSUM_SIZE)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testLog
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+static int TEST_RingWrite(uint32_t value)
+{
+  return TFFT_InstReadWriteFile(&g_testLog, TEST_FILE_RING, sizeof(value), (uint8_t*)&value, TFFT_RW_WRITE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+static int TEST_RingHolds(uint32_t value)
+{
+  uint32_t data = 0;
+
+  return TFFT_InstReadWriteFile(&g_testLog, TEST_FILE_RING, sizeof(data), (uint8_t*)&data, TFFT_RW_READ, 0) ==
+         TFFT_RW_OK && data == value;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that the log returns the records first, first + step, ... in turn
+   (count records), followed by TFFT_RW_LOG_END */
+static int TEST_LogHolds(uint8_t f_newestFirst, uint32_t first, int step, int count)
+{
+  TFFT_LOG_CURSOR cursor;
+  uint32_t data;
+  int i;
+
+  if(TFFT_InstLogOpen(&g_testLog, TEST_FILE_LOG, &cursor, f_newestFirst) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+  for(i = 0; i < count; i++)
+  {
+    if(TFFT_InstLogRead(&g_testLog, &cursor, &data) != TFFT_RW_OK || data != first + i * step)
+    {
+      return 0;
+    }
+  }
+
+  return TFFT_InstLogRead(&g_testLog, &cursor, &data) == TFFT_RW_LOG_END;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  TFFT_LOG_CURSOR cursor;
+  uint32_t value;
+  uint32_t data;
+  int slot;
+  int corrupted = 0;
+  int f_ok = 1;
+
+  TEST_ERASE();
+  TEST_Check(TEST_LogHolds(0, 0, 1, 0), "empty log has no records");
+
+  // Ring file, also past the wrap of the sequence number
+  for(value = 1; value <= 10 && f_ok; value++)
+  {
+    f_ok = (TEST_RingWrite(value) == TFFT_RW_OK);
+  }
+  TEST_Check(f_ok && TEST_RingHolds(10), "ring file returns the newest of 10 writes");
+  for(value = 11; value <= 0x10000 + 10 && f_ok; value++)
+  {
+    f_ok = (TEST_RingWrite(value) == TFFT_RW_OK);
+  }
+  TEST_Check(f_ok && TEST_RingHolds(0x10000 + 10), "ring file returns the newest after the sequence number wraps");
+  TEST_Check(TFFT_InstMount(&g_testLog, 0) == TFFT_RW_ERR_CHECKSUM && TEST_RingHolds(0x10000 + 10),
+             "ring file returns the newest after a mount");
+
+  // The older slots are the backup of the newest one
+  for(slot = 0; slot < TEST_SLOTS; slot++)
+  {
+    memcpy(&data, &sa_testEeprom[slot * TEST_SLOT_SIZE + TFFT_RING_HEADER_SIZE], sizeof(data));
+    if(data == 0x10000 + 10)
+    {
+      TEST_CORRUPT(slot * TEST_SLOT_SIZE + TFFT_RING_HEADER_SIZE);
+      corrupted++;
+    }
+  }
+  TEST_Check(corrupted == 1 && TFFT_InstMount(&g_testLog, 0) == TFFT_RW_ERR_CHECKSUM && TEST_RingHolds(0x10000 + 9),
+             "ring file returns the previous value when the newest slot is corrupt");
+  TEST_Check(TEST_RingWrite(100) == TFFT_RW_OK && TEST_RingHolds(100), "ring file is written after the corrupt slot");
+
+  // Log file
+  for(value = 1; value <= 6 && f_ok; value++)
+  {
+    f_ok = (TFFT_InstLogAppend(&g_testLog, TEST_FILE_LOG, &value) == TFFT_RW_OK);
+  }
+  TEST_Check(f_ok, "append 6 records to a log of 4 slots");
+  TEST_Check(TEST_LogHolds(0, 3, 1, TEST_SLOTS), "log returns records 3 to 6 oldest first");
+  TEST_Check(TEST_LogHolds(1, 6, -1, TEST_SLOTS), "log returns records 6 to 3 newest first");
+
+  TEST_Check(TFFT_InstLogOpen(&g_testLog, TEST_FILE_LOG, &cursor, 0) == TFFT_RW_OK, "open the log");
+  value = 7;
+  TEST_Check(TFFT_InstLogAppend(&g_testLog, TEST_FILE_LOG, &value) == TFFT_RW_OK, "append record 7");
+  TEST_Check(TFFT_InstLogRead(&g_testLog, &cursor, &data) == TFFT_RW_ERR_ELEMENT,
+             "record 3 was overwritten since the log was opened");
+  TEST_Check(TFFT_InstLogRead(&g_testLog, &cursor, &data) == TFFT_RW_OK && data == 4, "cursor moves on to record 4");
+
+  TEST_Check(TFFT_InstMount(&g_testLog, 0) == TFFT_RW_OK && TEST_LogHolds(0, 4, 1, TEST_SLOTS),
+             "log returns records 4 to 7 after a mount");
+
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_pack.c
+ * @brief Packed files: data is run length compressed when written and
+ * decompressed when read.
+ *
+ * A packed file of 64 bytes with 20 bytes reserved for the compressed data,
+ * of an instance on a RAM EEPROM with backup mode, is written with mostly
+ * empty, repeated and literal data, which must read back as written. Data
+ * that does not compress into the reserved bytes is rejected without
+ * changing the file, and a corrupt first copy is read from the backup copy.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_PACK_ENABLED=1 -DTFFT_BACKUP_MODE_ENABLED=1 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_pack.c tfft.c
+ *     tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_pack
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_PACK_ENABLED || !TFFT_BACKUP_MODE_ENABLED || !TFFT_CHECKSUM_ENABLED || TFFT_CACHE_ENABLED
+#error "Build with TFFT_PACK_ENABLED 1, backup mode and a checksum, without cache"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_PACKED 64
+#define TEST_RESERVED    20
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_PACKED, TEST_SIZE_PACKED, TFFT_FILE_TYPE_PACKED, TEST_RESERVED) \
+  TFFT_FILE(TEST_FILE_AFTER,  sizeof(uint32_t), TFFT_FILE_TYPE_NORMAL, 1)
+
+/* EEPROM address of the stored length and the compressed data of the first copy */
+#define TEST_ADDRESS_LENGTH 0
+#define TEST_ADDRESS_DATA   TFFT_PACK_HEADER_SIZE
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testPack
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Write(const uint8_t *pData, TFFT_SIZE_TYPE size)
+{
+  uint8_t au8_data[TEST_SIZE_PACKED];
+
+  memcpy(au8_data, pData, size);
+  return TFFT_InstReadWriteFile(&g_testPack, TEST_FILE_PACKED, size, au8_data, TFFT_RW_WRITE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that the packed file holds the size bytes of pData followed by zeros */
+static int TEST_Holds(const uint8_t *pData, TFFT_SIZE_TYPE size)
+{
+  uint8_t au8_data[TEST_SIZE_PACKED];
+  TFFT_SIZE_TYPE i;
+
+  memset(au8_data, 0xEE, sizeof(au8_data));
+  if(TFFT_InstReadWriteFile(&g_testPack, TEST_FILE_PACKED, sizeof(au8_data), au8_data, TFFT_RW_READ, 0) != TFFT_RW_OK ||
+     memcmp(au8_data, pData, size) != 0)
+  {
+    return 0;
+  }
+  for(i = size; i < sizeof(au8_data) && au8_data[i] == 0; i++)
+  {
+  }
+
+  return i == sizeof(au8_data);
+}
+
+/*----------------------------------------------------------------------------*/
+static uint32_t TEST_StoredLength(void)
+{
+  return (uint32_t)(sa_testEeprom[TEST_ADDRESS_LENGTH] | (sa_testEeprom[TEST_ADDRESS_LENGTH + 1] << 8));
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  static const uint8_t au8_text[] = "label";
+  uint8_t au8_runs[TEST_SIZE_PACKED];
+  uint8_t au8_literal[TEST_SIZE_PACKED];
+  uint32_t after = 0x12345678;
+  uint32_t value = 0;
+  int i;
+
+  TEST_ERASE();
+  TEST_Check(TFFT_InstReadWriteFile(&g_testPack, TEST_FILE_AFTER, sizeof(after), (uint8_t*)&after, TFFT_RW_WRITE, 0) ==
+             TFFT_RW_OK, "write the file after the packed file");
+
+  // Trailing zeros are dropped: one control byte and five literal bytes
+  TEST_Check(TEST_Write(au8_text, sizeof(au8_text)) == TFFT_RW_OK, "write a short string");
+  TEST_Check(TEST_StoredLength() == 1 + sizeof(au8_text) - 1, "string is stored without the trailing zeros");
+  TEST_Check(TEST_Holds(au8_text, sizeof(au8_text)), "string reads back with the rest of the file zero");
+
+  // Runs of three and more are stored as two bytes
+  memset(au8_runs, 0xAA, 40);
+  memset(&au8_runs[40], 0x55, 20);
+  au8_runs[60] = 1;
+  au8_runs[61] = 2;
+  au8_runs[62] = 2;
+  au8_runs[63] = 3;
+  TEST_Check(TEST_Write(au8_runs, sizeof(au8_runs)) == TFFT_RW_OK, "write runs of repeated bytes");
+  TEST_Check(TEST_StoredLength() == 2 + 2 + 5, "runs are stored as two bytes each");
+  TEST_Check(TEST_Holds(au8_runs, sizeof(au8_runs)), "runs read back");
+
+  // Literal data that just fits in the reserved bytes
+  for(i = 0; i < TEST_SIZE_PACKED; i++)
+  {
+    au8_literal[i] = (uint8_t)(i + 1);
+  }
+  TEST_Check(TEST_Write(au8_literal, TEST_RESERVED - 1) == TFFT_RW_OK && TEST_StoredLength() == TEST_RESERVED,
+             "write literal data of the reserved size");
+  TEST_Check(TEST_Holds(au8_literal, TEST_RESERVED - 1), "literal data reads back");
+
+  TEST_Check(TEST_Write(au8_literal, TEST_RESERVED) == TFFT_RW_ERR_FILE_TOO_LARGE,
+             "data that does not compress into the reserved bytes is rejected");
+  TEST_Check(TEST_Holds(au8_literal, TEST_RESERVED - 1), "rejected write leaves the file as it was");
+
+  // The backup copy is read when the first copy is corrupt
+  TEST_CORRUPT(TEST_ADDRESS_DATA);
+  TEST_Check(TEST_Holds(au8_literal, TEST_RESERVED - 1), "corrupt first copy is read from the backup copy");
+  sa_testEeprom[TEST_ADDRESS_LENGTH] = 0xFF;
+  sa_testEeprom[TEST_ADDRESS_LENGTH + 1] = 0xFF;
+  TEST_Check(TEST_Holds(au8_literal, TEST_RESERVED - 1), "bad stored length is read from the backup copy");
+
+  TEST_Check(TFFT_InstReadWriteFile(&g_testPack, TEST_FILE_AFTER, sizeof(value), (uint8_t*)&value, TFFT_RW_READ, 0) ==
+             TFFT_RW_OK && value == after, "file after the packed file is not touched");
+
+  return s_failures ? 1 : 0;
+}
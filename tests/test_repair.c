@@ -0,0 +1,174 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file test_repair.c
+ * @brief Repair of bad copies in backup mode, by TFFT_Scrub() and reads.
+ *
+ * Two files of an instance on a RAM EEPROM in backup mode get a corrupt
+ * first copy and a corrupt backup copy. A pass of TFFT_Scrub() in small
+ * steps must rewrite both bad copies from the good ones, which a read that
+ * falls back to the backup copy also does. A file without a valid copy is
+ * counted as unrepairable and left as it is.
+ * Prints one line per check and returns 1 if any check failed.
+ * Build from the repository root, e.g.:
+ * gcc -O2 -DTFFT_BACKUP_MODE_ENABLED=1 -DTFFT_REPAIR_ENABLED=1 -DTFFT_DEBUG_ENABLED=0 -I. tests/test_repair.c tfft.c
+ *     tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o test_repair
+ *
+ * @author Lars Jelleryd
+ */
+
+#include "test_eeprom.h"
+
+#if !TFFT_REPAIR_ENABLED || TFFT_CACHE_ENABLED
+#error "Build with TFFT_BACKUP_MODE_ENABLED 1 and TFFT_REPAIR_ENABLED 1, without cache"
+#endif
+
+#include "tfft_instance.h"
+
+#define TEST_SIZE_A 16
+#define TEST_SIZE_B 8
+
+#define TEST_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(TEST_FILE_A, TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(TEST_FILE_B, TEST_SIZE_B, TFFT_FILE_TYPE_NORMAL, 1)
+
+#define TEST_FILE_SIZE(fname) (TFFT_SIZE_TYPE)(((fname) == TEST_FILE_A) ? TEST_SIZE_A : TEST_SIZE_B)
+
+/* EEPROM address of the first and the backup copy of the files */
+#define TEST_ADDRESS_A        0
+#define TEST_ADDRESS_B        TFFT_FILE_REAL_SIZE(TEST_SIZE_A, TFFT_FILE_TYPE_NORMAL, 1)
+#define TEST_COPY_SIZE(fname) (TEST_FILE_SIZE(fname) + TFFT_CHECKSUM_SIZE)
+#define TEST_ADDRESS(fname)   (((fname) == TEST_FILE_A) ? TEST_ADDRESS_A : TEST_ADDRESS_B)
+
+TFFT_FILE_NAMES(TEST_FILE_TABLE, TEST_FILE_COUNT)
+
+#define TFFT_INSTANCE_NAME              g_testRepair
+#define TFFT_INSTANCE_FILES             TEST_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS     0
+#define TFFT_INSTANCE_END_ADDRESS       (TEST_EEPROM_SIZE - 1)
+#define TFFT_INSTANCE_PAGE_SIZE         16
+#define TFFT_INSTANCE_DRIVER            (&s_testDriver)
+#define TFFT_INSTANCE_STATIC
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+static int TEST_Write(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_A];
+
+  memset(au8_data, fill, sizeof(au8_data));
+  return TFFT_InstReadWriteFile(&g_testRepair, fname, TEST_FILE_SIZE(fname), au8_data, TFFT_RW_WRITE, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that fname holds fill in every byte */
+static int TEST_Holds(TFFT_FILE_NAME_TYPE fname, uint8_t fill)
+{
+  uint8_t au8_data[TEST_SIZE_A];
+  TFFT_SIZE_TYPE size = TEST_FILE_SIZE(fname);
+  TFFT_SIZE_TYPE i;
+
+  if(TFFT_InstReadWriteFile(&g_testRepair, fname, size, au8_data, TFFT_RW_READ, 0) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+  for(i = 0; i < size && au8_data[i] == fill; i++)
+  {
+  }
+
+  return i == size;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check that both copies of fname in the EEPROM are equal */
+static int TEST_CopiesEqual(TFFT_FILE_NAME_TYPE fname)
+{
+  return memcmp(&sa_testEeprom[TEST_ADDRESS(fname)], &sa_testEeprom[TEST_ADDRESS(fname) + TEST_COPY_SIZE(fname)],
+                TEST_COPY_SIZE(fname)) == 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Scrub maxBytes per call until a pass is done. Returns the number of
+   calls, or 0 if a call failed or the pass did not end. */
+static int TEST_ScrubPass(uint32_t maxBytes)
+{
+  int calls = 0;
+  int rtnCode;
+
+  do
+  {
+    rtnCode = TFFT_InstScrub(&g_testRepair, maxBytes);
+    calls++;
+  } while(rtnCode == TFFT_RW_OK && calls < 100);
+
+  return (rtnCode == TFFT_RW_SCRUB_DONE) ? calls : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+  TFFT_REPAIR_COUNTERS counters;
+  uint8_t au8_data[TEST_SIZE_A];
+  int calls;
+
+  TEST_ERASE();
+  (void)TFFT_InstMount(&g_testRepair, 0); // Blank, no valid file
+  TEST_Check(TEST_Write(TEST_FILE_A, 0x11) == TFFT_RW_OK && TEST_Write(TEST_FILE_B, 0x22) == TFFT_RW_OK,
+             "write A and B");
+  TFFT_InstResetRepairCounters(&g_testRepair);
+
+  TEST_Check(TEST_ScrubPass(8) > 0, "scrub pass over good files");
+  TFFT_InstGetRepairCounters(&g_testRepair, &counters);
+  TEST_Check(counters.repairs == 0 && counters.scrubPasses == 1 && counters.scrubBytes > 0,
+             "good files are verified and not repaired");
+
+  // Bad first copy of A, bad backup copy of B
+  TEST_CORRUPT(TEST_ADDRESS_A + 3);
+  TEST_CORRUPT(TEST_ADDRESS_B + TEST_COPY_SIZE(TEST_FILE_B) + 1);
+  TEST_Check(!TEST_CopiesEqual(TEST_FILE_A) && !TEST_CopiesEqual(TEST_FILE_B), "corrupt one copy of A and of B");
+  calls = TEST_ScrubPass(8);
+  TEST_Check(calls > 1, "scrub pass is done in several calls");
+  TFFT_InstGetRepairCounters(&g_testRepair, &counters);
+  TEST_Check(counters.repairs == 2 && counters.unrepairable == 0 && counters.scrubPasses == 2,
+             "scrub repairs the bad copies of A and B");
+  TEST_Check(TEST_CopiesEqual(TEST_FILE_A) && TEST_CopiesEqual(TEST_FILE_B), "both copies are equal after the scrub");
+
+  // The repaired first copy of A is used when the backup copy goes bad
+  TEST_CORRUPT(TEST_ADDRESS_A + TEST_COPY_SIZE(TEST_FILE_A) + 3);
+  TEST_Check(TEST_Holds(TEST_FILE_A, 0x11), "A is read from the repaired first copy");
+  TEST_CORRUPT(TEST_ADDRESS_A + TEST_COPY_SIZE(TEST_FILE_A) + 3); // Flipped back
+
+  // A read that falls back to the backup copy repairs the first copy
+  TEST_CORRUPT(TEST_ADDRESS_B);
+  TEST_Check(TEST_Holds(TEST_FILE_B, 0x22), "B is read from the backup copy");
+  TFFT_InstGetRepairCounters(&g_testRepair, &counters);
+  TEST_Check(counters.repairs == 3 && TEST_CopiesEqual(TEST_FILE_B), "read repairs the first copy of B");
+
+  // Without a valid copy there is nothing to repair from
+  TEST_CORRUPT(TEST_ADDRESS_B);
+  TEST_CORRUPT(TEST_ADDRESS_B + TEST_COPY_SIZE(TEST_FILE_B));
+  TEST_Check(TEST_ScrubPass(TEST_EEPROM_SIZE) > 0, "scrub pass with both copies of B bad");
+  TFFT_InstGetRepairCounters(&g_testRepair, &counters);
+  TEST_Check(counters.repairs == 3 && counters.unrepairable == 1, "B is counted as unrepairable");
+  TEST_Check(TFFT_InstReadWriteFile(&g_testRepair, TEST_FILE_B, TEST_SIZE_B, au8_data, TFFT_RW_READ, 0) ==
+             TFFT_RW_ERR_CHECKSUM, "read of B fails with a checksum error");
+
+  return s_failures ? 1 : 0;
+}
@@ -38,12 +38,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 
-#define TFFT_INCLUDE_USER_FILE_TABLE
 #include "tfft.h"
-#undef TFFT_INCLUDE_USER_FILE_TABLE
+#include "tfft_instance.h"
 
-#if TFFT_USE_FILE_CRC16
+#if TFFT_USE_FILE_CRC32C
+#include "tfft_crc32c.h"
+#elif TFFT_USE_FILE_CRC16
 #include "tfft_crc16.h"
 #elif TFFT_USE_FILE_CRC8
 #include "tfft_crc8.h"
@@ -59,346 +61,5658 @@
  The EEPROM might be as small as 128 bytes and using a real file system is just not feasible.
  */
 
-/* Macros */
-#define TFFT_IS_ADDRESS_IN_RANGE(addr) (addr >= TFFT_START_ADDRESS && addr <= TFFT_END_ADDRESS)
-#define TFFT_IS_FILE_NAME_ALLOWED(fname) (fname >= 0 && fname < TFFT_FILE_COUNT)
+/* Macros. All functions work on the instance pInst. */
+#define TFFT_IS_ADDRESS_IN_RANGE(pInst, addr) ((addr) >= (pInst)->startAddress && (addr) <= (pInst)->endAddress)
+#define TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) ((fname) >= 0 && (fname) < (pInst)->pTable->fileCount)
 
-#define TFFT_GET_FILE_SIZE_WITH_CHECKSUM(fname) sa_fileTable[fname] + TFFT_USE_FILE_CRC8 + (TFFT_USE_FILE_CRC16 * 2)
+#define TFFT_FILE_SIZE(pInst, fname) ((pInst)->pTable->pSize[fname])
+#define TFFT_FILE_TYPE(pInst, fname) ((pInst)->pTable->pType[fname])
+#define TFFT_FILE_SLOTS(pInst, fname) ((pInst)->pTable->pCount[fname])
+#define TFFT_FILE_IS_RING(pInst, fname) TFFT_IS_RING_TYPE(TFFT_FILE_TYPE(pInst, fname))
 
-static uint8_t saf_busy = 0;
-static uint32_t sau32_errorCount = 0;
+#define TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname) (TFFT_FILE_SIZE(pInst, fname) + TFFT_CHECKSUM_SIZE)
 
+#if TFFT_FLASH_ENABLED
+#define TFFT_IS_FLASH(pInst) ((pInst)->flashSectorSize != 0)
+#else
+#define TFFT_IS_FLASH(pInst) 0
+#endif
+
+/* Chunk size used by TFFT_Mount() and TFFT_VerifyAll() */
+#ifndef TFFT_MOUNT_CHUNK_SIZE
+#define TFFT_MOUNT_CHUNK_SIZE 64
+#endif
+
+#ifndef TFFT_LOCK_TIMEOUT_MS
+#define TFFT_LOCK_TIMEOUT_MS 0
+#endif
+
+/* Ring file state (only valid for ring files) */
+#define TFFT_GetRingState(pInst, fname) (&(pInst)->pRingState[(pInst)->pTable->pRingIndex[fname]])
+
+/* Bit maps with one bit per file */
+#define TFFT_BIT_GET(map, n) ((map)[(n) >> 3] & (1 << ((n) & 7)))
+#define TFFT_BIT_SET(map, n) ((map)[(n) >> 3] |= (uint8_t)(1 << ((n) & 7)))
+#define TFFT_BIT_CLR(map, n) ((map)[(n) >> 3] &= (uint8_t)~(1 << ((n) & 7)))
+
+#if TFFT_CACHE_ENABLED
+/* Cached data of a file */
+#define TFFT_GetCacheData(pInst, fname) (&(pInst)->pCache[(pInst)->pTable->pCacheOffset[fname]])
+#endif
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+/* Copy of the data to write of a queued asynchronous write */
+#define TFFT_GetAsyncData(pInst, pEntry) \
+  (&(pInst)->pAsyncData[(uint32_t)((pEntry) - (pInst)->asyncQueue) * (pInst)->pTable->maxFileSize])
+
+static TFFT_ASYNC_ENTRY* TFFT_AsyncFind(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname);
+#endif /* TFFT_ASYNC_QUEUE_SIZE > 0 */
+
+#if TFFT_STATS_ENABLED
+#if TFFT_COUNTERS_ATOMIC
+#define TFFT_STATS_ADD(index, field, n) \
+  atomic_fetch_add_explicit(&pInst->pStats[index][TFFT_STATS_##field], (uint32_t)(n), memory_order_relaxed)
+#define TFFT_STATS_GET(index, field) \
+  ((uint32_t)atomic_load_explicit(&pInst->pStats[index][TFFT_STATS_##field], memory_order_relaxed))
+#else
+#define TFFT_STATS_ADD(index, field, n) (pInst->pStats[index][TFFT_STATS_##field] += (uint32_t)(n))
+#define TFFT_STATS_GET(index, field) (pInst->pStats[index][TFFT_STATS_##field])
+#endif
+
+/* One entry per file and a last entry for what is not done for a single
+   file (TFFT_Mount(), merged batch transfers and invalid file names) */
+#define TFFT_STATS_OTHER (pInst->pTable->fileCount)
+#define TFFT_STATS_INDEX(fname) (TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) ? (fname) : TFFT_STATS_OTHER)
+
+#define TFFT_STATS_SET_FILE(fname) (pInst->statsIndex = TFFT_STATS_INDEX(fname))
+#define TFFT_STATS_CALL(fname, size, f_write, rtnVal, startTime) TFFT_StatsCall(pInst, fname, size, f_write, rtnVal, startTime)
+#define TFFT_STATS_CLEAR_FILE() (pInst->statsIndex = TFFT_STATS_OTHER)
+#define TFFT_STATS_LOW_LEVEL(rtnCode) \
+  do{TFFT_STATS_ADD(pInst->statsIndex, lowLevelCalls, 1); if((rtnCode) != TFFT_RW_OK) TFFT_STATS_ADD(pInst->statsIndex, lowLevelErrors, 1);}while(0)
+#else
+#define TFFT_STATS_ADD(index, field, n) do{}while(0)
+#define TFFT_STATS_SET_FILE(fname) do{}while(0)
+#define TFFT_STATS_CLEAR_FILE() do{}while(0)
+#define TFFT_STATS_LOW_LEVEL(rtnCode) do{}while(0)
+#define TFFT_STATS_CALL(fname, size, f_write, rtnVal, startTime) do{}while(0)
+#endif /* TFFT_STATS_ENABLED */
+
+#if TFFT_TRACE_SIZE > 0
+/* Trace ring. Calls running in parallel under the shared lock take entries
+   with an atomic counter. Low level calls are counted from TFFT_Lock(0). */
+#define TFFT_TRACE(op, fname, size, rtnVal, startTime, lowLevelCalls) \
+  TFFT_TraceAdd(pInst, op, fname, size, rtnVal, startTime, lowLevelCalls)
+#define TFFT_TRACE_LOW_LEVEL() (pInst->traceLowLevel++)
+#else
+#define TFFT_TRACE(op, fname, size, rtnVal, startTime, lowLevelCalls) do{}while(0)
+#define TFFT_TRACE_LOW_LEVEL() do{}while(0)
+#endif /* TFFT_TRACE_SIZE > 0 */
+
+#define TFFT_COUNT_LOW_LEVEL(rtnCode) do{TFFT_STATS_LOW_LEVEL(rtnCode); TFFT_TRACE_LOW_LEVEL();}while(0)
+
+#if TFFT_VIEW_ENABLED
+/* Every write invalidates the views of the file. The generation is changed
+   before the data, so a caller that compares it after using a view sees
+   the write. */
+#if TFFT_BUSY_FLAG_ATOMIC
+#define TFFT_VIEW_CHANGED(fname) \
+  do{if(TFFT_IS_FILE_NAME_ALLOWED(pInst, fname)) atomic_fetch_add(&pInst->pGeneration[fname], 1u);}while(0)
+#define TFFT_VIEW_GENERATION_GET(fname) ((uint32_t)atomic_load(&pInst->pGeneration[fname]))
+#else
+#define TFFT_VIEW_CHANGED(fname) do{if(TFFT_IS_FILE_NAME_ALLOWED(pInst, fname)) pInst->pGeneration[fname]++;}while(0)
+#define TFFT_VIEW_GENERATION_GET(fname) (pInst->pGeneration[fname])
+#endif
+#else
+#define TFFT_VIEW_CHANGED(fname) do{}while(0)
+#endif /* TFFT_VIEW_ENABLED */
+
+//=========================================================
+// Default instance, set up from tfft_user.h
+//=========================================================
+static int TFFT_DefaultWriteByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t byte)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_WRITE_BYTE_FUNC(address, byte);
+}
+
+static int TFFT_DefaultReadByte(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pByte)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_READ_BYTE_FUNC(address, pByte);
+}
+
+#ifdef TFFT_EEPROM_READ_BLOCK_FUNC
+static int TFFT_DefaultReadBlock(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_READ_BLOCK_FUNC(address, pData, len);
+}
+#define TFFT_DEFAULT_READ_BLOCK TFFT_DefaultReadBlock
+#else
+#define TFFT_DEFAULT_READ_BLOCK 0
+#endif
+
+#ifdef TFFT_EEPROM_WRITE_PAGE_FUNC
+static int TFFT_DefaultWritePage(void *pDevice, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_WRITE_PAGE_FUNC(address, pData, len);
+}
+#define TFFT_DEFAULT_WRITE_PAGE TFFT_DefaultWritePage
+#else
+#define TFFT_DEFAULT_WRITE_PAGE 0
+#endif
+
+#ifdef TFFT_EEPROM_IS_READY_FUNC
+static int TFFT_DefaultIsReady(void *pDevice)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_IS_READY_FUNC();
+}
+#define TFFT_DEFAULT_IS_READY TFFT_DefaultIsReady
+#else
+#define TFFT_DEFAULT_IS_READY 0
+#endif
+
+#ifdef TFFT_LOCK_FUNC
+static int TFFT_DefaultLock(void *pDevice, uint8_t f_shared, uint32_t timeoutMs)
+{
+  (void)pDevice;
+  return TFFT_LOCK_FUNC(f_shared, timeoutMs);
+}
+
+static void TFFT_DefaultUnlock(void *pDevice, uint8_t f_shared)
+{
+  (void)pDevice;
+  TFFT_UNLOCK_FUNC(f_shared);
+}
+#define TFFT_DEFAULT_LOCK TFFT_DefaultLock
+#define TFFT_DEFAULT_UNLOCK TFFT_DefaultUnlock
+#else
+#define TFFT_DEFAULT_LOCK 0
+#define TFFT_DEFAULT_UNLOCK 0
+#endif
+
+#ifdef TFFT_EEPROM_ERASE_SECTOR_FUNC
+static int TFFT_DefaultEraseSector(void *pDevice, TFFT_ADDR_TYPE address)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_ERASE_SECTOR_FUNC(address);
+}
+#define TFFT_DEFAULT_ERASE_SECTOR TFFT_DefaultEraseSector
+#else
+#define TFFT_DEFAULT_ERASE_SECTOR 0
+#endif
+
+#ifdef TFFT_EEPROM_MAP_FUNC
+static const uint8_t* TFFT_DefaultMap(void *pDevice, TFFT_ADDR_TYPE address)
+{
+  (void)pDevice;
+  return TFFT_EEPROM_MAP_FUNC(address);
+}
+#define TFFT_DEFAULT_MAP TFFT_DefaultMap
+#else
+#define TFFT_DEFAULT_MAP 0
+#endif
+
+static const TFFT_DRIVER s_defaultDriver =
+{
+  TFFT_DefaultWriteByte,
+  TFFT_DefaultReadByte,
+  TFFT_DEFAULT_READ_BLOCK,
+  TFFT_DEFAULT_WRITE_PAGE,
+  TFFT_DEFAULT_IS_READY,
+  TFFT_DEFAULT_LOCK,
+  TFFT_DEFAULT_UNLOCK,
+  TFFT_DEFAULT_ERASE_SECTOR,
+  TFFT_DEFAULT_MAP
+};
+
+#define TFFT_INSTANCE_NAME          s_defaultInstance
+#define TFFT_INSTANCE_STATIC
+#define TFFT_INSTANCE_FILES         TFFT_FILE_TABLE
+#define TFFT_INSTANCE_START_ADDRESS TFFT_START_ADDRESS
+#define TFFT_INSTANCE_END_ADDRESS   TFFT_END_ADDRESS
+#define TFFT_INSTANCE_PAGE_SIZE     TFFT_EEPROM_PAGE_SIZE
+#define TFFT_INSTANCE_DRIVER        (&s_defaultDriver)
+#ifdef TFFT_FLASH_SECTOR_SIZE
+#define TFFT_INSTANCE_FLASH_SECTOR_SIZE TFFT_FLASH_SECTOR_SIZE
+#endif
+#include "tfft_instance.h"
+
+/*----------------------------------------------------------------------------*/
+/* Instance used by all functions without instance parameter */
+TFFT_INSTANCE* TFFT_GetDefaultInstance(void)
+{
+  return &s_defaultInstance;
+}
+
+/*----------------------------------------------------------------------------*/
+uint32_t TFFT_InstGetErrorCount(TFFT_INSTANCE *pInst)
+{
+  return pInst->errorCount;
+}
+
+/*----------------------------------------------------------------------------*/
+void TFFT_InstResetErrorCount(TFFT_INSTANCE *pInst)
+{
+  pInst->errorCount = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Number of bytes actually written to EEPROM (including checksum and backup) */
+uint32_t TFFT_InstGetBytesWritten(TFFT_INSTANCE *pInst)
+{
+  return pInst->bytesWritten;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Number of bytes not written since they were unchanged (compare before write) */
+uint32_t TFFT_InstGetBytesSkipped(TFFT_INSTANCE *pInst)
+{
+  return pInst->bytesSkipped;
+}
+
+/*----------------------------------------------------------------------------*/
+void TFFT_InstResetByteCounts(TFFT_INSTANCE *pInst)
+{
+  pInst->bytesWritten = 0;
+  pInst->bytesSkipped = 0;
+}
+
+#if TFFT_REPAIR_ENABLED
+/*----------------------------------------------------------------------------*/
+void TFFT_InstGetRepairCounters(TFFT_INSTANCE *pInst, TFFT_REPAIR_COUNTERS *pCounters)
+{
+  *pCounters = pInst->repair;
+}
+
+/*----------------------------------------------------------------------------*/
+void TFFT_InstResetRepairCounters(TFFT_INSTANCE *pInst)
+{
+  pInst->repair.repairs = 0;
+  pInst->repair.unrepairable = 0;
+  pInst->repair.scrubBytes = 0;
+  pInst->repair.scrubPasses = 0;
+}
+#endif
+
+#if TFFT_CALL_TIME_USED
+/*----------------------------------------------------------------------------*/
+/* Time for the statistics and the trace, always 0 without TFFT_GET_TIME_FUNC */
+static uint32_t TFFT_CallTime(void)
+{
+#ifdef TFFT_GET_TIME_FUNC
+  return TFFT_GET_TIME_FUNC();
+#else
+  return 0;
+#endif
+}
+#endif
+
+#if TFFT_STATS_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Count a read or write call that is done */
+static void TFFT_StatsCall(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint32_t size, uint8_t f_write,
+                           int rtnVal, uint32_t startTime)
+{
+  uint32_t index = TFFT_STATS_INDEX(fname);
+
+  if(rtnVal == TFFT_RW_ERR_EEPROM_BUSY)
+  {
+    TFFT_STATS_ADD(index, busy, 1);
+  }
+  else
+  {
+    if(rtnVal != TFFT_RW_OK)
+    {
+      TFFT_STATS_ADD(index, errors, 1);
+    }
+    if(f_write)
+    {
+      TFFT_STATS_ADD(index, writes, 1);
+      TFFT_STATS_ADD(index, bytesWritten, (rtnVal == TFFT_RW_OK) ? size : 0);
+    }
+    else
+    {
+      if(index != TFFT_STATS_OTHER && TFFT_FILE_TYPE(pInst, fname) != TFFT_FILE_TYPE_ARRAY && size > TFFT_FILE_SIZE(pInst, fname))
+      {
+        size = TFFT_FILE_SIZE(pInst, fname);
+      }
+      TFFT_STATS_ADD(index, reads, 1);
+      TFFT_STATS_ADD(index, bytesRead, (rtnVal == TFFT_RW_OK) ? size : 0);
+    }
+  }
+
+  TFFT_STATS_ADD(index, time, TFFT_CallTime() - startTime);
+}
+
+/*----------------------------------------------------------------------------*/
+static void TFFT_StatsCopy(TFFT_INSTANCE *pInst, uint32_t index, TFFT_FILE_STATS *pStats)
+{
+#define TFFT_STATS_COPY_ENTRY(field) pStats->field += TFFT_STATS_GET(index, field);
+  TFFT_STATS_FIELDS(TFFT_STATS_COPY_ENTRY)
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get the statistics of one file since start or TFFT_ResetStats() */
+int TFFT_InstGetFileStats(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_FILE_STATS *pStats)
+{
+  TFFT_FILE_STATS zero = {0};
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return TFFT_RW_ERR_FILE_NAME;
+  }
+
+  *pStats = zero;
+  TFFT_StatsCopy(pInst, fname, pStats);
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get the sum of the statistics of all files, including low level calls
+   and errors of TFFT_Mount(), TFFT_VerifyAll(), merged batch transfers
+   and calls with invalid file names */
+void TFFT_InstGetStats(TFFT_INSTANCE *pInst, TFFT_FILE_STATS *pStats)
+{
+  TFFT_FILE_STATS zero = {0};
+  uint32_t index;
+
+  *pStats = zero;
+  for(index = 0; index <= TFFT_STATS_OTHER; index++)
+  {
+    TFFT_StatsCopy(pInst, index, pStats);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Set all statistics to 0. Should not be called while other calls are in
+   progress. */
+void TFFT_InstResetStats(TFFT_INSTANCE *pInst)
+{
+  uint32_t index;
+  uint8_t field;
+
+  for(index = 0; index <= TFFT_STATS_OTHER; index++)
+  {
+    for(field = 0; field < TFFT_STATS_FIELD_COUNT; field++)
+    {
+#if TFFT_COUNTERS_ATOMIC
+      atomic_store_explicit(&pInst->pStats[index][field], 0, memory_order_relaxed);
+#else
+      pInst->pStats[index][field] = 0;
+#endif
+    }
+  }
+}
+#endif /* TFFT_STATS_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Take the lock before accessing EEPROM or internal state. Shared locks
+   (f_shared = 1) are only used for reads of the RAM cache, which may run in
+   parallel. Without lock function in the driver both are the same busy
+   flag of the instance.
+   Returns TFFT_RW_OK or TFFT_RW_ERR_EEPROM_BUSY */
+static int TFFT_Lock(TFFT_INSTANCE *pInst, uint8_t f_shared)
+{
+  const TFFT_DRIVER *pDriver = pInst->pDriver;
+  int rtnCode;
+
+  if(pDriver->lock)
+  {
+    rtnCode = (pDriver->lock(pInst->pDevice, f_shared, TFFT_LOCK_TIMEOUT_MS) == 0) ? TFFT_RW_OK : TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+#if TFFT_BUSY_FLAG_ATOMIC
+    rtnCode = atomic_flag_test_and_set(&pInst->f_busy) ? TFFT_RW_ERR_EEPROM_BUSY : TFFT_RW_OK;
+#else
+    rtnCode = TFFT_RW_ERR_EEPROM_BUSY;
+    if(!pInst->f_busy)
+    {
+      pInst->f_busy = 1;
+      rtnCode = TFFT_RW_OK;
+    }
+#endif
+  }
+
+#if TFFT_TRACE_SIZE > 0
+  if(rtnCode == TFFT_RW_OK && !f_shared)
+  {
+    pInst->traceLowLevel = 0; // Low level calls are traced per locked call
+  }
+#endif
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Release the lock taken with TFFT_Lock() */
+static void TFFT_Unlock(TFFT_INSTANCE *pInst, uint8_t f_shared)
+{
+  if(pInst->pDriver->lock)
+  {
+    pInst->pDriver->unlock(pInst->pDevice, f_shared);
+  }
+  else
+  {
+#if TFFT_BUSY_FLAG_ATOMIC
+    atomic_flag_clear(&pInst->f_busy);
+#else
+    pInst->f_busy = 0;
+#endif
+  }
+}
+
+#if TFFT_TRACE_SIZE > 0
+/*----------------------------------------------------------------------------*/
+/* Add a call to the trace ring. The oldest entry is overwritten. */
+static void TFFT_TraceAdd(TFFT_INSTANCE *pInst, uint8_t op, uint32_t fname, uint32_t size, int rtnVal,
+                          uint32_t startTime, uint16_t lowLevelCalls)
+{
+  TFFT_TRACE_ENTRY *pEntry;
+  uint32_t seq;
+
+#if TFFT_COUNTERS_ATOMIC
+  seq = (uint32_t)atomic_fetch_add_explicit(&pInst->traceCount, 1, memory_order_relaxed);
+#else
+  seq = pInst->traceCount++;
+#endif
+
+  pEntry = &pInst->trace[seq % TFFT_TRACE_SIZE];
+  pEntry->seq = seq;
+  pEntry->start = startTime;
+  pEntry->end = TFFT_CallTime();
+  pEntry->size = size;
+  pEntry->fname = (uint16_t)fname;
+  pEntry->lowLevelCalls = lowLevelCalls;
+  pEntry->result = (int8_t)rtnVal;
+  pEntry->op = op;
+}
+
+/*----------------------------------------------------------------------------*/
+static uint8_t* TFFT_TracePut(uint8_t *pBuf, uint32_t value, uint8_t len)
+{
+  uint8_t i;
+
+  for(i = 0; i < len; i++)
+  {
+    *pBuf++ = (uint8_t)(value >> (8 * i)); // Least significant byte first
+  }
+
+  return pBuf;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Copy the trace to pBuf in the dump format described in tfft.h, oldest
+   entry first. If the buffer can not hold all entries, the newest entries
+   that fit are copied. TFFT_TRACE_DUMP_SIZE bytes hold the whole trace.
+   The number of bytes used is returned in pLength.
+   Returns TFFT_RW_OK, TFFT_RW_ERR_EEPROM_BUSY or TFFT_RW_ERR_FILE_TOO_LARGE
+   if the buffer is smaller than TFFT_TRACE_HEADER_SIZE */
+int TFFT_InstTraceDump(TFFT_INSTANCE *pInst, uint8_t *pBuf, uint32_t bufSize, uint32_t *pLength)
+{
+  const TFFT_TRACE_ENTRY *pEntry;
+  uint32_t total;
+  uint32_t count;
+  uint32_t seq;
+
+  *pLength = 0;
+
+  if(bufSize < TFFT_TRACE_HEADER_SIZE)
+  {
+    return TFFT_RW_ERR_FILE_TOO_LARGE;
+  }
+
+  // The exclusive lock keeps calls from adding entries
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  total = (uint32_t)pInst->traceCount;
+  count = (total < TFFT_TRACE_SIZE) ? total : TFFT_TRACE_SIZE;
+  if(count > (bufSize - TFFT_TRACE_HEADER_SIZE) / TFFT_TRACE_RECORD_SIZE)
+  {
+    count = (bufSize - TFFT_TRACE_HEADER_SIZE) / TFFT_TRACE_RECORD_SIZE;
+  }
+
+  *pLength = TFFT_TRACE_HEADER_SIZE + count * TFFT_TRACE_RECORD_SIZE;
+
+  pBuf = TFFT_TracePut(pBuf, TFFT_TRACE_MAGIC, 4);
+  pBuf = TFFT_TracePut(pBuf, TFFT_TRACE_VERSION, 1);
+  pBuf = TFFT_TracePut(pBuf, TFFT_TRACE_RECORD_SIZE, 1);
+  pBuf = TFFT_TracePut(pBuf, pInst->pTable->fileCount, 2);
+  pBuf = TFFT_TracePut(pBuf, count, 4);
+  pBuf = TFFT_TracePut(pBuf, total, 4);
+
+  for(seq = total - count; seq != total; seq++)
+  {
+    pEntry = &pInst->trace[seq % TFFT_TRACE_SIZE];
+    pBuf = TFFT_TracePut(pBuf, pEntry->seq, 4);
+    pBuf = TFFT_TracePut(pBuf, pEntry->start, 4);
+    pBuf = TFFT_TracePut(pBuf, pEntry->end, 4);
+    pBuf = TFFT_TracePut(pBuf, pEntry->size, 4);
+    pBuf = TFFT_TracePut(pBuf, pEntry->fname, 2);
+    pBuf = TFFT_TracePut(pBuf, pEntry->lowLevelCalls, 2);
+    pBuf = TFFT_TracePut(pBuf, (uint8_t)pEntry->result, 1);
+    pBuf = TFFT_TracePut(pBuf, pEntry->op, 1);
+    pBuf = TFFT_TracePut(pBuf, 0, 2); // Reserved
+  }
+
+  TFFT_Unlock(pInst, 0);
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Remove all entries from the trace */
+int TFFT_InstTraceClear(TFFT_INSTANCE *pInst)
+{
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  pInst->traceCount = 0;
+  TFFT_Unlock(pInst, 0);
+
+  return TFFT_RW_OK;
+}
+#endif /* TFFT_TRACE_SIZE > 0 */
+
+/*----------------------------------------------------------------------------*/
+static TFFT_SIZE_TYPE TFFT_GetTypeMaxFileSize(void)
+{
+  switch(sizeof(TFFT_SIZE_TYPE))
+  {
+      case 1:
+        return (TFFT_SIZE_TYPE)0xFF;
+      case 2:
+        return (TFFT_SIZE_TYPE)0xFFFF;
+      case 4:
+        return (TFFT_SIZE_TYPE)0xFFFFFFFF;
+      default:
+        return 0;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+static TFFT_SIZE_TYPE TFFT_EepromStrlen(const char *pStr)
+{
+  TFFT_SIZE_TYPE len;
+  TFFT_SIZE_TYPE maxLen = TFFT_GetTypeMaxFileSize();
+
+  for(len = 0; len < maxLen && pStr[len] != '\0'; len++)
+  {
+  }
+
+  return len;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get the start address of the file (fname must be a valid file name) */
+#define TFFT_GetAddress(pInst, fname) ((pInst)->pTable->pAddress[fname])
+
+/*----------------------------------------------------------------------------*/
+size_t TFFT_GetFileTableSize(void)
+{
+  return sizeof(s_defaultInstance_fileSize);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read block from EEPROM. Block read function is used if available,
+   otherwise the block is read byte by byte. */
+static int TFFT_LowLevelRead(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  const TFFT_DRIVER *pDriver = pInst->pDriver;
+  TFFT_ADDR_TYPE i;
+  int rtnCode;
+
+  if(pDriver->readBlock)
+  {
+    rtnCode = pDriver->readBlock(pInst->pDevice, address, pData, len);
+    TFFT_COUNT_LOW_LEVEL(rtnCode);
+    return rtnCode;
+  }
+
+  for(i = 0; i < len; i++)
+  {
+    rtnCode = pDriver->readByte(pInst->pDevice, address + i, &pData[i]);
+    TFFT_COUNT_LOW_LEVEL(rtnCode);
+
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode; // EEPROM Read error
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write block to EEPROM. The block must not cross a page boundary.
+   Page write function is used if available, otherwise the block is
+   written byte by byte. */
+static int TFFT_LowLevelWrite(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  const TFFT_DRIVER *pDriver = pInst->pDriver;
+  TFFT_ADDR_TYPE i;
+  int rtnCode;
+
+  if(pDriver->writePage)
+  {
+    rtnCode = pDriver->writePage(pInst->pDevice, address, pData, len);
+    TFFT_COUNT_LOW_LEVEL(rtnCode);
+    return rtnCode;
+  }
+
+  for(i = 0; i < len; i++)
+  {
+    rtnCode = pDriver->writeByte(pInst->pDevice, address + i, pData[i]);
+    TFFT_COUNT_LOW_LEVEL(rtnCode);
+
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode; // EEPROM Write error
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write block to EEPROM, but only the bytes that differ from what is
+   already stored. The block must not cross a page boundary.
+   With page writes, one page write covering the first to the last changed
+   byte is used. Number of written bytes is returned in pWritten. */
+static int TFFT_LowLevelWriteChanged(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, const uint8_t *pData,
+                                     TFFT_ADDR_TYPE len, TFFT_ADDR_TYPE *pWritten)
+{
+  uint8_t au8_current[TFFT_EEPROM_PAGE_SIZE];
+  TFFT_ADDR_TYPE first;
+  TFFT_ADDR_TYPE last;
+  int rtnCode;
+
+  *pWritten = 0;
+
+  rtnCode = TFFT_LowLevelRead(pInst, address, au8_current, len);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  for(first = 0; first < len && pData[first] == au8_current[first]; first++)
+  {
+  }
+
+  if(first == len)
+  {
+    return TFFT_RW_OK; // Nothing changed
+  }
+
+  for(last = len - 1; pData[last] == au8_current[last]; last--)
+  {
+  }
+
+  if(pInst->pDriver->writePage)
+  {
+    *pWritten = last - first + 1;
+    return TFFT_LowLevelWrite(pInst, address + first, &pData[first], *pWritten);
+  }
+
+  for( ; first <= last; first++)
+  {
+    if(pData[first] != au8_current[first])
+    {
+      rtnCode = pInst->pDriver->writeByte(pInst->pDevice, address + first, pData[first]);
+      TFFT_COUNT_LOW_LEVEL(rtnCode);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        return rtnCode; // EEPROM Write error
+      }
+      (*pWritten)++;
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+#if TFFT_CHECKSUM_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Update checksum with a block of data. If pData is null, the block is
+   treated as zeros (padding). */
+static void TFFT_ChecksumUpdate(TFFT_CHECKSUM_TYPE *pChecksum, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  if(pData)
+  {
+#if TFFT_USE_FILE_CRC8
+    *pChecksum = TFFT_Crc8Buffer(pData, len, *pChecksum);
+#elif TFFT_USE_FILE_CRC16
+    *pChecksum = TFFT_Crc16Buffer(pData, len, *pChecksum);
+#else // TFFT_USE_FILE_CRC32C
+    *pChecksum = TFFT_Crc32cBuffer(pData, len, *pChecksum);
+#endif
+  }
+  else
+  {
+    for( ; len > 0; len--)
+    {
+#if TFFT_USE_FILE_CRC8
+      TFFT_Crc8(0, pChecksum);
+#elif TFFT_USE_FILE_CRC16
+      TFFT_Crc16(0, pChecksum);
+#else // TFFT_USE_FILE_CRC32C
+      TFFT_Crc32c(0, pChecksum);
+#endif
+    }
+  }
+}
+#endif /* TFFT_CHECKSUM_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Size of an area in EEPROM (header, data and checksum). Without checksum
+   only the header and the requested data are transferred. */
+static TFFT_ADDR_TYPE TFFT_AreaSize(TFFT_ADDR_TYPE headerSize, TFFT_ADDR_TYPE size, TFFT_ADDR_TYPE dataSize)
+{
+#if TFFT_CHECKSUM_ENABLED
+  (void)size;
+  return headerSize + dataSize + TFFT_CHECKSUM_SIZE;
+#else
+  (void)dataSize;
+  return headerSize + size;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get length of the next page aligned chunk of an area */
+static TFFT_ADDR_TYPE TFFT_ChunkLength(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, TFFT_ADDR_TYPE offset, TFFT_ADDR_TYPE totalSize)
+{
+  TFFT_ADDR_TYPE len = pInst->pageSize - ((address + offset) % pInst->pageSize);
+
+  if(len > (totalSize - offset))
+  {
+    len = totalSize - offset;
+  }
+
+  return len;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Prepare writing an area to EEPROM. The area consists of an optional
+   header, dataSize bytes of data and the checksum (if used), which covers
+   both header and data. Only the first size bytes of data are taken from
+   pData, the rest is padded with zeros. Header and data must be kept
+   unchanged until the write is done.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_AreaWriteBegin(TFFT_INSTANCE *pInst, TFFT_AREA_WRITE *pWrite, TFFT_ADDR_TYPE address,
+                               const uint8_t *pHeader, TFFT_ADDR_TYPE headerSize,
+                               const uint8_t *pData, TFFT_ADDR_TYPE size, TFFT_ADDR_TYPE dataSize,
+                               uint8_t f_write)
+{
+  pWrite->address = address;
+  pWrite->pHeader = pHeader;
+  pWrite->headerSize = headerSize;
+  pWrite->pData = pData;
+  pWrite->size = size;
+  pWrite->dataSize = dataSize;
+  pWrite->offset = 0;
+  pWrite->totalSize = TFFT_AreaSize(headerSize, size, dataSize);
+  pWrite->f_compare = (f_write == TFFT_RW_WRITE_COMPARE) || (f_write == TFFT_RW_WRITE && TFFT_COMPARE_BEFORE_WRITE);
+
+  // Range is checked once for the whole area instead of for every byte
+  if(pWrite->totalSize > 0 &&
+     (!TFFT_IS_ADDRESS_IN_RANGE(pInst, address) || !TFFT_IS_ADDRESS_IN_RANGE(pInst, address + pWrite->totalSize - 1)))
+  {
+    return(TFFT_RW_ERR_ADDRESS); // Address out of range
+  }
+
+#if TFFT_CHECKSUM_ENABLED
+  // The whole allocated memory is covered by the checksum. Data shorter
+  // than the file size is padded with zeros.
+  pWrite->checksum = 0;
+  TFFT_ChecksumUpdate(&pWrite->checksum, pHeader, headerSize);
+  TFFT_ChecksumUpdate(&pWrite->checksum, pData, size);
+  TFFT_ChecksumUpdate(&pWrite->checksum, 0, dataSize - size);
+#if TFFT_DEBUG_ENABLED
+  printf("Write checksum = 0x%04X\n", (unsigned int)pWrite->checksum);
+#endif
+#endif
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write the next page aligned chunk of an area. The write is done when
+   offset has reached totalSize.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_AreaWriteStep(TFFT_INSTANCE *pInst, TFFT_AREA_WRITE *pWrite)
+{
+  TFFT_ADDR_TYPE offset = pWrite->offset;
+  TFFT_ADDR_TYPE headerSize = pWrite->headerSize;
+  TFFT_ADDR_TYPE dataEnd = headerSize + pWrite->size;
+  TFFT_ADDR_TYPE len = TFFT_ChunkLength(pInst, pWrite->address, offset, pWrite->totalSize);
+  TFFT_ADDR_TYPE i;
+  TFFT_ADDR_TYPE pos;
+  TFFT_ADDR_TYPE written;
+  const uint8_t *pChunk;
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  int rtnCode;
+
+  // Chunks that only contain data are written directly from the callers
+  // buffer, all other chunks are put together in the page buffer.
+  if(offset >= headerSize && (offset + len) <= dataEnd)
+  {
+    pChunk = &pWrite->pData[offset - headerSize];
+  }
+  else
+  {
+    for(i = 0; i < len; i++)
+    {
+      pos = offset + i;
+      if(pos < headerSize)
+      {
+        au8_page[i] = pWrite->pHeader[pos];
+      }
+      else if(pos < dataEnd)
+      {
+        au8_page[i] = pWrite->pData[pos - headerSize];
+      }
+#if TFFT_CHECKSUM_ENABLED
+      else if(pos >= (headerSize + pWrite->dataSize))
+      {
+        // Checksum is stored least significant byte first
+        au8_page[i] = (uint8_t)(pWrite->checksum >> (8 * (pos - headerSize - pWrite->dataSize)));
+      }
+#endif
+      else
+      {
+        au8_page[i] = 0; // Padding
+      }
+    }
+    pChunk = au8_page;
+  }
+
+  if(pWrite->f_compare)
+  {
+    rtnCode = TFFT_LowLevelWriteChanged(pInst, pWrite->address + offset, pChunk, len, &written);
+  }
+  else
+  {
+    rtnCode = TFFT_LowLevelWrite(pInst, pWrite->address + offset, pChunk, len);
+    written = len;
+  }
+
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return(rtnCode); // Negative value
+  }
+
+  pInst->bytesWritten += written;
+  pInst->bytesSkipped += len - written;
+  pWrite->offset += len;
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write an area from/to EEPROM. See TFFT_AreaWriteBegin() for the
+   layout of an area. On read, only the first size bytes of data are
+   copied to pData.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_TransferArea(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, uint8_t *pHeader, TFFT_ADDR_TYPE headerSize,
+                             uint8_t *pData, TFFT_ADDR_TYPE size, TFFT_ADDR_TYPE dataSize, uint8_t f_write)
+{
+  TFFT_ADDR_TYPE dataEnd = headerSize + size;
+  TFFT_ADDR_TYPE totalSize;
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  TFFT_ADDR_TYPE i;
+  TFFT_ADDR_TYPE pos;
+  uint8_t *pChunk;
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  int rtnCode;
+
+#if TFFT_CHECKSUM_ENABLED
+  TFFT_ADDR_TYPE areaSize = headerSize + dataSize;
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_CHECKSUM_TYPE fileChecksum = 0;
+#endif
+
+  if(f_write)
+  {
+    TFFT_AREA_WRITE write;
+
+    rtnCode = TFFT_AreaWriteBegin(pInst, &write, address, pHeader, headerSize, pData, size, dataSize, f_write);
+
+    while(rtnCode == TFFT_RW_OK && write.offset < write.totalSize)
+    {
+      rtnCode = TFFT_AreaWriteStep(pInst, &write);
+    }
+
+    return rtnCode;
+  }
+
+  totalSize = TFFT_AreaSize(headerSize, size, dataSize);
+
+  // Range is checked once for the whole area instead of for every byte
+  if(totalSize > 0 && (!TFFT_IS_ADDRESS_IN_RANGE(pInst, address) || !TFFT_IS_ADDRESS_IN_RANGE(pInst, address + totalSize - 1)))
+  {
+    return(TFFT_RW_ERR_ADDRESS); // Address out of range
+  }
+
+  // Read header, data, padding and checksum in page aligned chunks.
+  // Chunks that only contain data are read directly to the callers
+  // buffer, all other chunks go through the page buffer.
+  for(offset = 0; offset < totalSize; offset += len)
+  {
+    len = TFFT_ChunkLength(pInst, address, offset, totalSize);
+
+    if(offset >= headerSize && (offset + len) <= dataEnd)
+    {
+      pChunk = &pData[offset - headerSize];
+    }
+    else
+    {
+      pChunk = au8_page;
+    }
+
+    rtnCode = TFFT_LowLevelRead(pInst, address + offset, pChunk, len);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return(rtnCode); // Negative value
+    }
+
+#if TFFT_CHECKSUM_ENABLED
+    if(offset < areaSize)
+    {
+      TFFT_ChecksumUpdate(&checksum, pChunk, ((offset + len) <= areaSize) ? len : (areaSize - offset));
+    }
+#endif
+    if(pChunk == au8_page)
+    {
+      for(i = 0; i < len; i++)
+      {
+        pos = offset + i;
+        if(pos < headerSize)
+        {
+          pHeader[pos] = au8_page[i];
+        }
+        else if(pos < dataEnd)
+        {
+          pData[pos - headerSize] = au8_page[i];
+        }
+#if TFFT_CHECKSUM_ENABLED
+        else if(pos >= areaSize)
+        {
+          fileChecksum |= ((TFFT_CHECKSUM_TYPE)au8_page[i] << (8 * (pos - areaSize)));
+        }
+#endif
+      }
+    }
+  }
+
+#if TFFT_CHECKSUM_ENABLED
+#if TFFT_DEBUG_ENABLED
+  printf("Read file checksum = 0x%04X\n", (unsigned int)fileChecksum);
+  printf("Read calculated checksum = 0x%04X\n", (unsigned int)checksum);
+#endif
+  if(fileChecksum != checksum)
+  {
+    return(TFFT_RW_ERR_CHECKSUM); // Checksum error
+  }
+#endif /* TFFT_CHECKSUM_ENABLED */
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check the requested size against the file table. Too large reads and
+   truncated writes are adjusted to the file size. Used by all whole file
+   reads and writes, so it also rejects array and log files. */
+static int TFFT_CheckFileSize(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE *pSize, uint8_t f_write, uint8_t f_truncate)
+{
+  if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_ARRAY || TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_LOG)
+  {
+    return(TFFT_RW_ERR_FILE_TYPE); // Array and log files have their own calls
+  }
+
+  // Is the size of the requested file to store larger than
+  // what has been reserved in the file table?
+  if(*pSize > TFFT_FILE_SIZE(pInst, fname))
+  {
+    if(f_write && !f_truncate)
+    {
+      return(TFFT_RW_ERR_FILE_TOO_LARGE); // Trying to write too large file
+    }
+    else // Write with truncated data or, if read, adjust length
+    {
+      *pSize = TFFT_FILE_SIZE(pInst, fname);
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+#if TFFT_BACKUP_MODE_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Read/Write file from/to EEPROM
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_ReadWriteFileInternal(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate, uint8_t f_duplicate)
+#else
+static int TFFT_ReadWriteFileInternal(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+#endif
+{
+  TFFT_ADDR_TYPE address;
+  int rtnCode;
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
+  }
+
+  rtnCode = TFFT_CheckFileSize(pInst, fname, &size, f_write, f_truncate);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  address = TFFT_GetAddress(pInst, fname);
+
+#if TFFT_BACKUP_MODE_ENABLED
+  // If the file to access is the duplicate (aka backup) file, then it will reside
+  // after the first (primary) file.
+  if(f_duplicate)
+  {
+    address += TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+  }
+#endif // TFFT_BACKUP_MODE_ENABLED
+
+  return TFFT_TransferArea(pInst, address, 0, 0, pData, size, TFFT_FILE_SIZE(pInst, fname), f_write);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Address of a slot in a ring file */
+static TFFT_ADDR_TYPE TFFT_RingSlotAddress(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t slot)
+{
+  return TFFT_GetAddress(pInst, fname) + slot * (TFFT_RING_HEADER_SIZE + TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname));
+}
+
+/*----------------------------------------------------------------------------*/
+/* Update the ring file state with a valid slot found by a scan. The
+   records reach from the oldest to the newest valid slot. */
+static void TFFT_RingSlotValid(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t slot, const uint8_t *pHeader)
+{
+  TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+  uint16_t seq = (uint16_t)(pHeader[0] | (pHeader[1] << 8));
+  uint16_t oldest = (uint16_t)(pState->seq - pState->records + 1);
+
+  // Sequence numbers wrap around, so compare the difference
+  if(!pState->f_valid)
+  {
+    pState->f_valid = 1;
+    pState->slot = slot;
+    pState->seq = seq;
+    pState->records = 1;
+  }
+  else if((int16_t)(seq - pState->seq) > 0)
+  {
+    pState->records = (uint16_t)(pState->records + (uint16_t)(seq - pState->seq));
+    pState->slot = slot;
+    pState->seq = seq;
+  }
+  else if((int16_t)(seq - oldest) < 0)
+  {
+    pState->records = (uint16_t)(pState->records + (uint16_t)(oldest - seq));
+  }
+
+  if(pState->records > TFFT_FILE_SLOTS(pInst, fname))
+  {
+    pState->records = TFFT_FILE_SLOTS(pInst, fname); // Slot left from another file table
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Find the newest valid slot of a ring file. Every slot is read and
+   verified, so this is only done once (at first access or by
+   TFFT_ScanRingFiles) and whenever the newest slot turns out to be bad. */
+static int TFFT_RingScan(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+  uint8_t au8_header[TFFT_RING_HEADER_SIZE];
+  uint16_t slot;
+  int rtnCode;
+
+  pState->f_scanned = 0;
+  pState->f_valid = 0;
+
+  for(slot = 0; slot < TFFT_FILE_SLOTS(pInst, fname); slot++)
+  {
+    // Read header only, but the whole slot to verify the checksum
+    rtnCode = TFFT_TransferArea(pInst, TFFT_RingSlotAddress(pInst, fname, slot), au8_header, TFFT_RING_HEADER_SIZE,
+                                0, 0, TFFT_FILE_SIZE(pInst, fname), TFFT_RW_READ);
+    if(rtnCode == TFFT_RW_ERR_CHECKSUM)
+    {
+      continue; // Slot never written or write interrupted
+    }
+    else if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    TFFT_RingSlotValid(pInst, fname, slot, au8_header);
+  }
+
+  pState->f_scanned = 1;
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get the slot to write next in a ring file and its header (sequence
+   number). The ring file must have been scanned. */
+static uint16_t TFFT_RingNextSlot(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint8_t *pHeader)
+{
+  TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+  uint16_t slot = 0;
+  uint16_t seq = 0;
+
+  if(pState->f_valid)
+  {
+    slot = (uint16_t)((pState->slot + 1) % TFFT_FILE_SLOTS(pInst, fname));
+    seq = (uint16_t)(pState->seq + 1);
+  }
+
+  pHeader[0] = (uint8_t)seq;
+  pHeader[1] = (uint8_t)(seq >> 8);
+
+  return slot;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Update the ring file state after writing a slot */
+static void TFFT_RingWriteDone(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t slot, const uint8_t *pHeader, int rtnCode)
+{
+  TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+
+  if(rtnCode == TFFT_RW_OK)
+  {
+    pState->records = pState->f_valid ? pState->records : 0;
+    if(pState->records < TFFT_FILE_SLOTS(pInst, fname))
+    {
+      pState->records++; // Else the oldest slot was overwritten
+    }
+    pState->f_valid = 1;
+    pState->slot = slot;
+    pState->seq = (uint16_t)(pHeader[0] | (pHeader[1] << 8));
+  }
+  else
+  {
+    pState->f_scanned = 0; // Unknown state of the slot, scan again next time
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write ring or log file with checked size. Writes go to the slot
+   after the newest one, reads are done from the newest valid slot. */
+static int TFFT_RingTransfer(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                             uint8_t *pData, uint8_t f_write)
+{
+  TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+  uint8_t au8_header[TFFT_RING_HEADER_SIZE];
+  uint16_t slot;
+  int rtnCode;
+
+  if(!pState->f_scanned)
+  {
+    rtnCode = TFFT_RingScan(pInst, fname);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+
+  if(f_write)
+  {
+    slot = TFFT_RingNextSlot(pInst, fname, au8_header);
+    rtnCode = TFFT_TransferArea(pInst, TFFT_RingSlotAddress(pInst, fname, slot), au8_header, TFFT_RING_HEADER_SIZE,
+                                pData, size, TFFT_FILE_SIZE(pInst, fname), f_write);
+    TFFT_RingWriteDone(pInst, fname, slot, au8_header, rtnCode);
+
+    return rtnCode;
+  }
+
+  if(!pState->f_valid)
+  {
+    return TFFT_RW_ERR_CHECKSUM; // No valid slot
+  }
+
+  rtnCode = TFFT_TransferArea(pInst, TFFT_RingSlotAddress(pInst, fname, pState->slot), au8_header, TFFT_RING_HEADER_SIZE,
+                              pData, size, TFFT_FILE_SIZE(pInst, fname), f_write);
+  if(rtnCode == TFFT_RW_ERR_CHECKSUM)
+  {
+    // Newest slot has gone bad. Fall back to the newest of the remaining slots.
+    TFFT_STATS_ADD(fname, checksumErrors, 1);
+    rtnCode = TFFT_RingScan(pInst, fname);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      rtnCode = pState->f_valid ? TFFT_TransferArea(pInst, TFFT_RingSlotAddress(pInst, fname, pState->slot), au8_header,
+                                                   TFFT_RING_HEADER_SIZE, pData, size, TFFT_FILE_SIZE(pInst, fname), f_write)
+                                : TFFT_RW_ERR_CHECKSUM;
+    }
+    if(rtnCode == TFFT_RW_OK)
+    {
+      TFFT_STATS_ADD(fname, backupReads, 1);
+    }
+  }
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write ring file */
+static int TFFT_RingReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                              uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  int rtnCode = TFFT_CheckFileSize(pInst, fname, &size, f_write, f_truncate);
+
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  return TFFT_RingTransfer(pInst, fname, size, pData, f_write);
+}
+
+#if TFFT_FLASH_ENABLED
+/* Start address of a sector of a flash instance */
+#define TFFT_FlashSectorAddress(pInst, sector) \
+  ((TFFT_ADDR_TYPE)((pInst)->startAddress + (uint32_t)(sector) * (pInst)->flashSectorSize))
+
+/* Number of sectors of a flash instance */
+#define TFFT_FlashSectorCount(pInst) \
+  ((uint16_t)(((uint32_t)(pInst)->endAddress - (pInst)->startAddress + 1) / (pInst)->flashSectorSize))
+
+/* Size of the record of a file */
+#define TFFT_FLASH_FILE_RECORD_SIZE(pInst, fname) ((TFFT_ADDR_TYPE)TFFT_FLASH_RECORD_SIZE(TFFT_FILE_SIZE(pInst, fname)))
+
+/*----------------------------------------------------------------------------*/
+/* Check if TFFT_Poll() is writing a record. The log must then not be
+   scanned or moved to a new sector, as the record would be lost. */
+static uint8_t TFFT_FlashAsyncBusy(TFFT_INSTANCE *pInst)
+{
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  return pInst->pAsyncActive && pInst->asyncWrite.offset < pInst->asyncWrite.totalSize;
+#else
+  (void)pInst;
+  return 0;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Program data to flash in page aligned chunks */
+static int TFFT_FlashProgram(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE size)
+{
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  int rtnCode;
+
+  for(offset = 0; offset < size; offset += len)
+  {
+    len = TFFT_ChunkLength(pInst, address, offset, size);
+    rtnCode = TFFT_LowLevelWrite(pInst, address + offset, &pData[offset], len);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+    pInst->bytesWritten += len;
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Find the active sector (newest complete one) and the newest valid record
+   of each file with one sequential read of the active sector. Everything
+   after the last record must be erased, else the sector is treated as full
+   and the next write starts a new sector.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_FlashScan(TFFT_INSTANCE *pInst)
+{
+  TFFT_ADDR_TYPE sectorSize = pInst->flashSectorSize;
+  TFFT_ADDR_TYPE sectorAddress;
+  TFFT_ADDR_TYPE recordStart = TFFT_FLASH_SECTOR_HEADER_SIZE; // Offsets in the sector
+  TFFT_ADDR_TYPE recordEnd = 0;
+  TFFT_ADDR_TYPE dataEnd = 0;
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  TFFT_ADDR_TYPE pos;
+  TFFT_ADDR_TYPE i;
+  TFFT_ADDR_TYPE n;
+  TFFT_FILE_NAME_TYPE fname;
+  uint8_t au8_chunk[TFFT_MOUNT_CHUNK_SIZE];
+  uint8_t f_erased = 0; // Past the last record
+  uint16_t sector;
+  uint16_t seq;
+  int rtnCode;
+#if TFFT_CHECKSUM_ENABLED
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_CHECKSUM_TYPE fileChecksum = 0;
+  TFFT_ADDR_TYPE j;
+#endif
+
+  if(TFFT_FlashAsyncBusy(pInst))
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  pInst->f_flashScanned = 0;
+  pInst->flashSector = TFFT_FLASH_NO_SECTOR;
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    pInst->pFlashIndex[fname] = 0;
+  }
+
+  for(sector = 0; sector < TFFT_FlashSectorCount(pInst); sector++)
+  {
+    rtnCode = TFFT_LowLevelRead(pInst, TFFT_FlashSectorAddress(pInst, sector), au8_chunk, TFFT_FLASH_SECTOR_HEADER_SIZE);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    // Sequence numbers wrap around, so compare the difference
+    seq = (uint16_t)(au8_chunk[1] | (au8_chunk[2] << 8));
+    if(au8_chunk[0] == TFFT_FLASH_SECTOR_MAGIC && au8_chunk[3] == TFFT_FLASH_SECTOR_COMPLETE &&
+       (pInst->flashSector == TFFT_FLASH_NO_SECTOR || (int16_t)(seq - pInst->flashSeq) > 0))
+    {
+      pInst->flashSector = sector;
+      pInst->flashSeq = seq;
+    }
+  }
+
+  pInst->flashWriteOffset = sectorSize; // Full until the erased end is found
+  pInst->f_flashScanned = 1;
+
+  if(pInst->flashSector == TFFT_FLASH_NO_SECTOR)
+  {
+    return TFFT_RW_OK; // Empty log, the first write starts a sector
+  }
+
+  sectorAddress = TFFT_FlashSectorAddress(pInst, pInst->flashSector);
+
+  for(offset = TFFT_FLASH_SECTOR_HEADER_SIZE; offset < sectorSize; offset += len)
+  {
+    len = (sectorSize - offset < TFFT_MOUNT_CHUNK_SIZE) ? (sectorSize - offset) : TFFT_MOUNT_CHUNK_SIZE;
+
+    rtnCode = TFFT_LowLevelRead(pInst, sectorAddress + offset, au8_chunk, len);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    for(i = 0; i < len; i += n)
+    {
+      pos = offset + i;
+      n = 1;
+
+      if(f_erased)
+      {
+        if(au8_chunk[i] != TFFT_FLASH_ERASED)
+        {
+          pInst->flashWriteOffset = sectorSize; // E.g. a write interrupted before the file name byte
+          return TFFT_RW_OK;
+        }
+        continue;
+      }
+
+      if(pos == recordStart)
+      {
+        fname = au8_chunk[i];
+        if(fname == TFFT_FLASH_ERASED)
+        {
+          f_erased = 1;
+          pInst->flashWriteOffset = pos;
+          continue;
+        }
+
+        if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) ||
+           (uint32_t)pos + TFFT_FLASH_FILE_RECORD_SIZE(pInst, fname) > sectorSize)
+        {
+          return TFFT_RW_OK; // Not a record, nothing after it can be trusted
+        }
+
+        dataEnd = pos + 1 + TFFT_FILE_SIZE(pInst, fname);
+        recordEnd = pos + TFFT_FLASH_FILE_RECORD_SIZE(pInst, fname);
+#if TFFT_CHECKSUM_ENABLED
+        checksum = 0;
+        fileChecksum = 0;
+#endif
+      }
+
+      // Piece of the chunk up to the next checksum/record boundary
+      n = ((pos < dataEnd) ? dataEnd : recordEnd) - pos;
+      n = (n < len - i) ? n : len - i;
+
+#if TFFT_CHECKSUM_ENABLED
+      if(pos < dataEnd)
+      {
+        TFFT_ChecksumUpdate(&checksum, &au8_chunk[i], n);
+      }
+      else
+      {
+        // Checksum is stored least significant byte first
+        for(j = 0; j < n; j++)
+        {
+          fileChecksum |= ((TFFT_CHECKSUM_TYPE)au8_chunk[i + j] << (8 * (pos + j - dataEnd)));
+        }
+      }
+#endif
+
+      if(pos + n == recordEnd)
+      {
+#if TFFT_CHECKSUM_ENABLED
+        if(checksum != fileChecksum)
+        {
+          TFFT_STATS_ADD(fname, checksumErrors, 1); // Older record of the file is used
+        }
+        else
+#endif
+        {
+          pInst->pFlashIndex[fname] = sectorAddress + recordStart;
+        }
+        recordStart = recordEnd;
+      }
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Start the next sector: erase it and copy the newest record of each file
+   to it. The sector is only marked complete when all records are copied, so
+   the current sector stays active if this is interrupted. The file being
+   written is copied too, so it is not lost if its new record is not
+   programmed afterwards.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_FlashCollect(TFFT_INSTANCE *pInst)
+{
+  TFFT_ADDR_TYPE sectorAddress;
+  TFFT_ADDR_TYPE writeOffset = TFFT_FLASH_SECTOR_HEADER_SIZE;
+  TFFT_ADDR_TYPE recordSize;
+  TFFT_ADDR_TYPE source;
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  TFFT_FILE_NAME_TYPE fname;
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE > TFFT_FLASH_SECTOR_HEADER_SIZE ? TFFT_EEPROM_PAGE_SIZE : TFFT_FLASH_SECTOR_HEADER_SIZE];
+  uint16_t sector = 0;
+  uint16_t seq = 0;
+  int rtnCode;
+
+  if(TFFT_FlashAsyncBusy(pInst))
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  if(!pInst->pDriver->eraseSector)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_ERASE;
+  }
+
+  if(pInst->flashSector != TFFT_FLASH_NO_SECTOR)
+  {
+    sector = (uint16_t)((pInst->flashSector + 1) % TFFT_FlashSectorCount(pInst));
+    seq = (uint16_t)(pInst->flashSeq + 1);
+  }
+  sectorAddress = TFFT_FlashSectorAddress(pInst, sector);
+
+  rtnCode = pInst->pDriver->eraseSector(pInst->pDevice, sectorAddress);
+  TFFT_COUNT_LOW_LEVEL(rtnCode);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  // Header without state, the state byte is left erased until complete
+  au8_page[0] = TFFT_FLASH_SECTOR_MAGIC;
+  au8_page[1] = (uint8_t)seq;
+  au8_page[2] = (uint8_t)(seq >> 8);
+  rtnCode = TFFT_FlashProgram(pInst, sectorAddress, au8_page, TFFT_FLASH_SECTOR_HEADER_SIZE - 1);
+
+  for(fname = 0; fname < pInst->pTable->fileCount && rtnCode == TFFT_RW_OK; fname++)
+  {
+    source = pInst->pFlashIndex[fname];
+    if(!source)
+    {
+      continue;
+    }
+
+    // Records are copied as they are, the checksum covers the file name
+    TFFT_VIEW_CHANGED(fname);
+    recordSize = TFFT_FLASH_FILE_RECORD_SIZE(pInst, fname);
+    for(offset = 0; offset < recordSize && rtnCode == TFFT_RW_OK; offset += len)
+    {
+      len = TFFT_ChunkLength(pInst, sectorAddress + writeOffset, offset, recordSize);
+      rtnCode = TFFT_LowLevelRead(pInst, source + offset, au8_page, len);
+      if(rtnCode == TFFT_RW_OK)
+      {
+        rtnCode = TFFT_FlashProgram(pInst, sectorAddress + writeOffset + offset, au8_page, len);
+      }
+    }
+
+    pInst->pFlashIndex[fname] = sectorAddress + writeOffset;
+    writeOffset += recordSize;
+  }
+
+  if(rtnCode == TFFT_RW_OK)
+  {
+    au8_page[0] = TFFT_FLASH_SECTOR_COMPLETE;
+    rtnCode = TFFT_FlashProgram(pInst, sectorAddress + TFFT_FLASH_SECTOR_HEADER_SIZE - 1, au8_page, 1);
+  }
+
+  if(rtnCode != TFFT_RW_OK)
+  {
+    pInst->f_flashScanned = 0; // Index is partly moved, scan again next time
+    return rtnCode;
+  }
+
+  pInst->flashSector = sector;
+  pInst->flashSeq = seq;
+  pInst->flashWriteOffset = writeOffset;
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Reserve room for a record of fname in the active sector, starting a new
+   sector if it does not fit. The address of the record is returned in
+   pAddress. */
+static int TFFT_FlashPrepareWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE *pAddress)
+{
+  TFFT_ADDR_TYPE recordSize = TFFT_FLASH_FILE_RECORD_SIZE(pInst, fname);
+  int rtnCode;
+
+  if(!pInst->f_flashScanned)
+  {
+    rtnCode = TFFT_FlashScan(pInst);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+
+  if(pInst->flashSector == TFFT_FLASH_NO_SECTOR ||
+     (uint32_t)pInst->flashWriteOffset + recordSize > pInst->flashSectorSize)
+  {
+    rtnCode = TFFT_FlashCollect(pInst);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+
+  *pAddress = TFFT_FlashSectorAddress(pInst, pInst->flashSector) + pInst->flashWriteOffset;
+  pInst->flashWriteOffset += recordSize;
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Update the index after writing a record */
+static void TFFT_FlashWriteDone(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address, int rtnCode)
+{
+  if(rtnCode == TFFT_RW_OK)
+  {
+    pInst->pFlashIndex[fname] = address;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write file of a flash instance. Writes append a record, reads are
+   done from the newest valid record. */
+static int TFFT_FlashReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                               uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  uint8_t au8_header[1];
+  TFFT_ADDR_TYPE address;
+  int rtnCode;
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
+  }
+
+  rtnCode = TFFT_CheckFileSize(pInst, fname, &size, f_write, f_truncate);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  if(f_write)
+  {
+    rtnCode = TFFT_FlashPrepareWrite(pInst, fname, &address);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      // The record is written to erased flash, so there is nothing to compare with
+      au8_header[0] = (uint8_t)fname;
+      rtnCode = TFFT_TransferArea(pInst, address, au8_header, 1, pData, size, TFFT_FILE_SIZE(pInst, fname), TFFT_RW_WRITE_ALWAYS);
+      TFFT_FlashWriteDone(pInst, fname, address, rtnCode);
+    }
+
+    return rtnCode;
+  }
+
+  if(!pInst->f_flashScanned)
+  {
+    rtnCode = TFFT_FlashScan(pInst);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+
+  address = pInst->pFlashIndex[fname];
+  if(!address)
+  {
+    return TFFT_RW_ERR_CHECKSUM; // No valid record
+  }
+
+  rtnCode = TFFT_TransferArea(pInst, address, au8_header, 1, pData, size, TFFT_FILE_SIZE(pInst, fname), f_write);
+  if(rtnCode == TFFT_RW_ERR_CHECKSUM)
+  {
+    // Newest record has gone bad. Fall back to the newest of the remaining records.
+    TFFT_STATS_ADD(fname, checksumErrors, 1);
+    rtnCode = TFFT_FlashScan(pInst);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      address = pInst->pFlashIndex[fname];
+      rtnCode = address ? TFFT_TransferArea(pInst, address, au8_header, 1, pData, size, TFFT_FILE_SIZE(pInst, fname), f_write)
+                        : TFFT_RW_ERR_CHECKSUM;
+    }
+    if(rtnCode == TFFT_RW_OK)
+    {
+      TFFT_STATS_ADD(fname, backupReads, 1);
+    }
+  }
+
+  return rtnCode;
+}
+#endif /* TFFT_FLASH_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Find the newest slot of all ring and log files. Optional, call at startup
+   to avoid the scan at the first access of each ring or log file. */
+int TFFT_InstScanRingFiles(TFFT_INSTANCE *pInst)
+{
+  TFFT_FILE_NAME_TYPE fname;
+  int rtnVal = TFFT_RW_OK;
+  int rtnCode;
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+#if TFFT_FLASH_ENABLED
+  if(TFFT_IS_FLASH(pInst))
+  {
+    rtnVal = TFFT_FlashScan(pInst); // All files are records in the log
+    TFFT_Unlock(pInst, 0);
+    return rtnVal;
+  }
+#endif
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    if(TFFT_FILE_IS_RING(pInst, fname))
+    {
+      rtnCode = TFFT_RingScan(pInst, fname);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        rtnVal = rtnCode;
+      }
+    }
+  }
+
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+}
+
+#define TFFT_UPDATE_ERROR_COUNT(fname, rtnVal) \
+  do{if((rtnVal)!=TFFT_RW_OK){pInst->errorCount++; \
+     if((rtnVal)==TFFT_RW_ERR_CHECKSUM) TFFT_STATS_ADD(TFFT_STATS_INDEX(fname), checksumErrors, 1);}}while(0)
+
+#if TFFT_REPAIR_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Rewrite the bad copy at address to with the first len bytes of the good
+   copy at address from. Only bytes that differ are written. The lock must
+   be held by the caller.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_RepairCopy(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE from,
+                           TFFT_ADDR_TYPE to, TFFT_ADDR_TYPE len)
+{
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE written;
+  int rtnCode = TFFT_RW_OK;
+
+  (void)fname; // Without statistics
+
+  for(offset = 0; offset < len && rtnCode == TFFT_RW_OK; offset += n)
+  {
+    n = TFFT_ChunkLength(pInst, to, offset, len);
+    rtnCode = TFFT_LowLevelRead(pInst, from + offset, au8_page, n);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      rtnCode = TFFT_LowLevelWriteChanged(pInst, to + offset, au8_page, n, &written);
+      pInst->bytesWritten += written;
+      pInst->bytesSkipped += (rtnCode == TFFT_RW_OK) ? n - written : 0;
+    }
+  }
+  TFFT_UPDATE_ERROR_COUNT(fname, rtnCode);
+
+  if(rtnCode == TFFT_RW_OK)
+  {
+    pInst->repair.repairs++;
+    TFFT_STATS_ADD(fname, repairs, 1);
+  }
+
+  return rtnCode;
+}
+#endif /* TFFT_REPAIR_ENABLED */
+
+#if TFFT_PACK_ENABLED
+/* Bytes of one copy of a packed file: length, compressed data and checksum */
+#define TFFT_PACK_COPY_SIZE(pInst, fname) (TFFT_PACK_HEADER_SIZE + TFFT_FILE_SLOTS(pInst, fname) + TFFT_CHECKSUM_SIZE)
+
+/*----------------------------------------------------------------------------*/
+/* Compress size bytes of pData to pOut (PackBits style run length coding).
+   Trailing zeros are dropped, they are restored when read. A control byte
+   below 0x80 is followed by control + 1 literal bytes, a control byte of
+   0x80 and above by one byte that is repeated (control & 0x7F) + 3 times.
+   Returns the compressed length, or TFFT_RW_ERR_FILE_TOO_LARGE if it is
+   larger than capacity */
+static int TFFT_PackEncode(const uint8_t *pData, uint32_t size, uint8_t *pOut, uint32_t capacity)
+{
+  uint32_t in = 0;
+  uint32_t out = 0;
+  uint32_t start;
+  uint32_t run;
+
+  while(size > 0 && pData[size - 1] == 0)
+  {
+    size--;
+  }
+
+  while(in < size)
+  {
+    for(run = 1; in + run < size && run < 130 && pData[in + run] == pData[in]; run++)
+    {
+    }
+
+    if(run >= 3)
+    {
+      if(out + 2 > capacity)
+      {
+        return TFFT_RW_ERR_FILE_TOO_LARGE;
+      }
+      pOut[out++] = (uint8_t)(0x80 | (run - 3));
+      pOut[out++] = pData[in];
+      in += run;
+    }
+    else
+    {
+      // Literal bytes up to the next run of three
+      start = in;
+      do
+      {
+        in++;
+      } while(in < size && in - start < 128 &&
+              !(in + 2 < size && pData[in] == pData[in + 1] && pData[in] == pData[in + 2]));
+
+      if(out + 1 + (in - start) > capacity)
+      {
+        return TFFT_RW_ERR_FILE_TOO_LARGE;
+      }
+      pOut[out++] = (uint8_t)(in - start - 1);
+      while(start < in)
+      {
+        pOut[out++] = pData[start++];
+      }
+    }
+  }
+
+  return (int)out;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Decompress len bytes of pIn. The first size bytes of the fileSize bytes
+   of the file are copied to pData, bytes after the compressed data are zero.
+   Returns TFFT_RW_OK, or TFFT_RW_ERR_CHECKSUM if the data is malformed */
+static int TFFT_PackDecode(const uint8_t *pIn, uint32_t len, uint8_t *pData, uint32_t size, uint32_t fileSize)
+{
+  uint32_t in = 0;
+  uint32_t pos = 0;
+  uint32_t n;
+  uint8_t control;
+
+  while(in < len)
+  {
+    control = pIn[in++];
+    n = (control < 0x80) ? (uint32_t)control + 1 : (uint32_t)(control & 0x7F) + 3;
+
+    if(((control < 0x80) ? in + n : in + 1) > len || pos + n > fileSize)
+    {
+      return(TFFT_RW_ERR_CHECKSUM); // Stored with another file table or corrupted
+    }
+
+    for(; n > 0; n--, pos++)
+    {
+      if(pos < size)
+      {
+        pData[pos] = pIn[in];
+      }
+      in += (control < 0x80);
+    }
+    in += (control >= 0x80);
+  }
+
+  for(; pos < size; pos++)
+  {
+    pData[pos] = 0;
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read one copy of a packed file to the pack buffer. Only the stored
+   length and compressed data are read.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_PackReadCopy(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint8_t copy, uint32_t *pLen)
+{
+  TFFT_ADDR_TYPE address = TFFT_GetAddress(pInst, fname) + copy * TFFT_PACK_COPY_SIZE(pInst, fname);
+  uint8_t au8_header[TFFT_PACK_HEADER_SIZE];
+  int rtnCode;
+
+  rtnCode = TFFT_LowLevelRead(pInst, address, au8_header, TFFT_PACK_HEADER_SIZE);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  *pLen = (uint32_t)(au8_header[0] | (au8_header[1] << 8));
+  if(*pLen > TFFT_FILE_SLOTS(pInst, fname))
+  {
+    return(TFFT_RW_ERR_CHECKSUM); // Never written or corrupted length
+  }
+
+  return TFFT_TransferArea(pInst, address, au8_header, TFFT_PACK_HEADER_SIZE, pInst->pPackBuffer,
+                           (TFFT_ADDR_TYPE)*pLen, (TFFT_ADDR_TYPE)*pLen, TFFT_RW_READ);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write a packed file from/to EEPROM without going through the cache.
+   Data is compressed once and written to each copy, reads fall back to the
+   backup copy. The lock must be held by the caller.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_PackReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                              uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  uint8_t au8_header[TFFT_PACK_HEADER_SIZE];
+  uint32_t len;
+  uint8_t copy;
+  int rtnCode;
+  int rtnVal;
+#if TFFT_REPAIR_ENABLED
+  int rtnFirst = TFFT_RW_OK;
+#endif
+
+  rtnVal = TFFT_CheckFileSize(pInst, fname, &size, f_write, f_truncate);
+  if(rtnVal != TFFT_RW_OK)
+  {
+    return rtnVal;
+  }
+
+  if(f_write)
+  {
+    rtnVal = TFFT_PackEncode(pData, size, pInst->pPackBuffer, TFFT_FILE_SLOTS(pInst, fname));
+    if(rtnVal < 0)
+    {
+      return rtnVal; // Does not fit in the bytes reserved for the file
+    }
+    len = (uint32_t)rtnVal;
+    au8_header[0] = (uint8_t)len;
+    au8_header[1] = (uint8_t)(len >> 8);
+
+    // Write backup copy also if the first copy failed, report the first error
+    rtnVal = TFFT_RW_OK;
+    for(copy = 0; copy <= TFFT_BACKUP_MODE_ENABLED; copy++)
+    {
+      rtnCode = TFFT_TransferArea(pInst, TFFT_GetAddress(pInst, fname) + copy * TFFT_PACK_COPY_SIZE(pInst, fname),
+                                  au8_header, TFFT_PACK_HEADER_SIZE, pInst->pPackBuffer,
+                                  (TFFT_ADDR_TYPE)len, (TFFT_ADDR_TYPE)len, f_write);
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnCode);
+      if(rtnVal == TFFT_RW_OK)
+      {
+        rtnVal = rtnCode;
+      }
+    }
+
+    if(rtnVal == TFFT_RW_OK)
+    {
+      TFFT_STATS_ADD(fname, packedBytes, TFFT_FILE_SIZE(pInst, fname));
+      TFFT_STATS_ADD(fname, storedBytes, TFFT_PACK_HEADER_SIZE + len);
+    }
+
+    return rtnVal;
+  }
+
+  // The backup copy is read if the first copy is bad
+  for(copy = 0; copy <= TFFT_BACKUP_MODE_ENABLED; copy++)
+  {
+    rtnVal = TFFT_PackReadCopy(pInst, fname, copy, &len);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      rtnVal = TFFT_PackDecode(pInst->pPackBuffer, len, pData, size, TFFT_FILE_SIZE(pInst, fname));
+    }
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+
+    if(rtnVal == TFFT_RW_OK)
+    {
+      if(copy > 0)
+      {
+        TFFT_STATS_ADD(fname, backupReads, 1);
+#if TFFT_REPAIR_ENABLED
+        if(rtnFirst == TFFT_RW_ERR_CHECKSUM)
+        {
+          // Rewrite the bad first copy, the data read is good anyway
+          (void)TFFT_RepairCopy(pInst, fname, TFFT_GetAddress(pInst, fname) + TFFT_PACK_COPY_SIZE(pInst, fname),
+                                TFFT_GetAddress(pInst, fname),
+                                (TFFT_ADDR_TYPE)(TFFT_PACK_HEADER_SIZE + len + TFFT_CHECKSUM_SIZE));
+        }
+#endif
+      }
+      break;
+    }
+#if TFFT_REPAIR_ENABLED
+    rtnFirst = rtnVal;
+#endif
+  }
+
+  return rtnVal;
+}
+#endif /* TFFT_PACK_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write file from/to EEPROM without going through the cache.
+   The lock must be held by the caller. */
+static int TFFT_DeviceReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                                uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  int rtnVal;
+
+  TFFT_STATS_SET_FILE(fname);
+  if(f_write)
+  {
+    TFFT_VIEW_CHANGED(fname);
+  }
+
+#if TFFT_FLASH_ENABLED
+  if(TFFT_IS_FLASH(pInst))
+  {
+    // All file types are records in the log, older records act as backup
+    rtnVal = TFFT_FlashReadWrite(pInst, fname, size, pData, f_write, f_truncate);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+  }
+  else
+#endif
+  if(TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) && TFFT_FILE_IS_RING(pInst, fname))
+  {
+    // Ring files are not duplicated in backup mode, older slots act as backup
+    rtnVal = TFFT_RingReadWrite(pInst, fname, size, pData, f_write, f_truncate);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+  }
+#if TFFT_PACK_ENABLED
+  else if(TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) && TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+  {
+    // Compressed, with its own backup copy
+    rtnVal = TFFT_PackReadWrite(pInst, fname, size, pData, f_write, f_truncate);
+  }
+#endif
+  else
+  {
+#if TFFT_BACKUP_MODE_ENABLED
+    // Write/Read first copy
+    rtnVal = TFFT_ReadWriteFileInternal(pInst, fname, size, pData, f_write, f_truncate, 0);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+
+    if(f_write)
+    {
+      // Write second copy (backup)
+      rtnVal = TFFT_ReadWriteFileInternal(pInst, fname, size, pData, f_write, f_truncate, 1);
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    }
+    else if(rtnVal != TFFT_RW_OK)
+    {
+#if TFFT_REPAIR_ENABLED
+      int rtnFirst = rtnVal;
+
+#endif
+#if TFFT_DEBUG_ENABLED
+      printf("rtnVal = %d\n", rtnVal);
+#endif
+      // There was an error reading the first copy, read the backup copy.
+      rtnVal = TFFT_ReadWriteFileInternal(pInst, fname, size, pData, f_write, f_truncate, 1);
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+      if(rtnVal == TFFT_RW_OK)
+      {
+        TFFT_STATS_ADD(fname, backupReads, 1);
+#if TFFT_REPAIR_ENABLED
+        if(rtnFirst == TFFT_RW_ERR_CHECKSUM)
+        {
+          // Rewrite the bad first copy, the data read is good anyway
+          (void)TFFT_RepairCopy(pInst, fname, TFFT_GetAddress(pInst, fname) + TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname),
+                                TFFT_GetAddress(pInst, fname), TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname));
+        }
+#endif
+      }
+    }
+#else
+    rtnVal = TFFT_ReadWriteFileInternal(pInst, fname, size, pData, f_write, f_truncate);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+#endif // TFFT_BACKUP_MODE_ENABLED
+  }
+
+  TFFT_STATS_CLEAR_FILE();
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Address of a copy of an element of an array file. Each element is stored
+   as a normal file, followed by its backup copy in backup mode. */
+static TFFT_ADDR_TYPE TFFT_ArrayElementAddress(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t index, uint8_t copy)
+{
+  return TFFT_GetAddress(pInst, fname) +
+         ((TFFT_ADDR_TYPE)index * (1 + TFFT_BACKUP_MODE_ENABLED) + copy) * TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write count elements of an array file from/to EEPROM without going
+   through the cache, starting at element first. Only these elements are
+   read (and verified) or written. The range must have been checked and
+   the lock must be held by the caller.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred (stops at the first bad element) */
+static int TFFT_ArrayReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count,
+                               uint8_t *pData, uint8_t f_write)
+{
+  TFFT_ADDR_TYPE size = TFFT_FILE_SIZE(pInst, fname);
+  uint16_t index;
+  int rtnVal = TFFT_RW_OK;
+
+  TFFT_STATS_SET_FILE(fname);
+  if(f_write)
+  {
+    TFFT_VIEW_CHANGED(fname);
+  }
+
+  for(index = first; index < first + count && rtnVal == TFFT_RW_OK; index++, pData += size)
+  {
+    rtnVal = TFFT_TransferArea(pInst, TFFT_ArrayElementAddress(pInst, fname, index, 0), 0, 0, pData, size, size, f_write);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+
+#if TFFT_BACKUP_MODE_ENABLED
+    if(f_write)
+    {
+      // Write backup copy also if the first copy failed, report the first error
+      int rtnCode = TFFT_TransferArea(pInst, TFFT_ArrayElementAddress(pInst, fname, index, 1), 0, 0, pData, size, size, f_write);
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnCode);
+      if(rtnVal == TFFT_RW_OK)
+      {
+        rtnVal = rtnCode;
+      }
+    }
+    else if(rtnVal != TFFT_RW_OK)
+    {
+#if TFFT_REPAIR_ENABLED
+      int rtnFirst = rtnVal;
+
+#endif
+      // There was an error reading the first copy, read the backup copy.
+      rtnVal = TFFT_TransferArea(pInst, TFFT_ArrayElementAddress(pInst, fname, index, 1), 0, 0, pData, size, size, f_write);
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+      if(rtnVal == TFFT_RW_OK)
+      {
+        TFFT_STATS_ADD(fname, backupReads, 1);
+#if TFFT_REPAIR_ENABLED
+        if(rtnFirst == TFFT_RW_ERR_CHECKSUM)
+        {
+          // Rewrite the bad first copy of the element
+          (void)TFFT_RepairCopy(pInst, fname, TFFT_ArrayElementAddress(pInst, fname, index, 1),
+                                TFFT_ArrayElementAddress(pInst, fname, index, 0), TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname));
+        }
+#endif
+      }
+    }
+#endif // TFFT_BACKUP_MODE_ENABLED
+  }
+
+  TFFT_STATS_CLEAR_FILE();
+
+  return rtnVal;
+}
+
+#if TFFT_REPAIR_ENABLED
+/* Number of elements of a file, each has two copies */
+#define TFFT_REPAIR_ELEMENTS(pInst, fname) \
+  ((TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_ARRAY) ? TFFT_FILE_SLOTS(pInst, fname) : 1)
+
+/* A completely verified copy is valid */
+#define TFFT_COPY_VALID(pVerify) ((pVerify)->f_lengthValid && (pVerify)->checksum == (pVerify)->fileChecksum)
+
+/*----------------------------------------------------------------------------*/
+/* Address of a copy of a normal or packed file or of an array element */
+static TFFT_ADDR_TYPE TFFT_CopyAddress(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t element, uint8_t copy)
+{
+#if TFFT_PACK_ENABLED
+  if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+  {
+    return TFFT_GetAddress(pInst, fname) + copy * TFFT_PACK_COPY_SIZE(pInst, fname);
+  }
+#endif
+
+  return TFFT_ArrayElementAddress(pInst, fname, element, copy);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Verify the next page aligned chunk, at most maxBytes (not 0), of the copy
+   at address. pVerify->offset must be 0 at the start of the copy, which is
+   completely verified when the offset has reached pVerify->areaEnd.
+   Returns the number of bytes read or a negative value
+   indicating that an error occurred */
+static int TFFT_VerifyCopyStep(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address,
+                               TFFT_COPY_VERIFY *pVerify, uint32_t maxBytes)
+{
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  TFFT_ADDR_TYPE len;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE i;
+  int bytesRead = 0;
+  int rtnCode;
+
+  if(pVerify->offset == 0)
+  {
+    pVerify->checksum = 0;
+    pVerify->fileChecksum = 0;
+    pVerify->f_lengthValid = 1;
+    pVerify->dataEnd = TFFT_FILE_SIZE(pInst, fname);
+#if TFFT_PACK_ENABLED
+    if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+    {
+      // Only the compressed data is covered by the checksum
+      rtnCode = TFFT_LowLevelRead(pInst, address, au8_page, TFFT_PACK_HEADER_SIZE);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        return rtnCode;
+      }
+      bytesRead = TFFT_PACK_HEADER_SIZE;
+
+      n = (TFFT_ADDR_TYPE)(au8_page[0] | (au8_page[1] << 8));
+      if(n > TFFT_FILE_SLOTS(pInst, fname))
+      {
+        pVerify->f_lengthValid = 0; // Never written or corrupted length
+        pVerify->areaEnd = 0;
+        return bytesRead;
+      }
+      pVerify->dataEnd = TFFT_PACK_HEADER_SIZE + n;
+    }
+#endif
+    pVerify->areaEnd = pVerify->dataEnd + TFFT_CHECKSUM_SIZE;
+  }
+
+  len = TFFT_ChunkLength(pInst, address, pVerify->offset, pVerify->areaEnd);
+  len = (len > maxBytes) ? (TFFT_ADDR_TYPE)maxBytes : len;
+  rtnCode = TFFT_LowLevelRead(pInst, address + pVerify->offset, au8_page, len);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  // Data (and header), then the stored checksum least significant byte first
+  n = (pVerify->offset < pVerify->dataEnd) ? pVerify->dataEnd - pVerify->offset : 0;
+  n = (n < len) ? n : len;
+  TFFT_ChecksumUpdate(&pVerify->checksum, au8_page, n);
+  for(i = n; i < len; i++)
+  {
+    pVerify->fileChecksum |= ((TFFT_CHECKSUM_TYPE)au8_page[i] << (8 * (pVerify->offset + i - pVerify->dataEnd)));
+  }
+  pVerify->offset += len;
+
+  return bytesRead + (int)len;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Verify both copies of a normal or packed file or of an array element and
+   rewrite a bad copy from the good one. The lock must be held by the caller.
+   Returns TFFT_RW_OK if both copies are valid (after the repair),
+   TFFT_RW_ERR_CHECKSUM if no copy is valid or another negative value
+   indicating that an error occurred */
+static int TFFT_RepairElement(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t element)
+{
+  TFFT_COPY_VERIFY verify[2];
+  uint8_t copy;
+  int rtnCode;
+
+  for(copy = 0; copy < 2; copy++)
+  {
+    verify[copy].offset = 0;
+    do
+    {
+      rtnCode = TFFT_VerifyCopyStep(pInst, fname, TFFT_CopyAddress(pInst, fname, element, copy),
+                                    &verify[copy], pInst->pageSize);
+      if(rtnCode < 0)
+      {
+        TFFT_UPDATE_ERROR_COUNT(fname, rtnCode);
+        return rtnCode;
+      }
+    } while(verify[copy].offset < verify[copy].areaEnd);
+  }
+
+  if(TFFT_COPY_VALID(&verify[0]) == TFFT_COPY_VALID(&verify[1]))
+  {
+    return TFFT_COPY_VALID(&verify[0]) ? TFFT_RW_OK : TFFT_RW_ERR_CHECKSUM;
+  }
+
+  // The good copy
+  copy = TFFT_COPY_VALID(&verify[0]) ? 0 : 1;
+
+  return TFFT_RepairCopy(pInst, fname, TFFT_CopyAddress(pInst, fname, element, copy),
+                         TFFT_CopyAddress(pInst, fname, element, copy ^ 1), verify[copy].areaEnd);
+}
+#endif /* TFFT_REPAIR_ENABLED */
+
+#if TFFT_CACHE_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Write a dirty file from the cache to EEPROM. Lock must be held. */
+static int TFFT_CacheFlushFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  int rtnVal = TFFT_RW_OK;
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  if(TFFT_AsyncFind(pInst, fname))
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY; // Flush when the queued write is done
+  }
+#endif
+
+  if(TFFT_BIT_GET(pInst->pCacheDirty, fname))
+  {
+    rtnVal = TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_WRITE, 0);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      TFFT_BIT_CLR(pInst->pCacheDirty, fname);
+    }
+  }
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write all dirty files from the cache to EEPROM. Lock must be held. */
+static int TFFT_CacheFlushAll(TFFT_INSTANCE *pInst)
+{
+  TFFT_FILE_NAME_TYPE fname;
+  int rtnVal = TFFT_RW_OK;
+  int rtnCode;
+
+  if(pInst->f_cacheDirty)
+  {
+    for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+    {
+      rtnCode = TFFT_CacheFlushFile(pInst, fname);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        rtnVal = rtnCode;
+      }
+    }
+
+    if(rtnVal == TFFT_RW_OK)
+    {
+      pInst->f_cacheDirty = 0;
+    }
+  }
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read a file that is valid in the cache. Only reads internal state, so a
+   shared lock is enough. Returns 1 if read, 0 if the file must be read with
+   TFFT_CacheReadWrite() (not cached, flush due or invalid file name). */
+static uint8_t TFFT_CacheReadShared(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, uint8_t *pData)
+{
+  const uint8_t *pCache;
+  TFFT_SIZE_TYPE i;
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) || !TFFT_BIT_GET(pInst->pCacheValid, fname) ||
+     TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_ARRAY)
+  {
+    return 0;
+  }
+
+#if defined(TFFT_GET_TIME_FUNC) && TFFT_CACHE_MAX_DIRTY_AGE > 0
+  if(pInst->f_cacheDirty && (uint32_t)(TFFT_GET_TIME_FUNC() - pInst->cacheDirtySince) >= TFFT_CACHE_MAX_DIRTY_AGE)
+  {
+    return 0;
+  }
+#endif
+
+  if(size > TFFT_FILE_SIZE(pInst, fname))
+  {
+    size = TFFT_FILE_SIZE(pInst, fname);
+  }
+
+  pCache = TFFT_GetCacheData(pInst, fname);
+  for(i = 0; i < size; i++)
+  {
+    pData[i] = pCache[i];
+  }
+
+  return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write file from/to the RAM cache. Files are loaded from EEPROM (and
+   verified) at the first read. Writes are only done to the cache and are
+   written to EEPROM by TFFT_Flush(), TFFT_FlushFile() or when the oldest
+   unwritten data is older than TFFT_CACHE_MAX_DIRTY_AGE. */
+static int TFFT_CacheReadWrite(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                               uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  uint8_t *pCache;
+  TFFT_SIZE_TYPE i;
+  uint8_t f_changed;
+  int rtnVal;
+
+#if defined(TFFT_GET_TIME_FUNC) && TFFT_CACHE_MAX_DIRTY_AGE > 0
+  if(pInst->f_cacheDirty && (uint32_t)(TFFT_GET_TIME_FUNC() - pInst->cacheDirtySince) >= TFFT_CACHE_MAX_DIRTY_AGE)
+  {
+    (void)TFFT_CacheFlushAll(pInst); // Errors are counted, file stays dirty
+  }
+#endif
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    rtnVal = TFFT_RW_ERR_FILE_NAME; // File name not allowed
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    return rtnVal;
+  }
+
+  rtnVal = TFFT_CheckFileSize(pInst, fname, &size, f_write, f_truncate);
+#if TFFT_PACK_ENABLED
+  if(rtnVal == TFFT_RW_OK && f_write && TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+  {
+    // Fail now if the data does not compress enough, not when it is flushed
+    rtnVal = TFFT_PackEncode(pData, size, pInst->pPackBuffer, TFFT_FILE_SLOTS(pInst, fname));
+    rtnVal = (rtnVal < 0) ? rtnVal : TFFT_RW_OK;
+  }
+#endif
+  if(rtnVal != TFFT_RW_OK)
+  {
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    return rtnVal;
+  }
+
+  pCache = TFFT_GetCacheData(pInst, fname);
+
+  if(f_write)
+  {
+    TFFT_VIEW_CHANGED(fname);
+
+    // Only mark as dirty if the file content really changes
+    f_changed = !TFFT_BIT_GET(pInst->pCacheValid, fname);
+    for(i = 0; i < TFFT_FILE_SIZE(pInst, fname); i++)
+    {
+      uint8_t byte = (i < size) ? pData[i] : 0; // Padding
+
+      if(pCache[i] != byte)
+      {
+        pCache[i] = byte;
+        f_changed = 1;
+      }
+    }
+
+    TFFT_BIT_SET(pInst->pCacheValid, fname);
+
+    if(f_changed)
+    {
+      TFFT_BIT_SET(pInst->pCacheDirty, fname);
+      if(!pInst->f_cacheDirty)
+      {
+        pInst->f_cacheDirty = 1;
+#ifdef TFFT_GET_TIME_FUNC
+        pInst->cacheDirtySince = TFFT_GET_TIME_FUNC();
+#endif
+      }
+    }
+  }
+  else // Read
+  {
+    if(!TFFT_BIT_GET(pInst->pCacheValid, fname))
+    {
+      rtnVal = TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), pCache, TFFT_RW_READ, 0);
+      if(rtnVal != TFFT_RW_OK)
+      {
+        return rtnVal;
+      }
+      TFFT_BIT_SET(pInst->pCacheValid, fname);
+    }
+
+    for(i = 0; i < size; i++)
+    {
+      pData[i] = pCache[i];
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+#endif /* TFFT_CACHE_ENABLED */
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+/*----------------------------------------------------------------------------*/
+/* Find the newest queued or active asynchronous write of a file */
+static TFFT_ASYNC_ENTRY* TFFT_AsyncFind(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  TFFT_ASYNC_ENTRY *pFound = 0;
+  uint8_t i;
+
+  for(i = 0; i < TFFT_ASYNC_QUEUE_SIZE; i++)
+  {
+    if(pInst->asyncQueue[i].f_used && pInst->asyncQueue[i].fname == fname &&
+       (!pFound || pFound == pInst->pAsyncActive))
+    {
+      pFound = &pInst->asyncQueue[i];
+    }
+  }
+
+  return pFound;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Returns 1 if any asynchronous write is queued or in progress */
+static uint8_t TFFT_AsyncPending(TFFT_INSTANCE *pInst)
+{
+  uint8_t i;
+
+  for(i = 0; i < TFFT_ASYNC_QUEUE_SIZE; i++)
+  {
+    if(pInst->asyncQueue[i].f_used)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Start writing the current copy of the active asynchronous write */
+static int TFFT_AsyncBeginCopy(TFFT_INSTANCE *pInst)
+{
+  TFFT_ASYNC_ENTRY *pEntry = pInst->pAsyncActive;
+  TFFT_FILE_NAME_TYPE fname = pEntry->fname;
+  int rtnCode;
+#if TFFT_FLASH_ENABLED
+  TFFT_ADDR_TYPE address;
+
+  if(TFFT_IS_FLASH(pInst))
+  {
+    pInst->asyncWrite.totalSize = 0; // No record in progress while preparing
+    rtnCode = TFFT_FlashPrepareWrite(pInst, fname, &address);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    pInst->asyncHeader[0] = (uint8_t)fname;
+    return TFFT_AreaWriteBegin(pInst, &pInst->asyncWrite, address, pInst->asyncHeader, 1,
+                               TFFT_GetAsyncData(pInst, pEntry), pEntry->size, TFFT_FILE_SIZE(pInst, fname), TFFT_RW_WRITE_ALWAYS);
+  }
+#endif
+
+  if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_RING)
+  {
+    if(!TFFT_GetRingState(pInst, fname)->f_scanned)
+    {
+      rtnCode = TFFT_RingScan(pInst, fname);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        return rtnCode;
+      }
+    }
+
+    pInst->asyncSlot = TFFT_RingNextSlot(pInst, fname, pInst->asyncHeader);
+    return TFFT_AreaWriteBegin(pInst, &pInst->asyncWrite, TFFT_RingSlotAddress(pInst, fname, pInst->asyncSlot),
+                               pInst->asyncHeader, TFFT_RING_HEADER_SIZE,
+                               TFFT_GetAsyncData(pInst, pEntry), pEntry->size, TFFT_FILE_SIZE(pInst, fname), TFFT_RW_WRITE);
+  }
+
+  return TFFT_AreaWriteBegin(pInst, &pInst->asyncWrite,
+                             TFFT_GetAddress(pInst, fname) + pInst->asyncCopy * TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname),
+                             0, 0, TFFT_GetAsyncData(pInst, pEntry), pEntry->size, TFFT_FILE_SIZE(pInst, fname), TFFT_RW_WRITE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Queue a write of a file. The data is copied, so the callers buffer may be
+   reused directly. The write is done one chunk (page) at a time by
+   TFFT_Poll(). Higher priority writes are done first, writes with the same
+   priority in queue order. A queued write of the same file that has not
+   been started yet is replaced by the new data; its callback is called with
+   TFFT_RW_OK. Reads of a file with a queued write return the queued data.
+   The callback (optional) is called when the write is done. Packed files
+   are compressed when written, so they can not be queued.
+   Returns TFFT_RW_OK if queued, TFFT_RW_ERR_QUEUE_FULL if the queue is full
+   or another negative value indicating that an error occurred */
+int TFFT_InstWriteAsync(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, const void *pData,
+                    uint8_t priority, TFFT_ASYNC_CALLBACK callback)
+{
+  TFFT_ASYNC_ENTRY *pEntry;
+  TFFT_ASYNC_CALLBACK replacedCallback = 0;
+  TFFT_SIZE_TYPE i;
+  int rtnVal;
+  uint8_t n;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return TFFT_RW_ERR_FILE_NAME;
+  }
+
+  if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+  {
+    return TFFT_RW_ERR_FILE_TYPE;
+  }
+
+  rtnVal = TFFT_CheckFileSize(pInst, fname, &size, TFFT_RW_WRITE, 0);
+  if(rtnVal != TFFT_RW_OK)
+  {
+    return rtnVal;
+  }
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    TFFT_STATS_CALL(fname, size, TFFT_RW_WRITE, TFFT_RW_ERR_EEPROM_BUSY, startTime);
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  pEntry = TFFT_AsyncFind(pInst, fname);
+  if(pEntry && pEntry != pInst->pAsyncActive)
+  {
+    replacedCallback = pEntry->callback; // Replace queued write
+  }
+  else
+  {
+    pEntry = 0;
+    for(n = 0; n < TFFT_ASYNC_QUEUE_SIZE && !pEntry; n++)
+    {
+      if(!pInst->asyncQueue[n].f_used)
+      {
+        pEntry = &pInst->asyncQueue[n];
+      }
+    }
+  }
+
+  if(pEntry)
+  {
+    TFFT_VIEW_CHANGED(fname);
+    pEntry->callback = callback;
+    pEntry->order = pInst->asyncOrder++;
+    pEntry->size = size;
+    pEntry->fname = fname;
+    pEntry->priority = priority;
+    pEntry->f_used = 1;
+    for(i = 0; i < size; i++)
+    {
+      TFFT_GetAsyncData(pInst, pEntry)[i] = ((const uint8_t*)pData)[i];
+    }
+
+#if TFFT_CACHE_ENABLED
+    // The cache gets the new data directly. It does not need to be flushed
+    // since the queued write will write the same data.
+    for(i = 0; i < TFFT_FILE_SIZE(pInst, fname); i++)
+    {
+      TFFT_GetCacheData(pInst, fname)[i] = (i < size) ? TFFT_GetAsyncData(pInst, pEntry)[i] : 0;
+    }
+    TFFT_BIT_SET(pInst->pCacheValid, fname);
+    TFFT_BIT_CLR(pInst->pCacheDirty, fname);
+#endif
+  }
+  else
+  {
+    rtnVal = TFFT_RW_ERR_QUEUE_FULL;
+  }
+
+  TFFT_TRACE(TFFT_TRACE_WRITE_ASYNC, fname, size, rtnVal, startTime, 0);
+  TFFT_Unlock(pInst, 0);
+
+#if TFFT_STATS_ENABLED
+  if(rtnVal != TFFT_RW_OK)
+  {
+    TFFT_StatsCall(pInst, fname, size, TFFT_RW_WRITE, rtnVal, startTime); // Done writes are counted by TFFT_Poll()
+  }
+#endif
+
+  if(replacedCallback)
+  {
+    replacedCallback(fname, TFFT_RW_OK);
+  }
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read the data of a queued write. Lock must be held. */
+static int TFFT_AsyncReadQueued(TFFT_INSTANCE *pInst, TFFT_ASYNC_ENTRY *pEntry, TFFT_SIZE_TYPE size, uint8_t *pData)
+{
+  TFFT_SIZE_TYPE i;
+
+  if(size > TFFT_FILE_SIZE(pInst, pEntry->fname))
+  {
+    size = TFFT_FILE_SIZE(pInst, pEntry->fname);
+  }
+
+  for(i = 0; i < size; i++)
+  {
+    pData[i] = (i < pEntry->size) ? TFFT_GetAsyncData(pInst, pEntry)[i] : 0;
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Status of asynchronous writes of a file.
+   Returns TFFT_RW_PENDING if a write is queued or in progress, else TFFT_RW_OK.
+   The result of each write is given to its callback. */
+int TFFT_InstGetAsyncStatus(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return TFFT_RW_ERR_FILE_NAME;
+  }
+
+  return TFFT_AsyncFind(pInst, fname) ? TFFT_RW_PENDING : TFFT_RW_OK;
+}
+#endif /* TFFT_ASYNC_QUEUE_SIZE > 0 */
+
+/*----------------------------------------------------------------------------*/
+/* Advance queued asynchronous writes by one chunk (one page write or, without
+   page write function, one chunk of byte writes). Call from the main loop or
+   a timer, e.g. once per EEPROM write cycle. If the driver has an isReady
+   function, nothing is done while the EEPROM is busy with a write cycle.
+   Returns TFFT_RW_PENDING if writes remain, TFFT_RW_OK when the queue is
+   empty or TFFT_RW_ERR_EEPROM_BUSY if another TFFT call is in progress.
+   Does nothing if TFFT_ASYNC_QUEUE_SIZE is 0. */
+int TFFT_InstPoll(TFFT_INSTANCE *pInst)
+{
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  TFFT_ASYNC_ENTRY *pEntry;
+  TFFT_ASYNC_CALLBACK doneCallback = 0;
+  TFFT_FILE_NAME_TYPE doneFname = 0;
+  int doneResult = TFFT_RW_OK;
+  int rtnCode = TFFT_RW_OK;
+  uint8_t f_pending = 0;
+  uint8_t i;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  if(pInst->pDriver->isReady && !pInst->pDriver->isReady(pInst->pDevice))
+  {
+    f_pending = TFFT_AsyncPending(pInst);
+    TFFT_Unlock(pInst, 0);
+    return f_pending ? TFFT_RW_PENDING : TFFT_RW_OK;
+  }
+
+  if(!pInst->pAsyncActive)
+  {
+    // Start the queued write with highest priority
+    for(i = 0; i < TFFT_ASYNC_QUEUE_SIZE; i++)
+    {
+      pEntry = &pInst->asyncQueue[i];
+      if(pEntry->f_used &&
+         (!pInst->pAsyncActive || pEntry->priority > pInst->pAsyncActive->priority ||
+          (pEntry->priority == pInst->pAsyncActive->priority &&
+           (int32_t)(pEntry->order - pInst->pAsyncActive->order) < 0)))
+      {
+        pInst->pAsyncActive = pEntry;
+      }
+    }
+
+    if(pInst->pAsyncActive)
+    {
+      TFFT_STATS_SET_FILE(pInst->pAsyncActive->fname);
+      pInst->asyncCopy = 0;
+      rtnCode = TFFT_AsyncBeginCopy(pInst);
+    }
+  }
+
+  if(pInst->pAsyncActive)
+  {
+    pEntry = pInst->pAsyncActive;
+    TFFT_STATS_SET_FILE(pEntry->fname);
+
+    if(rtnCode == TFFT_RW_OK)
+    {
+      rtnCode = TFFT_AreaWriteStep(pInst, &pInst->asyncWrite);
+    }
+
+    if(rtnCode == TFFT_RW_OK && pInst->asyncWrite.offset >= pInst->asyncWrite.totalSize)
+    {
+#if TFFT_BACKUP_MODE_ENABLED
+      if(pInst->asyncCopy == 0 && TFFT_FILE_TYPE(pInst, pInst->pAsyncActive->fname) != TFFT_FILE_TYPE_RING &&
+         !TFFT_IS_FLASH(pInst))
+      {
+        pInst->asyncCopy = 1; // Write second copy (backup) at next poll
+        rtnCode = TFFT_AsyncBeginCopy(pInst);
+        if(rtnCode == TFFT_RW_OK)
+        {
+          TFFT_STATS_ADD(pEntry->fname, time, TFFT_CallTime() - startTime);
+          TFFT_STATS_CLEAR_FILE();
+          TFFT_TRACE(TFFT_TRACE_POLL, pEntry->fname, pEntry->size, rtnCode, startTime, pInst->traceLowLevel);
+          TFFT_Unlock(pInst, 0);
+          return TFFT_RW_PENDING;
+        }
+      }
+      else
+#endif
+      {
+        doneCallback = pInst->pAsyncActive->callback;
+        doneFname = pInst->pAsyncActive->fname;
+        doneResult = TFFT_RW_OK;
+      }
+    }
+
+    if(rtnCode != TFFT_RW_OK || pInst->asyncWrite.offset >= pInst->asyncWrite.totalSize)
+    {
+      // Write done or failed
+      if(rtnCode != TFFT_RW_OK)
+      {
+        pInst->errorCount++;
+        doneCallback = pInst->pAsyncActive->callback;
+        doneFname = pInst->pAsyncActive->fname;
+        doneResult = rtnCode;
+      }
+
+#if TFFT_FLASH_ENABLED
+      if(TFFT_IS_FLASH(pInst))
+      {
+        TFFT_FlashWriteDone(pInst, pInst->pAsyncActive->fname, pInst->asyncWrite.address, rtnCode);
+      }
+      else
+#endif
+      if(TFFT_FILE_TYPE(pInst, pInst->pAsyncActive->fname) == TFFT_FILE_TYPE_RING)
+      {
+        TFFT_RingWriteDone(pInst, pInst->pAsyncActive->fname, pInst->asyncSlot, pInst->asyncHeader, rtnCode);
+      }
+
+      TFFT_STATS_CALL(pInst->pAsyncActive->fname, pInst->pAsyncActive->size, TFFT_RW_WRITE, rtnCode, startTime);
+      pInst->pAsyncActive->f_used = 0;
+      pInst->pAsyncActive = 0;
+    }
+    else
+    {
+      TFFT_STATS_ADD(pEntry->fname, time, TFFT_CallTime() - startTime);
+    }
+
+    TFFT_STATS_CLEAR_FILE();
+    TFFT_TRACE(TFFT_TRACE_POLL, pEntry->fname, pEntry->size, rtnCode, startTime, pInst->traceLowLevel);
+  }
+
+  f_pending = TFFT_AsyncPending(pInst);
+
+  TFFT_Unlock(pInst, 0);
+
+  // Callback is called without the lock, so it may call TFFT functions
+  if(doneCallback)
+  {
+    doneCallback(doneFname, doneResult);
+  }
+
+  return f_pending ? TFFT_RW_PENDING : TFFT_RW_OK;
+#else
+  (void)pInst;
+  return TFFT_RW_OK;
+#endif /* TFFT_ASYNC_QUEUE_SIZE > 0 */
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write all cached files that have been changed to EEPROM.
+   Does nothing if the cache is not enabled. */
+int TFFT_InstFlush(TFFT_INSTANCE *pInst)
+{
+  int rtnVal = TFFT_RW_OK;
+
+#if TFFT_CACHE_ENABLED
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  rtnVal = TFFT_CacheFlushAll(pInst);
+  TFFT_TRACE(TFFT_TRACE_FLUSH, TFFT_TRACE_ALL_FILES, 0, rtnVal, startTime, pInst->traceLowLevel);
+  TFFT_Unlock(pInst, 0);
+#else
+  (void)pInst;
+#endif
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write one cached file to EEPROM if it has been changed.
+   Does nothing if the cache is not enabled. */
+int TFFT_InstFlushFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  int rtnVal = TFFT_RW_OK;
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return TFFT_RW_ERR_FILE_NAME;
+  }
+
+#if TFFT_CACHE_ENABLED
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  rtnVal = TFFT_CacheFlushFile(pInst, fname);
+  TFFT_TRACE(TFFT_TRACE_FLUSH, fname, 0, rtnVal, startTime, pInst->traceLowLevel);
+  TFFT_Unlock(pInst, 0);
+#endif
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Load all files into the cache. Optional, call at startup to avoid
+   loading each file at its first read. Files that fail verification are
+   left to be loaded (and fail) at the first read.
+   Does nothing if the cache is not enabled. */
+int TFFT_InstCacheLoad(TFFT_INSTANCE *pInst)
+{
+  int rtnVal = TFFT_RW_OK;
+
+#if TFFT_CACHE_ENABLED
+  TFFT_FILE_NAME_TYPE fname;
+  int rtnCode;
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_LOG)
+    {
+      continue; // Log records are always read from EEPROM
+    }
+    if(!TFFT_BIT_GET(pInst->pCacheValid, fname))
+    {
+      if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_ARRAY)
+      {
+        rtnCode = TFFT_ArrayReadWrite(pInst, fname, 0, TFFT_FILE_SLOTS(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ);
+      }
+      else
+      {
+        rtnCode = TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ, 0);
+      }
+      if(rtnCode == TFFT_RW_OK)
+      {
+        TFFT_BIT_SET(pInst->pCacheValid, fname);
+      }
+      else
+      {
+        rtnVal = rtnCode;
+      }
+    }
+  }
+  TFFT_Unlock(pInst, 0);
+#else
+  (void)pInst;
+#endif
+
+  return rtnVal;
+}
+
+#if TFFT_FLASH_ENABLED
+/*----------------------------------------------------------------------------*/
+/* TFFT_VerifyPass() of a flash instance. The log is scanned again, which
+   verifies all records of the active sector. Files without a valid record
+   are invalid. */
+static int TFFT_FlashVerifyPass(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult, uint8_t f_load)
+{
+  TFFT_FILE_NAME_TYPE fname;
+  int rtnCode;
+
+  (void)f_load;
+
+  rtnCode = TFFT_FlashScan(pInst);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    if(!pInst->pFlashIndex[fname])
+    {
+      pResult->invalidCount++;
+      continue;
+    }
+
+    TFFT_BIT_SET(pResult->valid, fname);
+    TFFT_BIT_SET(pResult->primary, fname);
+#if TFFT_CACHE_ENABLED
+    if(f_load && !TFFT_BIT_GET(pInst->pCacheValid, fname) &&
+       TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ, 0) == TFFT_RW_OK)
+    {
+      TFFT_BIT_SET(pInst->pCacheValid, fname);
+    }
+#endif
+  }
+
+  return (pResult->invalidCount == 0) ? TFFT_RW_OK : TFFT_RW_ERR_CHECKSUM;
+}
+#endif /* TFFT_FLASH_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Verify all files with one sequential read of the whole file area. The
+   state of ring files is set from the same pass, so they need no scan.
+   If f_load is set, verified files that are not already cached are loaded
+   into the cache. Lock must be held.
+   Returns TFFT_RW_OK if all files are valid, TFFT_RW_ERR_CHECKSUM if at
+   least one file can not be read, or a low level read error */
+static int TFFT_VerifyPass(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult, uint8_t f_load)
+{
+  TFFT_ADDR_TYPE totalSize = (TFFT_ADDR_TYPE)pInst->pTable->layoutSize;
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  TFFT_ADDR_TYPE i;
+  TFFT_ADDR_TYPE j;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE dataEnd = 0;
+  TFFT_ADDR_TYPE areaSize = 0;  // End of the checksum
+  TFFT_ADDR_TYPE areaEnd = 0;   // End of the area, unused bytes of packed files follow the checksum
+  TFFT_ADDR_TYPE areaPos = 0;
+  TFFT_ADDR_TYPE headerSize = 0;
+  TFFT_FILE_NAME_TYPE fname = 0;
+  uint16_t area = 0;      // Copy of a normal file, array element or packed file, or slot of a ring file
+  uint16_t areaCount = 0;
+  uint8_t copy = 0;       // Copy of the area (normal, array and packed files)
+  uint8_t au8_chunk[TFFT_MOUNT_CHUNK_SIZE];
+  uint8_t au8_header[TFFT_RING_HEADER_SIZE]; // Also holds the length of packed files
+  uint8_t *pCache = 0;    // Cache entry being loaded, 0 = none
+  TFFT_RING_STATE *pState = 0; // Ring file being verified, 0 = none
+  uint8_t f_areaValid;
+  uint8_t f_lengthValid = 1;  // Length of a packed file is not larger than its reserved bytes
+  uint8_t f_elementValid = 0; // A copy of the current element is valid
+  uint8_t f_fileValid = 0;    // All elements so far have a valid copy
+  int rtnCode;
+#if TFFT_CHECKSUM_ENABLED
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_CHECKSUM_TYPE fileChecksum = 0;
+#endif
+
+  (void)f_load;
+
+  for(i = 0; i < TFFT_FILE_BITMAP_SIZE; i++)
+  {
+    pResult->valid[i] = 0;
+    pResult->primary[i] = 0;
+    pResult->backup[i] = 0;
+  }
+  pResult->invalidCount = 0;
+
+#if TFFT_FLASH_ENABLED
+  if(TFFT_IS_FLASH(pInst))
+  {
+    return TFFT_FlashVerifyPass(pInst, pResult, f_load);
+  }
+#endif
+
+  for(offset = 0; offset < totalSize; offset += len)
+  {
+    len = (totalSize - offset < TFFT_MOUNT_CHUNK_SIZE) ? (totalSize - offset) : TFFT_MOUNT_CHUNK_SIZE;
+
+    rtnCode = TFFT_LowLevelRead(pInst, pInst->startAddress + offset, au8_chunk, len);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    for(i = 0; i < len; i += n)
+    {
+      if(areaPos == 0)
+      {
+        if(area == 0)
+        {
+          // First area of a file
+          if(TFFT_FILE_IS_RING(pInst, fname))
+          {
+            headerSize = TFFT_RING_HEADER_SIZE;
+            areaCount = TFFT_FILE_SLOTS(pInst, fname);
+            areaEnd = headerSize + TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+            pState = TFFT_GetRingState(pInst, fname);
+            pState->f_scanned = 0;
+            pState->f_valid = 0;
+          }
+          else if(TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED)
+          {
+            // The length header tells where the checksum is
+            headerSize = TFFT_PACK_HEADER_SIZE;
+            areaCount = 1 + TFFT_BACKUP_MODE_ENABLED;
+            areaEnd = headerSize + TFFT_FILE_SLOTS(pInst, fname) + TFFT_CHECKSUM_SIZE;
+            pState = 0;
+          }
+          else
+          {
+            // A normal file is verified as an array of one element
+            headerSize = 0;
+            areaCount = (uint16_t)((1 + TFFT_BACKUP_MODE_ENABLED) *
+                                   ((TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_ARRAY) ? TFFT_FILE_SLOTS(pInst, fname) : 1));
+            areaEnd = TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+            pState = 0;
+          }
+          if(!pState)
+          {
+            // The copy bits are cleared when a copy of an element is bad
+            TFFT_BIT_SET(pResult->primary, fname);
+#if TFFT_BACKUP_MODE_ENABLED
+            TFFT_BIT_SET(pResult->backup, fname);
+#endif
+            f_elementValid = 0;
+            f_fileValid = 1;
+          }
+
+          pCache = 0;
+#if TFFT_CACHE_ENABLED
+          if(f_load && headerSize == 0 && !TFFT_BIT_GET(pInst->pCacheValid, fname))
+          {
+            pCache = TFFT_GetCacheData(pInst, fname);
+          }
+#endif
+        }
+        copy = (uint8_t)(area % (1 + TFFT_BACKUP_MODE_ENABLED));
+        areaSize = areaEnd;
+        dataEnd = areaSize - TFFT_CHECKSUM_SIZE;
+        f_lengthValid = 1;
+#if TFFT_CHECKSUM_ENABLED
+        checksum = 0;
+        fileChecksum = 0;
+#endif
+      }
+
+      // Piece of the chunk up to the next header/data/checksum boundary
+      n = ((areaPos < headerSize) ? headerSize : (areaPos < dataEnd) ? dataEnd :
+           (areaPos < areaSize) ? areaSize : areaEnd) - areaPos;
+      n = (n < len - i) ? n : len - i;
+
+      if(areaPos < dataEnd)
+      {
+#if TFFT_CHECKSUM_ENABLED
+        TFFT_ChecksumUpdate(&checksum, &au8_chunk[i], n);
+#endif
+        if(areaPos < headerSize)
+        {
+          for(j = 0; j < n; j++)
+          {
+            au8_header[areaPos + j] = au8_chunk[i + j];
+          }
+        }
+        else if(pCache && (copy == 0 || !f_elementValid))
+        {
+          // The backup copy is only loaded if the first copy is bad
+          TFFT_ADDR_TYPE cacheOffset = (TFFT_ADDR_TYPE)(area / (1 + TFFT_BACKUP_MODE_ENABLED)) * TFFT_FILE_SIZE(pInst, fname);
+
+          for(j = 0; j < n; j++)
+          {
+            pCache[cacheOffset + areaPos + j] = au8_chunk[i + j];
+          }
+        }
+      }
+#if TFFT_CHECKSUM_ENABLED
+      else if(areaPos < areaSize)
+      {
+        // Checksum is stored least significant byte first
+        for(j = 0; j < n; j++)
+        {
+          fileChecksum |= ((TFFT_CHECKSUM_TYPE)au8_chunk[i + j] << (8 * (areaPos + j - dataEnd)));
+        }
+      }
+#endif
+
+      areaPos += n;
+      if(!pState && areaPos == headerSize && headerSize > 0)
+      {
+        // Length of a packed file, only the compressed data is checked
+        TFFT_ADDR_TYPE packLen = (TFFT_ADDR_TYPE)(au8_header[0] | (au8_header[1] << 8));
+
+        if(packLen > TFFT_FILE_SLOTS(pInst, fname))
+        {
+          f_lengthValid = 0;
+        }
+        else
+        {
+          dataEnd = headerSize + packLen;
+          areaSize = dataEnd + TFFT_CHECKSUM_SIZE;
+        }
+      }
+      if(areaPos < areaEnd)
+      {
+        continue;
+      }
+
+      // End of area
+#if TFFT_CHECKSUM_ENABLED
+      f_areaValid = (checksum == fileChecksum) && f_lengthValid;
+#else
+      f_areaValid = f_lengthValid;
+#endif
+      if(f_areaValid && pState)
+      {
+        TFFT_RingSlotValid(pInst, fname, area, au8_header);
+      }
+      else if(!pState)
+      {
+        if(!f_areaValid)
+        {
+          TFFT_BIT_CLR((copy == 0) ? pResult->primary : pResult->backup, fname);
+          TFFT_STATS_ADD(fname, checksumErrors, 1); // Ring slots that were never written are expected
+        }
+        f_elementValid |= f_areaValid;
+        if(copy == TFFT_BACKUP_MODE_ENABLED)
+        {
+          // Last copy of the element
+          f_fileValid &= f_elementValid;
+          f_elementValid = 0;
+        }
+      }
+
+      areaPos = 0;
+      area++;
+      if(area < areaCount)
+      {
+        continue;
+      }
+
+      // End of file
+      if(pState)
+      {
+        pState->f_scanned = 1;
+        f_areaValid = pState->f_valid;
+      }
+      else
+      {
+        f_areaValid = f_fileValid;
+      }
+
+      if(f_areaValid)
+      {
+        TFFT_BIT_SET(pResult->valid, fname);
+#if TFFT_CACHE_ENABLED
+        if(pCache)
+        {
+          TFFT_BIT_SET(pInst->pCacheValid, fname);
+        }
+#endif
+      }
+      else
+      {
+        pResult->invalidCount++;
+      }
+
+      area = 0;
+      fname++;
+    }
+  }
+
+#if TFFT_CACHE_ENABLED
+  // The newest slot of a ring file is only known after all slots have been
+  // verified, so ring files are loaded from the newest slot afterwards.
+  // Packed files are decompressed when loaded.
+  for(fname = 0; fname < pInst->pTable->fileCount && f_load; fname++)
+  {
+    if((TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_RING || TFFT_FILE_TYPE(pInst, fname) == TFFT_FILE_TYPE_PACKED) &&
+       TFFT_BIT_GET(pResult->valid, fname) &&
+       !TFFT_BIT_GET(pInst->pCacheValid, fname))
+    {
+      rtnCode = TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ, 0);
+      if(rtnCode == TFFT_RW_OK)
+      {
+        TFFT_BIT_SET(pInst->pCacheValid, fname);
+      }
+    }
+  }
+#endif
+
+  return (pResult->invalidCount == 0) ? TFFT_RW_OK : TFFT_RW_ERR_CHECKSUM;
+}
+
+#if TFFT_LAYOUT_ENABLED
+/* Address of the layout header and of a progress record of an instance */
+#define TFFT_LAYOUT_ADDRESS(pInst) \
+  ((TFFT_ADDR_TYPE)((pInst)->endAddress + 1 - TFFT_LAYOUT_AREA_SIZE((pInst)->pTable->layoutMaxFiles)))
+#define TFFT_LAYOUT_COPY_ADDRESS(pInst, copy) \
+  (TFFT_LAYOUT_ADDRESS(pInst) + (copy) * TFFT_LAYOUT_COPY_SIZE((pInst)->pTable->layoutMaxFiles))
+#define TFFT_LAYOUT_PROGRESS_ADDRESS(pInst, slot) \
+  (TFFT_LAYOUT_COPY_ADDRESS(pInst, 2) + (slot) * (TFFT_LAYOUT_PROGRESS_SIZE + TFFT_CHECKSUM_SIZE))
+/* Bytes of the file table in a copy of the layout header of an instance */
+#define TFFT_LAYOUT_ENTRIES_SIZE(pInst) ((TFFT_ADDR_TYPE)((pInst)->pTable->layoutMaxFiles * TFFT_LAYOUT_ENTRY_SIZE))
+
+#define TFFT_LAYOUT_GET16(p) ((uint16_t)((p)[0] | ((p)[1] << 8)))
+#define TFFT_LAYOUT_GET32(p) ((uint32_t)TFFT_LAYOUT_GET16(p) | ((uint32_t)TFFT_LAYOUT_GET16((p) + 2) << 16))
+#define TFFT_LAYOUT_PUT16(p, v) do{(p)[0] = (uint8_t)(v); (p)[1] = (uint8_t)((v) >> 8);}while(0)
+#define TFFT_LAYOUT_PUT32(p, v) do{TFFT_LAYOUT_PUT16(p, v); TFFT_LAYOUT_PUT16((p) + 2, (v) >> 16);}while(0)
+
+/*----------------------------------------------------------------------------*/
+/* Entry of a file of the file table of an instance in the layout header */
+static void TFFT_LayoutEncode(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint8_t *pEntry)
+{
+  TFFT_LAYOUT_PUT16(pEntry, TFFT_FILE_SIZE(pInst, fname));
+  pEntry[2] = TFFT_FILE_TYPE(pInst, fname);
+  TFFT_LAYOUT_PUT16(pEntry + 3, TFFT_FILE_SLOTS(pInst, fname));
+}
+
+/*----------------------------------------------------------------------------*/
+/* Hash (FNV-1a) of the file table of an instance: file count and entries */
+static uint32_t TFFT_LayoutHash(TFFT_INSTANCE *pInst)
+{
+  uint8_t au8_entry[TFFT_LAYOUT_ENTRY_SIZE];
+  uint32_t hash = 2166136261u;
+  TFFT_FILE_NAME_TYPE fname;
+  uint8_t i;
+
+  TFFT_LAYOUT_PUT16(au8_entry, pInst->pTable->fileCount);
+  for(i = 0; i < 2; i++)
+  {
+    hash = (hash ^ au8_entry[i]) * 16777619u;
+  }
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    TFFT_LayoutEncode(pInst, fname, au8_entry);
+    for(i = 0; i < TFFT_LAYOUT_ENTRY_SIZE; i++)
+    {
+      hash = (hash ^ au8_entry[i]) * 16777619u;
+    }
+  }
+
+  return hash;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write the layout header with the file table of an instance to a copy */
+static int TFFT_LayoutWriteHeader(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig, uint8_t copy, uint16_t seq)
+{
+  uint8_t au8_fixed[TFFT_LAYOUT_FIXED_SIZE];
+  TFFT_FILE_NAME_TYPE fname;
+  uint16_t i;
+
+  au8_fixed[0] = TFFT_LAYOUT_MAGIC;
+  au8_fixed[1] = TFFT_LAYOUT_FORMAT;
+  TFFT_LAYOUT_PUT16(&au8_fixed[2], seq);
+  TFFT_LAYOUT_PUT32(&au8_fixed[4], pMig->hash);
+  TFFT_LAYOUT_PUT16(&au8_fixed[8], pInst->pTable->fileCount);
+
+  for(i = 0; i < sizeof(pMig->au8_entries); i++)
+  {
+    pMig->au8_entries[i] = 0;
+  }
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    TFFT_LayoutEncode(pInst, fname, &pMig->au8_entries[fname * TFFT_LAYOUT_ENTRY_SIZE]);
+  }
+
+  return TFFT_TransferArea(pInst, TFFT_LAYOUT_COPY_ADDRESS(pInst, copy), au8_fixed, TFFT_LAYOUT_FIXED_SIZE,
+                           pMig->au8_entries, TFFT_LAYOUT_ENTRIES_SIZE(pInst), TFFT_LAYOUT_ENTRIES_SIZE(pInst),
+                           TFFT_RW_WRITE_COMPARE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read the newest valid copy of the layout header.
+   Returns 1 if found, 0 if no copy is valid or a negative value
+   indicating that an error occurred */
+static int TFFT_LayoutReadHeader(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig, uint32_t *pStoredHash)
+{
+  uint8_t au8_fixed[2][TFFT_LAYOUT_FIXED_SIZE];
+  uint8_t f_valid[2];
+  uint8_t copy;
+  int rtnCode;
+
+  // Checksum only, the table is read from the newest copy
+  for(copy = 0; copy < 2; copy++)
+  {
+    rtnCode = TFFT_TransferArea(pInst, TFFT_LAYOUT_COPY_ADDRESS(pInst, copy), au8_fixed[copy],
+                                TFFT_LAYOUT_FIXED_SIZE, 0, 0, TFFT_LAYOUT_ENTRIES_SIZE(pInst), TFFT_RW_READ);
+    if(rtnCode != TFFT_RW_OK && rtnCode != TFFT_RW_ERR_CHECKSUM)
+    {
+      return rtnCode;
+    }
+    f_valid[copy] = (rtnCode == TFFT_RW_OK && au8_fixed[copy][0] == TFFT_LAYOUT_MAGIC && au8_fixed[copy][1] == TFFT_LAYOUT_FORMAT);
+  }
+
+  if(!f_valid[0] && !f_valid[1])
+  {
+    return 0;
+  }
+
+  // Sequence numbers wrap around, so compare the difference
+  copy = (f_valid[0] && f_valid[1]) ?
+         ((int16_t)(TFFT_LAYOUT_GET16(&au8_fixed[1][2]) - TFFT_LAYOUT_GET16(&au8_fixed[0][2])) > 0) : f_valid[1];
+
+  pMig->copy = copy;
+  pMig->seq = TFFT_LAYOUT_GET16(&au8_fixed[copy][2]);
+  pMig->oldCount = TFFT_LAYOUT_GET16(&au8_fixed[copy][8]);
+  *pStoredHash = TFFT_LAYOUT_GET32(&au8_fixed[copy][4]);
+
+  rtnCode = TFFT_TransferArea(pInst, TFFT_LAYOUT_COPY_ADDRESS(pInst, copy), au8_fixed[copy],
+                              TFFT_LAYOUT_FIXED_SIZE, pMig->au8_entries, TFFT_LAYOUT_ENTRIES_SIZE(pInst),
+                              TFFT_LAYOUT_ENTRIES_SIZE(pInst), TFFT_RW_READ);
+
+  return (rtnCode == TFFT_RW_OK) ? 1 : rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write a progress record of the migration. Records are written in turn,
+   so the previous one is kept if the write is interrupted. */
+static int TFFT_LayoutWriteProgress(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig)
+{
+  uint8_t au8_record[TFFT_LAYOUT_PROGRESS_SIZE];
+
+  pMig->record++;
+  au8_record[0] = TFFT_LAYOUT_MAGIC;
+  TFFT_LAYOUT_PUT16(&au8_record[1], pMig->seq);
+  TFFT_LAYOUT_PUT32(&au8_record[3], pMig->hash);
+  TFFT_LAYOUT_PUT16(&au8_record[7], pMig->step);
+  TFFT_LAYOUT_PUT16(&au8_record[9], pMig->offset);
+  au8_record[11] = pMig->flags;
+  TFFT_LAYOUT_PUT16(&au8_record[12], pMig->record);
+
+  return TFFT_TransferArea(pInst, TFFT_LAYOUT_PROGRESS_ADDRESS(pInst, pMig->record & 1), au8_record,
+                           TFFT_LAYOUT_PROGRESS_SIZE, 0, 0, 0, TFFT_RW_WRITE_COMPARE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Continue from the newest progress record of a migration from the stored
+   header, if any. Returns TFFT_RW_ERR_FILE_TABLE if the migration was to
+   another file table. */
+static int TFFT_LayoutReadProgress(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig)
+{
+  uint8_t au8_record[TFFT_LAYOUT_PROGRESS_SIZE];
+  uint8_t f_found = 0;
+  uint8_t slot;
+  int rtnCode;
+
+  pMig->step = 0;
+  pMig->offset = 0;
+  pMig->flags = 0;
+  pMig->record = 0;
+
+  for(slot = 0; slot < 2; slot++)
+  {
+    rtnCode = TFFT_TransferArea(pInst, TFFT_LAYOUT_PROGRESS_ADDRESS(pInst, slot), au8_record,
+                                TFFT_LAYOUT_PROGRESS_SIZE, 0, 0, 0, TFFT_RW_READ);
+    if(rtnCode == TFFT_RW_ERR_CHECKSUM || au8_record[0] != TFFT_LAYOUT_MAGIC ||
+       TFFT_LAYOUT_GET16(&au8_record[1]) != pMig->seq)
+    {
+      continue; // Not written or from an earlier migration
+    }
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+    if(TFFT_LAYOUT_GET32(&au8_record[3]) != pMig->hash)
+    {
+      return(TFFT_RW_ERR_FILE_TABLE); // File table changed again before the migration was done
+    }
+    if(!f_found || (int16_t)(TFFT_LAYOUT_GET16(&au8_record[12]) - pMig->record) > 0)
+    {
+      f_found = 1;
+      pMig->step = TFFT_LAYOUT_GET16(&au8_record[7]);
+      pMig->offset = TFFT_LAYOUT_GET16(&au8_record[9]);
+      pMig->flags = au8_record[11];
+      pMig->record = TFFT_LAYOUT_GET16(&au8_record[12]);
+    }
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get move index of a migration. Index is file * 2 + copy.
+   Returns 1 if there is something to move, else 0 */
+static uint8_t TFFT_LayoutGetMove(TFFT_INSTANCE *pInst, const TFFT_LAYOUT_MIGRATION *pMig, uint16_t index,
+                                  TFFT_LAYOUT_MOVE *pMove)
+{
+  TFFT_FILE_NAME_TYPE fname = (TFFT_FILE_NAME_TYPE)(index / 2);
+  uint8_t copy = (uint8_t)(index % 2);
+  const uint8_t *pEntry = &pMig->au8_entries[fname * TFFT_LAYOUT_ENTRY_SIZE];
+  uint16_t oldSize = TFFT_LAYOUT_GET16(pEntry);
+  uint16_t oldCount = TFFT_LAYOUT_GET16(pEntry + 3);
+  uint16_t count;
+  uint8_t type;
+
+  if(fname >= pMig->oldCount || fname >= pInst->pTable->fileCount || pEntry[2] != TFFT_FILE_TYPE(pInst, fname))
+  {
+    return 0; // New or dropped file, or type changed
+  }
+
+  type = pEntry[2];
+  count = TFFT_FILE_SLOTS(pInst, fname);
+  pMove->from = pMig->oldAddress[fname];
+  pMove->to = TFFT_GetAddress(pInst, fname);
+  pMove->oldSize = 0;
+  pMove->newSize = 0;
+
+  if(type == TFFT_FILE_TYPE_NORMAL && oldSize != TFFT_FILE_SIZE(pInst, fname))
+  {
+    // Each copy is moved, padded and gets a new checksum
+    if(copy > TFFT_BACKUP_MODE_ENABLED)
+    {
+      return 0;
+    }
+    pMove->oldSize = oldSize;
+    pMove->newSize = TFFT_FILE_SIZE(pInst, fname);
+    pMove->from += copy * (oldSize + TFFT_CHECKSUM_SIZE);
+    pMove->to += copy * TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+    pMove->len = (oldSize < pMove->newSize) ? oldSize : pMove->newSize;
+    pMove->fromSize = oldSize + TFFT_CHECKSUM_SIZE;
+    pMove->toSize = pMove->newSize + TFFT_CHECKSUM_SIZE;
+    return 1;
+  }
+
+  if(oldSize != TFFT_FILE_SIZE(pInst, fname))
+  {
+    return 0; // Records and elements can not be resized
+  }
+
+  if(type == TFFT_FILE_TYPE_PACKED && oldCount != count)
+  {
+    // Each copy is moved with as much compressed data as fits
+    if(copy > TFFT_BACKUP_MODE_ENABLED)
+    {
+      return 0;
+    }
+    pMove->from += copy * (TFFT_PACK_HEADER_SIZE + oldCount + TFFT_CHECKSUM_SIZE);
+    pMove->to += copy * (TFFT_PACK_HEADER_SIZE + count + TFFT_CHECKSUM_SIZE);
+    pMove->len = TFFT_PACK_HEADER_SIZE + ((oldCount < count) ? oldCount : count) + TFFT_CHECKSUM_SIZE;
+  }
+  else
+  {
+    // The first slots or elements are kept
+    uint32_t oldReal = TFFT_FILE_REAL_SIZE(oldSize, type, oldCount);
+    uint32_t newReal = TFFT_FILE_REAL_SIZE(oldSize, type, count);
+
+    if(copy > 0)
+    {
+      return 0;
+    }
+    pMove->len = (TFFT_ADDR_TYPE)((oldReal < newReal) ? oldReal : newReal);
+  }
+  pMove->fromSize = pMove->len;
+  pMove->toSize = pMove->len;
+
+  return (pMove->from != pMove->to);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Select the next move of a migration. A move is done when no other move
+   that is not done needs the bytes it writes. Both tables keep the files in
+   order, so there is always such a move.
+   Returns 1 if a move is selected, 0 if all moves are done or a negative
+   value indicating that an error occurred */
+static int TFFT_LayoutNextMove(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig, TFFT_LAYOUT_MOVE *pMove)
+{
+  TFFT_LAYOUT_MOVE other;
+  uint16_t index;
+  uint16_t i;
+  uint8_t f_pending = 0;
+  uint8_t f_free;
+
+  for(index = 0; index < 2 * TFFT_LAYOUT_MAX_FILES; index++)
+  {
+    if(!TFFT_BIT_GET(pMig->pending, index))
+    {
+      continue;
+    }
+
+    f_pending = 1;
+    TFFT_LayoutGetMove(pInst, pMig, index, pMove);
+    f_free = 1;
+    for(i = 0; i < 2 * TFFT_LAYOUT_MAX_FILES && f_free; i++)
+    {
+      if(i != index && TFFT_BIT_GET(pMig->pending, i))
+      {
+        TFFT_LayoutGetMove(pInst, pMig, i, &other);
+        f_free = ((uint32_t)pMove->to + pMove->toSize <= other.from || (uint32_t)other.from + other.fromSize <= pMove->to);
+      }
+    }
+
+    if(f_free)
+    {
+      TFFT_BIT_CLR(pMig->pending, index);
+      return 1;
+    }
+  }
+
+  return f_pending ? TFFT_RW_ERR_FILE_TABLE : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write bytes that differ, in page aligned chunks. pData 0 writes zeros. */
+static int TFFT_LayoutWrite(TFFT_INSTANCE *pInst, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  uint8_t au8_zero[TFFT_EEPROM_PAGE_SIZE] = {0};
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE written;
+  int rtnCode;
+
+  for(offset = 0; offset < len; offset += n)
+  {
+    n = TFFT_ChunkLength(pInst, address, offset, len);
+    rtnCode = TFFT_LowLevelWriteChanged(pInst, address + offset, pData ? &pData[offset] : au8_zero, n, &written);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+    pInst->bytesWritten += written;
+    pInst->bytesSkipped += n - written;
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Pad a moved copy of a resized normal file and write its checksum. A copy
+   that was not valid before the move gets a wrong checksum. */
+static int TFFT_LayoutSeal(TFFT_INSTANCE *pInst, const TFFT_LAYOUT_MOVE *pMove, uint8_t f_valid)
+{
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE n;
+  uint8_t i;
+  int rtnCode;
+
+  rtnCode = TFFT_LayoutWrite(pInst, pMove->to + pMove->len, 0, pMove->newSize - pMove->len);
+
+  for(offset = 0; offset < pMove->len && rtnCode == TFFT_RW_OK; offset += n)
+  {
+    n = TFFT_ChunkLength(pInst, pMove->to, offset, pMove->len);
+    rtnCode = TFFT_LowLevelRead(pInst, pMove->to + offset, au8_page, n);
+    TFFT_ChecksumUpdate(&checksum, au8_page, n);
+  }
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+  TFFT_ChecksumUpdate(&checksum, 0, pMove->newSize - pMove->len);
+
+  if(!f_valid)
+  {
+    checksum = (TFFT_CHECKSUM_TYPE)~checksum;
+  }
+  // Checksum is stored least significant byte first
+  for(i = 0; i < TFFT_CHECKSUM_SIZE; i++)
+  {
+    au8_page[i] = (uint8_t)(checksum >> (8 * i));
+  }
+
+  return TFFT_LayoutWrite(pInst, pMove->to + pMove->newSize, au8_page, TFFT_CHECKSUM_SIZE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Do a move of a migration, continuing at the offset of the migration.
+   Moves to a higher address are copied from the end, so no byte is
+   overwritten before it is copied. If the old and new bytes overlap, at
+   most the distance is copied at a time and the progress is recorded
+   after each chunk, so that the move can continue after power loss. */
+static int TFFT_LayoutMove(TFFT_INSTANCE *pInst, TFFT_LAYOUT_MIGRATION *pMig, const TFFT_LAYOUT_MOVE *pMove)
+{
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  TFFT_ADDR_TYPE distance = (pMove->to > pMove->from) ? (pMove->to - pMove->from) : (pMove->from - pMove->to);
+  TFFT_ADDR_TYPE start;
+  TFFT_ADDR_TYPE n;
+  uint8_t f_overlap = (distance < pMove->len);
+  int rtnCode;
+
+  if(pMove->oldSize && !(pMig->flags & TFFT_LAYOUT_CHECKED))
+  {
+    // The old checksum may be overwritten by the move, so verify first
+    rtnCode = TFFT_TransferArea(pInst, pMove->from, 0, 0, 0, 0, pMove->oldSize, TFFT_RW_READ);
+    if(rtnCode != TFFT_RW_OK && rtnCode != TFFT_RW_ERR_CHECKSUM)
+    {
+      return rtnCode;
+    }
+    pMig->flags = TFFT_LAYOUT_CHECKED | ((rtnCode == TFFT_RW_OK) ? TFFT_LAYOUT_SOURCE_VALID : 0);
+    rtnCode = TFFT_LayoutWriteProgress(pInst, pMig);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+
+  while(distance > 0 && pMig->offset < pMove->len)
+  {
+    if(pMove->to > pMove->from)
+    {
+      // Chunk ending at the last byte not done, within one page
+      n = (TFFT_ADDR_TYPE)((pMove->to + pMove->len - pMig->offset - 1) % pInst->pageSize + 1);
+      n = (n < pMove->len - pMig->offset) ? n : (pMove->len - pMig->offset);
+      n = (f_overlap && n > distance) ? distance : n;
+      start = pMove->len - pMig->offset - n;
+    }
+    else
+    {
+      start = pMig->offset;
+      n = TFFT_ChunkLength(pInst, pMove->to, start, pMove->len);
+      n = (f_overlap && n > distance) ? distance : n;
+    }
+
+    rtnCode = TFFT_LowLevelRead(pInst, pMove->from + start, au8_page, n);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      rtnCode = TFFT_LayoutWrite(pInst, pMove->to + start, au8_page, n);
+    }
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    pMig->offset += n;
+    if(f_overlap && pMig->offset < pMove->len)
+    {
+      rtnCode = TFFT_LayoutWriteProgress(pInst, pMig);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        return rtnCode;
+      }
+    }
+  }
+
+  if(pMove->oldSize)
+  {
+    return TFFT_LayoutSeal(pInst, pMove, (pMig->flags & TFFT_LAYOUT_SOURCE_VALID) != 0);
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check the layout header and move the files if the file table has changed
+   since it was written. The header is written when the migration is done,
+   or when there is none. Lock must be held.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+static int TFFT_LayoutMount(TFFT_INSTANCE *pInst)
+{
+  TFFT_LAYOUT_MIGRATION mig;
+  TFFT_LAYOUT_MOVE move;
+  uint32_t storedHash = 0;
+  uint32_t address;
+  uint16_t index;
+  uint16_t step;
+  int rtnCode;
+
+  mig.hash = TFFT_LayoutHash(pInst);
+
+  rtnCode = TFFT_LayoutReadHeader(pInst, &mig, &storedHash);
+  if(rtnCode <= 0)
+  {
+    // First mount, the files are stored with the current table
+    return (rtnCode == 0) ? TFFT_LayoutWriteHeader(pInst, &mig, 0, 0) : rtnCode;
+  }
+
+  if(storedHash == mig.hash && mig.oldCount == pInst->pTable->fileCount)
+  {
+    return TFFT_RW_OK; // File table not changed
+  }
+
+  // Addresses of the stored table. Files must have fitted below the header.
+  if(mig.oldCount > pInst->pTable->layoutMaxFiles)
+  {
+    return(TFFT_RW_ERR_FILE_TABLE);
+  }
+  address = pInst->startAddress;
+  for(index = 0; index < mig.oldCount; index++)
+  {
+    const uint8_t *pEntry = &mig.au8_entries[index * TFFT_LAYOUT_ENTRY_SIZE];
+
+    if(pEntry[2] > TFFT_FILE_TYPE_PACKED)
+    {
+      return(TFFT_RW_ERR_FILE_TABLE);
+    }
+    mig.oldAddress[index] = (TFFT_ADDR_TYPE)address;
+    address += TFFT_FILE_REAL_SIZE((uint32_t)TFFT_LAYOUT_GET16(pEntry), pEntry[2], (uint32_t)TFFT_LAYOUT_GET16(pEntry + 3));
+  }
+  if(address > TFFT_LAYOUT_ADDRESS(pInst))
+  {
+    return(TFFT_RW_ERR_FILE_TABLE);
+  }
+
+  rtnCode = TFFT_LayoutReadProgress(pInst, &mig);
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  for(index = 0; index < 2 * TFFT_LAYOUT_MAX_FILES; index++)
+  {
+    if(TFFT_LayoutGetMove(pInst, &mig, index, &move))
+    {
+      TFFT_BIT_SET(mig.pending, index);
+    }
+    else
+    {
+      TFFT_BIT_CLR(mig.pending, index);
+    }
+  }
+
+  // The order of the moves only depends on the two tables, so the moves
+  // done before an interruption are selected again and skipped
+  for(step = 0; (rtnCode = TFFT_LayoutNextMove(pInst, &mig, &move)) > 0; step++)
+  {
+    if(step < mig.step)
+    {
+      continue;
+    }
+
+    rtnCode = TFFT_LayoutMove(pInst, &mig, &move);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+
+    mig.step = step + 1;
+    mig.offset = 0;
+    mig.flags = 0;
+    rtnCode = TFFT_LayoutWriteProgress(pInst, &mig);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+  }
+  if(rtnCode != TFFT_RW_OK)
+  {
+    return rtnCode;
+  }
+
+  // Done. The new header makes the progress records obsolete.
+  return TFFT_LayoutWriteHeader(pInst, &mig, mig.copy ^ 1, mig.seq + 1);
+}
+#endif /* TFFT_LAYOUT_ENABLED */
+
+#if TFFT_REPAIR_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Repair the elements with a bad copy of the files that TFFT_VerifyPass()
+   found a bad copy of. Errors are only counted. */
+static void TFFT_MountRepair(TFFT_INSTANCE *pInst, const TFFT_VERIFY_RESULT *pResult)
+{
+  TFFT_FILE_NAME_TYPE fname;
+  uint16_t element;
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    if(!TFFT_FILE_IS_RING(pInst, fname) &&
+       (!TFFT_BIT_GET(pResult->primary, fname) || !TFFT_BIT_GET(pResult->backup, fname)))
+    {
+      TFFT_STATS_SET_FILE(fname);
+      for(element = 0; element < TFFT_REPAIR_ELEMENTS(pInst, fname); element++)
+      {
+        (void)TFFT_RepairElement(pInst, fname, element);
+      }
+      TFFT_STATS_CLEAR_FILE();
+    }
+  }
+}
+#endif /* TFFT_REPAIR_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Verify all files with one sequential read of the whole file area and
+   set up the state of ring files. With the cache enabled, all valid files
+   are also loaded into the cache. Call at startup instead of
+   TFFT_ScanRingFiles() and TFFT_CacheLoad(). pResult is optional.
+   Returns TFFT_RW_OK if all files are valid, TFFT_RW_ERR_CHECKSUM if at
+   least one file can not be read, TFFT_RW_ERR_FILE_TABLE if the files can
+   not be moved to a changed file table (layout header enabled), or another
+   negative value indicating that an error occurred. With repair enabled,
+   bad copies are rewritten from the good ones, pResult still shows the
+   copies found bad. */
+int TFFT_InstMount(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult)
+{
+  TFFT_VERIFY_RESULT result;
+  int rtnVal;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+#if TFFT_LAYOUT_ENABLED
+  if(!TFFT_IS_FLASH(pInst) && pInst->pTable->layoutMaxFiles)
+  {
+    rtnVal = TFFT_LayoutMount(pInst);
+    if(rtnVal != TFFT_RW_OK)
+    {
+      // Files are not where the file table expects them
+      if(pResult)
+      {
+        TFFT_FILE_NAME_TYPE i;
+
+        for(i = 0; i < TFFT_FILE_BITMAP_SIZE; i++)
+        {
+          pResult->valid[i] = 0;
+          pResult->primary[i] = 0;
+          pResult->backup[i] = 0;
+        }
+        pResult->invalidCount = (TFFT_FILE_NAME_TYPE)pInst->pTable->fileCount;
+      }
+      TFFT_TRACE(TFFT_TRACE_MOUNT, TFFT_TRACE_ALL_FILES, 0, rtnVal, startTime, pInst->traceLowLevel);
+      TFFT_Unlock(pInst, 0);
+      return rtnVal;
+    }
+  }
+#endif
+
+  rtnVal = TFFT_VerifyPass(pInst, pResult ? pResult : &result, 1);
+#if TFFT_REPAIR_ENABLED
+  if(!TFFT_IS_FLASH(pInst))
+  {
+    TFFT_MountRepair(pInst, pResult ? pResult : &result);
+  }
+#endif
+  TFFT_TRACE(TFFT_TRACE_MOUNT, TFFT_TRACE_ALL_FILES, 0, rtnVal, startTime, pInst->traceLowLevel);
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Verify all files (both copies in backup mode and all ring file slots)
+   with one sequential read of the whole file area. The cache is not
+   changed. pResult is optional. Return values as for TFFT_Mount(). */
+int TFFT_InstVerifyAll(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult)
+{
+  TFFT_VERIFY_RESULT result;
+  int rtnVal;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  rtnVal = TFFT_VerifyPass(pInst, pResult ? pResult : &result, 0);
+  TFFT_TRACE(TFFT_TRACE_VERIFY, TFFT_TRACE_ALL_FILES, 0, rtnVal, startTime, pInst->traceLowLevel);
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+}
+
+#if TFFT_REPAIR_ENABLED
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+/* Files not scrubbed: older slots of ring and log files act as backup, a
+   queued write replaces both copies */
+#define TFFT_SCRUB_SKIP(pInst, fname) (TFFT_FILE_IS_RING(pInst, fname) || TFFT_AsyncFind(pInst, fname))
+#else
+#define TFFT_SCRUB_SKIP(pInst, fname) TFFT_FILE_IS_RING(pInst, fname)
+#endif
+
+/*----------------------------------------------------------------------------*/
+/* Verify up to maxBytes of the copies of the files, continuing where the
+   previous call stopped, and repair elements with a bad copy.
+   Returns TFFT_RW_OK, TFFT_RW_SCRUB_DONE at the end of a pass or a
+   negative value indicating that an error occurred */
+int TFFT_InstScrub(TFFT_INSTANCE *pInst, uint32_t maxBytes)
+{
+  TFFT_SCRUB_STATE *pScrub = &pInst->scrub;
+  uint32_t bytesLeft = maxBytes;
+  int rtnCode;
+  int rtnVal = TFFT_RW_OK;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  while(bytesLeft > 0 && rtnVal == TFFT_RW_OK)
+  {
+    if(pScrub->fname >= pInst->pTable->fileCount || TFFT_IS_FLASH(pInst))
+    {
+      // Pass completed (older records of a flash instance act as backup)
+      pScrub->fname = 0;
+      pInst->repair.scrubPasses++;
+      rtnVal = TFFT_RW_SCRUB_DONE;
+    }
+    else if(TFFT_SCRUB_SKIP(pInst, pScrub->fname))
+    {
+      pScrub->verify.offset = 0;
+      pScrub->element = 0;
+      pScrub->copy = 0;
+      pScrub->validCopies = 0;
+      pScrub->fname++;
+    }
+    else
+    {
+      TFFT_STATS_SET_FILE(pScrub->fname);
+      rtnCode = TFFT_VerifyCopyStep(pInst, pScrub->fname, TFFT_CopyAddress(pInst, pScrub->fname, pScrub->element, pScrub->copy),
+                                    &pScrub->verify, bytesLeft);
+      if(rtnCode < 0)
+      {
+        // The copy is verified again from the start by the next call
+        TFFT_UPDATE_ERROR_COUNT(pScrub->fname, rtnCode);
+        pScrub->verify.offset = 0;
+        rtnVal = rtnCode;
+      }
+      else
+      {
+        pInst->repair.scrubBytes += (uint32_t)rtnCode;
+        bytesLeft -= ((uint32_t)rtnCode < bytesLeft) ? (uint32_t)rtnCode : bytesLeft;
+
+        if(pScrub->verify.offset >= pScrub->verify.areaEnd)
+        {
+          // End of copy
+          pScrub->validCopies |= (uint8_t)(TFFT_COPY_VALID(&pScrub->verify) << pScrub->copy);
+          pScrub->verify.offset = 0;
+          pScrub->copy++;
+        }
+
+        if(pScrub->copy == 2)
+        {
+          // End of element. Writes may have been done since the first copy
+          // was verified, so both copies are verified again before a repair.
+          if(pScrub->validCopies != 3)
+          {
+            rtnCode = TFFT_RepairElement(pInst, pScrub->fname, pScrub->element);
+            if(rtnCode == TFFT_RW_ERR_CHECKSUM)
+            {
+              pInst->repair.unrepairable++;
+            }
+            else
+            {
+              rtnVal = rtnCode;
+            }
+          }
+          pScrub->copy = 0;
+          pScrub->validCopies = 0;
+          pScrub->element++;
+          if(pScrub->element >= TFFT_REPAIR_ELEMENTS(pInst, pScrub->fname))
+          {
+            pScrub->element = 0;
+            pScrub->fname++;
+          }
+        }
+      }
+      TFFT_STATS_CLEAR_FILE();
+    }
+  }
+
+  TFFT_TRACE(TFFT_TRACE_SCRUB, TFFT_TRACE_ALL_FILES, maxBytes, rtnVal, startTime, pInst->traceLowLevel);
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+}
+#endif /* TFFT_REPAIR_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Device address of a byte of the image of an instance. The image holds the
+   file area followed by the layout header area, or the whole area of a
+   flash instance. */
+static TFFT_ADDR_TYPE TFFT_ImageAddress(TFFT_INSTANCE *pInst, uint32_t offset)
+{
+#if TFFT_LAYOUT_ENABLED
+  if(!TFFT_IS_FLASH(pInst) && offset >= pInst->pTable->layoutSize)
+  {
+    return (TFFT_ADDR_TYPE)(TFFT_LAYOUT_ADDRESS(pInst) + (offset - pInst->pTable->layoutSize));
+  }
+#endif
+
+  return (TFFT_ADDR_TYPE)(pInst->startAddress + offset);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Bytes of the image from offset up to end that are contiguous in the device */
+static uint32_t TFFT_ImageSegmentLength(TFFT_INSTANCE *pInst, uint32_t offset, uint32_t end)
+{
+#if TFFT_LAYOUT_ENABLED
+  if(!TFFT_IS_FLASH(pInst) && offset < pInst->pTable->layoutSize && end > pInst->pTable->layoutSize)
+  {
+    return pInst->pTable->layoutSize - offset;
+  }
+#else
+  (void)pInst;
+#endif
+
+  return end - offset;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Forget the state of all files after an import, they are read again */
+static void TFFT_ImageInvalidate(TFFT_INSTANCE *pInst)
+{
+  TFFT_FILE_NAME_TYPE fname;
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    TFFT_VIEW_CHANGED(fname);
+#if TFFT_CACHE_ENABLED
+    TFFT_BIT_CLR(pInst->pCacheValid, fname);
+    TFFT_BIT_CLR(pInst->pCacheDirty, fname);
+#endif
+    if(TFFT_FILE_IS_RING(pInst, fname))
+    {
+      TFFT_GetRingState(pInst, fname)->f_scanned = 0;
+    }
+  }
+#if TFFT_CACHE_ENABLED
+  pInst->f_cacheDirty = 0;
+#endif
+#if TFFT_FLASH_ENABLED
+  pInst->f_flashScanned = 0;
+#endif
+#if TFFT_REPAIR_ENABLED
+  pInst->scrub.verify.offset = 0;
+  pInst->scrub.element = 0;
+  pInst->scrub.fname = 0;
+  pInst->scrub.copy = 0;
+  pInst->scrub.validCopies = 0;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Verify all files after the last part of an image was imported. Files that
+   are invalid because all their bytes are erased (0xFF) are accepted, they
+   were not written to the image (see tools/tfft_image.c). Lock must be held.
+   Returns TFFT_RW_OK, TFFT_RW_ERR_CHECKSUM if a file of the image is
+   corrupt or a low level read error */
+static int TFFT_ImageVerify(TFFT_INSTANCE *pInst)
+{
+  TFFT_VERIFY_RESULT result;
+  uint8_t au8_chunk[TFFT_MOUNT_CHUNK_SIZE];
+  TFFT_FILE_NAME_TYPE fname;
+  TFFT_ADDR_TYPE address;
+  TFFT_ADDR_TYPE fileEnd;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE i;
+  int rtnCode = TFFT_VerifyPass(pInst, &result, 0);
+
+  for(fname = 0; fname < pInst->pTable->fileCount && rtnCode == TFFT_RW_ERR_CHECKSUM; fname++)
+  {
+    if(TFFT_FILE_BIT(result.valid, fname))
+    {
+      continue;
+    }
+
+    fileEnd = (fname + 1 < pInst->pTable->fileCount) ? TFFT_GetAddress(pInst, fname + 1) :
+              (TFFT_ADDR_TYPE)(pInst->startAddress + pInst->pTable->layoutSize);
+    for(address = TFFT_GetAddress(pInst, fname); address < fileEnd; address += n)
+    {
+      n = (fileEnd - address < TFFT_MOUNT_CHUNK_SIZE) ? (fileEnd - address) : TFFT_MOUNT_CHUNK_SIZE;
+      rtnCode = TFFT_LowLevelRead(pInst, address, au8_chunk, n);
+      for(i = 0; i < n && rtnCode == TFFT_RW_OK && au8_chunk[i] == 0xFF; i++)
+      {
+      }
+      if(rtnCode != TFFT_RW_OK || i < n)
+      {
+        return (rtnCode != TFFT_RW_OK) ? rtnCode : TFFT_RW_ERR_CHECKSUM;
+      }
+    }
+
+    result.invalidCount--;
+    rtnCode = (result.invalidCount == 0) ? TFFT_RW_OK : TFFT_RW_ERR_CHECKSUM;
+  }
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Size of the image of an instance (see TFFT_ExportImage()) */
+uint32_t TFFT_InstGetImageSize(TFFT_INSTANCE *pInst)
+{
+  if(TFFT_IS_FLASH(pInst))
+  {
+    return (uint32_t)pInst->endAddress - pInst->startAddress + 1;
+  }
+
+#if TFFT_LAYOUT_ENABLED
+  return pInst->pTable->layoutSize + TFFT_LAYOUT_AREA_SIZE(pInst->pTable->layoutMaxFiles);
+#else
+  return pInst->pTable->layoutSize;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read len bytes of the image of an instance from offset on, with one low
+   level read per contiguous part. Files changed in the cache are only in
+   the image after TFFT_Flush().
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstExportImage(TFFT_INSTANCE *pInst, uint32_t offset, uint8_t *pData, uint32_t len)
+{
+  uint32_t end = offset + len;
+  uint32_t pos;
+  uint32_t n;
+  int rtnCode = TFFT_RW_OK;
+
+  if(offset > TFFT_InstGetImageSize(pInst) || len > TFFT_InstGetImageSize(pInst) - offset)
+  {
+    return TFFT_RW_ERR_ADDRESS;
+  }
+
+  if(TFFT_Lock(pInst, 1) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  for(pos = offset; pos < end && rtnCode == TFFT_RW_OK; pos += n)
+  {
+    n = TFFT_ImageSegmentLength(pInst, pos, end);
+    rtnCode = TFFT_LowLevelRead(pInst, TFFT_ImageAddress(pInst, pos), &pData[pos - offset], (TFFT_ADDR_TYPE)n);
+  }
+
+  TFFT_Unlock(pInst, 1);
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write len bytes of the image of an instance from offset on with
+   sequential page writes, then read them back in one pass and compare.
+   Sectors of a flash instance are erased when the part holding their first
+   byte is imported, erased pages are not programmed.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstImportImage(TFFT_INSTANCE *pInst, uint32_t offset, const uint8_t *pData, uint32_t len)
+{
+  uint8_t au8_chunk[TFFT_MOUNT_CHUNK_SIZE];
+  uint32_t end = offset + len;
+  uint32_t pos;
+  TFFT_ADDR_TYPE address;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE i;
+  int rtnCode = TFFT_RW_OK;
+
+  if(offset > TFFT_InstGetImageSize(pInst) || len > TFFT_InstGetImageSize(pInst) - offset)
+  {
+    return TFFT_RW_ERR_ADDRESS;
+  }
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  if(TFFT_AsyncPending(pInst))
+  {
+    TFFT_Unlock(pInst, 0);
+    return TFFT_RW_ERR_EEPROM_BUSY; // A queued write would overwrite the image
+  }
+#endif
+
+  // Page aligned chunks, in address order
+  for(pos = offset; pos < end && rtnCode == TFFT_RW_OK; pos += n)
+  {
+    address = TFFT_ImageAddress(pInst, pos);
+    n = (TFFT_ADDR_TYPE)TFFT_ImageSegmentLength(pInst, pos, end);
+    n = TFFT_ChunkLength(pInst, address, 0, n);
+
+#if TFFT_FLASH_ENABLED
+    if(TFFT_IS_FLASH(pInst))
+    {
+      if((address - pInst->startAddress) % pInst->flashSectorSize == 0)
+      {
+        if(!pInst->pDriver->eraseSector)
+        {
+          rtnCode = TFFT_RW_ERR_LOW_LEVEL_ERASE;
+          break;
+        }
+        rtnCode = pInst->pDriver->eraseSector(pInst->pDevice, address);
+        TFFT_COUNT_LOW_LEVEL(rtnCode);
+        if(rtnCode != TFFT_RW_OK)
+        {
+          break;
+        }
+      }
+
+      for(i = 0; i < n && pData[pos - offset + i] == TFFT_FLASH_ERASED; i++)
+      {
+      }
+      if(i == n)
+      {
+        continue; // Left erased
+      }
+    }
+#endif
+
+    rtnCode = TFFT_LowLevelWrite(pInst, address, &pData[pos - offset], n);
+    if(rtnCode == TFFT_RW_OK)
+    {
+      pInst->bytesWritten += n;
+    }
+  }
+
+  // One read pass over the written bytes
+  for(pos = offset; pos < end && rtnCode == TFFT_RW_OK; pos += n)
+  {
+    n = (TFFT_ADDR_TYPE)TFFT_ImageSegmentLength(pInst, pos, end);
+    n = (n < TFFT_MOUNT_CHUNK_SIZE) ? n : TFFT_MOUNT_CHUNK_SIZE;
+    rtnCode = TFFT_LowLevelRead(pInst, TFFT_ImageAddress(pInst, pos), au8_chunk, n);
+
+    for(i = 0; i < n && rtnCode == TFFT_RW_OK; i++)
+    {
+      if(au8_chunk[i] != pData[pos - offset + i])
+      {
+        rtnCode = TFFT_RW_ERR_LOW_LEVEL_WRITE; // Not stored as written
+      }
+    }
+  }
+
+  // The whole image is in the device when its last part is imported
+  if(rtnCode == TFFT_RW_OK && end == TFFT_InstGetImageSize(pInst) && !TFFT_IS_FLASH(pInst))
+  {
+    rtnCode = TFFT_ImageVerify(pInst);
+  }
+
+  if(rtnCode != TFFT_RW_OK)
+  {
+    pInst->errorCount++;
+  }
+  TFFT_ImageInvalidate(pInst);
+  TFFT_Unlock(pInst, 0);
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write file, going through the async queue and the cache when enabled.
+   The lock must be held by the caller. */
+static int TFFT_ReadWriteLocked(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                                uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  TFFT_ASYNC_ENTRY *pEntry = TFFT_AsyncFind(pInst, fname);
+
+  if(pEntry && f_write)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY; // The queued write would overwrite this write
+  }
+  else if(pEntry)
+  {
+    return TFFT_AsyncReadQueued(pInst, pEntry, size, pData);
+  }
+#endif
+
+#if TFFT_CACHE_ENABLED
+  return TFFT_CacheReadWrite(pInst, fname, size, pData, f_write, f_truncate);
+#else
+  return TFFT_DeviceReadWrite(pInst, fname, size, pData, f_write, f_truncate);
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Size of a normal file in EEPROM including checksum and backup copy */
+#define TFFT_GET_FILE_REAL_SIZE(pInst, fname) (TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname) * (1 + TFFT_BACKUP_MODE_ENABLED))
+
+/*----------------------------------------------------------------------------*/
+/* Check if a batch item can be part of a merged transfer. Other items are
+   transferred one by one, so items that fail the size check get the same
+   error as when transferred alone. */
+static uint8_t TFFT_BatchIsMergeable(TFFT_INSTANCE *pInst, const TFFT_BATCH_ITEM *pItem, uint8_t f_write)
+{
+  TFFT_FILE_NAME_TYPE fname = pItem->fname;
+  TFFT_SIZE_TYPE size = pItem->size;
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname) || TFFT_FILE_TYPE(pInst, fname) != TFFT_FILE_TYPE_NORMAL ||
+     TFFT_IS_FLASH(pInst))
+  {
+    return 0; // Files of flash instances are not at fixed addresses
+  }
+
+  if(TFFT_CheckFileSize(pInst, fname, &size, f_write, 0) != TFFT_RW_OK)
+  {
+    return 0;
+  }
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  if(TFFT_AsyncFind(pInst, fname))
+  {
+    return 0;
+  }
+#endif
+
+  if(f_write)
+  {
+#if TFFT_CACHE_ENABLED
+    return 0; // Writes only go to the cache
+#elif TFFT_CHECKSUM_ENABLED
+    return 1;
+#else
+    return size == TFFT_FILE_SIZE(pInst, fname); // No padding is written without checksum
+#endif
+  }
+
+#if TFFT_CACHE_ENABLED
+  return !TFFT_BIT_GET(pInst->pCacheValid, fname);
+#else
+  return 1;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Set the result of the files first..last of a run */
+static void TFFT_BatchRunResult(TFFT_BATCH_ITEM *pItems, const uint16_t *pIndex,
+                                TFFT_FILE_NAME_TYPE first, TFFT_FILE_NAME_TYPE last, int rtnCode)
+{
+  TFFT_FILE_NAME_TYPE fname;
+
+  for(fname = first; fname <= last; fname++)
+  {
+    pItems[pIndex[fname] - 1].result = rtnCode;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Transfer the files first..last as one sequential transfer in page aligned
+   chunks. Files with consecutive names are adjacent in EEPROM, so several
+   small files share each page read/write. The result of each file is set
+   in its batch item. Read results that are not TFFT_RW_OK are retried one
+   by one by the caller. */
+static void TFFT_BatchRun(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, const uint16_t *pIndex,
+                          TFFT_FILE_NAME_TYPE first, TFFT_FILE_NAME_TYPE last, uint8_t f_write)
+{
+  TFFT_ADDR_TYPE address = TFFT_GetAddress(pInst, first);
+  TFFT_ADDR_TYPE totalSize = TFFT_GetAddress(pInst, last) + TFFT_GET_FILE_REAL_SIZE(pInst, last) - address;
+  TFFT_ADDR_TYPE fileStart = address;
+  TFFT_ADDR_TYPE fullSize = TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, first);
+  TFFT_ADDR_TYPE fileSize = TFFT_FILE_SIZE(pInst, first);
+  TFFT_ADDR_TYPE offset;
+  TFFT_ADDR_TYPE len;
+  TFFT_ADDR_TYPE i;
+  TFFT_ADDR_TYPE j;
+  TFFT_ADDR_TYPE n;
+  TFFT_ADDR_TYPE pos;
+  TFFT_ADDR_TYPE written;
+  TFFT_FILE_NAME_TYPE fname = first;
+  TFFT_FILE_NAME_TYPE chunkFirst;
+  TFFT_BATCH_ITEM *pItem = &pItems[pIndex[first] - 1];
+  uint8_t *pData = (uint8_t*)pItem->pData;
+  TFFT_ADDR_TYPE size = pItem->size;
+  uint8_t au8_page[TFFT_EEPROM_PAGE_SIZE];
+  uint8_t f_compare = TFFT_COMPARE_BEFORE_WRITE;
+  int rtnCode;
+#if TFFT_CHECKSUM_ENABLED
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_CHECKSUM_TYPE fileChecksum = 0;
+#endif
+
+  // Range is checked once for the whole run
+  if(!TFFT_IS_ADDRESS_IN_RANGE(pInst, address) || !TFFT_IS_ADDRESS_IN_RANGE(pInst, address + totalSize - 1))
+  {
+    TFFT_BatchRunResult(pItems, pIndex, first, last, TFFT_RW_ERR_ADDRESS);
+    return;
+  }
+
+#if TFFT_CACHE_ENABLED
+  // Files are read to the cache, then copied to the callers buffer
+  pData = TFFT_GetCacheData(pInst, first);
+  size = fileSize;
+#endif
+
+#if TFFT_VIEW_ENABLED
+  for(i = first; f_write && i <= last; i++)
+  {
+    TFFT_VIEW_CHANGED(i);
+  }
+#endif
+
+  for(offset = 0; offset < totalSize; offset += len)
+  {
+    len = TFFT_ChunkLength(pInst, address, offset, totalSize);
+    chunkFirst = fname;
+
+    if(!f_write)
+    {
+      rtnCode = TFFT_LowLevelRead(pInst, address + offset, au8_page, len);
+      if(rtnCode != TFFT_RW_OK)
+      {
+        TFFT_BatchRunResult(pItems, pIndex, chunkFirst, last, rtnCode);
+        return;
+      }
+    }
+
+    for(i = 0; i < len; i += n)
+    {
+      pos = address + offset + i - fileStart;
+
+      if(pos >= fullSize * (1 + TFFT_BACKUP_MODE_ENABLED))
+      {
+        // Next file
+        fileStart += fullSize * (1 + TFFT_BACKUP_MODE_ENABLED);
+        fname++;
+        pos = 0;
+        fullSize = TFFT_GET_FILE_SIZE_WITH_CHECKSUM(pInst, fname);
+        fileSize = TFFT_FILE_SIZE(pInst, fname);
+        pItem = &pItems[pIndex[fname] - 1];
+        pData = (uint8_t*)pItem->pData;
+        size = pItem->size;
+#if TFFT_CACHE_ENABLED
+        pData = TFFT_GetCacheData(pInst, fname);
+        size = fileSize;
+#endif
+#if TFFT_CHECKSUM_ENABLED
+        checksum = 0;
+        fileChecksum = 0;
+#endif
+      }
+
+#if TFFT_CHECKSUM_ENABLED
+      if(pos == 0 && f_write)
+      {
+        TFFT_ChecksumUpdate(&checksum, pData, size);
+        TFFT_ChecksumUpdate(&checksum, 0, fileSize - size);
+      }
+#endif
+
+      // The backup copy (second copy) has the same content as the first.
+      // Only the first copy is verified on read.
+      if(pos >= fullSize)
+      {
+        pos -= fullSize;
+        if(!f_write)
+        {
+          n = fullSize - pos;
+          n = (n < len - i) ? n : len - i;
+          continue;
+        }
+      }
+
+      // Piece of the chunk up to the next data/checksum boundary
+      n = ((pos < fileSize) ? fileSize : fullSize) - pos;
+      n = (n < len - i) ? n : len - i;
+
+      if(pos < fileSize)
+      {
+        for(j = 0; j < n; j++)
+        {
+          if(f_write)
+          {
+            au8_page[i + j] = (pos + j < size) ? pData[pos + j] : 0; // Data or padding
+          }
+          else if(pos + j < size)
+          {
+            pData[pos + j] = au8_page[i + j];
+          }
+        }
+#if TFFT_CHECKSUM_ENABLED
+        if(!f_write)
+        {
+          TFFT_ChecksumUpdate(&checksum, &au8_page[i], n);
+        }
+#else
+        if(!f_write && pos + n == fileSize)
+        {
+          pItem->result = TFFT_RW_OK; // Nothing to verify without checksum
+        }
+#endif
+      }
+#if TFFT_CHECKSUM_ENABLED
+      else
+      {
+        // Checksum is stored least significant byte first
+        for(j = 0; j < n; j++)
+        {
+          if(f_write)
+          {
+            au8_page[i + j] = (uint8_t)(checksum >> (8 * (pos + j - fileSize)));
+          }
+          else
+          {
+            fileChecksum |= ((TFFT_CHECKSUM_TYPE)au8_page[i + j] << (8 * (pos + j - fileSize)));
+          }
+        }
+
+        if(!f_write && pos + n == fullSize)
+        {
+          pItem->result = (fileChecksum == checksum) ? TFFT_RW_OK : TFFT_RW_ERR_CHECKSUM;
+        }
+      }
+#endif
+    }
+
+    if(f_write)
+    {
+      if(f_compare)
+      {
+        rtnCode = TFFT_LowLevelWriteChanged(pInst, address + offset, au8_page, len, &written);
+      }
+      else
+      {
+        rtnCode = TFFT_LowLevelWrite(pInst, address + offset, au8_page, len);
+        written = len;
+      }
+
+      if(rtnCode != TFFT_RW_OK)
+      {
+        TFFT_BatchRunResult(pItems, pIndex, chunkFirst, last, rtnCode);
+        return;
+      }
+
+      pInst->bytesWritten += written;
+      pInst->bytesSkipped += len - written;
+    }
+  }
+
+  if(f_write)
+  {
+    TFFT_BatchRunResult(pItems, pIndex, first, last, TFFT_RW_OK); // All written
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read or write a batch of files under one lock. Files are transferred in
+   address order and files that are adjacent in EEPROM are merged into one
+   sequential transfer. */
+static int TFFT_BatchTransfer(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, uint16_t count, uint8_t f_write)
+{
+  uint16_t *pIndex = pInst->pBatchIndex; // Batch item + 1 of each merged file, 0 = none
+  TFFT_BATCH_ITEM *pItem;
+  TFFT_FILE_NAME_TYPE fname;
+  TFFT_FILE_NAME_TYPE last;
+  int rtnVal = TFFT_RW_OK;
+  uint16_t k;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    for(k = 0; k < count; k++)
+    {
+      pItems[k].result = TFFT_RW_ERR_EEPROM_BUSY;
+      TFFT_STATS_CALL(pItems[k].fname, pItems[k].size, f_write, TFFT_RW_ERR_EEPROM_BUSY, startTime);
+    }
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    pIndex[fname] = 0;
+  }
+
+  // The last item of a file is merged. Earlier items of the same file and
+  // items that can not be merged are transferred one by one first.
+  for(k = 0; k < count; k++)
+  {
+    pItem = &pItems[k];
+    pItem->result = TFFT_RW_ERR_CHECKSUM; // Until read and verified
+
+    if(TFFT_BatchIsMergeable(pInst, pItem, f_write))
+    {
+      if(pIndex[pItem->fname])
+      {
+        pItem = &pItems[pIndex[pItem->fname] - 1];
+        pItem->result = TFFT_ReadWriteLocked(pInst, pItem->fname, pItem->size, (uint8_t*)pItem->pData, f_write, 0);
+      }
+      pIndex[pItems[k].fname] = k + 1;
+    }
+    else
+    {
+      pItem->result = TFFT_ReadWriteLocked(pInst, pItem->fname, pItem->size, (uint8_t*)pItem->pData, f_write, 0);
+    }
+  }
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname = last + 1)
+  {
+    last = fname;
+    if(pIndex[fname])
+    {
+      while(last + 1 < pInst->pTable->fileCount && pIndex[last + 1])
+      {
+        last++;
+      }
+      TFFT_BatchRun(pInst, pItems, pIndex, fname, last, f_write);
+    }
+  }
+
+  for(fname = 0; fname < pInst->pTable->fileCount; fname++)
+  {
+    if(pIndex[fname])
+    {
+      pItem = &pItems[pIndex[fname] - 1];
+
+      if(!f_write && pItem->result != TFFT_RW_OK)
+      {
+        // Retry one by one, which also tries the backup copy
+        pItem->result = TFFT_ReadWriteLocked(pInst, fname, pItem->size, (uint8_t*)pItem->pData, f_write, 0);
+      }
+#if TFFT_CACHE_ENABLED
+      else if(!f_write)
+      {
+        TFFT_BIT_SET(pInst->pCacheValid, fname);
+        for(k = 0; k < pItem->size && k < TFFT_FILE_SIZE(pInst, fname); k++)
+        {
+          ((uint8_t*)pItem->pData)[k] = TFFT_GetCacheData(pInst, fname)[k];
+        }
+      }
+#endif
+      else if(pItem->result != TFFT_RW_OK)
+      {
+        pInst->errorCount++;
+      }
+    }
+  }
+
+#if TFFT_TRACE_SIZE > 0
+  for(k = 0; k < count; k++)
+  {
+    TFFT_TraceAdd(pInst, f_write ? TFFT_TRACE_BATCH_WRITE : TFFT_TRACE_BATCH_READ, pItems[k].fname, pItems[k].size,
+                  pItems[k].result, startTime, (k + 1 == count) ? pInst->traceLowLevel : 0);
+  }
+#endif
+
+  TFFT_Unlock(pInst, 0);
+
+#if TFFT_STATS_ENABLED
+  // The time of the whole batch is counted as not file specific
+  for(k = 0; k < count; k++)
+  {
+    TFFT_StatsCall(pInst, pItems[k].fname, pItems[k].size, f_write, pItems[k].result, TFFT_CallTime());
+  }
+  TFFT_STATS_ADD(TFFT_STATS_OTHER, time, TFFT_CallTime() - startTime);
+#endif
+
+  for(k = 0; k < count && rtnVal == TFFT_RW_OK; k++)
+  {
+    rtnVal = pItems[k].result;
+  }
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read several files with one lock. Files that are adjacent in EEPROM are
+   read with one sequential transfer, which needs far fewer low level
+   transactions than reading the files one by one.
+   The result of each file is set in its item.
+   Returns TFFT_RW_OK if all files were read, else the first error */
+int TFFT_InstReadBatch(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, uint16_t count)
+{
+  return TFFT_BatchTransfer(pInst, pItems, count, TFFT_RW_READ);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write several files with one lock. Files that are adjacent in EEPROM are
+   written with one sequential transfer, so small files share page writes.
+   The result of each file is set in its item.
+   Returns TFFT_RW_OK if all files were written, else the first error */
+int TFFT_InstWriteBatch(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, uint16_t count)
+{
+  return TFFT_BatchTransfer(pInst, pItems, count, TFFT_RW_WRITE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check the elements of an array file call */
+static int TFFT_ArrayCheck(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count)
+{
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
+  }
+  if(TFFT_FILE_TYPE(pInst, fname) != TFFT_FILE_TYPE_ARRAY)
+  {
+    return(TFFT_RW_ERR_FILE_TYPE);
+  }
+  if((uint32_t)first + count > TFFT_FILE_SLOTS(pInst, fname))
+  {
+    return(TFFT_RW_ERR_ELEMENT);
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write elements of an array file. The cache is written through, so
+   only the given elements are written to EEPROM. Reads are done from the
+   cache if the file is loaded, else only the given elements are read from
+   EEPROM. */
+static int TFFT_ArrayTransfer(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count,
+                              uint8_t *pData, uint8_t f_write)
+{
+  uint32_t size = 0;
+  int rtnVal;
+#if TFFT_CACHE_ENABLED
+  uint8_t *pCache;
+  uint32_t i;
+#endif
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+#if TFFT_CACHE_ENABLED
+  if(!f_write)
+  {
+    // Reads of loaded array files only need a shared lock
+    if(TFFT_Lock(pInst, 1) != TFFT_RW_OK)
+    {
+      TFFT_STATS_CALL(fname, size, f_write, TFFT_RW_ERR_EEPROM_BUSY, startTime);
+      return TFFT_RW_ERR_EEPROM_BUSY;
+    }
+    rtnVal = TFFT_ArrayCheck(pInst, fname, first, count);
+    if(rtnVal == TFFT_RW_OK && TFFT_BIT_GET(pInst->pCacheValid, fname))
+    {
+      size = (uint32_t)count * TFFT_FILE_SIZE(pInst, fname);
+      pCache = TFFT_GetCacheData(pInst, fname) + (uint32_t)first * TFFT_FILE_SIZE(pInst, fname);
+      for(i = 0; i < size; i++)
+      {
+        pData[i] = pCache[i];
+      }
+      TFFT_TRACE(f_write, fname, size, TFFT_RW_OK, startTime, 0);
+      TFFT_Unlock(pInst, 1);
+      TFFT_STATS_CALL(fname, size, f_write, TFFT_RW_OK, startTime);
+      return TFFT_RW_OK;
+    }
+    TFFT_Unlock(pInst, 1);
+  }
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+    rtnVal = TFFT_ArrayCheck(pInst, fname, first, count);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      size = (uint32_t)count * TFFT_FILE_SIZE(pInst, fname);
+      rtnVal = TFFT_ArrayReadWrite(pInst, fname, first, count, pData, f_write);
+#if TFFT_CACHE_ENABLED
+      if(f_write && TFFT_BIT_GET(pInst->pCacheValid, fname))
+      {
+        if(rtnVal == TFFT_RW_OK)
+        {
+          pCache = TFFT_GetCacheData(pInst, fname) + (uint32_t)first * TFFT_FILE_SIZE(pInst, fname);
+          for(i = 0; i < size; i++)
+          {
+            pCache[i] = pData[i];
+          }
+        }
+        else
+        {
+          TFFT_BIT_CLR(pInst->pCacheValid, fname); // Unknown state in EEPROM
+        }
+      }
+#endif
+    }
+    else
+    {
+      TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    }
+    TFFT_TRACE(f_write, fname, size, rtnVal, startTime, pInst->traceLowLevel);
+    TFFT_Unlock(pInst, 0);
+  }
+
+  TFFT_STATS_CALL(fname, size, f_write, rtnVal, startTime);
+  (void)size; // Only used by statistics and trace
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read count elements of an array file, starting at element first.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstReadRange(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, void *pData)
+{
+  return TFFT_ArrayTransfer(pInst, fname, first, count, (uint8_t*)pData, TFFT_RW_READ);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write count elements of an array file, starting at element first. Each
+   element is written with its checksum (and backup copy), the other
+   elements are not touched.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstWriteRange(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, const void *pData)
+{
+  return TFFT_ArrayTransfer(pInst, fname, first, count, (uint8_t*)pData, TFFT_RW_WRITE);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Check a log file call and scan the log if needed. Lock must be held. */
+static int TFFT_LogCheck(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
+  }
+  if(TFFT_FILE_TYPE(pInst, fname) != TFFT_FILE_TYPE_LOG)
+  {
+    return(TFFT_RW_ERR_FILE_TYPE);
+  }
+  if(!TFFT_GetRingState(pInst, fname)->f_scanned)
+  {
+    return TFFT_RingScan(pInst, fname);
+  }
+
+  return TFFT_RW_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Append a record to a log file. Only the slot after the newest record is
+   written, which holds the oldest record once the log is full.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstLogAppend(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const void *pData)
+{
+  uint32_t size = 0;
+  int rtnVal;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+    TFFT_STATS_SET_FILE(fname);
+    rtnVal = TFFT_LogCheck(pInst, fname);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      size = TFFT_FILE_SIZE(pInst, fname);
+      rtnVal = TFFT_RingTransfer(pInst, fname, TFFT_FILE_SIZE(pInst, fname), (uint8_t*)pData, TFFT_RW_WRITE);
+    }
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    TFFT_STATS_CLEAR_FILE();
+    TFFT_TRACE(TFFT_RW_WRITE, fname, size, rtnVal, startTime, pInst->traceLowLevel);
+    TFFT_Unlock(pInst, 0);
+  }
+
+  TFFT_STATS_CALL(fname, size, TFFT_RW_WRITE, rtnVal, startTime);
+  (void)size; // Only used by statistics and trace
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Set up a cursor over all records of a log file, from the newest or the
+   oldest record. Records appended later are not part of the iteration.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstLogOpen(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_LOG_CURSOR *pCursor, uint8_t f_newestFirst)
+{
+  TFFT_RING_STATE *pState;
+  int rtnVal;
+
+  pCursor->fname = fname;
+  pCursor->seq = 0;
+  pCursor->remaining = 0;
+  pCursor->f_newestFirst = f_newestFirst;
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  TFFT_STATS_SET_FILE(fname);
+  rtnVal = TFFT_LogCheck(pInst, fname);
+  if(rtnVal == TFFT_RW_OK)
+  {
+    pState = TFFT_GetRingState(pInst, fname);
+    if(pState->f_valid)
+    {
+      pCursor->remaining = pState->records;
+      pCursor->seq = f_newestFirst ? pState->seq : (uint16_t)(pState->seq - pState->records + 1);
+    }
+  }
+  TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+  TFFT_STATS_CLEAR_FILE();
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read the next record of a log cursor. The cursor moves on also if the
+   record fails, so the remaining records can still be read.
+   Returns TFFT_RW_OK, TFFT_RW_LOG_END if all records have been read,
+   TFFT_RW_ERR_ELEMENT if the record has been overwritten by appends since
+   TFFT_LogOpen() or another negative value indicating that an error
+   occurred */
+int TFFT_InstLogRead(TFFT_INSTANCE *pInst, TFFT_LOG_CURSOR *pCursor, void *pData)
+{
+  TFFT_FILE_NAME_TYPE fname = pCursor->fname;
+  TFFT_RING_STATE *pState;
+  uint8_t au8_header[TFFT_RING_HEADER_SIZE];
+  uint32_t size = 0;
+  uint16_t age;
+  uint16_t slot;
+  int rtnVal;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(pCursor->remaining == 0)
+  {
+    return TFFT_RW_LOG_END;
+  }
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+    TFFT_STATS_SET_FILE(fname);
+    rtnVal = TFFT_LogCheck(pInst, fname);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      pState = TFFT_GetRingState(pInst, fname);
+      age = (uint16_t)(pState->seq - pCursor->seq); // Appends after this record
+      if(!pState->f_valid || age >= pState->records)
+      {
+        rtnVal = TFFT_RW_ERR_ELEMENT;
+      }
+      else
+      {
+        size = TFFT_FILE_SIZE(pInst, fname);
+        slot = (uint16_t)((pState->slot + TFFT_FILE_SLOTS(pInst, fname) - age) % TFFT_FILE_SLOTS(pInst, fname));
+        rtnVal = TFFT_TransferArea(pInst, TFFT_RingSlotAddress(pInst, fname, slot), au8_header, TFFT_RING_HEADER_SIZE,
+                                   (uint8_t*)pData, size, size, TFFT_RW_READ);
+        if(rtnVal == TFFT_RW_OK && (uint16_t)(au8_header[0] | (au8_header[1] << 8)) != pCursor->seq)
+        {
+          rtnVal = TFFT_RW_ERR_CHECKSUM; // Slot holds an older record, the write of this one was lost
+        }
+      }
+
+      pCursor->seq = (uint16_t)(pCursor->f_newestFirst ? (pCursor->seq - 1) : (pCursor->seq + 1));
+      pCursor->remaining--;
+    }
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    TFFT_STATS_CLEAR_FILE();
+    TFFT_TRACE(TFFT_RW_READ, fname, size, rtnVal, startTime, pInst->traceLowLevel);
+    TFFT_Unlock(pInst, 0);
+  }
+
+  TFFT_STATS_CALL(fname, size, TFFT_RW_READ, rtnVal, startTime);
+  (void)size; // Only used by statistics and trace
+
+  return rtnVal;
+}
+
+#if TFFT_VIEW_ENABLED
+/*----------------------------------------------------------------------------*/
+/* Verify an area in mapped memory: header, dataSize bytes of data and the
+   checksum over both. Returns 1 if the area is valid. */
+static uint8_t TFFT_ViewVerify(const uint8_t *pArea, TFFT_ADDR_TYPE headerSize, TFFT_ADDR_TYPE dataSize)
+{
+#if TFFT_CHECKSUM_ENABLED
+  TFFT_CHECKSUM_TYPE checksum = 0;
+  TFFT_CHECKSUM_TYPE fileChecksum = 0;
+  uint8_t i;
+
+  TFFT_ChecksumUpdate(&checksum, pArea, headerSize + dataSize);
+  for(i = 0; i < TFFT_CHECKSUM_SIZE; i++)
+  {
+    fileChecksum |= ((TFFT_CHECKSUM_TYPE)pArea[headerSize + dataSize + i] << (8 * i));
+  }
+
+  return fileChecksum == checksum;
+#else
+  (void)pArea;
+  (void)headerSize;
+  (void)dataSize;
+  return 1;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/* Find the newest valid copy of a file in the memory of a mapped device:
+   the first or backup copy of normal files, the newest slot of ring files
+   or the newest record of flash instances. Lock must be held.
+   Returns TFFT_RW_ERR_FILE_TYPE if the address is not mapped. */
+static int TFFT_ViewMapped(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData)
+{
+  TFFT_ADDR_TYPE size = TFFT_FILE_SIZE(pInst, fname);
+  TFFT_ADDR_TYPE address = TFFT_GetAddress(pInst, fname);
+  TFFT_ADDR_TYPE headerSize = 0;
+  uint8_t copies = 1 + TFFT_BACKUP_MODE_ENABLED;
+  const uint8_t *pArea;
+  uint8_t copy;
+  int rtnCode;
+
+#if TFFT_FLASH_ENABLED
+  if(TFFT_IS_FLASH(pInst))
+  {
+    rtnCode = pInst->f_flashScanned ? TFFT_RW_OK : TFFT_FlashScan(pInst);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+    address = pInst->pFlashIndex[fname];
+    headerSize = 1; // File name
+    copies = address ? 1 : 0;
+  }
+  else
+#endif
+  if(TFFT_FILE_IS_RING(pInst, fname))
+  {
+    TFFT_RING_STATE *pState = TFFT_GetRingState(pInst, fname);
+
+    rtnCode = pState->f_scanned ? TFFT_RW_OK : TFFT_RingScan(pInst, fname);
+    if(rtnCode != TFFT_RW_OK)
+    {
+      return rtnCode;
+    }
+    address = TFFT_RingSlotAddress(pInst, fname, pState->slot);
+    headerSize = TFFT_RING_HEADER_SIZE;
+    copies = pState->f_valid ? 1 : 0; // Ring files are not duplicated in backup mode
+  }
+
+  for(copy = 0; copy < copies; copy++)
+  {
+    pArea = pInst->pDriver->map(pInst->pDevice, (TFFT_ADDR_TYPE)(address + copy * (size + TFFT_CHECKSUM_SIZE)));
+    if(!pArea)
+    {
+      return TFFT_RW_ERR_FILE_TYPE;
+    }
+    if(TFFT_ViewVerify(pArea, headerSize, size))
+    {
+      if(copy)
+      {
+        TFFT_STATS_ADD(fname, backupReads, 1);
+      }
+      *ppData = pArea + headerSize;
+      return TFFT_RW_OK;
+    }
+  }
+
+  return TFFT_RW_ERR_CHECKSUM;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get the data of a file for a view. Lock must be held. */
+static int TFFT_ViewFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData, uint32_t *pSize)
+{
+  uint8_t type;
+  int rtnCode = TFFT_RW_ERR_FILE_TYPE; // Not mapped
+
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
+  }
+
+  type = TFFT_FILE_TYPE(pInst, fname);
+  if(type == TFFT_FILE_TYPE_LOG)
+  {
+    return TFFT_RW_ERR_FILE_TYPE; // Records are read with a cursor
+  }
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  if(TFFT_AsyncFind(pInst, fname))
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY; // The file is being replaced
+  }
+#endif
+
+  *pSize = (uint32_t)TFFT_FILE_SIZE(pInst, fname) * ((type == TFFT_FILE_TYPE_ARRAY) ? TFFT_FILE_SLOTS(pInst, fname) : 1);
+
+#if TFFT_CACHE_ENABLED
+  if(TFFT_BIT_GET(pInst->pCacheValid, fname))
+  {
+    *ppData = TFFT_GetCacheData(pInst, fname);
+    return TFFT_RW_OK;
+  }
+#endif
+
+  // Elements of array files are not contiguous in the device and packed
+  // files are stored compressed
+  if(pInst->pDriver->map && type != TFFT_FILE_TYPE_ARRAY && type != TFFT_FILE_TYPE_PACKED)
+  {
+    rtnCode = TFFT_ViewMapped(pInst, fname, ppData);
+    if(rtnCode == TFFT_RW_ERR_CHECKSUM && (TFFT_IS_FLASH(pInst) || TFFT_FILE_IS_RING(pInst, fname)))
+    {
+      // Newest record or slot has gone bad. Scan again for the newest valid one.
+#if TFFT_FLASH_ENABLED
+      if(TFFT_IS_FLASH(pInst))
+      {
+        pInst->f_flashScanned = 0;
+      }
+      else
+#endif
+      {
+        TFFT_GetRingState(pInst, fname)->f_scanned = 0;
+      }
+      rtnCode = TFFT_ViewMapped(pInst, fname, ppData);
+    }
+  }
+
+#if TFFT_CACHE_ENABLED
+  if(rtnCode == TFFT_RW_ERR_FILE_TYPE)
+  {
+    // Load the file, the cache then holds the view
+    if(type == TFFT_FILE_TYPE_ARRAY)
+    {
+      rtnCode = TFFT_ArrayReadWrite(pInst, fname, 0, TFFT_FILE_SLOTS(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ);
+    }
+    else
+    {
+      rtnCode = TFFT_DeviceReadWrite(pInst, fname, TFFT_FILE_SIZE(pInst, fname), TFFT_GetCacheData(pInst, fname), TFFT_RW_READ, 0);
+    }
+    if(rtnCode == TFFT_RW_OK)
+    {
+      TFFT_BIT_SET(pInst->pCacheValid, fname);
+      *ppData = TFFT_GetCacheData(pInst, fname);
+    }
+  }
+#endif
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get a read-only view of a file without copying it. *pGeneration (optional)
+   is set to the generation of the file, which is changed by every write.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstGetFileView(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData,
+                         uint32_t *pLen, uint32_t *pGeneration)
+{
+  uint32_t size = 0;
+  int rtnVal;
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+    TFFT_STATS_SET_FILE(fname);
+    rtnVal = TFFT_ViewFile(pInst, fname, ppData, &size);
+    if(rtnVal == TFFT_RW_OK)
+    {
+      *pLen = size;
+      if(pGeneration)
+      {
+        *pGeneration = TFFT_VIEW_GENERATION_GET(fname);
+      }
+    }
+    else
+    {
+      size = 0;
+    }
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+    TFFT_STATS_CLEAR_FILE();
+    TFFT_TRACE(TFFT_RW_READ, fname, size, rtnVal, startTime, pInst->traceLowLevel);
+    TFFT_Unlock(pInst, 0);
+  }
+
+  TFFT_STATS_CALL(fname, size, TFFT_RW_READ, rtnVal, startTime);
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Generation of a file. A view is valid as long as the generation is the
+   same as when the view was taken. Does not take the lock.
+   Returns 0 for invalid file names */
+uint32_t TFFT_InstGetFileGeneration(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname)
+{
+  if(!TFFT_IS_FILE_NAME_ALLOWED(pInst, fname))
+  {
+    return 0;
+  }
+
+  return TFFT_VIEW_GENERATION_GET(fname);
+}
+#endif /* TFFT_VIEW_ENABLED */
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write file from/to EEPROM
+   f_write is one of TFFT_RW_READ, TFFT_RW_WRITE, TFFT_RW_WRITE_COMPARE
+   or TFFT_RW_WRITE_ALWAYS.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstReadWriteFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  int rtnVal;
+#if TFFT_CACHE_ENABLED
+  uint8_t f_done;
+#endif
+#if TFFT_CALL_TIME_USED
+  uint32_t startTime = TFFT_CallTime();
+#endif
+
+#if TFFT_CACHE_ENABLED
+  if(!f_write)
+  {
+    // Reads of valid cached files only need a shared lock
+    if(TFFT_Lock(pInst, 1) != TFFT_RW_OK)
+    {
+      TFFT_STATS_CALL(fname, size, f_write, TFFT_RW_ERR_EEPROM_BUSY, startTime);
+      return TFFT_RW_ERR_EEPROM_BUSY;
+    }
+    f_done = TFFT_CacheReadShared(pInst, fname, size, pData);
+    if(f_done)
+    {
+      TFFT_TRACE(f_write, fname, size, TFFT_RW_OK, startTime, 0);
+    }
+    TFFT_Unlock(pInst, 1);
+
+    if(f_done)
+    {
+      TFFT_STATS_CALL(fname, size, f_write, TFFT_RW_OK, startTime);
+      return TFFT_RW_OK;
+    }
+  }
+#endif
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
+  }
+  else
+  {
+    rtnVal = TFFT_ReadWriteLocked(pInst, fname, size, pData, f_write, f_truncate);
+    TFFT_TRACE(f_write, fname, size, rtnVal, startTime, pInst->traceLowLevel);
+    TFFT_Unlock(pInst, 0);
+  }
+
+  TFFT_STATS_CALL(fname, size, f_write, rtnVal, startTime);
+
+  return rtnVal;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Read/Write a normal file at its address with size equal to the file size.
+   For callers that have checked file name, type and size at compile time
+   (see tfft.hpp), so these checks are not repeated. Goes through
+   TFFT_InstReadWriteFile() for flash instances and when the cache, the
+   asynchronous queue, statistics or the trace are enabled.
+   Returns either TFFT_RW_OK or a negative value
+   indicating that an error occurred */
+int TFFT_InstTransferFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address,
+                          TFFT_SIZE_TYPE size, uint8_t *pData, uint8_t f_write)
+{
+#if TFFT_CACHE_ENABLED || TFFT_ASYNC_QUEUE_SIZE > 0 || TFFT_STATS_ENABLED || TFFT_TRACE_SIZE > 0
+  (void)address;
+  return TFFT_InstReadWriteFile(pInst, fname, size, pData, f_write, 0);
+#else
+  int rtnVal;
+
+  if(TFFT_IS_FLASH(pInst))
+  {
+    return TFFT_InstReadWriteFile(pInst, fname, size, pData, f_write, 0);
+  }
+
+  if(TFFT_Lock(pInst, 0) != TFFT_RW_OK)
+  {
+    return TFFT_RW_ERR_EEPROM_BUSY;
+  }
+
+  if(f_write)
+  {
+    TFFT_VIEW_CHANGED(fname);
+  }
+
+  rtnVal = TFFT_TransferArea(pInst, address, 0, 0, pData, size, size, f_write);
+  TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+
+#if TFFT_BACKUP_MODE_ENABLED
+  // The backup copy follows the first copy
+  if(f_write)
+  {
+    rtnVal = TFFT_TransferArea(pInst, address + size + TFFT_CHECKSUM_SIZE, 0, 0, pData, size, size, f_write);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+  }
+  else if(rtnVal != TFFT_RW_OK)
+  {
+#if TFFT_REPAIR_ENABLED
+    int rtnFirst = rtnVal;
+
+#endif
+    rtnVal = TFFT_TransferArea(pInst, address + size + TFFT_CHECKSUM_SIZE, 0, 0, pData, size, size, f_write);
+    TFFT_UPDATE_ERROR_COUNT(fname, rtnVal);
+#if TFFT_REPAIR_ENABLED
+    if(rtnVal == TFFT_RW_OK && rtnFirst == TFFT_RW_ERR_CHECKSUM)
+    {
+      // Rewrite the bad first copy, as TFFT_ReadWriteFile() does
+      (void)TFFT_RepairCopy(pInst, fname, address + size + TFFT_CHECKSUM_SIZE, address, size + TFFT_CHECKSUM_SIZE);
+    }
+#endif
+  }
+#endif
+
+  TFFT_Unlock(pInst, 0);
+
+  return rtnVal;
+#endif
+}
+
+//=========================================================
+// Default instance API
+//=========================================================
 /*----------------------------------------------------------------------------*/
 uint32_t TFFT_GetErrorCount()
 {
-  return sau32_errorCount;
+  return TFFT_InstGetErrorCount(&s_defaultInstance);
 }
 
 /*----------------------------------------------------------------------------*/
 void TFFT_ResetErrorCount()
 {
-  sau32_errorCount = 0;
+  TFFT_InstResetErrorCount(&s_defaultInstance);
 }
 
 /*----------------------------------------------------------------------------*/
-static TFFT_SIZE_TYPE TFFT_GetTypeMaxFileSize(void)
+uint32_t TFFT_GetBytesWritten(void)
 {
-  switch(sizeof(TFFT_SIZE_TYPE))
-  {
-      case 1:
-        return (TFFT_SIZE_TYPE)0xFF;
-      case 2:
-        return (TFFT_SIZE_TYPE)0xFFFF;
-      case 4:
-        return (TFFT_SIZE_TYPE)0xFFFFFFFF;
-      default:
-        return 0;
-  }
+  return TFFT_InstGetBytesWritten(&s_defaultInstance);
 }
 
 /*----------------------------------------------------------------------------*/
-static TFFT_SIZE_TYPE TFFT_EepromStrlen(const char *pStr)
+uint32_t TFFT_GetBytesSkipped(void)
 {
-  TFFT_SIZE_TYPE len;
-  TFFT_SIZE_TYPE maxLen = TFFT_GetTypeMaxFileSize();
-
-  for(len = 0; len < maxLen && pStr[len] != '\0'; len++)
-  {
-  }
-
-  return len;
+  return TFFT_InstGetBytesSkipped(&s_defaultInstance);
 }
 
 /*----------------------------------------------------------------------------*/
-/* Get file size with checksum and backup size (if used) */
-inline static TFFT_ADDR_TYPE TFFT_GetRealFileSize(TFFT_FILE_NAME_TYPE fname)
+void TFFT_ResetByteCounts(void)
 {
-  TFFT_ADDR_TYPE realSize = TFFT_GET_FILE_SIZE_WITH_CHECKSUM(fname);
-#if TFFT_BACKUP_MODE_ENABLED
-    realSize *= 2;
-#endif // TFFT_BACKUP_MODE_ENABLED
-  return realSize;
+  TFFT_InstResetByteCounts(&s_defaultInstance);
 }
 
+#if TFFT_STATS_ENABLED
 /*----------------------------------------------------------------------------*/
-/* Calculate the address based on size of preceding data */
-static TFFT_ADDR_TYPE TFFT_GetAddress(TFFT_FILE_NAME_TYPE fname)
+int TFFT_GetFileStats(TFFT_FILE_NAME_TYPE fname, TFFT_FILE_STATS *pStats)
 {
-  TFFT_FILE_NAME_TYPE i;
-  TFFT_ADDR_TYPE address = TFFT_START_ADDRESS;
-
-  for(i = 0; i < TFFT_FILE_COUNT; i++)
-  {
-    if(i == fname)
-    {
-      return address;
-    }
+  return TFFT_InstGetFileStats(&s_defaultInstance, fname, pStats);
+}
 
-    address += TFFT_GetRealFileSize(i);
-  }
+/*----------------------------------------------------------------------------*/
+void TFFT_GetStats(TFFT_FILE_STATS *pStats)
+{
+  TFFT_InstGetStats(&s_defaultInstance, pStats);
+}
 
-  return 0;
+/*----------------------------------------------------------------------------*/
+void TFFT_ResetStats(void)
+{
+  TFFT_InstResetStats(&s_defaultInstance);
 }
+#endif /* TFFT_STATS_ENABLED */
 
+#if TFFT_TRACE_SIZE > 0
 /*----------------------------------------------------------------------------*/
-/* Use this to verify that the highest possible address fits chosen data type */
-uint32_t TFFT_GetMaxAddress(void)
+int TFFT_TraceDump(uint8_t *pBuf, uint32_t bufSize, uint32_t *pLength)
 {
-  TFFT_FILE_NAME_TYPE i;
-  unsigned long address = (uint32_t)TFFT_START_ADDRESS;
+  return TFFT_InstTraceDump(&s_defaultInstance, pBuf, bufSize, pLength);
+}
 
-  for(i = 0; i < TFFT_FILE_COUNT; i++)
-  {
-    address += TFFT_GetRealFileSize(i);
-  }
+/*----------------------------------------------------------------------------*/
+int TFFT_TraceClear(void)
+{
+  return TFFT_InstTraceClear(&s_defaultInstance);
+}
+#endif /* TFFT_TRACE_SIZE > 0 */
 
-  return (address - 1);
+/*----------------------------------------------------------------------------*/
+int TFFT_ScanRingFiles(void)
+{
+  return TFFT_InstScanRingFiles(&s_defaultInstance);
 }
 
+#if TFFT_ASYNC_QUEUE_SIZE > 0
 /*----------------------------------------------------------------------------*/
-size_t TFFT_GetFileTableSize(void)
+int TFFT_WriteAsync(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, const void *pData,
+                    uint8_t priority, TFFT_ASYNC_CALLBACK callback)
 {
-  return sizeof(sa_fileTable);
+  return TFFT_InstWriteAsync(&s_defaultInstance, fname, size, pData, priority, callback);
 }
 
 /*----------------------------------------------------------------------------*/
-/* Read/Write byte from/to EEPROM */
-static int TFFT_ReadWriteByte(TFFT_ADDR_TYPE address, uint8_t *pByte, uint8_t f_write, uint16_t *pChecksum)
+int TFFT_GetAsyncStatus(TFFT_FILE_NAME_TYPE fname)
 {
-  int rtnCode;
+  return TFFT_InstGetAsyncStatus(&s_defaultInstance, fname);
+}
+#endif /* TFFT_ASYNC_QUEUE_SIZE > 0 */
 
-  if(TFFT_IS_ADDRESS_IN_RANGE(address))
-  {
-    if(f_write)
-    {
-      rtnCode = TFFT_EEPROM_WRITE_BYTE_FUNC(address, *pByte);
-    }
-    else // Read
-    {
-      rtnCode = TFFT_EEPROM_READ_BYTE_FUNC(address, pByte);
-    }
+/*----------------------------------------------------------------------------*/
+int TFFT_ReadRange(TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, void *pData)
+{
+  return TFFT_InstReadRange(&s_defaultInstance, fname, first, count, pData);
+}
 
-    if(rtnCode != TFFT_RW_OK)
-    {
-      return rtnCode; // EEPROM Read/Write error
-    }
+/*----------------------------------------------------------------------------*/
+int TFFT_WriteRange(TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, const void *pData)
+{
+  return TFFT_InstWriteRange(&s_defaultInstance, fname, first, count, pData);
+}
 
-#if TFFT_USE_FILE_CRC8 || TFFT_USE_FILE_CRC16
-    if(pChecksum)
-    {
-#if TFFT_USE_FILE_CRC8
-      TFFT_Crc8(*pByte, (uint8_t*)pChecksum);
-#else // TFFT_USE_FILE_CRC16
-      TFFT_Crc16(*pByte, pChecksum);
-#endif
-    }
-#endif
+/*----------------------------------------------------------------------------*/
+int TFFT_LogAppend(TFFT_FILE_NAME_TYPE fname, const void *pData)
+{
+  return TFFT_InstLogAppend(&s_defaultInstance, fname, pData);
+}
 
-    return TFFT_RW_OK; // Success
-  }
+/*----------------------------------------------------------------------------*/
+int TFFT_LogOpen(TFFT_FILE_NAME_TYPE fname, TFFT_LOG_CURSOR *pCursor, uint8_t f_newestFirst)
+{
+  return TFFT_InstLogOpen(&s_defaultInstance, fname, pCursor, f_newestFirst);
+}
 
-  return TFFT_RW_ERR_ADDRESS; // Address out of range
+/*----------------------------------------------------------------------------*/
+int TFFT_LogRead(TFFT_LOG_CURSOR *pCursor, void *pData)
+{
+  return TFFT_InstLogRead(&s_defaultInstance, pCursor, pData);
 }
 
-#if TFFT_BACKUP_MODE_ENABLED
+#if TFFT_VIEW_ENABLED
 /*----------------------------------------------------------------------------*/
-/* Read/Write file from/to EEPROM
-   Returns either TFFT_RW_OK or a negative value
-   indicating that an error occurred */
-static int TFFT_ReadWriteFileInternal(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
-                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate, uint8_t f_duplicate)
-#else
-static int TFFT_ReadWriteFileInternal(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
-                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
-#endif
+int TFFT_GetFileView(TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData, uint32_t *pLen, uint32_t *pGeneration)
 {
-  TFFT_ADDR_TYPE address;
-  TFFT_ADDR_TYPE i;
-  int rtnCode;
+  return TFFT_InstGetFileView(&s_defaultInstance, fname, ppData, pLen, pGeneration);
+}
 
-#if TFFT_USE_FILE_CRC8 || TFFT_USE_FILE_CRC16
-  uint16_t u16Temp = 0;
-  uint16_t checksum = 0;
+/*----------------------------------------------------------------------------*/
+uint32_t TFFT_GetFileGeneration(TFFT_FILE_NAME_TYPE fname)
+{
+  return TFFT_InstGetFileGeneration(&s_defaultInstance, fname);
+}
 #endif
 
-  if(!TFFT_IS_FILE_NAME_ALLOWED(fname))
-  {
-    return(TFFT_RW_ERR_FILE_NAME); // File name not allowed
-  }
-
-  // Is the size of the requested file to store larger than
-  // what has been reserved in the file table?
-  if(size > sa_fileTable[fname])
-  {
-    if(f_write && !f_truncate)
-    {
-      return(TFFT_RW_ERR_FILE_TOO_LARGE); // Trying to write too large file
-    }
-    else // Write with truncated data or, if read, adjust length
-    {
-      size = sa_fileTable[fname];
-    }
-  }
+/*----------------------------------------------------------------------------*/
+int TFFT_Poll(void)
+{
+  return TFFT_InstPoll(&s_defaultInstance);
+}
 
-  address = TFFT_GetAddress(fname);
+/*----------------------------------------------------------------------------*/
+int TFFT_Flush(void)
+{
+  return TFFT_InstFlush(&s_defaultInstance);
+}
 
-#if TFFT_BACKUP_MODE_ENABLED
-  // If the file to access is the duplicate (aka backup) file, then it will reside
-  // after the first (primary) file.
-  if(f_duplicate)
-  {
-    address += TFFT_GET_FILE_SIZE_WITH_CHECKSUM(fname);
-  }
-#endif // TFFT_BACKUP_MODE_ENABLED
+/*----------------------------------------------------------------------------*/
+int TFFT_FlushFile(TFFT_FILE_NAME_TYPE fname)
+{
+  return TFFT_InstFlushFile(&s_defaultInstance, fname);
+}
 
-  for(i = address; i < (address + size); i++)
-  {
-#if TFFT_USE_FILE_CRC8 || TFFT_USE_FILE_CRC16
-    rtnCode = TFFT_ReadWriteByte(i, pData, f_write, &checksum);
-#else
-    rtnCode = TFFT_ReadWriteByte(i, pData, f_write, 0);
-#endif
+/*----------------------------------------------------------------------------*/
+int TFFT_CacheLoad(void)
+{
+  return TFFT_InstCacheLoad(&s_defaultInstance);
+}
 
-    if(rtnCode != TFFT_RW_OK)
-    {
-      return(rtnCode);
-    }
+/*----------------------------------------------------------------------------*/
+int TFFT_Mount(TFFT_VERIFY_RESULT *pResult)
+{
+  return TFFT_InstMount(&s_defaultInstance, pResult);
+}
 
-    pData++;
-  }
+/*----------------------------------------------------------------------------*/
+int TFFT_VerifyAll(TFFT_VERIFY_RESULT *pResult)
+{
+  return TFFT_InstVerifyAll(&s_defaultInstance, pResult);
+}
 
-#if TFFT_USE_FILE_CRC8 || TFFT_USE_FILE_CRC16
-  // Continue write or read so whole allocated memory
-  // is used, otherwise the checksum won't be correct
-  for( ; i < (address + size); i++)
-  {
-    rtnCode = TFFT_ReadWriteByte(i, (uint8_t*)&u16Temp, f_write, &checksum);
+#if TFFT_REPAIR_ENABLED
+/*----------------------------------------------------------------------------*/
+int TFFT_Scrub(uint32_t maxBytes)
+{
+  return TFFT_InstScrub(&s_defaultInstance, maxBytes);
+}
 
-    if(rtnCode != TFFT_RW_OK)
-    {
-      return(rtnCode);
-    }
-  }
+/*----------------------------------------------------------------------------*/
+void TFFT_GetRepairCounters(TFFT_REPAIR_COUNTERS *pCounters)
+{
+  TFFT_InstGetRepairCounters(&s_defaultInstance, pCounters);
+}
 
-  // Write/Read checksum bytes
-  if(f_write)
-  {
-#if TFFT_DEBUG_ENABLED
-    printf("Write checksum = 0x%04X\n", (unsigned int)checksum);
-#endif
-    rtnCode = TFFT_ReadWriteByte(i, (uint8_t*)&checksum, f_write, 0);
-#if TFFT_USE_FILE_CRC16
-    rtnCode = TFFT_ReadWriteByte(i + 1, ((uint8_t*)&checksum) + 1, f_write, 0);
-#endif
-  }
-  else // Read
-  {
-      rtnCode = TFFT_ReadWriteByte(i, (uint8_t*)&u16Temp, f_write, 0);
-#if TFFT_USE_FILE_CRC16
-      rtnCode = TFFT_ReadWriteByte(i + 1, ((uint8_t*)&u16Temp) + 1, f_write, 0);
-#endif
-#if TFFT_DEBUG_ENABLED
-      printf("Read file checksum = 0x%04X\n", (unsigned int)u16Temp);
-      printf("Read calculated checksum = 0x%04X\n", (unsigned int)checksum);
+/*----------------------------------------------------------------------------*/
+void TFFT_ResetRepairCounters(void)
+{
+  TFFT_InstResetRepairCounters(&s_defaultInstance);
+}
 #endif
-      if(u16Temp != checksum)
-      {
-        return(TFFT_RW_ERR_CHECKSUM); // Checksum error
-      }
-  }
 
-  if(rtnCode != TFFT_RW_OK)
-  {
-    return(rtnCode); // Negative value
-  }
-#endif /* TFFT_USE_FILE_CRC8 || TFFT_USE_FILE_CRC16 */
+/*----------------------------------------------------------------------------*/
+uint32_t TFFT_GetImageSize(void)
+{
+  return TFFT_InstGetImageSize(&s_defaultInstance);
+}
 
-  return TFFT_RW_OK;
+/*----------------------------------------------------------------------------*/
+int TFFT_ExportImage(uint32_t offset, uint8_t *pData, uint32_t len)
+{
+  return TFFT_InstExportImage(&s_defaultInstance, offset, pData, len);
 }
 
-#define TFFT_UPDATE_ERROR_COUNT(retVal) do{if((rtnVal)!=TFFT_RW_OK)sau32_errorCount++;}while(0)
+/*----------------------------------------------------------------------------*/
+int TFFT_ImportImage(uint32_t offset, const uint8_t *pData, uint32_t len)
+{
+  return TFFT_InstImportImage(&s_defaultInstance, offset, pData, len);
+}
 
 /*----------------------------------------------------------------------------*/
-/* Read/Write file from/to EEPROM
-   Returns either TFFT_RW_OK or a negative value
-   indicating that an error occurred */
-int TFFT_ReadWriteFile(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
-                         uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+int TFFT_ReadBatch(TFFT_BATCH_ITEM *pItems, uint16_t count)
 {
-  int rtnVal;
+  return TFFT_InstReadBatch(&s_defaultInstance, pItems, count);
+}
 
-  //TODO: Checking and setting the busy flag should be a safe section
-  if(saf_busy)
-  {
-    rtnVal = TFFT_RW_ERR_EEPROM_BUSY;
-  }
-  else
-  {
-    saf_busy = 1;
-#if TFFT_BACKUP_MODE_ENABLED
-    // Write/Read first copy
-    rtnVal = TFFT_ReadWriteFileInternal(fname, size, pData, f_write, f_truncate, 0);
-    TFFT_UPDATE_ERROR_COUNT(rtnVal);
+/*----------------------------------------------------------------------------*/
+int TFFT_WriteBatch(TFFT_BATCH_ITEM *pItems, uint16_t count)
+{
+  return TFFT_InstWriteBatch(&s_defaultInstance, pItems, count);
+}
 
-    if(f_write)
-    {
-      // Write second copy (backup)
-      rtnVal = TFFT_ReadWriteFileInternal(fname, size, pData, f_write, f_truncate, 1);
-      TFFT_UPDATE_ERROR_COUNT(rtnVal);
-    }
-    else if(rtnVal != TFFT_RW_OK)
-    {
-#if TFFT_DEBUG_ENABLED
-      printf("rtnVal = %d\n", rtnVal);
-#endif
-      // There was an error reading the first copy, read the backup copy.
-      rtnVal = TFFT_ReadWriteFileInternal(fname, size, pData, f_write, f_truncate, 1);
-      TFFT_UPDATE_ERROR_COUNT(rtnVal);
-    }
-#else
-    rtnVal = TFFT_ReadWriteFileInternal(fname, size, pData, f_write, f_truncate);
-    TFFT_UPDATE_ERROR_COUNT(rtnVal);
-#endif // TFFT_BACKUP_MODE_ENABLED
-    saf_busy = 0;
-  }
+/*----------------------------------------------------------------------------*/
+int TFFT_ReadWriteFile(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                       uint8_t *pData, uint8_t f_write, uint8_t f_truncate)
+{
+  return TFFT_InstReadWriteFile(&s_defaultInstance, fname, size, pData, f_write, f_truncate);
+}
 
-  return rtnVal;
+/*----------------------------------------------------------------------------*/
+int TFFT_TransferFile(TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address, TFFT_SIZE_TYPE size,
+                      uint8_t *pData, uint8_t f_write)
+{
+  return TFFT_InstTransferFile(&s_defaultInstance, fname, address, size, pData, f_write);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_Write64(TFFT_FILE_NAME_TYPE fname, uint64_t data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(uint64_t), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(uint64_t), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_Write32(TFFT_FILE_NAME_TYPE fname, uint32_t data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(uint32_t), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(uint32_t), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_Write16(TFFT_FILE_NAME_TYPE fname, uint16_t data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(uint16_t), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(uint16_t), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_Write8(TFFT_FILE_NAME_TYPE fname, uint8_t data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(uint8_t), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(uint8_t), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_WriteFloat(TFFT_FILE_NAME_TYPE fname, float data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(float), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(float), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
 int TFFT_WriteDouble(TFFT_FILE_NAME_TYPE fname, double data)
 {
-  return TFFT_ReadWriteFile(fname, sizeof(double), (uint8_t*)&data, 1, 0);
+  return TFFT_ReadWriteFile(fname, sizeof(double), (uint8_t*)&data, TFFT_RW_WRITE, 0);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -409,7 +5723,7 @@ int TFFT_WriteString(TFFT_FILE_NAME_TYPE fname, const char *pStr)
 {
   // Also write null terminator if string is shorter than what fits in eeprom.
   // If length of string is same as what fits in eeprom, the null terminator will be excluded.
-  return TFFT_ReadWriteFile(fname, (TFFT_EepromStrlen(pStr) + 1), (uint8_t*)pStr, 1, 1);
+  return TFFT_ReadWriteFile(fname, (TFFT_EepromStrlen(pStr) + 1), (uint8_t*)pStr, TFFT_RW_WRITE, 1);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -424,7 +5738,7 @@ int TFFT_ReadString(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE maxStrLen, char *p
   // Insert null terminator at maxStrLen (guarantees that string will be terminated)
   pStr[maxStrLen] = '\0';
 
-  return TFFT_ReadWriteFile(fname, maxStrLen, (uint8_t*)pStr, 0, 0);
+  return TFFT_ReadWriteFile(fname, maxStrLen, (uint8_t*)pStr, TFFT_RW_READ, 0);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -451,6 +5765,12 @@ const char* TFFT_RetValToStr(int retVal)
     case TFFT_RW_ERR_FILE_TABLE:
         p = "File table is corrupt";
         break;
+    case TFFT_RW_ERR_FILE_TYPE:
+        p = "Call not possible for the type of the file";
+        break;
+    case TFFT_RW_ERR_ELEMENT:
+        p = "Element out of range";
+        break;
     case TFFT_RW_ERR_LOW_LEVEL_WRITE:
         p = "Low level write failed";
         break;
@@ -460,6 +5780,21 @@ const char* TFFT_RetValToStr(int retVal)
     case TFFT_RW_ERR_EEPROM_BUSY:
         p = "EEPROM currently busy. Try later.";
         break;
+    case TFFT_RW_ERR_QUEUE_FULL:
+        p = "Asynchronous write queue is full";
+        break;
+    case TFFT_RW_ERR_LOW_LEVEL_ERASE:
+        p = "Low level sector erase failed";
+        break;
+    case TFFT_RW_PENDING:
+        p = "Write pending";
+        break;
+    case TFFT_RW_LOG_END:
+        p = "End of log";
+        break;
+    case TFFT_RW_SCRUB_DONE:
+        p = "Scrub pass done";
+        break;
     default:
         p = "Unknown value!";
         break;
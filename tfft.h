@@ -29,29 +29,427 @@
 #ifndef TFFT_H_
 #define TFFT_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "tfft_user.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Return codes for writing/reading
 #define TFFT_RW_OK                    0 // Success
 #define TFFT_RW_ERR_FILE_NAME        -1 // File name not allowed
 #define TFFT_RW_ERR_FILE_TOO_LARGE   -2 // Trying to write too large file
 #define TFFT_RW_ERR_ADDRESS          -3 // Address out of range
 #define TFFT_RW_ERR_CHECKSUM         -4 // CRC error
-#define TFFT_RW_ERR_FILE_TABLE       -5 // File table is corrupt
+#define TFFT_RW_ERR_FILE_TABLE       -5 // File table is corrupt or can not be migrated
+#define TFFT_RW_ERR_FILE_TYPE        -6 // Call not possible for the type of the file
+#define TFFT_RW_ERR_ELEMENT          -7 // Element out of range (array files)
 #define TFFT_RW_ERR_LOW_LEVEL_WRITE -10 // Low level write failed
 #define TFFT_RW_ERR_LOW_LEVEL_READ  -11 // Low level read failed
 #define TFFT_RW_ERR_EEPROM_BUSY     -12 // EEPROM currently busy. Try later.
+#define TFFT_RW_ERR_QUEUE_FULL      -13 // Asynchronous write queue is full
+#define TFFT_RW_ERR_LOW_LEVEL_ERASE -14 // Low level sector erase failed (flash)
+#define TFFT_RW_PENDING               1 // Asynchronous write queued or in progress
+#define TFFT_RW_LOG_END               2 // No more records (TFFT_LogRead())
+#define TFFT_RW_SCRUB_DONE            3 // A pass over all files is done (TFFT_Scrub())
+
+// Values for f_write in TFFT_ReadWriteFile()
+#define TFFT_RW_READ           0 // Read file
+#define TFFT_RW_WRITE          1 // Write file. Compare before write if TFFT_COMPARE_BEFORE_WRITE is set.
+#define TFFT_RW_WRITE_COMPARE  3 // Write file. Only bytes that differ from the stored file are written.
+#define TFFT_RW_WRITE_ALWAYS   5 // Write file. All bytes are written.
+
+#if(TFFT_USE_FILE_CRC8 + TFFT_USE_FILE_CRC16 + TFFT_USE_FILE_CRC32C > 1)
+#error TFFT_USE_FILE_CRC8, TFFT_USE_FILE_CRC16 and TFFT_USE_FILE_CRC32C are mutually exclusive!
+#endif
+
+// File types used in the file table in tfft_user.h
+#define TFFT_FILE_TYPE_NORMAL 0 // Normal file. Count must be 1.
+#define TFFT_FILE_TYPE_RING   1 // Wear leveled file. Count is the number of slots.
+#define TFFT_FILE_TYPE_ARRAY  2 // Array of count elements of size bytes, checksum per element.
+#define TFFT_FILE_TYPE_LOG    3 // Circular log of count records of size bytes, stored as a ring file.
+#define TFFT_FILE_TYPE_PACKED 4 // Compressed file of size bytes, stored in count bytes (TFFT_PACK_ENABLED).
+
+/** Log files use the slots of a ring file, every slot is a record */
+#define TFFT_IS_RING_TYPE(type) ((type) == TFFT_FILE_TYPE_RING || (type) == TFFT_FILE_TYPE_LOG)
 
-#if(TFFT_USE_FILE_CRC8 && TFFT_USE_FILE_CRC16)
-#error TFFT_USE_FILE_CRC8 and TFFT_USE_FILE_CRC16 are mutually exclusive!
+/** File name enum of a file table, countName is set to the number of files.
+Also used for the file tables of other instances (see tfft_instance.h). */
+#define TFFT_FILE_NAME_ENTRY(fname, size, type, count) fname,
+#define TFFT_FILE_NAMES(FILE_TABLE, countName) \
+  enum \
+  { \
+    FILE_TABLE(TFFT_FILE_NAME_ENTRY) \
+    countName \
+  };
+
+// File names generated from the file table in tfft_user.h
+TFFT_FILE_NAMES(TFFT_FILE_TABLE, TFFT_FILE_COUNT)
+
+/** Largest number of files of all instances. Sizes the bit maps of
+TFFT_VERIFY_RESULT. */
+#ifndef TFFT_MAX_FILE_COUNT
+#define TFFT_MAX_FILE_COUNT TFFT_FILE_COUNT
 #endif
 
-uint32_t TFFT_GetMaxAddress(void);
+/** Number of checksum bytes stored after each file */
+#define TFFT_CHECKSUM_SIZE (TFFT_USE_FILE_CRC8 + (TFFT_USE_FILE_CRC16 * 2) + (TFFT_USE_FILE_CRC32C * 4))
+
+/** Set if a checksum is stored after each file */
+#define TFFT_CHECKSUM_ENABLED (TFFT_CHECKSUM_SIZE > 0)
+
+/** Size of the sequence number stored in each slot of a ring file */
+#define TFFT_RING_HEADER_SIZE 2
+
+/** Size of the length of the compressed data stored before it in packed files */
+#define TFFT_PACK_HEADER_SIZE 2
+
+/** Number of bytes used in EEPROM by a file, including checksum and backup
+copy (if used). Ring and log files use count slots with sequence number and
+checksum each, but no backup copy. Array files store each element as a normal file
+(element, checksum and backup copy). Packed files store the compressed length
+and up to count bytes of compressed data with checksum and backup copy. */
+#define TFFT_FILE_REAL_SIZE(size, type, count) \
+  (TFFT_IS_RING_TYPE(type) ? ((count) * (TFFT_RING_HEADER_SIZE + (size) + TFFT_CHECKSUM_SIZE)) : \
+   ((type) == TFFT_FILE_TYPE_ARRAY) ? ((count) * ((size) + TFFT_CHECKSUM_SIZE) * (1 + TFFT_BACKUP_MODE_ENABLED)) : \
+   ((type) == TFFT_FILE_TYPE_PACKED) ? ((TFFT_PACK_HEADER_SIZE + (count) + TFFT_CHECKSUM_SIZE) * (1 + TFFT_BACKUP_MODE_ENABLED)) : \
+                                     (((size) + TFFT_CHECKSUM_SIZE) * (1 + TFFT_BACKUP_MODE_ENABLED)))
+
+/** Number of data bytes of a file, all elements of an array file */
+#define TFFT_FILE_DATA_SIZE(size, type, count) ((size) * (((type) == TFFT_FILE_TYPE_ARRAY) ? (count) : 1))
+
+// Memory layout of the files. Never instantiated, only used to let the
+// compiler calculate file offsets (offsetof) and total size (sizeof).
+#define TFFT_FILE_LAYOUT_ENTRY(fname, size, type, count) uint8_t fname[TFFT_FILE_REAL_SIZE(size, type, count)];
+typedef struct
+{
+  TFFT_FILE_TABLE(TFFT_FILE_LAYOUT_ENTRY)
+} TFFT_FILE_LAYOUT;
+
+/** Highest EEPROM address used by the file table */
+#define TFFT_MAX_ADDRESS ((uint32_t)TFFT_START_ADDRESS + sizeof(TFFT_FILE_LAYOUT) - 1)
+
+/** Number of bytes of a bit map with one bit per file */
+#define TFFT_FILE_BITMAP_SIZE ((TFFT_MAX_FILE_COUNT + 7) / 8)
+
+/** Bit of file fname in a bit map with one bit per file */
+#define TFFT_FILE_BIT(map, fname) (((map)[(fname) >> 3] >> ((fname) & 7)) & 1)
+
+/** Result of TFFT_Mount() and TFFT_VerifyAll() */
+typedef struct
+{
+  uint8_t valid[TFFT_FILE_BITMAP_SIZE];   // File can be read (a valid copy or ring slot)
+  uint8_t primary[TFFT_FILE_BITMAP_SIZE]; // First copy of a normal file is valid
+  uint8_t backup[TFFT_FILE_BITMAP_SIZE];  // Backup copy is valid (backup mode only)
+  TFFT_FILE_NAME_TYPE invalidCount;       // Number of files that can not be read
+} TFFT_VERIFY_RESULT;
+
+/** Device functions of an instance. The functions get the pDevice pointer
+of the instance and otherwise work as the functions set in tfft_user.h
+(TFFT_EEPROM_WRITE_BYTE_FUNC etc.). Optional functions are 0 if not used.
+Without lock function, a call made while another call to the same instance
+is in progress fails with TFFT_RW_ERR_EEPROM_BUSY. eraseSector is only used
+by flash instances (see TFFT_FLASH_ENABLED). map is only used by
+TFFT_GetFileView() and returns a pointer to the byte at address, or 0 if the
+device is not mapped. All addresses of the instance must then be mapped
+linearly (internal EEPROM emulation, memory mapped FRAM or flash). */
+typedef struct
+{
+  int (*writeByte)(void *pDevice, TFFT_ADDR_TYPE address, uint8_t byte);
+  int (*readByte)(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pByte);
+  int (*readBlock)(void *pDevice, TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len);         // Optional
+  int (*writePage)(void *pDevice, TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len);   // Optional
+  int (*isReady)(void *pDevice);                                                                       // Optional
+  int (*lock)(void *pDevice, uint8_t f_shared, uint32_t timeoutMs);                                    // Optional
+  void (*unlock)(void *pDevice, uint8_t f_shared);                                                     // With lock
+  int (*eraseSector)(void *pDevice, TFFT_ADDR_TYPE address);                                           // Flash only
+  const uint8_t* (*map)(void *pDevice, TFFT_ADDR_TYPE address);                                        // Optional
+} TFFT_DRIVER;
+
+/** One device with its file table and state. Generated with
+tfft_instance.h. The functions without instance parameter use the default
+instance, set up from tfft_user.h. */
+typedef struct TFFT_INSTANCE TFFT_INSTANCE;
+
+TFFT_INSTANCE* TFFT_GetDefaultInstance(void);
+
+#define TFFT_GetMaxAddress() TFFT_MAX_ADDRESS
 size_t TFFT_GetFileTableSize(void);
 uint32_t TFFT_GetErrorCount();
 void TFFT_ResetErrorCount();
+uint32_t TFFT_GetBytesWritten(void);
+uint32_t TFFT_GetBytesSkipped(void);
+void TFFT_ResetByteCounts(void);
+int TFFT_ScanRingFiles(void);
+int TFFT_Mount(TFFT_VERIFY_RESULT *pResult);
+int TFFT_VerifyAll(TFFT_VERIFY_RESULT *pResult);
+
+int TFFT_Flush(void);
+int TFFT_FlushFile(TFFT_FILE_NAME_TYPE fname);
+int TFFT_CacheLoad(void);
+
+uint32_t TFFT_InstGetErrorCount(TFFT_INSTANCE *pInst);
+void TFFT_InstResetErrorCount(TFFT_INSTANCE *pInst);
+uint32_t TFFT_InstGetBytesWritten(TFFT_INSTANCE *pInst);
+uint32_t TFFT_InstGetBytesSkipped(TFFT_INSTANCE *pInst);
+void TFFT_InstResetByteCounts(TFFT_INSTANCE *pInst);
+int TFFT_InstScanRingFiles(TFFT_INSTANCE *pInst);
+int TFFT_InstMount(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult);
+int TFFT_InstVerifyAll(TFFT_INSTANCE *pInst, TFFT_VERIFY_RESULT *pResult);
+
+int TFFT_InstFlush(TFFT_INSTANCE *pInst);
+int TFFT_InstFlushFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname);
+int TFFT_InstCacheLoad(TFFT_INSTANCE *pInst);
+
+#if TFFT_STATS_ENABLED
+/** Statistics counters, all uint32_t and wrapping:
+  reads          - Read calls
+  writes         - Write calls (asynchronous writes when done)
+  bytesRead      - Bytes read by the caller
+  bytesWritten   - Bytes given by the caller in successful writes
+  errors         - Read and write calls that failed (not counting busy)
+  checksumErrors - Copies or ring slots that failed checksum verification
+  backupReads    - Reads that used the backup copy or an older ring slot
+  lowLevelErrors - Failed low level calls
+  busy           - Calls rejected with TFFT_RW_ERR_EEPROM_BUSY
+  lowLevelCalls  - Calls of the user read/write functions
+  time           - Time spent in calls in TFFT_GET_TIME_FUNC units (0 without it)
+  packedBytes    - File bytes compressed by writes of packed files
+  storedBytes    - Bytes stored for them (length and compressed data). The
+                   compression ratio is storedBytes / packedBytes.
+  repairs        - Bad copies rewritten from the good copy (TFFT_REPAIR_ENABLED) */
+#define TFFT_STATS_FIELDS(TFFT_STAT) \
+  TFFT_STAT(reads) \
+  TFFT_STAT(writes) \
+  TFFT_STAT(bytesRead) \
+  TFFT_STAT(bytesWritten) \
+  TFFT_STAT(errors) \
+  TFFT_STAT(checksumErrors) \
+  TFFT_STAT(backupReads) \
+  TFFT_STAT(lowLevelErrors) \
+  TFFT_STAT(busy) \
+  TFFT_STAT(lowLevelCalls) \
+  TFFT_STAT(time) \
+  TFFT_STAT(packedBytes) \
+  TFFT_STAT(storedBytes) \
+  TFFT_STAT(repairs)
+
+#define TFFT_STATS_STRUCT_ENTRY(field) uint32_t field;
+typedef struct
+{
+  TFFT_STATS_FIELDS(TFFT_STATS_STRUCT_ENTRY)
+} TFFT_FILE_STATS;
+
+int TFFT_GetFileStats(TFFT_FILE_NAME_TYPE fname, TFFT_FILE_STATS *pStats);
+void TFFT_GetStats(TFFT_FILE_STATS *pStats);
+void TFFT_ResetStats(void);
+
+int TFFT_InstGetFileStats(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_FILE_STATS *pStats);
+void TFFT_InstGetStats(TFFT_INSTANCE *pInst, TFFT_FILE_STATS *pStats);
+void TFFT_InstResetStats(TFFT_INSTANCE *pInst);
+#endif /* TFFT_STATS_ENABLED */
+
+#if TFFT_TRACE_SIZE > 0
+/** Operations in the trace. TFFT_ReadWriteFile() calls use the f_write
+value (TFFT_RW_READ, TFFT_RW_WRITE, TFFT_RW_WRITE_COMPARE or
+TFFT_RW_WRITE_ALWAYS). Entries of a batch share start and end time and the
+last item has the low level calls of the whole batch. */
+#define TFFT_TRACE_WRITE_ASYNC  16 // TFFT_WriteAsync() (queued)
+#define TFFT_TRACE_POLL         17 // TFFT_Poll() that wrote a chunk of fname
+#define TFFT_TRACE_BATCH_READ   18 // Item of TFFT_ReadBatch()
+#define TFFT_TRACE_BATCH_WRITE  19 // Item of TFFT_WriteBatch()
+#define TFFT_TRACE_FLUSH        20 // TFFT_Flush() or TFFT_FlushFile()
+#define TFFT_TRACE_MOUNT        21 // TFFT_Mount()
+#define TFFT_TRACE_VERIFY       22 // TFFT_VerifyAll()
+#define TFFT_TRACE_SCRUB        23 // TFFT_Scrub(), size is maxBytes
+
+/** fname of operations that are not done for a single file */
+#define TFFT_TRACE_ALL_FILES 0xFFFF
+
+/** One traced call. Times are TFFT_GET_TIME_FUNC values (0 without it).
+Calls rejected with TFFT_RW_ERR_EEPROM_BUSY are not traced. */
+typedef struct
+{
+  uint32_t seq;           // Entry number since start or TFFT_TraceClear()
+  uint32_t start;         // Time at call start
+  uint32_t end;           // Time at call end
+  uint32_t size;          // Requested size
+  uint16_t fname;         // File name or TFFT_TRACE_ALL_FILES
+  uint16_t lowLevelCalls; // Calls of the user read/write functions
+  int8_t result;          // Return value
+  uint8_t op;             // TFFT_RW_READ/WRITE.. or TFFT_TRACE_..
+} TFFT_TRACE_ENTRY;
+
+/** Dump format of TFFT_TraceDump(), all values least significant byte first.
+Header: magic "TFTR" (uint32_t 0x52544654), uint8_t version, uint8_t record
+size, uint16_t number of files in the file table, uint32_t number of
+records, uint32_t seq of the next entry. Records, oldest first: seq, start,
+end, size (uint32_t), fname, lowLevelCalls (uint16_t), result (int8_t),
+op (uint8_t), 2 reserved bytes. */
+#define TFFT_TRACE_MAGIC          0x52544654
+#define TFFT_TRACE_VERSION        1
+#define TFFT_TRACE_HEADER_SIZE    16
+#define TFFT_TRACE_RECORD_SIZE    24
+#define TFFT_TRACE_DUMP_SIZE      (TFFT_TRACE_HEADER_SIZE + TFFT_TRACE_SIZE * TFFT_TRACE_RECORD_SIZE)
+
+int TFFT_TraceDump(uint8_t *pBuf, uint32_t bufSize, uint32_t *pLength);
+int TFFT_TraceClear(void);
+
+int TFFT_InstTraceDump(TFFT_INSTANCE *pInst, uint8_t *pBuf, uint32_t bufSize, uint32_t *pLength);
+int TFFT_InstTraceClear(TFFT_INSTANCE *pInst);
+#endif /* TFFT_TRACE_SIZE > 0 */
+
+/** One file of TFFT_ReadBatch() or TFFT_WriteBatch() */
+typedef struct
+{
+  TFFT_FILE_NAME_TYPE fname; // File to read or write
+  TFFT_SIZE_TYPE size;       // Number of bytes to read or write
+  void *pData;               // Data buffer
+  int result;                // Set to TFFT_RW_OK or a negative error code
+} TFFT_BATCH_ITEM;
+
+int TFFT_ReadBatch(TFFT_BATCH_ITEM *pItems, uint16_t count);
+int TFFT_WriteBatch(TFFT_BATCH_ITEM *pItems, uint16_t count);
+
+int TFFT_InstReadBatch(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, uint16_t count);
+int TFFT_InstWriteBatch(TFFT_INSTANCE *pInst, TFFT_BATCH_ITEM *pItems, uint16_t count);
+
+/** Called when an asynchronous write is done. result is TFFT_RW_OK or a
+negative value indicating that an error occurred. */
+typedef void (*TFFT_ASYNC_CALLBACK)(TFFT_FILE_NAME_TYPE fname, int result);
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+int TFFT_WriteAsync(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, const void *pData,
+                    uint8_t priority, TFFT_ASYNC_CALLBACK callback);
+int TFFT_GetAsyncStatus(TFFT_FILE_NAME_TYPE fname);
+
+int TFFT_InstWriteAsync(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, const void *pData,
+                        uint8_t priority, TFFT_ASYNC_CALLBACK callback);
+int TFFT_InstGetAsyncStatus(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname);
+#endif
+int TFFT_Poll(void);
+int TFFT_InstPoll(TFFT_INSTANCE *pInst);
 
 int TFFT_ReadWriteFile(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, uint8_t *pData, uint8_t f_write, uint8_t f_truncate);
+int TFFT_InstReadWriteFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size,
+                           uint8_t *pData, uint8_t f_write, uint8_t f_truncate);
+
+/** Transfer of a whole normal file at its address without the run time
+checks of TFFT_ReadWriteFile(). Used by the C++ front end (tfft.hpp), which
+checks file name, type and size at compile time. */
+int TFFT_TransferFile(TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address, TFFT_SIZE_TYPE size,
+                      uint8_t *pData, uint8_t f_write);
+int TFFT_InstTransferFile(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address,
+                          TFFT_SIZE_TYPE size, uint8_t *pData, uint8_t f_write);
+
+/** Elements of array files (TFFT_FILE_TYPE_ARRAY). Only the given elements
+are read or written, each with its own checksum. pData holds count elements
+of the size in the file table. Array files can not be accessed with
+TFFT_ReadWriteFile(), batches or asynchronous writes (TFFT_RW_ERR_FILE_TYPE). */
+int TFFT_ReadRange(TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, void *pData);
+int TFFT_WriteRange(TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, const void *pData);
+
+int TFFT_InstReadRange(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, void *pData);
+int TFFT_InstWriteRange(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, uint16_t first, uint16_t count, const void *pData);
+
+/** Cursor of a log file (TFFT_FILE_TYPE_LOG), set up by TFFT_LogOpen() */
+typedef struct
+{
+  TFFT_FILE_NAME_TYPE fname; // Log file
+  uint16_t seq;              // Sequence number of the next record to read
+  uint16_t remaining;        // Records left to read
+  uint8_t f_newestFirst;     // Read from the newest to the oldest record
+} TFFT_LOG_CURSOR;
+
+/** Log files. TFFT_LogAppend() writes one record of the size in the file
+table over the oldest one. TFFT_LogRead() reads the next record of a cursor
+and returns TFFT_RW_LOG_END after the last one. Only the records read are
+touched, each verified with its own checksum. Log files can not be accessed
+with TFFT_ReadWriteFile(), batches or asynchronous writes
+(TFFT_RW_ERR_FILE_TYPE). */
+int TFFT_LogAppend(TFFT_FILE_NAME_TYPE fname, const void *pData);
+int TFFT_LogOpen(TFFT_FILE_NAME_TYPE fname, TFFT_LOG_CURSOR *pCursor, uint8_t f_newestFirst);
+int TFFT_LogRead(TFFT_LOG_CURSOR *pCursor, void *pData);
+
+int TFFT_InstLogAppend(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const void *pData);
+int TFFT_InstLogOpen(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, TFFT_LOG_CURSOR *pCursor, uint8_t f_newestFirst);
+int TFFT_InstLogRead(TFFT_INSTANCE *pInst, TFFT_LOG_CURSOR *pCursor, void *pData);
+
+#if TFFT_VIEW_ENABLED
+/** Read-only view of a file without copying. *ppData is set to the verified
+data in the RAM cache or, if the file is not cached, in the memory of a
+mapped device (see map in TFFT_DRIVER). Without map function, the file is
+first loaded to the cache. *pLen is the file size (all elements of array
+files). The view stays valid until the file is written, which changes the
+generation returned in *pGeneration (optional, may be 0). Compare it with
+TFFT_GetFileGeneration() after using the data. Returns TFFT_RW_ERR_FILE_TYPE
+for log files and for files that are neither cached nor mapped (array and
+packed files are only viewed in the cache), TFFT_RW_ERR_EEPROM_BUSY while an asynchronous
+write of the file is queued. */
+int TFFT_GetFileView(TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData, uint32_t *pLen, uint32_t *pGeneration);
+uint32_t TFFT_GetFileGeneration(TFFT_FILE_NAME_TYPE fname);
+
+int TFFT_InstGetFileView(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname, const uint8_t **ppData,
+                         uint32_t *pLen, uint32_t *pGeneration);
+uint32_t TFFT_InstGetFileGeneration(TFFT_INSTANCE *pInst, TFFT_FILE_NAME_TYPE fname);
+#endif
+
+#if TFFT_REPAIR_ENABLED
+/** Counters of the repair of bad copies in backup mode */
+typedef struct
+{
+  uint32_t repairs;      // Bad copies rewritten from the good copy
+  uint32_t unrepairable; // Elements without a valid copy found by TFFT_Scrub()
+  uint32_t scrubBytes;   // Bytes verified by TFFT_Scrub()
+  uint32_t scrubPasses;  // Passes of TFFT_Scrub() over all files
+} TFFT_REPAIR_COUNTERS;
+
+/** Verify up to maxBytes of the copies of normal, array and packed files,
+continuing where the previous call stopped. When one copy of a file or
+element is bad, both are verified again and the bad copy is rewritten from
+the good one, which may exceed maxBytes. Ring and log files (older slots act
+as backup) and files with a queued asynchronous write are skipped.
+Returns TFFT_RW_OK, TFFT_RW_SCRUB_DONE when a pass over all files was
+completed (the next call starts a new pass) or a negative value indicating
+that an error occurred. */
+int TFFT_Scrub(uint32_t maxBytes);
+void TFFT_GetRepairCounters(TFFT_REPAIR_COUNTERS *pCounters);
+void TFFT_ResetRepairCounters(void);
+
+int TFFT_InstScrub(TFFT_INSTANCE *pInst, uint32_t maxBytes);
+void TFFT_InstGetRepairCounters(TFFT_INSTANCE *pInst, TFFT_REPAIR_COUNTERS *pCounters);
+void TFFT_InstResetRepairCounters(TFFT_INSTANCE *pInst);
+#endif
+
+/** Image of all files of an instance as stored in the device, with
+checksums, backup copies and ring slots: the file area followed by the
+layout header area (TFFT_LAYOUT_ENABLED), or the whole area of a flash
+instance. Built on a host with tools/tfft_image.c for factory provisioning.
+TFFT_ImportImage() writes a part of the image with sequential page writes,
+reads it back in one pass and returns TFFT_RW_ERR_LOW_LEVEL_WRITE if it was
+not stored as written. Parts must be imported in order on flash, whose
+sectors are erased when their first byte is imported. When the part that
+ends the image is imported (not on flash), all files are verified and
+TFFT_RW_ERR_CHECKSUM is returned if a file is invalid and not erased (all
+bytes 0xFF, not in the image). The state of all files is then read again
+from the device.
+Both return TFFT_RW_ERR_ADDRESS if offset and len are not within the
+image. */
+uint32_t TFFT_GetImageSize(void);
+int TFFT_ExportImage(uint32_t offset, uint8_t *pData, uint32_t len);
+int TFFT_ImportImage(uint32_t offset, const uint8_t *pData, uint32_t len);
+
+uint32_t TFFT_InstGetImageSize(TFFT_INSTANCE *pInst);
+int TFFT_InstExportImage(TFFT_INSTANCE *pInst, uint32_t offset, uint8_t *pData, uint32_t len);
+int TFFT_InstImportImage(TFFT_INSTANCE *pInst, uint32_t offset, const uint8_t *pData, uint32_t len);
+
+#define TFFT_ReadElement(fname, index, pDest) TFFT_ReadRange(fname, index, 1, pDest)
+#define TFFT_WriteElement(fname, index, pSrc) TFFT_WriteRange(fname, index, 1, pSrc)
+#define TFFT_InstReadElement(pInst, fname, index, pDest) TFFT_InstReadRange(pInst, fname, index, 1, pDest)
+#define TFFT_InstWriteElement(pInst, fname, index, pSrc) TFFT_InstWriteRange(pInst, fname, index, 1, pSrc)
 
 int TFFT_Write64(TFFT_FILE_NAME_TYPE fname, uint64_t data);
 int TFFT_Write32(TFFT_FILE_NAME_TYPE fname, uint32_t data);
@@ -61,7 +459,8 @@ int TFFT_Write8(TFFT_FILE_NAME_TYPE fname, uint8_t data);
 int TFFT_WriteFloat(TFFT_FILE_NAME_TYPE fname, float data);
 int TFFT_WriteDouble(TFFT_FILE_NAME_TYPE fname, double data);
 
-#define TFFT_WriteData(fname, size, pSrc) TFFT_ReadWriteFile(fname, size, (u8*)pSrc, 1, 0)
+#define TFFT_WriteData(fname, size, pSrc) TFFT_ReadWriteFile(fname, size, (uint8_t*)pSrc, TFFT_RW_WRITE, 0)
+#define TFFT_WriteDataCompare(fname, size, pSrc) TFFT_ReadWriteFile(fname, size, (uint8_t*)pSrc, TFFT_RW_WRITE_COMPARE, 0)
 
 /**
  * @brief Write unsigned 64 bit datatype
@@ -79,22 +478,26 @@ int TFFT_WriteDouble(TFFT_FILE_NAME_TYPE fname, double data);
 #define TFFT_WriteS8(fname, data) TFFT_Write8(fname, (uint8_t)data)
 #define TFFT_WriteChar(fname, data) TFFT_Write8(fname, (uint8_t)data)
 
-#define TFFT_ReadData(fname, size, pDest) TFFT_ReadWriteFile(fname, size, (uint8_t*)pDest, 0, 0)
+#define TFFT_ReadData(fname, size, pDest) TFFT_ReadWriteFile(fname, size, (uint8_t*)pDest, TFFT_RW_READ, 0)
 
-#define TFFT_ReadU64(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint64_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadS64(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int64_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadU32(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint32_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadS32(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int32_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadU16(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint16_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadS16(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int16_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadU8(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint8_t), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadChar(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(char), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadFloat(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(float), (uint8_t*)pDest, 0, 0)
-#define TFFT_ReadDouble(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(double), (uint8_t*)pDest, 0, 0)
+#define TFFT_ReadU64(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint64_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadS64(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int64_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadU32(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint32_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadS32(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int32_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadU16(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint16_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadS16(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(int16_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadU8(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(uint8_t), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadChar(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(char), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadFloat(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(float), (uint8_t*)pDest, TFFT_RW_READ, 0)
+#define TFFT_ReadDouble(fname, pDest) TFFT_ReadWriteFile(fname, sizeof(double), (uint8_t*)pDest, TFFT_RW_READ, 0)
 
 int TFFT_WriteString(TFFT_FILE_NAME_TYPE fname, const char *pStr);
 int TFFT_ReadString(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE maxStrLen, char *pStr);
 
 const char* TFFT_RetValToStr(int retVal);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* TFFT_H_ */
@@ -0,0 +1,186 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft.hpp
+ * @brief Header-only C++ (C++11) front end with typed file access.
+ *
+ * Address, size, type and checksum width of each file are computed at
+ * compile time from the same file table as the C library. A file is
+ * accessed as a type, so a wrong file name or a type that does not match
+ * the file size fails to compile:
+ *
+ * @code
+ * #include "tfft.hpp"
+ *
+ * typedef tfft::File<FILE3_NAME_SENSOR_VAL2_S32, int32_t> SensorVal2;
+ *
+ * int32_t v = 0;
+ * SensorVal2::read(v);
+ * SensorVal2::write(v + 1);
+ * @endcode
+ *
+ * Normal files go straight to TFFT_TransferFile() with the constant
+ * address and size, without the run time checks of TFFT_ReadWriteFile().
+ * Ring and packed files use TFFT_ReadWriteFile(). Array and log files
+ * have no File type (use the range and log functions).
+ *
+ * Files of other instances (see tfft_instance.h) get a table type with
+ * TFFT_CPP_TABLE() and are accessed with tfft::BasicFile:
+ *
+ * @code
+ * extern "C" TFFT_INSTANCE g_fram;
+ * TFFT_CPP_TABLE(FramTable, FRAM_FILE_TABLE, FRAM_FILE_COUNT, 0, &g_fram)
+ *
+ * typedef tfft::BasicFile<FramTable, FRAM_FILE_CONFIG, Config> FramConfig;
+ * @endcode
+ *
+ * @author Lars Jelleryd
+ */
+
+#ifndef TFFT_HPP_
+#define TFFT_HPP_
+
+#include <type_traits>
+
+#include "tfft.h"
+
+// Entries of the constexpr functions of a table type. Each file is compared
+// with the file name n, so no array is needed (C++11 constexpr).
+#define TFFT_CPP_SIZE_ENTRY(fname, size, type, count) ((n) == (fname)) ? (uint32_t)(size) :
+#define TFFT_CPP_TYPE_ENTRY(fname, size, type, count) ((n) == (fname)) ? (uint8_t)(type) :
+#define TFFT_CPP_COUNT_ENTRY(fname, size, type, count) ((n) == (fname)) ? (uint32_t)(count) :
+#define TFFT_CPP_OFFSET_ENTRY(fname, size, type, count) + (((fname) < (n)) ? (uint32_t)TFFT_FILE_REAL_SIZE(size, type, count) : 0)
+
+/** Table type tableName of the file table FILE_TABLE with countName files
+(see TFFT_FILE_NAMES()), stored from startAddress on the instance pInstance.
+Use at namespace scope. */
+#define TFFT_CPP_TABLE(tableName, FILE_TABLE, countName, startAddress, pInstance) \
+  struct tableName \
+  { \
+    static constexpr uint32_t fileCount() { return (uint32_t)(countName); } \
+    static constexpr uint32_t start() { return (uint32_t)(startAddress); } \
+    static constexpr uint32_t size(uint32_t n) { return FILE_TABLE(TFFT_CPP_SIZE_ENTRY) 0; } \
+    static constexpr uint8_t type(uint32_t n) { return FILE_TABLE(TFFT_CPP_TYPE_ENTRY) 0; } \
+    static constexpr uint32_t count(uint32_t n) { return FILE_TABLE(TFFT_CPP_COUNT_ENTRY) 0; } \
+    static constexpr uint32_t offset(uint32_t n) { return 0 FILE_TABLE(TFFT_CPP_OFFSET_ENTRY); } \
+    static int transfer(TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address, TFFT_SIZE_TYPE size, \
+                        uint8_t *pData, uint8_t f_write) \
+    { \
+      return TFFT_InstTransferFile(pInstance, fname, address, size, pData, f_write); \
+    } \
+    static int readWrite(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, uint8_t *pData, uint8_t f_write) \
+    { \
+      return TFFT_InstReadWriteFile(pInstance, fname, size, pData, f_write, 0); \
+    } \
+  };
+
+namespace tfft
+{
+
+/** Table type of the file table in tfft_user.h on the default instance */
+struct DefaultTable
+{
+  static constexpr uint32_t fileCount() { return TFFT_FILE_COUNT; }
+  static constexpr uint32_t start() { return TFFT_START_ADDRESS; }
+  static constexpr uint32_t size(uint32_t n) { return TFFT_FILE_TABLE(TFFT_CPP_SIZE_ENTRY) 0; }
+  static constexpr uint8_t type(uint32_t n) { return TFFT_FILE_TABLE(TFFT_CPP_TYPE_ENTRY) 0; }
+  static constexpr uint32_t count(uint32_t n) { return TFFT_FILE_TABLE(TFFT_CPP_COUNT_ENTRY) 0; }
+  static constexpr uint32_t offset(uint32_t n) { return 0 TFFT_FILE_TABLE(TFFT_CPP_OFFSET_ENTRY); }
+  static int transfer(TFFT_FILE_NAME_TYPE fname, TFFT_ADDR_TYPE address, TFFT_SIZE_TYPE size,
+                      uint8_t *pData, uint8_t f_write)
+  {
+    return TFFT_TransferFile(fname, address, size, pData, f_write);
+  }
+  static int readWrite(TFFT_FILE_NAME_TYPE fname, TFFT_SIZE_TYPE size, uint8_t *pData, uint8_t f_write)
+  {
+    return TFFT_ReadWriteFile(fname, size, pData, f_write, 0);
+  }
+};
+
+// The offsets must match the layout used by the C library
+#define TFFT_CPP_LAYOUT_CHECK(fname, size, type, count) \
+  static_assert(DefaultTable::offset(fname) == offsetof(TFFT_FILE_LAYOUT, fname), "offset of " #fname);
+TFFT_FILE_TABLE(TFFT_CPP_LAYOUT_CHECK)
+#undef TFFT_CPP_LAYOUT_CHECK
+
+/** File Name of the table type Table holding a value of type T. All
+properties are compile time constants. */
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T>
+class BasicFile
+{
+public:
+  static_assert(Name < Table::fileCount(), "file name not in the file table");
+  static_assert(std::is_trivially_copyable<T>::value, "files hold trivially copyable types");
+
+  static constexpr uint32_t size = Table::size(Name);             // Bytes of the file
+  static constexpr uint8_t type = Table::type(Name);              // TFFT_FILE_TYPE_...
+  static constexpr uint32_t count = Table::count(Name);           // Slots (ring files)
+  static constexpr uint32_t address = Table::start() + Table::offset(Name);
+  static constexpr uint32_t checksumSize = TFFT_CHECKSUM_SIZE;    // Bytes of the checksum of each copy
+  static constexpr uint32_t realSize = TFFT_FILE_REAL_SIZE(size, type, count); // Bytes used in EEPROM
+  static constexpr bool hasBackup = TFFT_BACKUP_MODE_ENABLED && type == TFFT_FILE_TYPE_NORMAL;
+  static constexpr uint32_t backupAddress = hasBackup ? (address + size + checksumSize) : 0; // 0 = no backup
+
+  static_assert(sizeof(T) == size, "type does not match the file size");
+  static_assert(type == TFFT_FILE_TYPE_NORMAL || type == TFFT_FILE_TYPE_RING || type == TFFT_FILE_TYPE_PACKED,
+                "array and log files are accessed with the range and log functions");
+  static_assert((TFFT_ADDR_TYPE)(address + realSize - 1) == address + realSize - 1, "TFFT_ADDR_TYPE too small");
+
+  /** Read the file. Returns TFFT_RW_OK or a negative error code. */
+  static int read(T &value)
+  {
+    return access(reinterpret_cast<uint8_t*>(&value), TFFT_RW_READ);
+  }
+
+  /** Write the file. f_write is TFFT_RW_WRITE, TFFT_RW_WRITE_COMPARE or
+  TFFT_RW_WRITE_ALWAYS. Returns TFFT_RW_OK or a negative error code. */
+  static int write(const T &value, uint8_t f_write = TFFT_RW_WRITE)
+  {
+    // Not modified by writes
+    return access(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&value)), f_write);
+  }
+
+private:
+  static int access(uint8_t *pData, uint8_t f_write)
+  {
+    // Constant condition, only one branch is compiled in
+    return (type == TFFT_FILE_TYPE_NORMAL) ?
+           Table::transfer(Name, (TFFT_ADDR_TYPE)address, (TFFT_SIZE_TYPE)size, pData, f_write) :
+           Table::readWrite(Name, (TFFT_SIZE_TYPE)size, pData, f_write);
+  }
+};
+
+// Definitions of the constants, needed when they are bound to a reference
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::size;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint8_t BasicFile<Table, Name, T>::type;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::count;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::address;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::checksumSize;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::realSize;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr bool BasicFile<Table, Name, T>::hasBackup;
+template<class Table, TFFT_FILE_NAME_TYPE Name, class T> constexpr uint32_t BasicFile<Table, Name, T>::backupAddress;
+
+/** File Name of the file table in tfft_user.h holding a value of type T */
+template<TFFT_FILE_NAME_TYPE Name, class T>
+using File = BasicFile<DefaultTable, Name, T>;
+
+} // namespace tfft
+
+#endif /* TFFT_HPP_ */
@@ -6,6 +6,10 @@
 #ifndef TFFT_CRC16_H_
 #define TFFT_CRC16_H_
 
+#include <stdint.h>
+#include <stddef.h>
+
 void TFFT_Crc16(uint8_t inpByte, uint16_t *pCrc);
+uint16_t TFFT_Crc16Buffer(const uint8_t *pData, size_t len, uint16_t init);
 
 #endif /* TFFT_CRC16_H_ */
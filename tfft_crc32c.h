@@ -0,0 +1,18 @@
+/**
+ * @file tfft_crc32c.h
+ * @brief CRC32C (Castagnoli) implementation
+ *
+ * The CRC is inverted before and after each call, so an init value of 0
+ * gives the standard CRC32C and calls can be chained.
+ */
+
+#ifndef TFFT_CRC32C_H_
+#define TFFT_CRC32C_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+void TFFT_Crc32c(uint8_t inpByte, uint32_t *pCrc);
+uint32_t TFFT_Crc32cBuffer(const uint8_t *pData, size_t len, uint32_t init);
+
+#endif /* TFFT_CRC32C_H_ */
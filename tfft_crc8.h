@@ -29,6 +29,10 @@
 #ifndef TFFT_CRC8_H_
 #define TFFT_CRC8_H_
 
+#include <stdint.h>
+#include <stddef.h>
+
 void TFFT_Crc8(uint8_t inpByte, uint8_t *pCrc);
+uint8_t TFFT_Crc8Buffer(const uint8_t *pData, size_t len, uint8_t init);
 
 #endif /* TFFT_CRC8_H_ */
@@ -0,0 +1,181 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft_crc_clmul.c
+ * @brief Carry-less multiply (PCLMUL) folding for non-reflected CRCs
+ *
+ * The buffer is seen as one large polynomial M(x) (first byte, most
+ * significant bit first = highest degree). Blocks of 128 bits are folded
+ * forward by multiplying with x^n mod P(x), which keeps the running value
+ * congruent to M(x) modulo P(x). The CRC of the 16 byte remainder is then
+ * the same as the CRC of the folded data.
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <string.h>
+
+#include "tfft_crc_clmul.h"
+
+#if TFFT_CRC_CLMUL_AVAILABLE
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+/* Fold constants for one polynomial P(x) = x^width + poly. Each is x^n mod P,
+   i.e. 1 shifted left n times, XOR:ing x^width + poly whenever bit width is set. */
+typedef struct
+{
+  uint32_t poly;
+  unsigned int width;
+  uint64_t k192; // Fold one block (with k128)
+  uint64_t k128;
+  uint64_t k576; // Fold four blocks (with k512)
+  uint64_t k512;
+} TFFT_CRC_CLMUL_KEYS;
+
+/* Constant, so threads and instances can fold in parallel */
+static const TFFT_CRC_CLMUL_KEYS sa_keys[] =
+{
+  {0x07,   8,  0x26,   0x02,   0x37,   0x10},   // CRC8 (tfft_crc8.c)
+  {0x1021, 16, 0x650B, 0xAEFC, 0x8832, 0x13FC}  // CRC16-CCITT (tfft_crc16.c)
+};
+
+/*----------------------------------------------------------------------------*/
+/* Checked once. Threads that call it at the same time all store the same
+   value, the atomic accesses keep that free of data races. */
+static int TFFT_CrcClmulSupported(void)
+{
+  static int s_supported = -1;
+  int supported = __atomic_load_n(&s_supported, __ATOMIC_RELAXED);
+
+  if(supported < 0)
+  {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    __atomic_store_n(&s_supported, supported, __ATOMIC_RELAXED);
+  }
+
+  return supported;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Load 16 bytes as a 128 bit polynomial, first byte most significant */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i TFFT_CrcLoad(const uint8_t *p)
+{
+  const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), reverse);
+}
+
+/*----------------------------------------------------------------------------*/
+/* acc * x^n mod P (not fully reduced), n given by the keys */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i TFFT_CrcFold(__m128i acc, __m128i keys)
+{
+  return _mm_xor_si128(_mm_clmulepi64_si128(acc, keys, 0x11),
+                       _mm_clmulepi64_si128(acc, keys, 0x00));
+}
+
+/*----------------------------------------------------------------------------*/
+__attribute__((target("pclmul,ssse3")))
+static size_t TFFT_CrcClmulFoldInternal(const uint8_t *pData, size_t len,
+                                        const TFFT_CRC_CLMUL_KEYS *pKeys,
+                                        uint32_t init, uint8_t *pRemainder)
+{
+  const uint8_t *p = pData;
+  const __m128i k128 = _mm_set_epi64x((long long)pKeys->k192, (long long)pKeys->k128);
+  const __m128i k512 = _mm_set_epi64x((long long)pKeys->k576, (long long)pKeys->k512);
+  __m128i acc0, acc1, acc2, acc3;
+  uint64_t hi;
+  uint64_t lo;
+
+  acc0 = TFFT_CrcLoad(p);
+  acc1 = TFFT_CrcLoad(p + 16);
+  acc2 = TFFT_CrcLoad(p + 32);
+  acc3 = TFFT_CrcLoad(p + 48);
+  p += 64;
+  len -= 64;
+
+  // The initial CRC value is the same as XOR:ing it into the first bits
+  acc0 = _mm_xor_si128(acc0, _mm_set_epi64x((long long)((uint64_t)init << (64 - pKeys->width)), 0));
+
+  // Four independent accumulators to hide the multiply latency
+  while(len >= 64)
+  {
+    acc0 = _mm_xor_si128(TFFT_CrcFold(acc0, k512), TFFT_CrcLoad(p));
+    acc1 = _mm_xor_si128(TFFT_CrcFold(acc1, k512), TFFT_CrcLoad(p + 16));
+    acc2 = _mm_xor_si128(TFFT_CrcFold(acc2, k512), TFFT_CrcLoad(p + 32));
+    acc3 = _mm_xor_si128(TFFT_CrcFold(acc3, k512), TFFT_CrcLoad(p + 48));
+    p += 64;
+    len -= 64;
+  }
+
+  acc1 = _mm_xor_si128(TFFT_CrcFold(acc0, k128), acc1);
+  acc2 = _mm_xor_si128(TFFT_CrcFold(acc1, k128), acc2);
+  acc3 = _mm_xor_si128(TFFT_CrcFold(acc2, k128), acc3);
+
+  while(len >= 16)
+  {
+    acc3 = _mm_xor_si128(TFFT_CrcFold(acc3, k128), TFFT_CrcLoad(p));
+    p += 16;
+    len -= 16;
+  }
+
+  hi = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc3, acc3)));
+  lo = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(acc3));
+  memcpy(pRemainder, &hi, 8);
+  memcpy(pRemainder + 8, &lo, 8);
+
+  return (size_t)(p - pData);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Fold the buffer into a 16 byte remainder (written to pRemainder).
+   poly is the CRC polynomial without the x^width term, init the initial
+   CRC value. The CRC of the folded bytes is the CRC of the remainder
+   calculated with initial value 0.
+   Returns the number of bytes folded (a multiple of 16) or 0 if folding
+   is not supported by the CPU, there are no constants for the polynomial
+   or the buffer is too short. */
+size_t TFFT_CrcClmulFold(const uint8_t *pData, size_t len, uint32_t poly,
+                         unsigned int width, uint32_t init, uint8_t *pRemainder)
+{
+  size_t i;
+
+  if(len < 64 || !TFFT_CrcClmulSupported())
+  {
+    return 0;
+  }
+
+  for(i = 0; i < sizeof(sa_keys) / sizeof(sa_keys[0]); i++)
+  {
+    if(sa_keys[i].width == width && sa_keys[i].poly == poly)
+    {
+      return TFFT_CrcClmulFoldInternal(pData, len, &sa_keys[i], init, pRemainder);
+    }
+  }
+
+  return 0;
+}
+
+#endif /* TFFT_CRC_CLMUL_AVAILABLE */
@@ -0,0 +1,54 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft_crc_clmul.h
+ * @brief Carry-less multiply (PCLMUL) folding for non-reflected CRCs
+ *
+ * Used by TFFT_Crc8Buffer() and TFFT_Crc16Buffer() to speed up checksum
+ * calculation of large buffers on x86-64. The buffer is folded into a
+ * 16 byte remainder that has the same CRC as the folded part of the buffer.
+ *
+ * @author Lars Jelleryd
+ */
+
+#ifndef TFFT_CRC_CLMUL_H_
+#define TFFT_CRC_CLMUL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Set to 1 to use PCLMUL folding when supported by the compiler and CPU
+(x86-64 with PCLMUL and SSSE3, checked at run time) */
+#ifndef TFFT_CRC_USE_CLMUL
+#define TFFT_CRC_USE_CLMUL 1
+#endif
+
+#if TFFT_CRC_USE_CLMUL && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TFFT_CRC_CLMUL_AVAILABLE 1
+#else
+#define TFFT_CRC_CLMUL_AVAILABLE 0
+#endif
+
+#if TFFT_CRC_CLMUL_AVAILABLE
+size_t TFFT_CrcClmulFold(const uint8_t *pData, size_t len, uint32_t poly,
+                         unsigned int width, uint32_t init, uint8_t *pRemainder);
+#endif
+
+#endif /* TFFT_CRC_CLMUL_H_ */
@@ -29,11 +29,91 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "tfft.h"
 
+/* Size of the default simulated EEPROM (used until TFFT_EepromSimuOpen()) */
+#define SIMU_DEFAULT_SIZE 2048
+
 /* For eeprom simulation */
-static uint8_t simEeprom[2048];
+static uint8_t simEeprom[SIMU_DEFAULT_SIZE];
+static uint32_t simWear[SIMU_DEFAULT_SIZE];
+
+/* Current memory, either simEeprom or a mapped file */
+static uint8_t *sp_mem = simEeprom;
+static uint32_t *sp_wear = simWear;
+static TFFT_EEPROM_SIMU_CONFIG s_config = {SIMU_DEFAULT_SIZE, TFFT_EEPROM_PAGE_SIZE, 0, 0, 0, 0, 0, 0, 0};
+static uint8_t sf_mapped = 0;
+
+/* Modelled time when the current write cycle is done (real time mode) */
+static uint64_t s_busyUntilNs = 0;
+
+/* Number of low level calls */
+static TFFT_EEPROM_SIMU_COUNTERS s_counters;
+
+/*----------------------------------------------------------------------------*/
+static uint64_t SIMU_NowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Account for one bus transaction of len bytes followed by a write cycle
+   of cycleNs (0 for reads). In real time mode, first wait for a write cycle
+   in progress (acknowledge polling) and then spin for the transfer. The
+   write cycle itself runs in the "background" until TFFT_EepromIsReady(). */
+static void SIMU_Transaction(uint32_t len, uint32_t cycleNs)
+{
+  uint64_t transferNs = (uint64_t)s_config.busOverheadNs + (uint64_t)s_config.byteTransferNs * len;
+  uint64_t now;
+
+  s_counters.simTimeNs += transferNs + cycleNs;
+
+  if(!s_config.f_realTime)
+  {
+    return;
+  }
+
+  now = SIMU_NowNs();
+  if(now < s_busyUntilNs)
+  {
+    s_counters.busyWaitNs += s_busyUntilNs - now;
+    while((now = SIMU_NowNs()) < s_busyUntilNs)
+    {
+    }
+  }
+
+  while(SIMU_NowNs() - now < transferNs)
+  {
+  }
+
+  s_busyUntilNs = now + transferNs + cycleNs;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Store a written byte. Flash can only clear bits, EEPROM cells are
+   rewritten (and worn) by every write. */
+static void SIMU_Program(uint32_t address, uint8_t byte)
+{
+  if(s_config.sectorSize)
+  {
+    sp_mem[address] &= byte;
+  }
+  else
+  {
+    sp_mem[address] = byte;
+    sp_wear[address]++;
+  }
+}
 
 /*----------------------------------------------------------------------------*/
 /* This should be an external platform specific function
@@ -43,7 +123,14 @@ static uint8_t simEeprom[2048];
    Return: 0 (TFFT_RW_OK) = write OK, -10 (TFFT_RW_ERR_LOW_LEVEL_WRITE) = write failed */
 int TFFT_EepromWriteByte(TFFT_ADDR_TYPE address, uint8_t byte)
 {
-  simEeprom[address] = byte;
+  if((uint32_t)address >= s_config.size)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_WRITE;
+  }
+
+  s_counters.byteWrites++;
+  SIMU_Transaction(1, s_config.byteWriteNs);
+  SIMU_Program(address, byte);
 
   return TFFT_RW_OK; // Write OK
 }
@@ -56,24 +143,289 @@ int TFFT_EepromWriteByte(TFFT_ADDR_TYPE address, uint8_t byte)
    Return: 0 (TFFT_RW_OK) = read OK, -11 (TFFT_RW_ERR_LOW_LEVEL_READ) = read failed */
 int TFFT_EepromReadByte(TFFT_ADDR_TYPE address, uint8_t *pByte)
 {
-  *pByte = simEeprom[address];
+  if((uint32_t)address >= s_config.size)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_READ;
+  }
+
+  s_counters.byteReads++;
+  SIMU_Transaction(1, 0);
+  *pByte = sp_mem[address];
 
   return TFFT_RW_OK; // Read OK
 }
 
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function
+   Write up to one page in a single write cycle. Writing across a page
+   boundary would wrap around within the page on a real EEPROM, so it is
+   treated as an error here.
+   Return: 0 (TFFT_RW_OK) = write OK, -10 (TFFT_RW_ERR_LOW_LEVEL_WRITE) = write failed,
+   -21 = page boundary crossed */
+int TFFT_EepromWritePage(TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  TFFT_ADDR_TYPE i;
+
+  if(len == 0 || (address / s_config.pageSize) != ((address + len - 1) / s_config.pageSize))
+  {
+    return -21; // Page boundary crossed
+  }
+
+  if((uint32_t)address + len > s_config.size)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_WRITE;
+  }
+
+  s_counters.pageWrites++;
+  s_counters.bytesWritten += len;
+  SIMU_Transaction(len, s_config.pageWriteNs);
+
+  for(i = 0; i < len; i++)
+  {
+    SIMU_Program(address + i, pData[i]);
+  }
+
+  return TFFT_RW_OK; // Write OK
+}
+
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function
+   Read a block of bytes in a single transaction.
+   Return: 0 (TFFT_RW_OK) = read OK, -11 (TFFT_RW_ERR_LOW_LEVEL_READ) = read failed */
+int TFFT_EepromReadBlock(TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+{
+  if((uint32_t)address + len > s_config.size)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_READ;
+  }
+
+  s_counters.blockReads++;
+  s_counters.bytesRead += len;
+  SIMU_Transaction(len, 0);
+
+  memcpy(pData, &sp_mem[address], len);
+
+  return TFFT_RW_OK; // Read OK
+}
+
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function (flash only)
+   Erase the sector starting at address to 0xFF. Each erase counts as one
+   write cycle of every cell of the sector.
+   Return: 0 (TFFT_RW_OK) = erase OK, -14 (TFFT_RW_ERR_LOW_LEVEL_ERASE) = erase failed */
+int TFFT_EepromEraseSector(TFFT_ADDR_TYPE address)
+{
+  uint32_t i;
+
+  if(s_config.sectorSize == 0 || (uint32_t)address % s_config.sectorSize != 0 ||
+     (uint32_t)address + s_config.sectorSize > s_config.size)
+  {
+    return TFFT_RW_ERR_LOW_LEVEL_ERASE;
+  }
+
+  s_counters.sectorErases++;
+  SIMU_Transaction(0, s_config.sectorEraseNs);
+
+  for(i = address; i < (uint32_t)address + s_config.sectorSize; i++)
+  {
+    sp_mem[i] = 0xFF;
+    sp_wear[i]++;
+  }
+
+  return TFFT_RW_OK; // Erase OK
+}
+
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function
+   Return 1 if the EEPROM is ready for a new write, 0 if a write cycle is
+   in progress. Only busy in real time mode. */
+int TFFT_EepromIsReady(void)
+{
+  return (!s_config.f_realTime || SIMU_NowNs() >= s_busyUntilNs) ? 1 : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function
+   Return a pointer to the simulated memory at address, which is a plain
+   array or a mapped file. Return 0 if the address is out of range. */
+const uint8_t* TFFT_EepromMap(TFFT_ADDR_TYPE address)
+{
+  if((uint32_t)address >= s_config.size)
+  {
+    return 0;
+  }
+
+  return &sp_mem[address];
+}
+
+/*----------------------------------------------------------------------------*/
+/* This should be an external platform specific function
+   Return current time in microseconds (wraps around) */
+uint32_t TFFT_EepromGetTime(void)
+{
+  return (uint32_t)(SIMU_NowNs() / 1000u);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Replace the default 2048 byte EEPROM with one described by pConfig.
+   If pPath is not NULL, the memory is a shared mapping of that file, so the
+   content is kept between runs. The file is created (erased to 0xFF) if it
+   does not exist and is extended if it is smaller than pConfig->size.
+   pPath NULL gives memory that is erased to 0xFF and lost at close.
+   Per cell write counts are only kept in RAM and start at 0.
+   Return: 0 = OK, -1 = failed (the previous EEPROM is still used) */
+int TFFT_EepromSimuOpen(const char *pPath, const TFFT_EEPROM_SIMU_CONFIG *pConfig)
+{
+  uint8_t *p_mem;
+  uint32_t *p_wear;
+  off_t oldSize = 0;
+  int fd = -1;
+
+  if(pConfig->size == 0)
+  {
+    return -1;
+  }
+
+  if(pPath != NULL)
+  {
+    fd = open(pPath, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+      return -1;
+    }
+    oldSize = lseek(fd, 0, SEEK_END);
+    if(oldSize < 0 || (oldSize < (off_t)pConfig->size && ftruncate(fd, pConfig->size) != 0))
+    {
+      close(fd);
+      return -1;
+    }
+    p_mem = mmap(NULL, pConfig->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+  }
+  else
+  {
+    p_mem = mmap(NULL, pConfig->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if(p_mem == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  p_wear = calloc(pConfig->size, sizeof(uint32_t));
+  if(p_wear == NULL)
+  {
+    munmap(p_mem, pConfig->size);
+    return -1;
+  }
+
+  // New cells are erased
+  if((off_t)pConfig->size > oldSize)
+  {
+    memset(&p_mem[oldSize], 0xFF, pConfig->size - (uint32_t)oldSize);
+  }
+
+  TFFT_EepromSimuClose();
+
+  sp_mem = p_mem;
+  sp_wear = p_wear;
+  s_config = *pConfig;
+  if(s_config.pageSize == 0)
+  {
+    s_config.pageSize = TFFT_EEPROM_PAGE_SIZE;
+  }
+  sf_mapped = 1;
+  s_busyUntilNs = 0;
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write back and unmap the memory opened with TFFT_EepromSimuOpen() and go
+   back to the default EEPROM */
+void TFFT_EepromSimuClose(void)
+{
+  TFFT_EEPROM_SIMU_CONFIG defaultConfig = {SIMU_DEFAULT_SIZE, TFFT_EEPROM_PAGE_SIZE, 0, 0, 0, 0, 0, 0, 0};
+
+  if(!sf_mapped)
+  {
+    return;
+  }
+
+  msync(sp_mem, s_config.size, MS_SYNC);
+  munmap(sp_mem, s_config.size);
+  free(sp_wear);
+
+  sp_mem = simEeprom;
+  sp_wear = simWear;
+  s_config = defaultConfig;
+  sf_mapped = 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Number of times the cell at address has been written (erased for flash) */
+uint32_t TFFT_EepromGetWear(uint32_t address)
+{
+  return (address < s_config.size) ? sp_wear[address] : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Highest write count of all cells. The address of the (first) most worn
+   cell is stored in pAddress if not NULL. */
+uint32_t TFFT_EepromGetMaxWear(uint32_t *pAddress)
+{
+  uint32_t i;
+  uint32_t maxAddress = 0;
+
+  for(i = 1; i < s_config.size; i++)
+  {
+    if(sp_wear[i] > sp_wear[maxAddress])
+    {
+      maxAddress = i;
+    }
+  }
+
+  if(pAddress != NULL)
+  {
+    *pAddress = maxAddress;
+  }
+
+  return sp_wear[maxAddress];
+}
+
+/*----------------------------------------------------------------------------*/
+void TFFT_EepromResetWear(void)
+{
+  memset(sp_wear, 0, s_config.size * sizeof(uint32_t));
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get number of low level calls since start or last reset */
+void TFFT_EepromGetCounters(TFFT_EEPROM_SIMU_COUNTERS *pCounters)
+{
+  *pCounters = s_counters;
+}
+
+/*----------------------------------------------------------------------------*/
+void TFFT_EepromResetCounters(void)
+{
+  TFFT_EEPROM_SIMU_COUNTERS zero = {0};
+  s_counters = zero;
+}
+
 /*----------------------------------------------------------------------------*/
 /* Print the content of the "EEPROM" */
 void TFFT_EepromPrintMemory(TFFT_ADDR_TYPE addrStart, TFFT_ADDR_TYPE addrEnd)
 {
   TFFT_ADDR_TYPE i;
 
-  for(i = addrStart; i <= addrEnd; i++)
+  for(i = addrStart; i <= addrEnd && (uint32_t)i < s_config.size; i++)
   {
     if(i % 16 == 0)
     {
       printf("\n");
     }
-    printf("%02X ", (unsigned int)simEeprom[i]);
+    printf("%02X ", (unsigned int)sp_mem[i]);
   }
 
 }
@@ -29,8 +29,66 @@
 #ifndef TFFT_EEPROM_SIMU_H_
 #define TFFT_EEPROM_SIMU_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of low level calls made to the simulated EEPROM */
+typedef struct
+{
+  uint32_t byteReads;    // TFFT_EepromReadByte calls
+  uint32_t byteWrites;   // TFFT_EepromWriteByte calls
+  uint32_t blockReads;   // TFFT_EepromReadBlock calls
+  uint32_t pageWrites;   // TFFT_EepromWritePage calls
+  uint32_t bytesRead;    // Bytes read with TFFT_EepromReadBlock
+  uint32_t bytesWritten; // Bytes written with TFFT_EepromWritePage
+  uint32_t sectorErases; // TFFT_EepromEraseSector calls
+  uint64_t simTimeNs;    // Modelled bus and write cycle time
+  uint64_t busyWaitNs;   // Time waited for write cycles (real time mode only)
+} TFFT_EEPROM_SIMU_COUNTERS;
+
+/** Simulated device used by TFFT_EepromSimuOpen(). All times are in
+nanoseconds and may be 0. Each low level call is one bus transaction of
+busOverheadNs + byteTransferNs per byte. Writes are followed by a write
+cycle of byteWriteNs (TFFT_EepromWriteByte) or pageWriteNs
+(TFFT_EepromWritePage). E.g. a 400 kHz I2C EEPROM: 50000, 22500, 5000000,
+5000000. An SPI FRAM: 1000, 200, 0, 0.
+With sectorSize set, the device is simulated as NOR flash: writes can only
+clear bits (the stored byte is ANDed with the written byte) and only
+TFFT_EepromEraseSector() sets a sector back to 0xFF. Wear is then counted
+per erase instead of per write. */
+typedef struct
+{
+  uint32_t size;           // Bytes (TFFT_ADDR_TYPE must be able to address all)
+  uint16_t pageSize;       // Page writes crossing a page fail. 0 = TFFT_EEPROM_PAGE_SIZE
+  uint32_t busOverheadNs;  // Per transaction (start, device and address bytes)
+  uint32_t byteTransferNs; // Per data byte on the bus
+  uint32_t byteWriteNs;    // Write cycle after a byte write
+  uint32_t pageWriteNs;    // Write cycle after a page write
+  uint8_t f_realTime;      // 1 = spend the modelled time, 0 = only count it in simTimeNs
+  uint32_t sectorSize;     // Flash erase sector size, 0 = EEPROM (bytes are rewritable)
+  uint32_t sectorEraseNs;  // Erase cycle after a sector erase
+} TFFT_EEPROM_SIMU_CONFIG;
+
 int TFFT_EepromWriteByte(TFFT_ADDR_TYPE address, uint8_t byte);
 int TFFT_EepromReadByte(TFFT_ADDR_TYPE address, uint8_t *pByte);
+int TFFT_EepromWritePage(TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len);
+int TFFT_EepromReadBlock(TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len);
+int TFFT_EepromEraseSector(TFFT_ADDR_TYPE address);
+int TFFT_EepromIsReady(void);
+const uint8_t* TFFT_EepromMap(TFFT_ADDR_TYPE address);
+uint32_t TFFT_EepromGetTime(void);
+int TFFT_EepromSimuOpen(const char *pPath, const TFFT_EEPROM_SIMU_CONFIG *pConfig);
+void TFFT_EepromSimuClose(void);
+uint32_t TFFT_EepromGetWear(uint32_t address);
+uint32_t TFFT_EepromGetMaxWear(uint32_t *pAddress);
+void TFFT_EepromResetWear(void);
+void TFFT_EepromGetCounters(TFFT_EEPROM_SIMU_COUNTERS *pCounters);
+void TFFT_EepromResetCounters(void);
 void TFFT_EepromPrintMemory(TFFT_ADDR_TYPE addrStart, TFFT_ADDR_TYPE addrEnd);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* TFFT_EEPROM_SIMU_H_ */
@@ -0,0 +1,658 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft_instance.h
+ * @brief TFFT instances (one per EEPROM/FRAM device)
+ *
+ * Defines the instance struct and, when TFFT_INSTANCE_NAME is defined,
+ * generates an instance with its file table and all RAM state from a file
+ * table list (same format as TFFT_FILE_TABLE in tfft_user.h). All tables
+ * and state are static, sized at compile time. Include the file again with
+ * new defines for each instance. tfft.c generates the default instance from
+ * TFFT_FILE_TABLE, which is used by all functions without instance
+ * parameter.
+ *
+ * Example:
+ * @code
+ * #include <stdint.h>
+ * #include "tfft.h"
+ * #include "fram_files.h" // FRAM_FILE_TABLE and TFFT_FILE_NAMES(FRAM_FILE_TABLE, FRAM_FILE_COUNT)
+ *
+ * static const TFFT_DRIVER s_framDriver = {FramWriteByte, FramReadByte, FramReadBlock, FramWritePage, 0, 0, 0, 0, 0};
+ *
+ * #define TFFT_INSTANCE_NAME          g_fram        // TFFT_INSTANCE g_fram
+ * #define TFFT_INSTANCE_FILES         FRAM_FILE_TABLE
+ * #define TFFT_INSTANCE_START_ADDRESS 0
+ * #define TFFT_INSTANCE_END_ADDRESS   8191
+ * #define TFFT_INSTANCE_PAGE_SIZE     16           // Optional, default TFFT_EEPROM_PAGE_SIZE
+ * #define TFFT_INSTANCE_DRIVER        (&s_framDriver)
+ * #define TFFT_INSTANCE_DEVICE        (&s_framBus)  // Optional, given to the driver functions
+ * #include "tfft_instance.h"
+ * @endcode
+ * Other files declare it with extern TFFT_INSTANCE g_fram; and use the
+ * TFFT_Inst..() functions. Define TFFT_INSTANCE_STATIC to make it static.
+ *
+ * With TFFT_LAYOUT_ENABLED, define TFFT_INSTANCE_LAYOUT_MAX_FILES to give an
+ * instance on a small device a smaller layout header than the default of
+ * TFFT_LAYOUT_MAX_FILES files, or 0 for no layout header. Like the default,
+ * it must never change once the instance is in use.
+ *
+ * With TFFT_FLASH_ENABLED, define TFFT_INSTANCE_FLASH_SECTOR_SIZE to put the
+ * instance on flash (see TFFT_FLASH_SECTOR_SIZE in tfft_user.h). The driver
+ * must then have an eraseSector function and the page size is the program
+ * size of the flash.
+ *
+ * @author Lars Jelleryd
+ */
+
+#ifndef TFFT_INSTANCE_H_
+#define TFFT_INSTANCE_H_
+
+#include <stddef.h>
+
+#include "tfft.h"
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define TFFT_BUSY_FLAG_ATOMIC 1
+#endif
+
+/* Statistics and trace need the time at the start of each call */
+#define TFFT_CALL_TIME_USED (TFFT_STATS_ENABLED || TFFT_TRACE_SIZE > 0)
+
+#if TFFT_CALL_TIME_USED && TFFT_BUSY_FLAG_ATOMIC
+#define TFFT_COUNTERS_ATOMIC 1
+#endif
+
+#if TFFT_USE_FILE_CRC32C
+#define TFFT_CHECKSUM_TYPE uint32_t
+#elif TFFT_USE_FILE_CRC16
+#define TFFT_CHECKSUM_TYPE uint16_t
+#else
+#define TFFT_CHECKSUM_TYPE uint8_t
+#endif
+
+/* Largest page size of all instances. Chunk size used when the low level
+   page write function is not used. */
+#ifndef TFFT_EEPROM_PAGE_SIZE
+#define TFFT_EEPROM_PAGE_SIZE 16
+#endif
+
+/* Compile time check. Fails to compile (negative array size) if cond is false. */
+#define TFFT_STATIC_ASSERT(cond, msg) typedef char msg[(cond) ? 1 : -1]
+
+#if TFFT_FLASH_ENABLED
+/* Flash log. Each sector starts with a header: magic byte, sequence number
+   (2 bytes, least significant first) and a state byte that is programmed to
+   TFFT_FLASH_SECTOR_COMPLETE when all live records have been copied to the
+   sector. The newest complete sector is the active one. Records follow
+   the header: file name byte, file data and checksum over both. */
+#define TFFT_FLASH_SECTOR_HEADER_SIZE 4
+#define TFFT_FLASH_SECTOR_MAGIC       0x54
+#define TFFT_FLASH_SECTOR_COMPLETE    0x00
+#define TFFT_FLASH_ERASED             0xFF
+#define TFFT_FLASH_NO_SECTOR          0xFFFF
+
+/* Size of a record of a file of size bytes */
+#define TFFT_FLASH_RECORD_SIZE(size) (1 + (size) + TFFT_CHECKSUM_SIZE)
+#endif /* TFFT_FLASH_ENABLED */
+
+#if TFFT_REPAIR_ENABLED && !(TFFT_BACKUP_MODE_ENABLED && TFFT_CHECKSUM_ENABLED)
+#error TFFT_REPAIR_ENABLED requires TFFT_BACKUP_MODE_ENABLED and a checksum!
+#endif
+
+#if TFFT_LAYOUT_ENABLED
+#if !TFFT_CHECKSUM_ENABLED
+#error TFFT_LAYOUT_ENABLED requires TFFT_USE_FILE_CRC8, TFFT_USE_FILE_CRC16 or TFFT_USE_FILE_CRC32C!
+#endif
+
+/* Layout header at the end of the EEPROM area of an instance (not flash).
+   Two copies, the newest valid one is used: magic byte, format, sequence
+   number (2 bytes), layout hash (4 bytes), file count (2 bytes) and size
+   (2 bytes), type and count (2 bytes) of each file, all least significant
+   byte first, followed by the checksum. They are followed by two migration
+   progress records, written in turn: magic byte, sequence number of the
+   header that is migrated from, hash of the layout that is migrated to,
+   step, offset, flags and record number, followed by the checksum. */
+#define TFFT_LAYOUT_MAGIC             0x4C
+#define TFFT_LAYOUT_FORMAT            1
+#define TFFT_LAYOUT_FIXED_SIZE        10
+#define TFFT_LAYOUT_ENTRY_SIZE        5
+#define TFFT_LAYOUT_PROGRESS_SIZE     14
+#define TFFT_LAYOUT_COPY_SIZE(maxFiles) \
+  (TFFT_LAYOUT_FIXED_SIZE + (maxFiles) * TFFT_LAYOUT_ENTRY_SIZE + TFFT_CHECKSUM_SIZE)
+#define TFFT_LAYOUT_AREA_SIZE(maxFiles) \
+  ((maxFiles) ? 2 * (TFFT_LAYOUT_COPY_SIZE(maxFiles) + TFFT_LAYOUT_PROGRESS_SIZE + TFFT_CHECKSUM_SIZE) : 0)
+
+/* Progress flags */
+#define TFFT_LAYOUT_CHECKED           0x01 // Old copy of the current move has been verified
+#define TFFT_LAYOUT_SOURCE_VALID      0x02 // and was valid
+
+/* One move of a migration: a file, or one copy of a resized normal or
+   packed file */
+typedef struct
+{
+  TFFT_ADDR_TYPE from;      // Old address
+  TFFT_ADDR_TYPE to;        // New address
+  TFFT_ADDR_TYPE len;       // Bytes moved
+  TFFT_ADDR_TYPE fromSize;  // Bytes at the old address that are needed until moved
+  TFFT_ADDR_TYPE toSize;    // Bytes written at the new address
+  TFFT_ADDR_TYPE oldSize;   // Data size of a resized normal file, 0 = not resized
+  TFFT_ADDR_TYPE newSize;   // New data size of a resized normal file
+} TFFT_LAYOUT_MOVE;
+
+/* Migration from the stored file table to the file table of an instance.
+   On the stack of TFFT_Mount(). */
+typedef struct
+{
+  uint8_t au8_entries[TFFT_LAYOUT_MAX_FILES * TFFT_LAYOUT_ENTRY_SIZE]; // Stored file table
+  TFFT_ADDR_TYPE oldAddress[TFFT_LAYOUT_MAX_FILES];  // Address of each file of the stored table
+  uint8_t pending[(2 * TFFT_LAYOUT_MAX_FILES + 7) / 8]; // Moves not done (bit map)
+  uint32_t hash;            // Hash of the file table of the instance
+  uint16_t oldCount;        // Number of files of the stored table
+  uint16_t seq;             // Sequence number of the stored header
+  uint16_t step;            // Moves done
+  uint16_t offset;          // Bytes done of the current move
+  uint16_t record;          // Number of the last progress record
+  uint8_t flags;            // Progress flags of the current move
+  uint8_t copy;             // Header copy that holds the stored table
+} TFFT_LAYOUT_MIGRATION;
+#else
+#define TFFT_LAYOUT_AREA_SIZE(maxFiles) 0
+#endif /* TFFT_LAYOUT_ENABLED */
+
+/* File table of an instance */
+typedef struct
+{
+  const TFFT_SIZE_TYPE *pSize;        // Size of each file (without checksum and backup), element size of array files
+  const uint8_t *pType;               // File type of each file
+  const uint16_t *pCount;             // Count of each file (number of slots or elements)
+  const TFFT_ADDR_TYPE *pAddress;     // Start address of each file
+  const uint16_t *pRingIndex;         // Ring state index of each file (only valid for ring files)
+#if TFFT_CACHE_ENABLED
+  const TFFT_ADDR_TYPE *pCacheOffset; // Offset of each file in the cache
+#endif
+  uint32_t layoutSize;                // Bytes used by all files
+  TFFT_SIZE_TYPE maxFileSize;         // Size of the largest file (element of array files)
+  TFFT_FILE_NAME_TYPE fileCount;      // Number of files
+#if TFFT_LAYOUT_ENABLED
+  uint16_t layoutMaxFiles;            // Files the layout header can describe, 0 = no header
+#endif
+} TFFT_TABLE;
+
+/* Ring file state in RAM */
+typedef struct
+{
+  uint16_t slot;     // Newest valid slot
+  uint16_t seq;      // Sequence number of newest valid slot
+  uint16_t records;  // Slots from the oldest to the newest valid slot (records of log files)
+  uint8_t f_valid;   // At least one slot is valid
+  uint8_t f_scanned; // Slots have been scanned
+} TFFT_RING_STATE;
+
+/* State of an area write in progress */
+typedef struct
+{
+  TFFT_ADDR_TYPE address;       // Start address of area
+  const uint8_t *pHeader;       // Header (optional)
+  TFFT_ADDR_TYPE headerSize;    // Header size
+  const uint8_t *pData;         // Data
+  TFFT_ADDR_TYPE size;          // Size of data in pData
+  TFFT_ADDR_TYPE dataSize;      // Allocated data size (padded with zeros)
+  TFFT_ADDR_TYPE offset;        // Next offset to write
+  TFFT_ADDR_TYPE totalSize;     // Total size of area including checksum
+  TFFT_CHECKSUM_TYPE checksum;  // Checksum to write
+  uint8_t f_compare;            // Compare before write
+} TFFT_AREA_WRITE;
+
+#if TFFT_REPAIR_ENABLED
+/* Verification of one copy of a normal or packed file or of an array
+   element, done in steps of at most one page */
+typedef struct
+{
+  TFFT_ADDR_TYPE offset;           // Next offset to verify, 0 = start of the copy
+  TFFT_ADDR_TYPE dataEnd;          // End of the bytes covered by the checksum
+  TFFT_ADDR_TYPE areaEnd;          // End of the checksum
+  TFFT_CHECKSUM_TYPE checksum;     // Calculated so far
+  TFFT_CHECKSUM_TYPE fileChecksum; // Stored checksum, read so far
+  uint8_t f_lengthValid;           // Length of a packed file is not larger than its reserved bytes
+} TFFT_COPY_VERIFY;
+
+/* Position of TFFT_Scrub() */
+typedef struct
+{
+  TFFT_COPY_VERIFY verify;         // Copy being verified
+  uint16_t element;                // Element of an array file (0 for other files)
+  TFFT_FILE_NAME_TYPE fname;       // File being verified
+  uint8_t copy;                    // Copy being verified
+  uint8_t validCopies;             // Bit per copy of the element found valid
+} TFFT_SCRUB_STATE;
+#endif
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+/* Queued asynchronous write. The data is kept in the async data of the
+   instance, one copy of the largest file per entry. */
+typedef struct
+{
+  TFFT_ASYNC_CALLBACK callback;        // Called when done (optional)
+  uint32_t order;                      // Queue order within the same priority
+  TFFT_SIZE_TYPE size;                 // Size of data
+  TFFT_FILE_NAME_TYPE fname;           // File name
+  uint8_t priority;                    // Higher value is written first
+  uint8_t f_used;                      // Entry is in use
+} TFFT_ASYNC_ENTRY;
+#endif
+
+#if TFFT_VIEW_ENABLED
+/* Generation of a file, changed by every write. Read without the lock by
+   TFFT_GetFileGeneration(), so atomic when possible. */
+#if TFFT_BUSY_FLAG_ATOMIC
+typedef atomic_uint_least32_t TFFT_VIEW_GENERATION;
+#else
+typedef volatile uint32_t TFFT_VIEW_GENERATION;
+#endif
+#endif
+
+#if TFFT_STATS_ENABLED
+/* Statistics counters. Cached reads update them with only the shared lock
+   held, so they are atomic when possible. */
+#define TFFT_STATS_FIELD_ENTRY(field) TFFT_STATS_##field,
+enum
+{
+  TFFT_STATS_FIELDS(TFFT_STATS_FIELD_ENTRY)
+  TFFT_STATS_FIELD_COUNT
+};
+
+#if TFFT_COUNTERS_ATOMIC
+typedef atomic_uint_least32_t TFFT_STATS_COUNTER;
+#else
+typedef uint32_t TFFT_STATS_COUNTER;
+#endif
+#endif /* TFFT_STATS_ENABLED */
+
+/* File table, device and state of one TFFT instance. Only accessed by
+   tfft.c, other code uses the TFFT_Inst..() functions. */
+struct TFFT_INSTANCE
+{
+  const TFFT_TABLE *pTable;      // File table
+  const TFFT_DRIVER *pDriver;    // Device functions
+  void *pDevice;                 // Given to the device functions
+  TFFT_ADDR_TYPE startAddress;   // First writable address
+  TFFT_ADDR_TYPE endAddress;     // Last writable address
+  uint16_t pageSize;             // Page size, at most TFFT_EEPROM_PAGE_SIZE
+
+  TFFT_RING_STATE *pRingState;   // One per ring file
+  uint16_t *pBatchIndex;         // Batch item + 1 of each merged file, one per file
+#if TFFT_BUSY_FLAG_ATOMIC
+  atomic_flag f_busy;            // Busy flag, used if the driver has no lock function
+#else
+  volatile uint8_t f_busy;
+#endif
+  uint32_t errorCount;
+  uint32_t bytesWritten;
+  uint32_t bytesSkipped;
+
+#if TFFT_CACHE_ENABLED
+  uint8_t *pCache;               // Data of all files
+  uint8_t *pCacheValid;          // File is loaded in cache (bit map)
+  uint8_t *pCacheDirty;          // File is changed in cache but not written to EEPROM (bit map)
+  uint8_t f_cacheDirty;          // At least one file is dirty
+  uint32_t cacheDirtySince;      // Time when first file became dirty
+#endif
+
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  TFFT_ASYNC_ENTRY asyncQueue[TFFT_ASYNC_QUEUE_SIZE];
+  uint8_t *pAsyncData;           // Data of each queue entry
+  uint32_t asyncOrder;
+  TFFT_ASYNC_ENTRY *pAsyncActive;                // The write in progress
+  TFFT_AREA_WRITE asyncWrite;
+  uint8_t asyncCopy;                             // Copy being written (backup mode)
+  uint16_t asyncSlot;                            // Slot being written (ring files)
+  uint8_t asyncHeader[TFFT_RING_HEADER_SIZE];    // Slot header (ring files)
+#endif
+
+#if TFFT_FLASH_ENABLED
+  TFFT_ADDR_TYPE flashSectorSize;   // Sector size, 0 = not a flash instance
+  TFFT_ADDR_TYPE *pFlashIndex;      // Address of the newest valid record of each file, 0 = none
+  TFFT_ADDR_TYPE flashWriteOffset;  // Offset of the next free byte in the active sector
+  uint16_t flashSector;             // Active sector, TFFT_FLASH_NO_SECTOR if none
+  uint16_t flashSeq;                // Sequence number of the active sector
+  uint8_t f_flashScanned;           // Log has been scanned
+#endif
+
+#if TFFT_VIEW_ENABLED
+  TFFT_VIEW_GENERATION *pGeneration; // One per file
+#endif
+
+#if TFFT_PACK_ENABLED
+  uint8_t *pPackBuffer;          // Compressed data of a packed file. Lock must be held.
+#endif
+
+#if TFFT_REPAIR_ENABLED
+  TFFT_REPAIR_COUNTERS repair;   // See TFFT_GetRepairCounters()
+  TFFT_SCRUB_STATE scrub;
+#endif
+
+#if TFFT_STATS_ENABLED
+  TFFT_STATS_COUNTER (*pStats)[TFFT_STATS_FIELD_COUNT]; // One entry per file and one for other work
+  uint32_t statsIndex;           // Entry that low level calls are counted for. Lock must be held.
+#endif
+
+#if TFFT_TRACE_SIZE > 0
+  TFFT_TRACE_ENTRY trace[TFFT_TRACE_SIZE];
+#if TFFT_COUNTERS_ATOMIC
+  atomic_uint_least32_t traceCount;
+#else
+  uint32_t traceCount;
+#endif
+  uint16_t traceLowLevel;        // Low level calls since TFFT_Lock(0)
+#endif
+};
+
+/* Entries used to generate the tables of an instance */
+#define TFFT_FILE_SIZE_ENTRY(fname, size, type, count) size,
+#define TFFT_FILE_TYPE_ENTRY(fname, size, type, count) type,
+#define TFFT_FILE_COUNT_ENTRY(fname, size, type, count) count,
+#define TFFT_FILE_ADDRESS_ENTRY(fname, size, type, count) \
+  (TFFT_ADDR_TYPE)(TFFT_INSTANCE_START_ADDRESS + offsetof(TFFT_INSTANCE_LAYOUT, fname)),
+
+/* One byte per file, and one more for each ring or log file. The offset in the
+   ring layout minus the offset in the name layout is the number of ring
+   files before a file. */
+#define TFFT_FILE_NAME_BYTE_ENTRY(fname, size, type, count) uint8_t fname;
+#define TFFT_RING_LAYOUT_ENTRY(fname, size, type, count) uint8_t fname[1 + TFFT_IS_RING_TYPE(type)];
+#define TFFT_RING_INDEX_ENTRY(fname, size, type, count) \
+  (uint16_t)(offsetof(TFFT_INSTANCE_RING_LAYOUT, fname) - offsetof(TFFT_INSTANCE_NAME_LAYOUT, fname)),
+
+/* Data of each file, without checksum and backup. The largest file is the
+   largest data of one file write, which is one element of array files. */
+#define TFFT_FILE_DATA_ENTRY(fname, size, type, count) uint8_t fname[TFFT_FILE_DATA_SIZE(size, type, count)];
+#define TFFT_FILE_MAX_ENTRY(fname, size, type, count) uint8_t fname[size];
+#define TFFT_CACHE_OFFSET_ENTRY(fname, size, type, count) (TFFT_ADDR_TYPE)offsetof(TFFT_INSTANCE_DATA_LAYOUT, fname),
+
+/* One record of each file (flash instances) */
+#define TFFT_FLASH_RECORD_ENTRY(fname, size, type, count) uint8_t fname[TFFT_FLASH_RECORD_SIZE(size)];
+#define TFFT_FLASH_NO_RECORD_ENTRY(fname, size, type, count) \
+  + ((type) == TFFT_FILE_TYPE_ARRAY || (type) == TFFT_FILE_TYPE_LOG || (type) == TFFT_FILE_TYPE_PACKED)
+
+/* Compressed data of packed files */
+#define TFFT_PACK_MAX_ENTRY(fname, size, type, count) uint8_t fname[(type) == TFFT_FILE_TYPE_PACKED ? (count) : 1];
+#define TFFT_PACK_FILE_ENTRY(fname, size, type, count) + ((type) == TFFT_FILE_TYPE_PACKED)
+
+#define TFFT_INSTANCE_CAT2(name, id) name##_##id
+#define TFFT_INSTANCE_CAT(name, id) TFFT_INSTANCE_CAT2(name, id)
+
+#endif /* TFFT_INSTANCE_H_ */
+
+//=========================================================
+// Instance generation (TFFT_INSTANCE_NAME defined)
+//=========================================================
+#ifdef TFFT_INSTANCE_NAME
+
+#if !defined(TFFT_INSTANCE_FILES) || !defined(TFFT_INSTANCE_START_ADDRESS) || \
+    !defined(TFFT_INSTANCE_END_ADDRESS) || !defined(TFFT_INSTANCE_DRIVER)
+#error TFFT_INSTANCE_FILES, TFFT_INSTANCE_START_ADDRESS, TFFT_INSTANCE_END_ADDRESS and TFFT_INSTANCE_DRIVER must be defined!
+#endif
+
+#ifndef TFFT_INSTANCE_PAGE_SIZE
+#define TFFT_INSTANCE_PAGE_SIZE TFFT_EEPROM_PAGE_SIZE
+#endif
+
+#ifndef TFFT_INSTANCE_DEVICE
+#define TFFT_INSTANCE_DEVICE 0
+#endif
+
+#ifndef TFFT_INSTANCE_LAYOUT_MAX_FILES
+#define TFFT_INSTANCE_LAYOUT_MAX_FILES TFFT_LAYOUT_MAX_FILES
+#endif
+
+#ifndef TFFT_INSTANCE_FLASH_SECTOR_SIZE
+#define TFFT_INSTANCE_FLASH_SECTOR_SIZE 0
+#elif !TFFT_FLASH_ENABLED
+#error TFFT_INSTANCE_FLASH_SECTOR_SIZE requires TFFT_FLASH_ENABLED!
+#endif
+
+// All names are prefixed with the instance name, so several instances can
+// be generated in the same C file
+#define TFFT_INSTANCE_ID(id) TFFT_INSTANCE_CAT(TFFT_INSTANCE_NAME, id)
+#define TFFT_INSTANCE_LAYOUT TFFT_INSTANCE_ID(layout)
+#define TFFT_INSTANCE_NAME_LAYOUT TFFT_INSTANCE_ID(nameLayout)
+#define TFFT_INSTANCE_RING_LAYOUT TFFT_INSTANCE_ID(ringLayout)
+#define TFFT_INSTANCE_DATA_LAYOUT TFFT_INSTANCE_ID(dataLayout)
+#define TFFT_INSTANCE_FILE_MAX TFFT_INSTANCE_ID(fileMax)
+#define TFFT_INSTANCE_RECORD_LAYOUT TFFT_INSTANCE_ID(recordLayout)
+#define TFFT_INSTANCE_RECORD_MAX TFFT_INSTANCE_ID(recordMax)
+#define TFFT_INSTANCE_PACK_MAX TFFT_INSTANCE_ID(packMax)
+
+// Layouts of the files. Never instantiated, only used to let the compiler
+// calculate offsets (offsetof) and sizes (sizeof).
+typedef struct
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_LAYOUT_ENTRY)
+} TFFT_INSTANCE_LAYOUT;
+
+typedef struct
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_NAME_BYTE_ENTRY)
+} TFFT_INSTANCE_NAME_LAYOUT;
+
+typedef struct
+{
+  TFFT_INSTANCE_FILES(TFFT_RING_LAYOUT_ENTRY)
+} TFFT_INSTANCE_RING_LAYOUT;
+
+typedef struct
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_DATA_ENTRY)
+} TFFT_INSTANCE_DATA_LAYOUT;
+
+typedef union
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_MAX_ENTRY)
+} TFFT_INSTANCE_FILE_MAX;
+
+typedef union
+{
+  TFFT_INSTANCE_FILES(TFFT_PACK_MAX_ENTRY)
+} TFFT_INSTANCE_PACK_MAX;
+
+#define TFFT_INSTANCE_FILE_COUNT sizeof(TFFT_INSTANCE_NAME_LAYOUT)
+#define TFFT_INSTANCE_RING_COUNT (sizeof(TFFT_INSTANCE_RING_LAYOUT) - sizeof(TFFT_INSTANCE_NAME_LAYOUT))
+#define TFFT_INSTANCE_MAX_ADDRESS ((uint32_t)TFFT_INSTANCE_START_ADDRESS + sizeof(TFFT_INSTANCE_LAYOUT) - 1)
+
+#if TFFT_INSTANCE_FLASH_SECTOR_SIZE == 0
+// The layout header (if enabled) is at the end of the area
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_MAX_ADDRESS + TFFT_LAYOUT_AREA_SIZE(TFFT_INSTANCE_LAYOUT_MAX_FILES) <= TFFT_INSTANCE_END_ADDRESS,
+                   TFFT_INSTANCE_ID(tfft_file_table_does_not_fit_in_eeprom));
+#if TFFT_LAYOUT_ENABLED
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_LAYOUT_MAX_FILES == 0 || TFFT_INSTANCE_FILE_COUNT <= TFFT_INSTANCE_LAYOUT_MAX_FILES,
+                   TFFT_INSTANCE_ID(tfft_layout_max_files_too_small));
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_LAYOUT_MAX_FILES <= TFFT_LAYOUT_MAX_FILES, TFFT_INSTANCE_ID(tfft_layout_max_files_too_large));
+#endif
+TFFT_STATIC_ASSERT((TFFT_ADDR_TYPE)TFFT_INSTANCE_MAX_ADDRESS == TFFT_INSTANCE_MAX_ADDRESS, TFFT_INSTANCE_ID(tfft_addr_type_too_small));
+#else
+// The newest record of every file plus the record being written (which
+// started the sector) must fit in one sector, file names must differ from
+// erased flash and there must be a sector to copy to. Records hold whole
+// files, so array, log and packed files are not possible.
+typedef struct
+{
+  TFFT_INSTANCE_FILES(TFFT_FLASH_RECORD_ENTRY)
+} TFFT_INSTANCE_RECORD_LAYOUT;
+
+typedef union
+{
+  TFFT_INSTANCE_FILES(TFFT_FLASH_RECORD_ENTRY)
+} TFFT_INSTANCE_RECORD_MAX;
+
+TFFT_STATIC_ASSERT(TFFT_FLASH_SECTOR_HEADER_SIZE + sizeof(TFFT_INSTANCE_RECORD_LAYOUT) + sizeof(TFFT_INSTANCE_RECORD_MAX) <=
+                   TFFT_INSTANCE_FLASH_SECTOR_SIZE,
+                   TFFT_INSTANCE_ID(tfft_files_do_not_fit_in_flash_sector));
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_START_ADDRESS % TFFT_INSTANCE_FLASH_SECTOR_SIZE == 0, TFFT_INSTANCE_ID(tfft_flash_start_not_sector_aligned));
+TFFT_STATIC_ASSERT(((uint32_t)TFFT_INSTANCE_END_ADDRESS - TFFT_INSTANCE_START_ADDRESS + 1) / TFFT_INSTANCE_FLASH_SECTOR_SIZE >= 2,
+                   TFFT_INSTANCE_ID(tfft_flash_needs_two_sectors));
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_FILE_COUNT < TFFT_FLASH_ERASED, TFFT_INSTANCE_ID(tfft_too_many_files_for_flash));
+TFFT_STATIC_ASSERT((0 TFFT_INSTANCE_FILES(TFFT_FLASH_NO_RECORD_ENTRY)) == 0, TFFT_INSTANCE_ID(tfft_no_array_log_or_packed_files_on_flash));
+#endif
+#if !TFFT_PACK_ENABLED
+TFFT_STATIC_ASSERT((0 TFFT_INSTANCE_FILES(TFFT_PACK_FILE_ENTRY)) == 0, TFFT_INSTANCE_ID(tfft_packed_files_need_pack_enabled));
+#endif
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_FILE_COUNT <= TFFT_MAX_FILE_COUNT, TFFT_INSTANCE_ID(tfft_max_file_count_too_small));
+TFFT_STATIC_ASSERT(TFFT_INSTANCE_PAGE_SIZE > 0 && TFFT_INSTANCE_PAGE_SIZE <= TFFT_EEPROM_PAGE_SIZE, TFFT_INSTANCE_ID(tfft_page_size_too_large));
+
+static const TFFT_SIZE_TYPE TFFT_INSTANCE_ID(fileSize)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_SIZE_ENTRY)
+};
+
+static const uint8_t TFFT_INSTANCE_ID(fileType)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_TYPE_ENTRY)
+};
+
+static const uint16_t TFFT_INSTANCE_ID(fileCount)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_COUNT_ENTRY)
+};
+
+static const TFFT_ADDR_TYPE TFFT_INSTANCE_ID(fileAddress)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_FILE_ADDRESS_ENTRY)
+};
+
+static const uint16_t TFFT_INSTANCE_ID(ringIndex)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_RING_INDEX_ENTRY)
+};
+
+#if TFFT_CACHE_ENABLED
+static const TFFT_ADDR_TYPE TFFT_INSTANCE_ID(cacheOffset)[TFFT_INSTANCE_FILE_COUNT] =
+{
+  TFFT_INSTANCE_FILES(TFFT_CACHE_OFFSET_ENTRY)
+};
+#endif
+
+static const TFFT_TABLE TFFT_INSTANCE_ID(table) =
+{
+  TFFT_INSTANCE_ID(fileSize),
+  TFFT_INSTANCE_ID(fileType),
+  TFFT_INSTANCE_ID(fileCount),
+  TFFT_INSTANCE_ID(fileAddress),
+  TFFT_INSTANCE_ID(ringIndex),
+#if TFFT_CACHE_ENABLED
+  TFFT_INSTANCE_ID(cacheOffset),
+#endif
+  (uint32_t)sizeof(TFFT_INSTANCE_LAYOUT),
+  (TFFT_SIZE_TYPE)sizeof(TFFT_INSTANCE_FILE_MAX),
+  (TFFT_FILE_NAME_TYPE)TFFT_INSTANCE_FILE_COUNT,
+#if TFFT_LAYOUT_ENABLED
+  (uint16_t)TFFT_INSTANCE_LAYOUT_MAX_FILES
+#endif
+};
+
+// RAM state
+static TFFT_RING_STATE TFFT_INSTANCE_ID(ringState)[TFFT_INSTANCE_RING_COUNT > 0 ? TFFT_INSTANCE_RING_COUNT : 1];
+static uint16_t TFFT_INSTANCE_ID(batchIndex)[TFFT_INSTANCE_FILE_COUNT];
+#if TFFT_CACHE_ENABLED
+static uint8_t TFFT_INSTANCE_ID(cache)[sizeof(TFFT_INSTANCE_DATA_LAYOUT)];
+static uint8_t TFFT_INSTANCE_ID(cacheValid)[(TFFT_INSTANCE_FILE_COUNT + 7) / 8];
+static uint8_t TFFT_INSTANCE_ID(cacheDirty)[(TFFT_INSTANCE_FILE_COUNT + 7) / 8];
+#endif
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+static uint8_t TFFT_INSTANCE_ID(asyncData)[TFFT_ASYNC_QUEUE_SIZE][sizeof(TFFT_INSTANCE_FILE_MAX)];
+#endif
+#if TFFT_FLASH_ENABLED
+static TFFT_ADDR_TYPE TFFT_INSTANCE_ID(flashIndex)[TFFT_INSTANCE_FILE_COUNT];
+#endif
+#if TFFT_VIEW_ENABLED
+static TFFT_VIEW_GENERATION TFFT_INSTANCE_ID(generation)[TFFT_INSTANCE_FILE_COUNT];
+#endif
+#if TFFT_PACK_ENABLED
+static uint8_t TFFT_INSTANCE_ID(packBuffer)[sizeof(TFFT_INSTANCE_PACK_MAX)];
+#endif
+#if TFFT_STATS_ENABLED
+static TFFT_STATS_COUNTER TFFT_INSTANCE_ID(stats)[TFFT_INSTANCE_FILE_COUNT + 1][TFFT_STATS_FIELD_COUNT];
+#endif
+
+#ifdef TFFT_INSTANCE_STATIC
+static
+#endif
+TFFT_INSTANCE TFFT_INSTANCE_NAME =
+{
+  .pTable = &TFFT_INSTANCE_ID(table),
+  .pDriver = TFFT_INSTANCE_DRIVER,
+  .pDevice = TFFT_INSTANCE_DEVICE,
+  .startAddress = TFFT_INSTANCE_START_ADDRESS,
+  .endAddress = TFFT_INSTANCE_END_ADDRESS,
+  .pageSize = TFFT_INSTANCE_PAGE_SIZE,
+  .pRingState = TFFT_INSTANCE_ID(ringState),
+  .pBatchIndex = TFFT_INSTANCE_ID(batchIndex),
+#if TFFT_BUSY_FLAG_ATOMIC
+  .f_busy = ATOMIC_FLAG_INIT,
+#endif
+#if TFFT_CACHE_ENABLED
+  .pCache = TFFT_INSTANCE_ID(cache),
+  .pCacheValid = TFFT_INSTANCE_ID(cacheValid),
+  .pCacheDirty = TFFT_INSTANCE_ID(cacheDirty),
+#endif
+#if TFFT_ASYNC_QUEUE_SIZE > 0
+  .pAsyncData = &TFFT_INSTANCE_ID(asyncData)[0][0],
+#endif
+#if TFFT_FLASH_ENABLED
+  .flashSectorSize = TFFT_INSTANCE_FLASH_SECTOR_SIZE,
+  .pFlashIndex = TFFT_INSTANCE_ID(flashIndex),
+  .flashSector = TFFT_FLASH_NO_SECTOR,
+#endif
+#if TFFT_VIEW_ENABLED
+  .pGeneration = TFFT_INSTANCE_ID(generation),
+#endif
+#if TFFT_PACK_ENABLED
+  .pPackBuffer = TFFT_INSTANCE_ID(packBuffer),
+#endif
+#if TFFT_STATS_ENABLED
+  .pStats = TFFT_INSTANCE_ID(stats),
+  .statsIndex = TFFT_INSTANCE_FILE_COUNT,
+#endif
+};
+
+#undef TFFT_INSTANCE_ID
+#undef TFFT_INSTANCE_LAYOUT
+#undef TFFT_INSTANCE_NAME_LAYOUT
+#undef TFFT_INSTANCE_RING_LAYOUT
+#undef TFFT_INSTANCE_DATA_LAYOUT
+#undef TFFT_INSTANCE_FILE_MAX
+#undef TFFT_INSTANCE_RECORD_LAYOUT
+#undef TFFT_INSTANCE_RECORD_MAX
+#undef TFFT_INSTANCE_PACK_MAX
+#undef TFFT_INSTANCE_FILE_COUNT
+#undef TFFT_INSTANCE_RING_COUNT
+#undef TFFT_INSTANCE_MAX_ADDRESS
+#undef TFFT_INSTANCE_NAME
+#undef TFFT_INSTANCE_FILES
+#undef TFFT_INSTANCE_START_ADDRESS
+#undef TFFT_INSTANCE_END_ADDRESS
+#undef TFFT_INSTANCE_PAGE_SIZE
+#undef TFFT_INSTANCE_DRIVER
+#undef TFFT_INSTANCE_DEVICE
+#undef TFFT_INSTANCE_LAYOUT_MAX_FILES
+#undef TFFT_INSTANCE_FLASH_SECTOR_SIZE
+#undef TFFT_INSTANCE_STATIC
+
+#endif /* TFFT_INSTANCE_NAME */
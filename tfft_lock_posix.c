@@ -0,0 +1,101 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "tfft_lock_posix.h"
+
+/* Shared for cached reads, exclusive for everything else */
+static pthread_rwlock_t s_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static atomic_uint_fast32_t s_acquired;
+static atomic_uint_fast32_t s_contended;
+static atomic_uint_fast32_t s_timeouts;
+
+/*----------------------------------------------------------------------------*/
+/* Take the lock, shared (f_shared = 1) or exclusive. Waits at most timeoutMs
+   milliseconds if the lock is taken, 0 = do not wait.
+   Returns 0 when locked, else nonzero */
+int TFFT_LockAcquire(uint8_t f_shared, uint32_t timeoutMs)
+{
+  struct timespec deadline;
+  int rtnCode;
+
+  rtnCode = f_shared ? pthread_rwlock_tryrdlock(&s_lock) : pthread_rwlock_trywrlock(&s_lock);
+  if(rtnCode == EBUSY || rtnCode == EAGAIN)
+  {
+    atomic_fetch_add_explicit(&s_contended, 1, memory_order_relaxed);
+
+    if(timeoutMs > 0)
+    {
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += timeoutMs / 1000;
+      deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+      if(deadline.tv_nsec >= 1000000000L)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+
+      rtnCode = f_shared ? pthread_rwlock_timedrdlock(&s_lock, &deadline) :
+                           pthread_rwlock_timedwrlock(&s_lock, &deadline);
+    }
+
+    if(rtnCode != 0)
+    {
+      atomic_fetch_add_explicit(&s_timeouts, 1, memory_order_relaxed);
+    }
+  }
+
+  if(rtnCode == 0)
+  {
+    atomic_fetch_add_explicit(&s_acquired, 1, memory_order_relaxed);
+  }
+
+  return rtnCode;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Release the lock taken by TFFT_LockAcquire() */
+void TFFT_LockRelease(uint8_t f_shared)
+{
+  (void)f_shared;
+  pthread_rwlock_unlock(&s_lock);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Get lock statistics */
+void TFFT_LockGetCounters(TFFT_LOCK_COUNTERS *pCounters)
+{
+  pCounters->acquired = (uint32_t)atomic_load_explicit(&s_acquired, memory_order_relaxed);
+  pCounters->contended = (uint32_t)atomic_load_explicit(&s_contended, memory_order_relaxed);
+  pCounters->timeouts = (uint32_t)atomic_load_explicit(&s_timeouts, memory_order_relaxed);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Reset lock statistics */
+void TFFT_LockResetCounters(void)
+{
+  atomic_store_explicit(&s_acquired, 0, memory_order_relaxed);
+  atomic_store_explicit(&s_contended, 0, memory_order_relaxed);
+  atomic_store_explicit(&s_timeouts, 0, memory_order_relaxed);
+}
@@ -0,0 +1,58 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft_lock_posix.h
+ * @brief Lock functions for hosted (POSIX) builds
+ *
+ * Implements TFFT_LOCK_FUNC and TFFT_UNLOCK_FUNC with a pthread read/write
+ * lock, so cached reads of different threads can run in parallel while
+ * writes and EEPROM access are exclusive. Lock statistics are kept with
+ * C11 atomics.
+ *
+ * @author Lars Jelleryd
+ */
+
+#ifndef TFFT_LOCK_POSIX_H_
+#define TFFT_LOCK_POSIX_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Lock statistics */
+typedef struct
+{
+  uint32_t acquired;  // Number of times the lock was taken
+  uint32_t contended; // Number of times the lock was not free at first try
+  uint32_t timeouts;  // Number of times the lock could not be taken in time
+} TFFT_LOCK_COUNTERS;
+
+int TFFT_LockAcquire(uint8_t f_shared, uint32_t timeoutMs);
+void TFFT_LockRelease(uint8_t f_shared);
+void TFFT_LockGetCounters(TFFT_LOCK_COUNTERS *pCounters);
+void TFFT_LockResetCounters(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TFFT_LOCK_POSIX_H_ */
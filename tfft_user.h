@@ -42,25 +42,158 @@ Used in file table. Smaller type = smaller file table. */
 used (is not used in file table and will only save memory in functions) */
 #define TFFT_FILE_NAME_TYPE uint8_t
 
+// The settings from here on (also the page size, mount chunk size and lock
+// timeout below) can be given on the compiler command line instead, e.g.
+// -DTFFT_DEBUG_ENABLED=0, to build variants from one tfft_user.h.
 /** Set to 1 if one byte CRC8 should be used, else to 0 */
+#ifndef TFFT_USE_FILE_CRC8
 #define TFFT_USE_FILE_CRC8 1
+#endif
 /** Set to 1 if two bytes CRC16 should be used, else to 0 */
+#ifndef TFFT_USE_FILE_CRC16
 #define TFFT_USE_FILE_CRC16 0
+#endif
+/** Set to 1 if four bytes CRC32C should be used, else to 0. Recommended for
+files of more than a few hundred bytes. Uses the crc32 instruction of SSE4.2
+or ARMv8 when available (tfft_crc32c.c). */
+#ifndef TFFT_USE_FILE_CRC32C
+#define TFFT_USE_FILE_CRC32C 0
+#endif
 
 /** First writable address in EEPROM. */
+#ifndef TFFT_START_ADDRESS
 #define TFFT_START_ADDRESS    16
+#endif
 /** Last writable address in EEPROM. */
+#ifndef TFFT_END_ADDRESS
 #define TFFT_END_ADDRESS    2047
+#endif
 
 /** Set to 1 to enable backup mode. If backup mode is enabled, the file will
 be stored twice for safety. If the primary file would fail in checksum verification,
 the backup will be used. This also means that it is of no use to enable this mode
-unless CRC8 or CRC16 is enabled. (CRC16 is recommended.) Also note that this mode
-will use twice as much space in the EEPROM! */
+unless CRC8, CRC16 or CRC32C is enabled. (CRC16 is recommended.) Also note
+that this mode will use twice as much space in the EEPROM! */
+#ifndef TFFT_BACKUP_MODE_ENABLED
 #define TFFT_BACKUP_MODE_ENABLED 0
+#endif
+
+/** Set to 1 to repair bad copies in backup mode. A read of a normal, array
+or packed file that falls back to the backup copy rewrites the bad copy from
+the good one, so a second fault does not lose the file. TFFT_Mount() also
+repairs the copies it finds bad, and TFFT_Scrub() verifies and repairs a
+given number of bytes per call, e.g. in idle ticks of the main loop.
+Requires TFFT_BACKUP_MODE_ENABLED and a checksum. */
+#ifndef TFFT_REPAIR_ENABLED
+#define TFFT_REPAIR_ENABLED 0
+#endif
+
+/** Set to 1 to read the stored file before writing and only write the bytes
+(or pages) that differ. Saves write cycles and wear when the same data is
+written again. Can be selected per call with TFFT_RW_WRITE_COMPARE and
+TFFT_RW_WRITE_ALWAYS regardless of this setting. */
+#ifndef TFFT_COMPARE_BEFORE_WRITE
+#define TFFT_COMPARE_BEFORE_WRITE 0
+#endif
+
+/** Set to 1 to keep a RAM copy of all file data. Reads are served from RAM
+after the file has been loaded and verified once. Writes are only done to RAM
+and written to EEPROM by TFFT_Flush(), TFFT_FlushFile() or when the oldest
+unwritten change is older than TFFT_CACHE_MAX_DIRTY_AGE. Uses as many bytes
+of RAM as the sum of all file sizes in the file table.
+NOTE: Unflushed data is lost at power loss! */
+#ifndef TFFT_CACHE_ENABLED
+#define TFFT_CACHE_ENABLED 0
+#endif
+
+/** Flush the cache when the oldest unwritten change is this old (in units
+of TFFT_GET_TIME_FUNC). 0 = only flush with TFFT_Flush()/TFFT_FlushFile().
+Checked at each read/write. Requires TFFT_GET_TIME_FUNC. */
+#ifndef TFFT_CACHE_MAX_DIRTY_AGE
+#define TFFT_CACHE_MAX_DIRTY_AGE 0
+#endif
+
+/** Number of asynchronous writes that can be queued with TFFT_WriteAsync().
+Queued writes are done one page at a time by TFFT_Poll(). Each queue entry
+uses RAM for a copy of the largest file. 0 = disabled. */
+#ifndef TFFT_ASYNC_QUEUE_SIZE
+#define TFFT_ASYNC_QUEUE_SIZE 0
+#endif
+
+/** Set to 1 to keep statistics per file (calls, bytes, checksum errors,
+backup reads, busy rejections, low level calls and, with TFFT_GET_TIME_FUNC,
+time spent). See TFFT_GetFileStats(). Uses 44 bytes of RAM per file. */
+#ifndef TFFT_STATS_ENABLED
+#define TFFT_STATS_ENABLED 0
+#endif
+
+/** Number of calls kept in the trace ring (TFFT_TraceDump()). Each call is
+recorded with file, size, operation, result, low level call count and start
+and end time from TFFT_GET_TIME_FUNC. Uses 24 bytes of RAM per entry.
+0 = disabled. */
+#ifndef TFFT_TRACE_SIZE
+#define TFFT_TRACE_SIZE 0
+#endif
+
+/** Set to 1 to support flash instances (internal MCU flash, SPI NOR) that
+can not rewrite single bytes. Files are then appended as records (file name,
+data, checksum) to the active sector and found through a RAM index. When the
+sector is full, the newest record of each file is copied to the next sector,
+which is erased first. Each instance selects flash with its sector size (see
+TFFT_FLASH_SECTOR_SIZE and tfft_instance.h), other instances are unchanged.
+Records are packed, so the flash must allow several program operations per
+page (NOR flash, not flash with ECC per program unit). Uses 2 bytes of RAM
+per file and flash instance. CRC8, CRC16 or CRC32C should be enabled to
+detect records that were interrupted by power loss. */
+#ifndef TFFT_FLASH_ENABLED
+#define TFFT_FLASH_ENABLED 0
+#endif
+
+/** Set to 1 to enable TFFT_GetFileView(), which gives a pointer to the data
+of a file in the RAM cache or in a memory mapped device instead of copying
+it (see TFFT_EEPROM_MAP_FUNC). Uses 4 bytes of RAM per file and instance for
+the generation counters. */
+#ifndef TFFT_VIEW_ENABLED
+#define TFFT_VIEW_ENABLED 0
+#endif
+
+/** Set to 1 to support packed files (TFFT_FILE_TYPE_PACKED), which are
+run length compressed before the checksum is calculated and decompressed
+when read. Uses a RAM buffer of the largest stored size of a packed file per
+instance. */
+#ifndef TFFT_PACK_ENABLED
+#define TFFT_PACK_ENABLED 0
+#endif
+
+/** Set to 1 to store the file table in a layout header at the end of the
+EEPROM area (TFFT_END_ADDRESS) of each instance (not flash). When the file
+table has changed since the header was written, e.g. a file was resized
+after a firmware update, TFFT_Mount() moves the files to their new
+addresses before they are verified. Only bytes that change are written and
+the progress is recorded in the header, so an interrupted migration
+continues at the next TFFT_Mount(). A file is kept if it is at the same
+position in the table with the same type and size, where ring, log, array
+and packed files may change their count (the first slots/elements are kept)
+and normal files their size (truncated or padded with zeros). Other files are
+invalid until written. TFFT_Mount() returns TFFT_RW_ERR_FILE_TABLE if the
+stored table can not be migrated. The end of the area must be unused when
+the header is first written. Requires CRC8, CRC16 or CRC32C. */
+#ifndef TFFT_LAYOUT_ENABLED
+#define TFFT_LAYOUT_ENABLED 0
+#endif
+
+/** Number of files that the layout header can describe. Sets the size of
+the header, so it must never change: 2 * (24 + 5 * TFFT_LAYOUT_MAX_FILES)
+bytes plus four checksums. About 8 bytes per file are used on the stack by
+TFFT_Mount(). Instances can have a smaller header, see tfft_instance.h. */
+#ifndef TFFT_LAYOUT_MAX_FILES
+#define TFFT_LAYOUT_MAX_FILES 16
+#endif
 
 /** Set to 1 to enable printf debug messages */
+#ifndef TFFT_DEBUG_ENABLED
 #define TFFT_DEBUG_ENABLED 1
+#endif
 
 //----- END: User defines -----------------
 
@@ -70,6 +203,7 @@ will use twice as much space in the EEPROM! */
 
 // Include the user supplied (platform specific) EEPROM read and write functions
 #include "tfft_eeprom_simu.h"
+#include "tfft_lock_posix.h"
 
 // Set function names
 
@@ -87,40 +221,132 @@ will use twice as much space in the EEPROM! */
    Return: 0 (TFFT_RW_OK) = read OK, -11 (TFFT_RW_ERR_LOW_LEVEL_READ) = read failed */
 #define TFFT_EEPROM_READ_BYTE_FUNC     TFFT_EepromReadByte
 
+/** Optional. Remove this define to read byte by byte with TFFT_EEPROM_READ_BYTE_FUNC.
+   int func(TFFT_ADDR_TYPE address, uint8_t *pData, TFFT_ADDR_TYPE len)
+   Reads len bytes starting at address in one transaction.
+   Return: 0 (TFFT_RW_OK) = read OK, -11 (TFFT_RW_ERR_LOW_LEVEL_READ) = read failed */
+#define TFFT_EEPROM_READ_BLOCK_FUNC    TFFT_EepromReadBlock
+
+/** Optional. Remove this define to write byte by byte with TFFT_EEPROM_WRITE_BYTE_FUNC.
+   int func(TFFT_ADDR_TYPE address, const uint8_t *pData, TFFT_ADDR_TYPE len)
+   Writes len bytes starting at address in one page write cycle. TFFT never
+   crosses a TFFT_EEPROM_PAGE_SIZE boundary in one call.
+   Return: 0 (TFFT_RW_OK) = write OK, -10 (TFFT_RW_ERR_LOW_LEVEL_WRITE) = write failed */
+#define TFFT_EEPROM_WRITE_PAGE_FUNC    TFFT_EepromWritePage
+
+/** Optional. Remove this define if the EEPROM can not report if it is ready.
+   int func(void)
+   Returns 0 while the EEPROM is busy with a write cycle, else 1.
+   Used by TFFT_Poll() to only start a new write when the EEPROM is ready. */
+#define TFFT_EEPROM_IS_READY_FUNC      TFFT_EepromIsReady
+
+/** Optional. Remove this define if there is no clock available.
+   uint32_t func(void)
+   Returns current time in any unit (e.g. milliseconds). Allowed to wrap. */
+#define TFFT_GET_TIME_FUNC             TFFT_EepromGetTime
+
+/** Optional. Only with TFFT_FLASH_ENABLED. Put the default instance on flash
+with sectors of this many bytes. TFFT_START_ADDRESS must be sector aligned
+and the range must hold at least two sectors. One sector must hold all files
+(each with one byte file name and checksum), one more record of the largest
+file and a 4 byte sector header.
+The page size is then the flash program size.
+   int eraseFunc(TFFT_ADDR_TYPE address)
+   Erases (sets to 0xFF) the sector starting at address.
+   Returns 0 (TFFT_RW_OK) on success, else a negative error code. */
+//#define TFFT_FLASH_SECTOR_SIZE         1024
+//#define TFFT_EEPROM_ERASE_SECTOR_FUNC  TFFT_EepromEraseSector
+
+/** Optional. Remove this define if the EEPROM is not mapped to memory.
+   const uint8_t* func(TFFT_ADDR_TYPE address)
+   Returns a pointer to the byte at address, or 0 if it is not mapped. All
+   addresses must be mapped linearly. Only used by TFFT_GetFileView(). */
+#define TFFT_EEPROM_MAP_FUNC           TFFT_EepromMap
+
+/** EEPROM page size in bytes. Data is transferred in page aligned chunks
+of at most this size (also when the byte functions are used). */
+#ifndef TFFT_EEPROM_PAGE_SIZE
+#define TFFT_EEPROM_PAGE_SIZE    16
+#endif
+
+/** Bytes read with each low level read by TFFT_Mount() and TFFT_VerifyAll().
+The buffer is on the stack. */
+#ifndef TFFT_MOUNT_CHUNK_SIZE
+#define TFFT_MOUNT_CHUNK_SIZE    64
+#endif
+
+/** Optional. Remove these defines to use a busy flag instead (atomic when
+   compiled as C11). A call made while another call is in progress then
+   fails with TFFT_RW_ERR_EEPROM_BUSY.
+   int lockFunc(uint8_t f_shared, uint32_t timeoutMs)
+   Returns 0 when locked, else nonzero. f_shared is 1 for calls that only
+   read the RAM cache and may run in parallel, 0 for exclusive access.
+   void unlockFunc(uint8_t f_shared)
+   On bare metal, e.g. disable/restore interrupts or use an RTOS mutex.
+   The EEPROM functions and the lock above are used by the default instance
+   (the TFFT_Xxx() functions). Other devices get their own instance with a
+   TFFT_DRIVER, see tfft_instance.h. */
+#define TFFT_LOCK_FUNC                 TFFT_LockAcquire
+#define TFFT_UNLOCK_FUNC               TFFT_LockRelease
+
+/** Milliseconds to wait for the lock before failing with
+TFFT_RW_ERR_EEPROM_BUSY. 0 = do not wait. Only used with TFFT_LOCK_FUNC. */
+#ifndef TFFT_LOCK_TIMEOUT_MS
+#define TFFT_LOCK_TIMEOUT_MS     100
+#endif
+
 //----- END: User Read and Write EEPROM functions ------
 
 //=======================================
 // START: File setup
 //=======================================
-// File "names". Should match the positions in the file table.
-enum
-{
-  FILE0_NAME_EEPROM_FILE_VERSION_U8,
-  FILE1_NAME_SENSOR_VAL1_U32,
-  FILE2_NAME_TEXT_LABEL1_STR10,
-  FILE3_NAME_SENSOR_VAL2_S32,
-  TFFT_FILE_COUNT // Number of files. MUST always be at the end.
-};
+// File "names", sizes, types and counts. The file name enum (FILE0_NAME_...
+// etc.), the file table and the address table are all generated from this
+// list, so the position in the list is the file name. Add new files at the
+// end to keep the addresses of already stored files.
+// Types:
+//   TFFT_FILE_TYPE_NORMAL - Normal file. Count must be 1.
+//   TFFT_FILE_TYPE_RING   - Wear leveled file for frequently written data.
+//                           Count is the number of slots the writes rotate
+//                           over (endurance is multiplied by count). Each
+//                           slot has a sequence number and checksum. Not
+//                           duplicated in backup mode, older slots are used
+//                           if the newest slot is bad.
+//   TFFT_FILE_TYPE_ARRAY  - Array of count elements of size bytes, e.g. a
+//                           calibration table. Each element has its own
+//                           checksum (and backup copy), so one element is
+//                           written without rewriting the whole table. Use
+//                           TFFT_ReadElement()/TFFT_WriteElement()/
+//                           TFFT_ReadRange()/TFFT_WriteRange(). Costs one
+//                           checksum per element, group small elements in
+//                           a struct to save space. Not on flash.
+//   TFFT_FILE_TYPE_LOG    - Circular log of count records of size bytes,
+//                           e.g. an event history. Stored as a ring file,
+//                           but every slot is a record. TFFT_LogAppend()
+//                           writes one record over the oldest, cursors of
+//                           TFFT_LogOpen()/TFFT_LogRead() read newest or
+//                           oldest first. Not on flash.
+//   TFFT_FILE_TYPE_PACKED - File of size bytes that is compressed (run length
+//                           coded, trailing zeros dropped) when written, e.g.
+//                           a mostly empty string or config blob. Count is
+//                           the number of bytes reserved for the compressed
+//                           data. Writes of data that does not compress into
+//                           count bytes fail with TFFT_RW_ERR_FILE_TOO_LARGE.
+//                           Not on flash, no asynchronous writes. Requires
+//                           TFFT_PACK_ENABLED.
+#define TFFT_FILE_TABLE(TFFT_FILE) \
+  TFFT_FILE(FILE0_NAME_EEPROM_FILE_VERSION_U8, sizeof(uint8_t),  TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(FILE1_NAME_SENSOR_VAL1_U32,        sizeof(uint32_t), TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(FILE2_NAME_TEXT_LABEL1_STR10,      FILE2_SIZE_STR10, TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(FILE3_NAME_SENSOR_VAL2_S32,        sizeof(int32_t),  TFFT_FILE_TYPE_NORMAL, 1) \
+  TFFT_FILE(FILE4_NAME_BOOT_COUNT_U32,         sizeof(uint32_t), TFFT_FILE_TYPE_RING,   4)
+
+// Largest file count of all instances (optional). Sizes the file bitmaps of
+// TFFT_Mount()/TFFT_VerifyAll(). Defaults to the count of TFFT_FILE_TABLE.
+//#define TFFT_MAX_FILE_COUNT 8
 
 // Files sizes (optional). Used for buffer allocation in user code, e.g. char buf[FILE2_SIZE_STR10+1]
 #define FILE2_SIZE_STR10 10
 //------- END: File setup -------------
 
-// This define is used to make sure that only tfft.c includes the file table.
-#ifdef TFFT_INCLUDE_USER_FILE_TABLE
-
-//=======================================
-// START: File table setup
-//=======================================
-const static TFFT_SIZE_TYPE sa_fileTable[TFFT_FILE_COUNT] =
-{
-    sizeof(uint8_t),   // FILE0_NAME_EEPROM_FILE_VERSION_U8
-    sizeof(uint32_t),  // FILE1_NAME_SENSOR_VAL1_U32
-    FILE2_SIZE_STR10,  // FILE2_NAME_TEXT_LABEL1_STR10
-    sizeof(int32_t)    // FILE3_NAME_SENSOR_VAL2_S32
-};
-//------- END: File table setup -------
-
-#endif /* TFFT_INCLUDE_USER_FILE_TABLE */
-
 #endif /* TFFT_USER_H_ */
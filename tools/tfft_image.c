@@ -0,0 +1,393 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2019 by Lars Jelleryd                                *
+ *                                                                          *
+ *  This file is part of Tiny Fixed File Table (TFFT).                     *
+ *                                                                          *
+ *  TFFT is free software: you can redistribute it and/or modify it         *
+ *  under the terms of the GNU Lesser General Public License as published   *
+ *  by the Free Software Foundation, either version 3 of the License, or    *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  TFFT is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with TFFT.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+
+/**
+ * @file tfft_image.c
+ * @brief Build the image of the default files for factory provisioning.
+ *
+ * The files listed in a defaults description are written with the TFFT
+ * calls to a simulated device, so checksums, backup copies, ring slot
+ * headers and the layout header are exactly as TFFT stores them. The image
+ * from TFFT_ExportImage() is written to the image file, which is programmed
+ * on each board with TFFT_ImportImage(). The image is then imported to a
+ * blank simulated device and mounted to check it. Device time of both ways
+ * is printed for a 400 kHz I2C EEPROM.
+ *
+ * Each line of the description writes one file (one record of ring and
+ * log files, the elements from first on of array files):
+ *   <file> <type> <values...>
+ *   <file>[first] <type> <values...>
+ * file is a file name of the file table or its number, type one of u8, s8,
+ * u16, s16, u32, s32, f32, f64 (values stored least significant byte first,
+ * as on little endian targets), hex (bytes, e.g. 01 a0ff) or str (the rest
+ * of the line, quotes are removed, without terminating zero). Bytes after
+ * the values are zero. Files that are not listed are left erased. Empty
+ * lines and lines starting with # are skipped.
+ *
+ * Usage: tfft_image <description file> <image file>
+ * Must be built with the file table (tfft_user.h) of the target, e.g.:
+ * gcc -O2 -I. tools/tfft_image.c tfft.c tfft_crc8.c tfft_crc16.c tfft_crc32c.c tfft_crc_clmul.c
+ *     tfft_eeprom_simu.c tfft_lock_posix.c -pthread -o tfft_image
+ *
+ * @author Lars Jelleryd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tfft.h"
+#include "tfft_eeprom_simu.h"
+
+/* Longest line of the description */
+#define IMAGE_LINE_SIZE 4096
+
+/* The default instance is on flash */
+#if TFFT_FLASH_ENABLED && defined(TFFT_FLASH_SECTOR_SIZE)
+#define IMAGE_FLASH 1
+#else
+#define IMAGE_FLASH 0
+#endif
+
+#define IMAGE_NAME_ENTRY(fname, size, type, count) #fname,
+#define IMAGE_SIZE_ENTRY(fname, size, type, count) (uint32_t)(size),
+#define IMAGE_TYPE_ENTRY(fname, size, type, count) (uint8_t)(type),
+#define IMAGE_COUNT_ENTRY(fname, size, type, count) (uint32_t)(count),
+
+static const char *s_fileNames[TFFT_FILE_COUNT] = { TFFT_FILE_TABLE(IMAGE_NAME_ENTRY) };
+static const uint32_t s_fileSize[TFFT_FILE_COUNT] = { TFFT_FILE_TABLE(IMAGE_SIZE_ENTRY) };
+static const uint8_t s_fileType[TFFT_FILE_COUNT] = { TFFT_FILE_TABLE(IMAGE_TYPE_ENTRY) };
+static const uint32_t s_fileCount[TFFT_FILE_COUNT] = { TFFT_FILE_TABLE(IMAGE_COUNT_ENTRY) };
+
+static uint8_t s_listed[TFFT_FILE_COUNT];
+
+/*----------------------------------------------------------------------------*/
+/* Simulated device of the default instance, 400 kHz I2C EEPROM timing */
+static int IMAGE_OpenDevice(void)
+{
+  TFFT_EEPROM_SIMU_CONFIG simConfig = {(uint32_t)TFFT_END_ADDRESS + 1, TFFT_EEPROM_PAGE_SIZE, 50000, 22500, 5000000, 5000000, 0, 0, 0};
+
+#if IMAGE_FLASH
+  simConfig.sectorSize = TFFT_FLASH_SECTOR_SIZE;
+#endif
+
+  return TFFT_EepromSimuOpen(NULL, &simConfig);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Store value with bytes bytes, least significant byte first */
+static int IMAGE_PutValue(uint8_t *pData, uint32_t *pLen, uint32_t capacity, uint64_t value, uint32_t bytes)
+{
+  uint32_t i;
+
+  if(*pLen + bytes > capacity)
+  {
+    return -1;
+  }
+
+  for(i = 0; i < bytes; i++)
+  {
+    pData[(*pLen)++] = (uint8_t)(value >> (8 * i));
+  }
+
+  return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Parse the values of a line to pData. Returns the number of bytes, or -1
+   if a value is malformed or they do not fit in capacity bytes */
+static long IMAGE_ParseValues(const char *pType, char *pValues, uint8_t *pData, uint32_t capacity)
+{
+  uint32_t len = 0;
+  char *pToken;
+  char *pEnd;
+  size_t n;
+
+  if(strcmp(pType, "str") == 0)
+  {
+    n = strlen(pValues);
+    if(n >= 2 && pValues[0] == '"' && pValues[n - 1] == '"')
+    {
+      pValues++;
+      n -= 2;
+    }
+    if(n > capacity)
+    {
+      return -1;
+    }
+    memcpy(pData, pValues, n);
+    return (long)n;
+  }
+
+  for(pToken = strtok(pValues, " \t"); pToken; pToken = strtok(NULL, " \t"))
+  {
+    int rtnCode;
+
+    if(strcmp(pType, "hex") == 0)
+    {
+      // Any number of bytes per token
+      for(n = 0; pToken[n] && pToken[n + 1]; n += 2)
+      {
+        char byte[3] = {pToken[n], pToken[n + 1], 0};
+
+        if(!isxdigit((unsigned char)byte[0]) || !isxdigit((unsigned char)byte[1]) ||
+           IMAGE_PutValue(pData, &len, capacity, strtoul(byte, NULL, 16), 1) != 0)
+        {
+          return -1;
+        }
+      }
+      if(pToken[n])
+      {
+        return -1; // Odd number of digits
+      }
+      continue;
+    }
+
+    if(strcmp(pType, "f32") == 0 || strcmp(pType, "f64") == 0)
+    {
+      double d = strtod(pToken, &pEnd);
+      float f = (float)d;
+      uint64_t bits = 0;
+
+      if(pType[1] == '3')
+      {
+        uint32_t u32;
+        memcpy(&u32, &f, sizeof(u32));
+        bits = u32;
+      }
+      else
+      {
+        memcpy(&bits, &d, sizeof(bits));
+      }
+      rtnCode = IMAGE_PutValue(pData, &len, capacity, bits, (pType[1] == '3') ? 4 : 8);
+    }
+    else if(pType[0] == 'u' || pType[0] == 's')
+    {
+      uint32_t bytes = (uint32_t)strtoul(&pType[1], NULL, 10) / 8;
+      uint64_t value = (pType[0] == 'u') ? (uint64_t)strtoull(pToken, &pEnd, 0) : (uint64_t)strtoll(pToken, &pEnd, 0);
+
+      if(bytes != 1 && bytes != 2 && bytes != 4)
+      {
+        return -1;
+      }
+      rtnCode = IMAGE_PutValue(pData, &len, capacity, value, bytes);
+    }
+    else
+    {
+      return -1; // Unknown type
+    }
+
+    if(rtnCode != 0 || *pEnd != 0)
+    {
+      return -1;
+    }
+  }
+
+  return (long)len;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Write the file of one line of the description */
+static int IMAGE_WriteLine(char *pLine, uint8_t *pData, uint32_t dataSize)
+{
+  char *pName = strtok(pLine, " \t");
+  char *pType = strtok(NULL, " \t");
+  char *pValues = strtok(NULL, "");
+  char *pIndex;
+  uint32_t first = 0;
+  uint32_t capacity;
+  uint32_t fname;
+  long len;
+
+  if(!pName || !pType || !pValues)
+  {
+    return -1;
+  }
+  while(isspace((unsigned char)*pValues))
+  {
+    pValues++;
+  }
+
+  pIndex = strchr(pName, '[');
+  if(pIndex)
+  {
+    *pIndex++ = 0;
+    first = (uint32_t)strtoul(pIndex, NULL, 0);
+  }
+
+  for(fname = 0; fname < TFFT_FILE_COUNT && strcmp(s_fileNames[fname], pName) != 0; fname++)
+  {
+  }
+  if(fname == TFFT_FILE_COUNT && isdigit((unsigned char)pName[0]))
+  {
+    fname = (uint32_t)strtoul(pName, NULL, 0);
+  }
+  if(fname >= TFFT_FILE_COUNT || (pIndex && (s_fileType[fname] != TFFT_FILE_TYPE_ARRAY || first >= s_fileCount[fname])))
+  {
+    return -1;
+  }
+
+  capacity = s_fileSize[fname];
+  if(s_fileType[fname] == TFFT_FILE_TYPE_ARRAY)
+  {
+    capacity *= s_fileCount[fname] - first;
+  }
+  if(capacity > dataSize)
+  {
+    return -1;
+  }
+
+  memset(pData, 0, capacity);
+  len = IMAGE_ParseValues(pType, pValues, pData, capacity);
+  if(len < 0)
+  {
+    return -1;
+  }
+
+  s_listed[fname] = 1;
+  switch(s_fileType[fname])
+  {
+    case TFFT_FILE_TYPE_ARRAY:
+      // The last element is padded with zeros
+      return TFFT_WriteRange((TFFT_FILE_NAME_TYPE)fname, (uint16_t)first,
+                             (uint16_t)((len + s_fileSize[fname] - 1) / s_fileSize[fname]), pData);
+
+    case TFFT_FILE_TYPE_LOG:
+      return TFFT_LogAppend((TFFT_FILE_NAME_TYPE)fname, pData);
+
+    default:
+      return TFFT_WriteData((TFFT_FILE_NAME_TYPE)fname, (TFFT_SIZE_TYPE)len, pData);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  static char line[IMAGE_LINE_SIZE];
+  static uint8_t data[sizeof(TFFT_FILE_LAYOUT)];
+  TFFT_EEPROM_SIMU_COUNTERS perFile;
+  TFFT_EEPROM_SIMU_COUNTERS import;
+  TFFT_VERIFY_RESULT result;
+  uint8_t *pImage;
+  uint32_t imageSize;
+  uint32_t lineNumber = 0;
+  uint32_t fname;
+  FILE *pFile;
+  int rtnCode;
+  int rtnVal = 0;
+
+  if(argc != 3)
+  {
+    fprintf(stderr, "Usage: tfft_image <description file> <image file>\n");
+    return 2;
+  }
+
+  pFile = fopen(argv[1], "r");
+  if(!pFile || IMAGE_OpenDevice() != 0)
+  {
+    fprintf(stderr, "tfft_image: can not open %s or the simulated device\n", argv[1]);
+    return 1;
+  }
+
+  TFFT_Mount(0);
+  TFFT_EepromResetCounters();
+
+  while(fgets(line, sizeof(line), pFile))
+  {
+    char *pLine = line;
+
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = 0;
+    while(isspace((unsigned char)*pLine))
+    {
+      pLine++;
+    }
+    if(*pLine == 0 || *pLine == '#')
+    {
+      continue;
+    }
+
+    rtnCode = IMAGE_WriteLine(pLine, data, sizeof(data));
+    if(rtnCode != 0)
+    {
+      fprintf(stderr, "tfft_image: %s:%lu: bad line or file not written (%d)\n", argv[1], (unsigned long)lineNumber, rtnCode);
+      rtnVal = 1;
+    }
+  }
+  fclose(pFile);
+
+  TFFT_Flush();
+  TFFT_EepromGetCounters(&perFile);
+
+  imageSize = TFFT_GetImageSize();
+  pImage = malloc(imageSize);
+  if(!pImage || TFFT_ExportImage(0, pImage, imageSize) != TFFT_RW_OK)
+  {
+    fprintf(stderr, "tfft_image: export failed\n");
+    return 1;
+  }
+
+  pFile = fopen(argv[2], "wb");
+  if(!pFile || fwrite(pImage, 1, imageSize, pFile) != imageSize || fclose(pFile) != 0)
+  {
+    fprintf(stderr, "tfft_image: can not write %s\n", argv[2]);
+    return 1;
+  }
+
+  // Provision a blank device with the image and check that it mounts
+  if(IMAGE_OpenDevice() != 0)
+  {
+    return 1;
+  }
+  TFFT_EepromResetCounters();
+  rtnCode = TFFT_ImportImage(0, pImage, imageSize);
+  TFFT_EepromGetCounters(&import);
+  TFFT_Mount(&result);
+
+  for(fname = 0; fname < TFFT_FILE_COUNT; fname++)
+  {
+    if(s_listed[fname] && !TFFT_FILE_BIT(result.valid, fname))
+    {
+      fprintf(stderr, "tfft_image: %s not valid in the image\n", s_fileNames[fname]);
+      rtnVal = 1;
+    }
+  }
+  if(rtnCode != TFFT_RW_OK)
+  {
+    fprintf(stderr, "tfft_image: import failed (%d)\n", rtnCode);
+    rtnVal = 1;
+  }
+
+  printf("%s: %lu bytes from address %lu", argv[2], (unsigned long)imageSize, (unsigned long)TFFT_START_ADDRESS);
+#if TFFT_LAYOUT_ENABLED && !IMAGE_FLASH
+  printf(" (layout header area of %lu bytes at address %lu)", (unsigned long)(imageSize - sizeof(TFFT_FILE_LAYOUT)),
+         (unsigned long)TFFT_END_ADDRESS + 1 - (imageSize - sizeof(TFFT_FILE_LAYOUT)));
+#endif
+  printf("\nwritten per file: %lu page writes, %lu byte writes, %.1f ms\n",
+         (unsigned long)perFile.pageWrites, (unsigned long)perFile.byteWrites, (double)perFile.simTimeNs / 1e6);
+  printf("imported: %lu page writes, %lu byte writes, %.1f ms (verified)\n",
+         (unsigned long)import.pageWrites, (unsigned long)import.byteWrites, (double)import.simTimeNs / 1e6);
+
+  TFFT_EepromSimuClose();
+  free(pImage);
+
+  return rtnVal;
+}